@@ -0,0 +1,886 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/sst_file_writer.h"
+#include "port/port.h"
+#include "spatial/curve.h"
+#include "spatial/format.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/thread_pool.h"
+
+// Loads archives of historical observations into table files with
+// SstFileWriter, and optionally ingests them into a DB.
+//
+//   bulk_load --input=2019.csv,2020.csv --db=/data/trips --threads=16
+//
+// The input is sorted by (key, valid time) with a parallel external merge
+// sort: --threads workers parse the input, each filling a buffer of
+// --memory / --threads bytes that is sorted and spilled to a run file when
+// full.  The runs are then split into key ranges that --threads workers
+// merge at the same time, each writing its own tables.  Memory use stays
+// at about --memory bytes plus one read buffer per run and worker.
+//
+// With --partition_order > 0, entries are first grouped by the cell of a
+// 2^order x 2^order Hilbert grid their location falls into (as with
+// Options::spatial_partition_order), so every table covers one cell and
+// has a tight spatial extent.  Entries without a location come last.
+// The versions of a key may then land in different tables; they are all
+// ingested in one call, which makes lookups take the newest version any
+// table holds, so the DB reads the same whatever the order.
+//
+// Input formats (--format):
+//   csv     -- one entry per line: key,valid time,x,y,value.  x and y are
+//              cells of the 2^28 x 2^28 key grid, both empty if the entry
+//              has no location.  The value is the rest of the line.
+//              Large files are split into chunks parsed in parallel.
+//   binary  -- a sequence of entries encoded as varint32 key length, key,
+//              fixed64 valid time, fixed64 x, fixed64 y, varint32 value
+//              length, value.  x and y are spatial::kOmitCoordinate if the
+//              entry has no location.  One worker per file.
+//
+// Keys are compared bytewise.  Of several entries with the same key and
+// valid time, one is kept.
+
+// Comma-separated list of input files.
+static const char* FLAGS_input = nullptr;
+
+// Format of the input files: "csv" or "binary".
+static const char* FLAGS_format = "csv";
+
+// Directory for run files and the tables written.
+static const char* FLAGS_output_dir = nullptr;
+
+// If set, ingest the tables into this DB (created if missing).
+static const char* FLAGS_db = nullptr;
+
+// Number of threads that parse and sort input, and that merge runs.
+static int FLAGS_threads = 4;
+
+// Memory for sort buffers, in MB, shared by the parsing threads.
+static int FLAGS_memory = 256;
+
+// CSV files are split into chunks of this many MB.
+static int FLAGS_chunk_size = 64;
+
+// Approximate size of the tables written.  A table is only cut between
+// keys, so all versions of a key end up in the same table.
+static int FLAGS_max_file_size = 64 << 20;
+
+// Order of the Hilbert grid the tables are partitioned by; 0 disables
+// partitioning.
+static int FLAGS_partition_order = 0;
+
+// Options of the tables written; must match those of the DB.
+static int FLAGS_block_size = 4096;
+static int FLAGS_bloom_bits = -1;
+
+namespace leveldb {
+
+namespace {
+
+Env* g_env = nullptr;
+
+// Partition of entries without a location.  Sorts after every cell.
+constexpr uint64_t kUnlocatedPartition = ~static_cast<uint64_t>(0);
+
+// Run files keep one index entry per this many records, from which merge
+// workers find the start of their key range, but at least kMinRunIndexSize
+// entries so that small runs still tell where to split the merge.
+constexpr size_t kRunIndexInterval = 4096;
+constexpr size_t kMinRunIndexSize = 64;
+
+// An entry of the input.  Slices point into a buffer of the owner.
+struct Record {
+  uint64_t partition;
+  Slice key;
+  ValidTime vt;
+  uint64_t x;
+  uint64_t y;
+  Slice value;
+};
+
+// Where a key range starts or ends: records compare by partition, then
+// key, so all versions of a key fall into the same range.
+struct RangeKey {
+  uint64_t partition;
+  std::string key;
+};
+
+int CompareRangeKey(uint64_t partition, const Slice& key, const RangeKey& k) {
+  if (partition != k.partition) {
+    return partition < k.partition ? -1 : +1;
+  }
+  return key.compare(k.key);
+}
+
+// Order of the sort: partition, key, then newest valid time first, which
+// is the order SstFileWriter::Put() expects.
+int CompareRecords(const Record& a, const Record& b) {
+  if (a.partition != b.partition) {
+    return a.partition < b.partition ? -1 : +1;
+  }
+  const int r = a.key.compare(b.key);
+  if (r != 0) {
+    return r;
+  }
+  if (a.vt != b.vt) {
+    return a.vt > b.vt ? -1 : +1;
+  }
+  return 0;
+}
+
+// Binary input format; run files put a varint64 partition in front.
+void EncodeRecord(const Record& r, bool with_partition, std::string* dst) {
+  if (with_partition) {
+    PutVarint64(dst, r.partition);
+  }
+  PutLengthPrefixedSlice(dst, r.key);
+  PutFixed64(dst, r.vt);
+  PutFixed64(dst, r.x);
+  PutFixed64(dst, r.y);
+  PutLengthPrefixedSlice(dst, r.value);
+}
+
+// Returns false if "input" does not start with a whole record.
+bool DecodeRecord(Slice* input, bool with_partition, Record* r) {
+  if (with_partition && !GetVarint64(input, &r->partition)) {
+    return false;
+  }
+  if (!GetLengthPrefixedSlice(input, &r->key) || input->size() < 24) {
+    return false;
+  }
+  r->vt = DecodeFixed64(input->data());
+  r->x = DecodeFixed64(input->data() + 8);
+  r->y = DecodeFixed64(input->data() + 16);
+  input->remove_prefix(24);
+  return GetLengthPrefixedSlice(input, &r->value);
+}
+
+// Reads the records of a binary input or run file in order.
+class RecordReader {
+ public:
+  RecordReader(SequentialFile* file, bool with_partition)
+      : file_(file),
+        with_partition_(with_partition),
+        scratch_(new char[kBufferSize]),
+        pos_(0),
+        eof_(false) {}
+
+  RecordReader(const RecordReader&) = delete;
+  RecordReader& operator=(const RecordReader&) = delete;
+
+  ~RecordReader() {
+    delete[] scratch_;
+    delete file_;
+  }
+
+  // Store the next record in *r, which stays valid until the next call.
+  // Returns false at the end of the file or on an error (see status()).
+  bool Next(Record* r) {
+    while (true) {
+      Slice input(buf_.data() + pos_, buf_.size() - pos_);
+      const size_t available = input.size();
+      if (DecodeRecord(&input, with_partition_, r)) {
+        pos_ += available - input.size();
+        return true;
+      }
+      if (eof_ || !status_.ok()) {
+        if (available != 0 && status_.ok()) {
+          status_ = Status::Corruption("truncated record");
+        }
+        return false;
+      }
+      Refill();
+    }
+  }
+
+  const Status& status() const { return status_; }
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  void Refill() {
+    buf_.erase(0, pos_);
+    pos_ = 0;
+    Slice fragment;
+    status_ = file_->Read(kBufferSize, &fragment, scratch_);
+    if (!status_.ok() || fragment.empty()) {
+      eof_ = true;
+    }
+    buf_.append(fragment.data(), fragment.size());
+  }
+
+  SequentialFile* const file_;
+  const bool with_partition_;
+  char* const scratch_;
+  std::string buf_;
+  size_t pos_;  // Start of the unread part of buf_
+  bool eof_;
+  Status status_;
+};
+
+// Part of an input file that one worker parses.
+struct InputChunk {
+  std::string fname;
+  uint64_t start;
+  uint64_t limit;
+};
+
+// A sorted run spilled to disk.
+struct SortedRun {
+  struct IndexEntry {
+    RangeKey key;
+    uint64_t offset;  // Of the record in the run file
+  };
+
+  std::string fname;
+  std::vector<IndexEntry> index;
+};
+
+struct Stats {
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> bad_lines{0};
+  std::atomic<uint64_t> duplicates{0};
+  std::atomic<uint64_t> bytes_written{0};
+};
+
+class Loader {
+ public:
+  Loader()
+      : filter_policy_(FLAGS_bloom_bits >= 0
+                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                           : nullptr),
+        curve_(spatial::kKeyOrder),
+        next_run_(0),
+        next_table_(0) {
+    table_options_.env = g_env;
+    table_options_.block_size = FLAGS_block_size;
+    table_options_.filter_policy = filter_policy_;
+  }
+
+  ~Loader() { delete filter_policy_; }
+
+  void Load() {
+    g_env->CreateDir(FLAGS_output_dir);
+    std::vector<InputChunk> chunks;
+    Status s = SplitInput(&chunks);
+    if (!s.ok()) {
+      Fail("reading input", s);
+    }
+
+    uint64_t start = g_env->NowMicros();
+    RunParallel(&Loader::SortWorker, &chunks);
+    std::fprintf(stdout, "sort:   %llu records (%llu bad lines) in %d runs, "
+                 "%.1f s\n",
+                 static_cast<unsigned long long>(stats_.records.load()),
+                 static_cast<unsigned long long>(stats_.bad_lines.load()),
+                 static_cast<int>(runs_.size()),
+                 (g_env->NowMicros() - start) * 1e-6);
+
+    start = g_env->NowMicros();
+    std::vector<std::pair<RangeKey*, RangeKey*>> ranges;
+    std::vector<RangeKey> splitters;
+    SplitKeyRanges(&splitters, &ranges);
+    RunParallel(&Loader::MergeWorker, &ranges);
+    for (const SortedRun& run : runs_) {
+      g_env->RemoveFile(run.fname);
+    }
+    std::sort(tables_.begin(), tables_.end());
+    std::fprintf(stdout, "merge:  %d tables, %.1f MB (%llu duplicates "
+                 "dropped), %.1f s\n",
+                 static_cast<int>(tables_.size()),
+                 stats_.bytes_written.load() / 1048576.0,
+                 static_cast<unsigned long long>(stats_.duplicates.load()),
+                 (g_env->NowMicros() - start) * 1e-6);
+
+    if (FLAGS_db != nullptr && !tables_.empty()) {
+      start = g_env->NowMicros();
+      Ingest();
+      std::fprintf(stdout, "ingest: %.1f s\n",
+                   (g_env->NowMicros() - start) * 1e-6);
+    }
+  }
+
+ private:
+  // Arguments of the tasks of one parallel phase.
+  template <typename Item>
+  struct Phase {
+    Loader* loader;
+    void (Loader::*worker)(const Item&);
+    const std::vector<Item>* items;
+    std::atomic<size_t> next{0};
+  };
+
+  template <typename Item>
+  static void RunPhaseWorker(void* arg) {
+    Phase<Item>* phase = reinterpret_cast<Phase<Item>*>(arg);
+    size_t i;
+    while ((i = phase->next.fetch_add(1)) < phase->items->size()) {
+      (phase->loader->*phase->worker)((*phase->items)[i]);
+    }
+  }
+
+  // Run "worker" over "items" on FLAGS_threads threads.
+  template <typename Item>
+  void RunParallel(void (Loader::*worker)(const Item&),
+                   const std::vector<Item>* items) {
+    Phase<Item> phase;
+    phase.loader = this;
+    phase.worker = worker;
+    phase.items = items;
+    {
+      ThreadPool pool(FLAGS_threads);
+      for (int i = 0; i < FLAGS_threads; i++) {
+        pool.Schedule(&Loader::RunPhaseWorker<Item>, &phase);
+      }
+    }  // Waits for the workers.
+    FlushSortBuffers();
+  }
+
+  static void Fail(const char* what, const Status& s) {
+    std::fprintf(stderr, "%s: %s\n", what, s.ToString().c_str());
+    std::exit(1);
+  }
+
+  Status SplitInput(std::vector<InputChunk>* chunks) {
+    const bool csv = strcmp(FLAGS_format, "csv") == 0;
+    const uint64_t chunk_size = static_cast<uint64_t>(FLAGS_chunk_size) << 20;
+    const char* p = FLAGS_input;
+    while (*p != '\0') {
+      const char* sep = strchr(p, ',');
+      const std::string fname =
+          sep != nullptr ? std::string(p, sep - p) : std::string(p);
+      p = sep != nullptr ? sep + 1 : p + fname.size();
+      if (fname.empty()) {
+        continue;
+      }
+      uint64_t size;
+      Status s = g_env->GetFileSize(fname, &size);
+      if (!s.ok()) {
+        return s;
+      }
+      if (!csv) {
+        chunks->push_back(InputChunk{fname, 0, size});
+        continue;
+      }
+      for (uint64_t start = 0; start < size; start += chunk_size) {
+        chunks->push_back(
+            InputChunk{fname, start, std::min(size, start + chunk_size)});
+      }
+    }
+    return Status::OK();
+  }
+
+  // Per-thread buffer of records waiting to be sorted into a run.
+  struct SortBuffer {
+    std::string data;              // Encoded records
+    std::vector<size_t> offsets;  // Of each record in data
+  };
+
+  SortBuffer* ThreadSortBuffer() {
+    thread_local SortBuffer* buffer = nullptr;
+    thread_local Loader* owner = nullptr;
+    if (owner != this) {
+      buffer = new SortBuffer;
+      owner = this;
+      MutexLock l(&mu_);
+      sort_buffers_.push_back(buffer);
+    }
+    return buffer;
+  }
+
+  void Add(SortBuffer* buffer, const Record& r) {
+    buffer->offsets.push_back(buffer->data.size());
+    EncodeRecord(r, /*with_partition=*/false, &buffer->data);
+    stats_.records.fetch_add(1, std::memory_order_relaxed);
+    // The offsets and the Record array built by Spill() take memory too.
+    const size_t budget =
+        (static_cast<size_t>(FLAGS_memory) << 20) / FLAGS_threads;
+    if (buffer->data.size() + buffer->offsets.size() * 64 >= budget) {
+      Spill(buffer);
+    }
+  }
+
+  void SortWorker(const InputChunk& chunk) {
+    SortBuffer* buffer = ThreadSortBuffer();
+    SequentialFile* file;
+    Status s = g_env->NewSequentialFile(chunk.fname, &file);
+    if (!s.ok()) {
+      Fail("opening input", s);
+    }
+    if (strcmp(FLAGS_format, "csv") != 0) {
+      RecordReader reader(file, /*with_partition=*/false);
+      Record r;
+      while (reader.Next(&r)) {
+        Add(buffer, r);
+      }
+      if (!reader.status().ok()) {
+        Fail(chunk.fname.c_str(), reader.status());
+      }
+      return;
+    }
+
+    // A line belongs to the chunk its first byte is in.  Other chunks start
+    // reading one byte early and skip up to the first newline, which ends
+    // the line the previous chunk parses (or is that byte itself).
+    uint64_t offset = chunk.start;  // Of pending[0] in the file
+    bool skip_first = false;
+    if (chunk.start > 0) {
+      offset = chunk.start - 1;
+      skip_first = true;
+      s = file->Skip(offset);
+    }
+    constexpr size_t kReadSize = 1 << 20;
+    char* scratch = new char[kReadSize];
+    std::string pending;
+    bool done = false;
+    while (s.ok() && !done) {
+      Slice fragment;
+      s = file->Read(kReadSize, &fragment, scratch);
+      if (!s.ok()) {
+        break;
+      }
+      const bool eof = fragment.empty();
+      pending.append(fragment.data(), fragment.size());
+      size_t line_start = 0;
+      while (!done && offset + line_start < chunk.limit) {
+        size_t line_end = pending.find('\n', line_start);
+        if (line_end == std::string::npos) {
+          if (!eof) {
+            break;  // Read the rest of the line
+          }
+          line_end = pending.size();  // Last line without a newline
+          done = true;
+        }
+        if (skip_first) {
+          skip_first = false;
+        } else {
+          ParseLine(buffer, Slice(pending.data() + line_start,
+                                  line_end - line_start));
+        }
+        line_start = line_end + 1;
+      }
+      if (eof || offset + line_start >= chunk.limit) {
+        done = true;
+      }
+      offset += line_start;
+      pending.erase(0, line_start);
+    }
+    delete[] scratch;
+    delete file;
+    if (!s.ok()) {
+      Fail(chunk.fname.c_str(), s);
+    }
+  }
+
+  // Parse "key,vt,x,y,value".
+  void ParseLine(SortBuffer* buffer, Slice line) {
+    if (!line.empty() && line[line.size() - 1] == '\r') {
+      line = Slice(line.data(), line.size() - 1);
+    }
+    if (line.empty()) {
+      return;
+    }
+    Slice fields[4];
+    for (Slice& field : fields) {
+      const char* comma = static_cast<const char*>(
+          memchr(line.data(), ',', line.size()));
+      if (comma == nullptr) {
+        stats_.bad_lines.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      field = Slice(line.data(), comma - line.data());
+      line.remove_prefix(field.size() + 1);
+    }
+    Record r;
+    r.partition = 0;
+    r.key = fields[0];
+    r.value = line;
+    bool ok = ParseNumber(fields[1], &r.vt);
+    if (fields[2].empty() && fields[3].empty()) {
+      r.x = r.y = spatial::kOmitCoordinate;
+    } else {
+      ok = ok && ParseNumber(fields[2], &r.x) && ParseNumber(fields[3], &r.y);
+    }
+    if (!ok || r.key.empty()) {
+      stats_.bad_lines.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Add(buffer, r);
+  }
+
+  static bool ParseNumber(const Slice& s, uint64_t* n) {
+    if (s.empty() || s.size() > 20) {
+      return false;
+    }
+    uint64_t v = 0;
+    for (size_t i = 0; i < s.size(); i++) {
+      if (s[i] < '0' || s[i] > '9') {
+        return false;
+      }
+      v = v * 10 + (s[i] - '0');
+    }
+    *n = v;
+    return true;
+  }
+
+  // Sort the records of "buffer" and write them to a new run file.
+  void Spill(SortBuffer* buffer) {
+    if (buffer->offsets.empty()) {
+      return;
+    }
+    std::vector<Record> records(buffer->offsets.size());
+    for (size_t i = 0; i < records.size(); i++) {
+      Slice input(buffer->data.data() + buffer->offsets[i],
+                  buffer->data.size() - buffer->offsets[i]);
+      DecodeRecord(&input, /*with_partition=*/false, &records[i]);
+    }
+    ComputePartitions(&records);
+    std::sort(records.begin(), records.end(),
+              [](const Record& a, const Record& b) {
+                return CompareRecords(a, b) < 0;
+              });
+
+    SortedRun run;
+    char name[100];
+    std::snprintf(name, sizeof(name), "/run-%06d.tmp",
+                  next_run_.fetch_add(1));
+    run.fname = std::string(FLAGS_output_dir) + name;
+    WritableFile* file;
+    Status s = g_env->NewWritableFile(run.fname, &file);
+    uint64_t offset = 0;
+    std::string encoded;
+    const size_t index_interval = std::max<size_t>(
+        1, std::min(kRunIndexInterval, records.size() / kMinRunIndexSize));
+    for (size_t i = 0; s.ok() && i < records.size(); i++) {
+      if (i % index_interval == 0) {
+        run.index.push_back(SortedRun::IndexEntry{
+            RangeKey{records[i].partition, records[i].key.ToString()},
+            offset});
+      }
+      encoded.clear();
+      EncodeRecord(records[i], /*with_partition=*/true, &encoded);
+      s = file->Append(encoded);
+      offset += encoded.size();
+    }
+    if (s.ok()) {
+      s = file->Close();
+    }
+    delete file;
+    if (!s.ok()) {
+      Fail("writing run", s);
+    }
+
+    buffer->data.clear();
+    buffer->offsets.clear();
+    MutexLock l(&mu_);
+    runs_.push_back(std::move(run));
+  }
+
+  // Map every record's location onto the partition grid, in one pass over
+  // the buffer.
+  void ComputePartitions(std::vector<Record>* records) const {
+    if (FLAGS_partition_order <= 0) {
+      return;
+    }
+    const int shift = 2 * (spatial::kKeyOrder - FLAGS_partition_order);
+    for (Record& r : *records) {
+      spatial::Linear t;
+      r.partition = curve_.MapInverse(r.x, r.y, &t) ? t >> shift
+                                                     : kUnlocatedPartition;
+    }
+  }
+
+  // Spill what the sort workers left in their buffers.
+  void FlushSortBuffers() {
+    for (SortBuffer* buffer : sort_buffers_) {
+      Spill(buffer);
+      delete buffer;
+    }
+    sort_buffers_.clear();
+  }
+
+  // Split the merge into FLAGS_threads key ranges holding about the same
+  // number of records, judging by the run indexes.
+  void SplitKeyRanges(std::vector<RangeKey>* splitters,
+                      std::vector<std::pair<RangeKey*, RangeKey*>>* ranges) {
+    std::vector<const RangeKey*> samples;
+    for (const SortedRun& run : runs_) {
+      for (const SortedRun::IndexEntry& e : run.index) {
+        samples.push_back(&e.key);
+      }
+    }
+    std::sort(samples.begin(), samples.end(),
+              [](const RangeKey* a, const RangeKey* b) {
+                return CompareRangeKey(a->partition, a->key, *b) < 0;
+              });
+    for (int i = 1; i < FLAGS_threads && !samples.empty(); i++) {
+      const RangeKey* k = samples[samples.size() * i / FLAGS_threads];
+      if (splitters->empty() ||
+          CompareRangeKey(k->partition, k->key, splitters->back()) > 0) {
+        splitters->push_back(*k);
+      }
+    }
+    RangeKey* lower = nullptr;
+    for (RangeKey& splitter : *splitters) {
+      ranges->emplace_back(lower, &splitter);
+      lower = &splitter;
+    }
+    ranges->emplace_back(lower, nullptr);
+  }
+
+  // Writes the tables of one merge worker.
+  class TableOutput {
+   public:
+    explicit TableOutput(Loader* loader)
+        : loader_(loader), writer_(loader->table_options_), open_(false) {}
+
+    ~TableOutput() { Finish(); }
+
+    void Add(const Record& r) {
+      if (open_ && (r.partition != partition_ || r.key != Slice(last_key_)) &&
+          (r.partition != partition_ ||
+           writer_.FileSize() >= static_cast<uint64_t>(FLAGS_max_file_size))) {
+        Finish();
+      }
+      if (!open_) {
+        Open(r.partition);
+      }
+      Status s = writer_.Put(r.key, r.vt, r.x, r.y, r.value);
+      if (!s.ok()) {
+        Fail(fname_.c_str(), s);
+      }
+      last_key_.assign(r.key.data(), r.key.size());
+    }
+
+   private:
+    void Open(uint64_t partition) {
+      char name[100];
+      std::snprintf(name, sizeof(name), "/%06d.ldb",
+                    loader_->next_table_.fetch_add(1) + 1);
+      fname_ = std::string(FLAGS_output_dir) + name;
+      Status s = writer_.Open(fname_);
+      if (!s.ok()) {
+        Fail(fname_.c_str(), s);
+      }
+      partition_ = partition;
+      open_ = true;
+    }
+
+    void Finish() {
+      if (!open_) {
+        return;
+      }
+      open_ = false;
+      Status s = writer_.Finish();
+      if (!s.ok()) {
+        Fail(fname_.c_str(), s);
+      }
+      loader_->stats_.bytes_written.fetch_add(writer_.FileSize(),
+                                              std::memory_order_relaxed);
+      MutexLock l(&loader_->mu_);
+      loader_->tables_.push_back(fname_);
+    }
+
+    Loader* const loader_;
+    SstFileWriter writer_;
+    bool open_;
+    std::string fname_;
+    uint64_t partition_;
+    std::string last_key_;
+  };
+
+  // One run positioned inside a merge worker's key range.
+  struct MergeInput {
+    RecordReader* reader;
+    Record current;
+  };
+
+  void MergeWorker(const std::pair<RangeKey*, RangeKey*>& range) {
+    const RangeKey* lower = range.first;
+    const RangeKey* upper = range.second;
+    auto below_upper = [upper](const Record& r) {
+      return upper == nullptr ||
+             CompareRangeKey(r.partition, r.key, *upper) < 0;
+    };
+
+    std::vector<MergeInput> inputs;
+    for (const SortedRun& run : runs_) {
+      // Start at the last index entry before the range.
+      uint64_t offset = 0;
+      if (lower != nullptr) {
+        for (const SortedRun::IndexEntry& e : run.index) {
+          if (CompareRangeKey(e.key.partition, e.key.key, *lower) >= 0) {
+            break;
+          }
+          offset = e.offset;
+        }
+      }
+      SequentialFile* file;
+      Status s = g_env->NewSequentialFile(run.fname, &file);
+      if (s.ok()) {
+        s = file->Skip(offset);
+      }
+      if (!s.ok()) {
+        Fail("reading run", s);
+      }
+      MergeInput input{new RecordReader(file, /*with_partition=*/true),
+                       Record()};
+      bool valid;
+      while ((valid = input.reader->Next(&input.current)) &&
+             lower != nullptr &&
+             CompareRangeKey(input.current.partition, input.current.key,
+                             *lower) < 0) {
+      }
+      if (!input.reader->status().ok()) {
+        Fail("reading run", input.reader->status());
+      }
+      if (valid && below_upper(input.current)) {
+        inputs.push_back(input);
+      } else {
+        delete input.reader;
+      }
+    }
+
+    // Min-heap of the inputs by current record.
+    auto greater = [](const MergeInput& a, const MergeInput& b) {
+      return CompareRecords(a.current, b.current) > 0;
+    };
+    std::make_heap(inputs.begin(), inputs.end(), greater);
+    TableOutput output(this);
+    std::string last_key;
+    uint64_t last_partition = 0;
+    ValidTime last_vt = 0;
+    bool has_last = false;
+    while (!inputs.empty()) {
+      std::pop_heap(inputs.begin(), inputs.end(), greater);
+      MergeInput& input = inputs.back();
+      const Record& r = input.current;
+      if (has_last && r.partition == last_partition && r.vt == last_vt &&
+          r.key == Slice(last_key)) {
+        stats_.duplicates.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        output.Add(r);
+        last_key.assign(r.key.data(), r.key.size());
+        last_partition = r.partition;
+        last_vt = r.vt;
+        has_last = true;
+      }
+      if (input.reader->Next(&input.current) && below_upper(input.current)) {
+        std::push_heap(inputs.begin(), inputs.end(), greater);
+      } else {
+        if (!input.reader->status().ok()) {
+          Fail("reading run", input.reader->status());
+        }
+        delete input.reader;
+        inputs.pop_back();
+      }
+    }
+  }
+
+  void Ingest() {
+    Options options;
+    options.create_if_missing = true;
+    options.block_size = FLAGS_block_size;
+    options.filter_policy = filter_policy_;
+    DB* db;
+    Status s = DB::Open(options, FLAGS_db, &db);
+    if (s.ok()) {
+      IngestExternalFileOptions ingest_options;
+      ingest_options.move_files = true;
+      s = db->IngestExternalFiles(ingest_options, tables_);
+      delete db;
+    }
+    if (!s.ok()) {
+      Fail("ingesting", s);
+    }
+  }
+
+  const FilterPolicy* const filter_policy_;
+  const spatial::Hilbert curve_;
+  Options table_options_;
+  Stats stats_;
+  std::atomic<int> next_run_;
+  std::atomic<int> next_table_;
+
+  // Workers append to these with mu_ held; between phases they are used
+  // without it.
+  port::Mutex mu_;
+  std::vector<SortBuffer*> sort_buffers_;
+  std::vector<SortedRun> runs_;
+  std::vector<std::string> tables_;
+};
+
+}  // namespace
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  std::string default_output_dir;
+
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (leveldb::Slice(argv[i]).starts_with("--input=")) {
+      FLAGS_input = argv[i] + strlen("--input=");
+    } else if (leveldb::Slice(argv[i]).starts_with("--format=") &&
+               (strcmp(argv[i] + strlen("--format="), "csv") == 0 ||
+                strcmp(argv[i] + strlen("--format="), "binary") == 0)) {
+      FLAGS_format = argv[i] + strlen("--format=");
+    } else if (leveldb::Slice(argv[i]).starts_with("--output_dir=")) {
+      FLAGS_output_dir = argv[i] + strlen("--output_dir=");
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      FLAGS_db = argv[i] + 5;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--memory=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_memory = n;
+    } else if (sscanf(argv[i], "--chunk_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_chunk_size = n;
+    } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--partition_order=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= static_cast<int>(spatial::kKeyOrder)) {
+      FLAGS_partition_order = n;
+    } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+  if (FLAGS_input == nullptr) {
+    std::fprintf(stderr, "--input=<file>[,<file>...] is required\n");
+    std::exit(1);
+  }
+
+  leveldb::g_env = leveldb::Env::Default();
+
+  if (FLAGS_output_dir == nullptr) {
+    leveldb::g_env->GetTestDirectory(&default_output_dir);
+    default_output_dir += "/bulkload";
+    FLAGS_output_dir = default_output_dir.c_str();
+  }
+
+  leveldb::Loader loader;
+  loader.Load();
+  return 0;
+}
@@ -0,0 +1,1056 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <queue>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/iterator.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "spatial/format.h"
+#include "util/coding.h"
+#include "util/histogram.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+// Spatio-temporal workloads over a population of moving objects.  Object
+// "i" is stored under the key "obj<i>"; every fill writes one version of
+// each object per tick with valid time = tick and (x, y) = the object's
+// position on the 2^kKeyOrder x 2^kKeyOrder grid.  The value starts with
+// the fixed64 x, y and tick so that scans can filter on position.
+//
+// Comma-separated list of operations to run in the specified order
+//   Ingest (each starts from an empty database):
+//      fillwalk      -- objects do a random walk
+//      fillroad      -- objects drive along a grid of roads
+//      fillhotspot   -- objects cluster around a few skewed hotspots
+//   Reads (against whatever the last fill wrote):
+//      readtime      -- Get(key, vt) of a random object at a random tick
+//      gets          -- GetS(vt, x, y) at a random point, once per precision
+//                       in --precisions
+//      window        -- objects whose latest position is in a random square
+//      knn           -- --knn objects nearest to a random point
+//      trajectory    -- --trajectory_len consecutive ticks of one object
+//   Meta operations:
+//      compact       -- Compact the entire DB
+//      stats         -- Print DB stats
+//      sstables      -- Print sstable info
+//      latency       -- Print the DB's latency histograms
+//      cachestats    -- Print per-shard block cache hit/miss/contention counts
+static const char* FLAGS_benchmarks =
+    "fillwalk,"
+    "readtime,"
+    "gets,"
+    "window,"
+    "knn,"
+    "trajectory,";
+
+// Number of object updates to write.
+static int FLAGS_num = 1000000;
+
+// Number of distinct moving objects.  FLAGS_num / FLAGS_objects ticks are
+// written by each fill.
+static int FLAGS_objects = 10000;
+
+// Number of point read operations to do.  If negative, do FLAGS_num reads.
+static int FLAGS_reads = -1;
+
+// Number of window and kNN queries to do; each one scans the database.
+static int FLAGS_scans = 100;
+
+// Number of concurrent threads to run.
+static int FLAGS_threads = 1;
+
+// Size of each value, including the 24-byte position header.
+static int FLAGS_value_size = 100;
+
+// Largest distance an object moves on either axis in one tick.
+static int FLAGS_step = 1 << 12;
+
+// Distance between parallel roads for fillroad.
+static int FLAGS_road_spacing = 1 << 16;
+
+// Number of hotspots for fillhotspot, and their radius.
+static int FLAGS_hotspots = 16;
+static int FLAGS_hotspot_radius = 1 << 18;
+
+// Comma-separated precisions exercised by "gets".
+static const char* FLAGS_precisions = "0,6,12";
+
+// Side of the square searched by "window".
+static int FLAGS_window_size = 1 << 22;
+
+// Number of neighbours returned by "knn".
+static int FLAGS_knn = 10;
+
+// Number of ticks read by each "trajectory" query.
+static int FLAGS_trajectory_len = 16;
+
+// Number of bytes to buffer in memtable before compacting
+// (initialized to default value by "main")
+static int FLAGS_write_buffer_size = 0;
+
+// Number of bytes written to each file.
+// (initialized to default value by "main")
+static int FLAGS_max_file_size = 0;
+
+// Approximate size of user data packed per block (before compression.
+// (initialized to default value by "main")
+static int FLAGS_block_size = 0;
+
+// Size of table index partitions; 0 keeps one index block per table.
+static int FLAGS_index_partition_size = 0;
+
+// Number of threads that open tables in the background after the DB is
+// opened; 0 opens them on first use.
+static int FLAGS_table_warmup_threads = 0;
+
+// Number of bytes to use as a cache of uncompressed data.
+// Negative means use default settings.
+static int FLAGS_cache_size = -1;
+
+// log2 of the number of block cache shards.  Negative means use default.
+static int FLAGS_cache_shard_bits = -1;
+
+// If true, use a CLOCK block cache instead of an LRU one.
+static bool FLAGS_clock_cache = false;
+
+// If true, keep table index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// Maximum number of files to keep open at the same time (use default if == 0)
+static int FLAGS_open_files = 0;
+
+// Bloom filter bits per key.
+// Negative means use default settings.
+static int FLAGS_bloom_bits = -1;
+
+// Order of the Hilbert cells flushes are partitioned on; 0 disables it.
+static int FLAGS_spatial_partition_order = 0;
+
+// If true, do not destroy the existing database.  If you set this
+// flag and also specify a benchmark that wants a fresh database, that
+// benchmark will fail.
+static bool FLAGS_use_existing_db = false;
+
+// Use the db with the following name.
+static const char* FLAGS_db = nullptr;
+
+namespace leveldb {
+
+namespace {
+leveldb::Env* g_env = nullptr;
+
+const spatial::Linear kSpaceSize = spatial::Linear{1} << spatial::kKeyOrder;
+const int kPositionHeaderSize = 24;
+
+// Helper for quickly generating random data.
+class RandomGenerator {
+ private:
+  std::string data_;
+  int pos_;
+
+ public:
+  RandomGenerator() {
+    Random rnd(301);
+    std::string piece;
+    while (data_.size() < 1048576) {
+      test::CompressibleString(&rnd, 0.5, 100, &piece);
+      data_.append(piece);
+    }
+    pos_ = 0;
+  }
+
+  Slice Generate(size_t len) {
+    if (pos_ + len > data_.size()) {
+      pos_ = 0;
+      assert(len < data_.size());
+    }
+    pos_ += len;
+    return Slice(data_.data() + pos_ - len, len);
+  }
+};
+
+class KeyBuffer {
+ public:
+  KeyBuffer() = default;
+  KeyBuffer& operator=(KeyBuffer& other) = delete;
+  KeyBuffer(KeyBuffer& other) = delete;
+
+  void Set(int object) {
+    std::snprintf(buffer_, sizeof(buffer_), "obj%012d", object);
+  }
+
+  Slice slice() const { return Slice(buffer_, 15); }
+
+ private:
+  char buffer_[32];
+};
+
+struct Position {
+  spatial::Linear x;
+  spatial::Linear y;
+};
+
+bool DecodePosition(const Slice& value, Position* pos) {
+  if (value.size() < kPositionHeaderSize) return false;
+  pos->x = DecodeFixed64(value.data());
+  pos->y = DecodeFixed64(value.data() + 8);
+  return true;
+}
+
+spatial::Linear Clamp(int64_t v) {
+  if (v < 0) return 0;
+  if (v >= static_cast<int64_t>(kSpaceSize)) return kSpaceSize - 1;
+  return static_cast<spatial::Linear>(v);
+}
+
+int64_t Step(Random* rnd, int max_step) {
+  return static_cast<int64_t>(rnd->Uniform(2 * max_step + 1)) - max_step;
+}
+
+// Produces the next position of every object owned by one thread.
+class MotionGenerator {
+ public:
+  virtual ~MotionGenerator() = default;
+  virtual Position Start(Random* rnd) = 0;
+  virtual Position Move(Random* rnd, const Position& pos) = 0;
+};
+
+class RandomWalk : public MotionGenerator {
+ public:
+  Position Start(Random* rnd) override {
+    return Position{rnd->Uniform(kSpaceSize), rnd->Uniform(kSpaceSize)};
+  }
+
+  Position Move(Random* rnd, const Position& pos) override {
+    return Position{Clamp(pos.x + Step(rnd, FLAGS_step)),
+                    Clamp(pos.y + Step(rnd, FLAGS_step))};
+  }
+};
+
+// Objects stay on a Manhattan grid of roads FLAGS_road_spacing apart.  At
+// each tick an object moves along its road, and at an intersection it may
+// turn onto the crossing road.
+class RoadNetwork : public MotionGenerator {
+ public:
+  Position Start(Random* rnd) override {
+    Position pos{rnd->Uniform(kSpaceSize), rnd->Uniform(kSpaceSize)};
+    if (rnd->OneIn(2)) {
+      pos.x = Snap(pos.x);
+    } else {
+      pos.y = Snap(pos.y);
+    }
+    return pos;
+  }
+
+  Position Move(Random* rnd, const Position& pos) override {
+    const bool on_vertical = pos.x % FLAGS_road_spacing == 0;
+    const bool on_horizontal = pos.y % FLAGS_road_spacing == 0;
+    bool move_y = on_vertical;
+    if (on_vertical && on_horizontal) {
+      move_y = rnd->OneIn(2);  // At an intersection: pick a direction.
+    }
+    const int64_t step = Step(rnd, FLAGS_step);
+    Position next = pos;
+    if (move_y) {
+      next.y = Clamp(pos.y + step);
+      if (Crosses(pos.y, next.y)) next.y = Snap(next.y);
+    } else {
+      next.x = Clamp(pos.x + step);
+      if (Crosses(pos.x, next.x)) next.x = Snap(next.x);
+    }
+    return next;
+  }
+
+ private:
+  static spatial::Linear Snap(spatial::Linear v) {
+    return Clamp((v / FLAGS_road_spacing) * FLAGS_road_spacing);
+  }
+
+  // True if the move from "a" to "b" passed a crossing road.
+  static bool Crosses(spatial::Linear a, spatial::Linear b) {
+    return a / FLAGS_road_spacing != b / FLAGS_road_spacing;
+  }
+};
+
+// Objects gather around FLAGS_hotspots fixed centres chosen with a skewed
+// distribution, so a few hotspots hold most of the objects.  Every tick an
+// object jitters inside its hotspot and occasionally jumps to another one.
+class Hotspots : public MotionGenerator {
+ public:
+  Hotspots() {
+    Random rnd(1729);
+    for (int i = 0; i < std::max(FLAGS_hotspots, 1); i++) {
+      centres_.push_back(
+          Position{rnd.Uniform(kSpaceSize), rnd.Uniform(kSpaceSize)});
+    }
+  }
+
+  Position Start(Random* rnd) override { return Near(rnd, Pick(rnd)); }
+
+  Position Move(Random* rnd, const Position& pos) override {
+    if (rnd->OneIn(100)) {
+      return Near(rnd, Pick(rnd));
+    }
+    return Position{Clamp(pos.x + Step(rnd, FLAGS_step)),
+                    Clamp(pos.y + Step(rnd, FLAGS_step))};
+  }
+
+ private:
+  const Position& Pick(Random* rnd) const {
+    const int max_log = 31 - __builtin_clz(centres_.size());
+    return centres_[rnd->Skewed(max_log) % centres_.size()];
+  }
+
+  static Position Near(Random* rnd, const Position& centre) {
+    return Position{Clamp(centre.x + Step(rnd, FLAGS_hotspot_radius)),
+                    Clamp(centre.y + Step(rnd, FLAGS_hotspot_radius))};
+  }
+
+  std::vector<Position> centres_;
+};
+
+spatial::Linear SquaredDistance(const Position& a, const Position& b) {
+  const spatial::Linear dx = a.x > b.x ? a.x - b.x : b.x - a.x;
+  const spatial::Linear dy = a.y > b.y ? a.y - b.y : b.y - a.y;
+  return dx * dx + dy * dy;  // Both < 2^28, so this fits in 64 bits.
+}
+
+class Stats {
+ private:
+  double start_;
+  double finish_;
+  double seconds_;
+  int done_;
+  int next_report_;
+  int64_t bytes_;
+  double last_op_finish_;
+  Histogram hist_;
+  std::string message_;
+
+ public:
+  Stats() { Start(); }
+
+  void Start() {
+    next_report_ = 100;
+    hist_.Clear();
+    done_ = 0;
+    bytes_ = 0;
+    seconds_ = 0;
+    message_.clear();
+    start_ = finish_ = last_op_finish_ = g_env->NowMicros();
+  }
+
+  void Merge(const Stats& other) {
+    hist_.Merge(other.hist_);
+    done_ += other.done_;
+    bytes_ += other.bytes_;
+    seconds_ += other.seconds_;
+    if (other.start_ < start_) start_ = other.start_;
+    if (other.finish_ > finish_) finish_ = other.finish_;
+
+    // Just keep the messages from one thread
+    if (message_.empty()) message_ = other.message_;
+  }
+
+  void Stop() {
+    finish_ = g_env->NowMicros();
+    seconds_ = (finish_ - start_) * 1e-6;
+  }
+
+  void AddMessage(Slice msg) {
+    if (msg.empty()) return;
+    if (!message_.empty()) message_.push_back(' ');
+    message_.append(msg.data(), msg.size());
+  }
+
+  void FinishedSingleOp() {
+    double now = g_env->NowMicros();
+    hist_.Add(now - last_op_finish_);
+    last_op_finish_ = now;
+
+    done_++;
+    if (done_ >= next_report_) {
+      if (next_report_ < 1000)
+        next_report_ += 100;
+      else if (next_report_ < 5000)
+        next_report_ += 500;
+      else if (next_report_ < 10000)
+        next_report_ += 1000;
+      else if (next_report_ < 50000)
+        next_report_ += 5000;
+      else if (next_report_ < 100000)
+        next_report_ += 10000;
+      else if (next_report_ < 500000)
+        next_report_ += 50000;
+      else
+        next_report_ += 100000;
+      std::fprintf(stderr, "... finished %d ops%30s\r", done_, "");
+      std::fflush(stderr);
+    }
+  }
+
+  void AddBytes(int64_t n) { bytes_ += n; }
+
+  void Report(const Slice& name) {
+    // Pretend at least one op was done in case we are running a benchmark
+    // that does not call FinishedSingleOp().
+    if (done_ < 1) done_ = 1;
+
+    // Throughput is computed on actual elapsed time, not the sum of
+    // per-thread elapsed times.
+    const double elapsed = (finish_ - start_) * 1e-6;
+    std::string extra;
+    if (bytes_ > 0) {
+      char rate[100];
+      std::snprintf(rate, sizeof(rate), "%6.1f MB/s;",
+                    (bytes_ / 1048576.0) / elapsed);
+      extra = rate;
+    }
+    if (!message_.empty()) {
+      if (!extra.empty()) extra.push_back(' ');
+      extra.append(message_);
+    }
+
+    std::fprintf(stdout,
+                 "%-14s : %11.3f micros/op; %10.0f ops/sec; "
+                 "P50 %.1f P99 %.1f P99.9 %.1f micros;%s%s\n",
+                 name.ToString().c_str(), seconds_ * 1e6 / done_,
+                 done_ / elapsed, hist_.Median(), hist_.Percentile(99.0),
+                 hist_.Percentile(99.9), (extra.empty() ? "" : " "),
+                 extra.c_str());
+    std::fflush(stdout);
+  }
+};
+
+// State shared by all concurrent executions of the same benchmark.
+struct SharedState {
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  int total GUARDED_BY(mu);
+
+  // Each thread goes through the following states:
+  //    (1) initializing
+  //    (2) waiting for others to be initialized
+  //    (3) running
+  //    (4) done
+
+  int num_initialized GUARDED_BY(mu);
+  int num_done GUARDED_BY(mu);
+  bool start GUARDED_BY(mu);
+
+  SharedState(int total)
+      : cv(&mu), total(total), num_initialized(0), num_done(0), start(false) {}
+};
+
+// Per-thread state for concurrent executions of the same benchmark.
+struct ThreadState {
+  int tid;      // 0..n-1 when running in n threads
+  Random rand;  // Has different seeds for different threads
+  Stats stats;
+  SharedState* shared;
+
+  ThreadState(int index, int seed) : tid(index), rand(seed), shared(nullptr) {}
+};
+
+Cache* NewBlockCache() {
+  if (FLAGS_cache_size < 0) {
+    return nullptr;
+  } else if (FLAGS_clock_cache) {
+    return NewClockCache(FLAGS_cache_size, FLAGS_cache_shard_bits);
+  } else {
+    return NewLRUCache(FLAGS_cache_size, FLAGS_cache_shard_bits);
+  }
+}
+
+}  // namespace
+
+class Benchmark {
+ private:
+  Cache* cache_;
+  const FilterPolicy* filter_policy_;
+  DB* db_;
+  int num_;
+  int reads_;
+  int ticks_;
+  int precision_;
+  // Recorded (time, position) points that "gets" queries.
+  struct Sample {
+    ValidTime time;
+    Position pos;
+  };
+  std::vector<Sample> samples_;
+  MotionGenerator* motion_;
+  int total_thread_count_;
+
+  void PrintHeader() {
+    std::fprintf(stdout, "Objects:    %d\n", FLAGS_objects);
+    std::fprintf(stdout, "Updates:    %d (%d ticks)\n", num_, Ticks());
+    std::fprintf(stdout, "Values:     %d bytes each\n", FLAGS_value_size);
+    std::fprintf(stdout, "Space:      2^%d x 2^%d\n",
+                 static_cast<int>(spatial::kKeyOrder),
+                 static_cast<int>(spatial::kKeyOrder));
+#if defined(__GNUC__) && !defined(__OPTIMIZE__)
+    std::fprintf(
+        stdout,
+        "WARNING: Optimization is disabled: benchmarks unnecessarily slow\n");
+#endif
+#ifndef NDEBUG
+    std::fprintf(
+        stdout,
+        "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+    std::fprintf(stdout, "------------------------------------------------\n");
+  }
+
+  static int Ticks() {
+    return std::max(1, (FLAGS_num + FLAGS_objects - 1) / FLAGS_objects);
+  }
+
+ public:
+  Benchmark()
+      : cache_(NewBlockCache()),
+        filter_policy_(FLAGS_bloom_bits >= 0
+                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                           : nullptr),
+        db_(nullptr),
+        num_(FLAGS_num),
+        reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
+        ticks_(FLAGS_use_existing_db ? Ticks() : 0),
+        precision_(0),
+        motion_(nullptr),
+        total_thread_count_(0) {
+    if (!FLAGS_use_existing_db) {
+      DestroyDB(FLAGS_db, Options());
+    }
+  }
+
+  ~Benchmark() {
+    delete db_;
+    delete motion_;
+    delete cache_;
+    delete filter_policy_;
+  }
+
+  void Run() {
+    PrintHeader();
+    Open();
+
+    const char* benchmarks = FLAGS_benchmarks;
+    while (benchmarks != nullptr) {
+      const char* sep = strchr(benchmarks, ',');
+      Slice name;
+      if (sep == nullptr) {
+        name = benchmarks;
+        benchmarks = nullptr;
+      } else {
+        name = Slice(benchmarks, sep - benchmarks);
+        benchmarks = sep + 1;
+      }
+
+      num_ = FLAGS_num;
+      reads_ = (FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads);
+
+      void (Benchmark::*method)(ThreadState*) = nullptr;
+      bool fresh_db = false;
+
+      if (name == Slice("fillwalk")) {
+        fresh_db = true;
+        SetMotion(new RandomWalk);
+        method = &Benchmark::Fill;
+      } else if (name == Slice("fillroad")) {
+        fresh_db = true;
+        SetMotion(new RoadNetwork);
+        method = &Benchmark::Fill;
+      } else if (name == Slice("fillhotspot")) {
+        fresh_db = true;
+        SetMotion(new Hotspots);
+        method = &Benchmark::Fill;
+      } else if (name == Slice("readtime")) {
+        method = &Benchmark::ReadAtTime;
+      } else if (name == Slice("gets")) {
+        RunGetS();
+      } else if (name == Slice("window")) {
+        method = &Benchmark::Window;
+      } else if (name == Slice("knn")) {
+        method = &Benchmark::NearestNeighbours;
+      } else if (name == Slice("trajectory")) {
+        method = &Benchmark::Trajectory;
+      } else if (name == Slice("compact")) {
+        method = &Benchmark::Compact;
+      } else if (name == Slice("stats")) {
+        PrintStats("leveldb.stats");
+      } else if (name == Slice("sstables")) {
+        PrintStats("leveldb.sstables");
+      } else if (name == Slice("latency")) {
+        PrintStats("leveldb.latency-histograms");
+      } else if (name == Slice("cachestats")) {
+        PrintStats("leveldb.block-cache-stats");
+      } else {
+        if (!name.empty()) {  // No error message for empty name
+          std::fprintf(stderr, "unknown benchmark '%s'\n",
+                       name.ToString().c_str());
+        }
+      }
+
+      if (fresh_db) {
+        if (FLAGS_use_existing_db) {
+          std::fprintf(stdout, "%-14s : skipped (--use_existing_db is true)\n",
+                       name.ToString().c_str());
+          method = nullptr;
+        } else {
+          delete db_;
+          db_ = nullptr;
+          DestroyDB(FLAGS_db, Options());
+          Open();
+        }
+      }
+
+      if (method != nullptr) {
+        RunBenchmark(FLAGS_threads, name, method);
+      }
+    }
+  }
+
+ private:
+  struct ThreadArg {
+    Benchmark* bm;
+    SharedState* shared;
+    ThreadState* thread;
+    void (Benchmark::*method)(ThreadState*);
+  };
+
+  static void ThreadBody(void* v) {
+    ThreadArg* arg = reinterpret_cast<ThreadArg*>(v);
+    SharedState* shared = arg->shared;
+    ThreadState* thread = arg->thread;
+    {
+      MutexLock l(&shared->mu);
+      shared->num_initialized++;
+      if (shared->num_initialized >= shared->total) {
+        shared->cv.SignalAll();
+      }
+      while (!shared->start) {
+        shared->cv.Wait();
+      }
+    }
+
+    thread->stats.Start();
+    (arg->bm->*(arg->method))(thread);
+    thread->stats.Stop();
+
+    {
+      MutexLock l(&shared->mu);
+      shared->num_done++;
+      if (shared->num_done >= shared->total) {
+        shared->cv.SignalAll();
+      }
+    }
+  }
+
+  void RunBenchmark(int n, Slice name,
+                    void (Benchmark::*method)(ThreadState*)) {
+    SharedState shared(n);
+
+    ThreadArg* arg = new ThreadArg[n];
+    for (int i = 0; i < n; i++) {
+      arg[i].bm = this;
+      arg[i].method = method;
+      arg[i].shared = &shared;
+      ++total_thread_count_;
+      // Seed the thread's random state deterministically based upon thread
+      // creation across all benchmarks. This ensures that the seeds are unique
+      // but reproducible when rerunning the same set of benchmarks.
+      arg[i].thread = new ThreadState(i, /*seed=*/1000 + total_thread_count_);
+      arg[i].thread->shared = &shared;
+      g_env->StartThread(ThreadBody, &arg[i]);
+    }
+
+    shared.mu.Lock();
+    while (shared.num_initialized < n) {
+      shared.cv.Wait();
+    }
+
+    shared.start = true;
+    shared.cv.SignalAll();
+    while (shared.num_done < n) {
+      shared.cv.Wait();
+    }
+    shared.mu.Unlock();
+
+    for (int i = 1; i < n; i++) {
+      arg[0].thread->stats.Merge(arg[i].thread->stats);
+    }
+    arg[0].thread->stats.Report(name);
+
+    for (int i = 0; i < n; i++) {
+      delete arg[i].thread;
+    }
+    delete[] arg;
+  }
+
+  void Open() {
+    assert(db_ == nullptr);
+    Options options;
+    options.env = g_env;
+    options.create_if_missing = !FLAGS_use_existing_db;
+    options.block_cache = cache_;
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_file_size = FLAGS_max_file_size;
+    options.block_size = FLAGS_block_size;
+    options.max_open_files = FLAGS_open_files;
+    options.filter_policy = filter_policy_;
+    options.spatial_partition_order = FLAGS_spatial_partition_order;
+    options.table_warmup_threads = FLAGS_table_warmup_threads;
+    Status s = DB::Open(options, FLAGS_db, &db_);
+    if (!s.ok()) {
+      std::fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+      std::exit(1);
+    }
+  }
+
+  void SetMotion(MotionGenerator* motion) {
+    delete motion_;
+    motion_ = motion;
+  }
+
+  // Thread "tid" of "n" owns objects tid, tid + n, ... and writes one
+  // version of each of them per tick, in tick order.
+  void Fill(ThreadState* thread) {
+    const int n = thread->shared->total;
+    std::vector<int> objects;
+    std::vector<Position> positions;
+    for (int i = thread->tid; i < FLAGS_objects; i += n) {
+      objects.push_back(i);
+      positions.push_back(motion_->Start(&thread->rand));
+    }
+
+    RandomGenerator gen;
+    WriteBatch batch;
+    KeyBuffer key;
+    std::string value;
+    int64_t bytes = 0;
+    int written = 0;
+    const int quota = num_ / n;
+    for (int tick = 0; written < quota && !objects.empty(); tick++) {
+      for (size_t i = 0; i < objects.size() && written < quota; i++) {
+        Position& pos = positions[i];
+        if (tick > 0) pos = motion_->Move(&thread->rand, pos);
+        key.Set(objects[i]);
+        value.clear();
+        PutFixed64(&value, pos.x);
+        PutFixed64(&value, pos.y);
+        PutFixed64(&value, tick);
+        if (FLAGS_value_size > kPositionHeaderSize) {
+          Slice pad = gen.Generate(FLAGS_value_size - kPositionHeaderSize);
+          value.append(pad.data(), pad.size());
+        }
+        batch.Clear();
+        batch.Put(key.slice(), tick, pos.x, pos.y, value);
+        Status s = db_->Write(WriteOptions(), &batch);
+        if (!s.ok()) {
+          std::fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+          std::exit(1);
+        }
+        bytes += key.slice().size() + value.size();
+        written++;
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    thread->stats.AddBytes(bytes);
+
+    MutexLock l(&thread->shared->mu);
+    ticks_ = std::max(ticks_, (written + static_cast<int>(objects.size()) - 1) /
+                                  std::max<int>(objects.size(), 1));
+  }
+
+  ValidTime RandomTick(Random* rnd) const {
+    return ticks_ > 0 ? rnd->Uniform(ticks_) : 0;
+  }
+
+  void ReadAtTime(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    int found = 0;
+    KeyBuffer key;
+    for (int i = 0; i < reads_; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_objects));
+      if (db_->Get(options, key.slice(), RandomTick(&thread->rand), &value)
+              .ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Reads back the recorded position of random objects at random ticks, so
+  // that "gets" queries points that hold an object.  Runs untimed.
+  void SamplePositions() {
+    samples_.clear();
+    Random rnd(301);
+    std::string value;
+    KeyBuffer key;
+    const int n = std::min(std::max(reads_, 1), 1 << 16);
+    for (int i = 0; i < n; i++) {
+      key.Set(rnd.Uniform(FLAGS_objects));
+      Position pos;
+      if (db_->Get(ReadOptions(), key.slice(), RandomTick(&rnd), &value)
+              .ok() &&
+          DecodePosition(value, &pos)) {
+        samples_.push_back(Sample{DecodeFixed64(value.data() + 16), pos});
+      }
+    }
+  }
+
+  // Runs one "gets@<p>" benchmark for every precision in --precisions.
+  void RunGetS() {
+    SamplePositions();
+    if (samples_.empty()) {
+      std::fprintf(stderr, "gets: the database holds no positions\n");
+      return;
+    }
+    const char* precisions = FLAGS_precisions;
+    while (precisions != nullptr && *precisions != '\0') {
+      precision_ = std::atoi(precisions);
+      char name[32];
+      std::snprintf(name, sizeof(name), "gets@%d", precision_);
+      RunBenchmark(FLAGS_threads, name, &Benchmark::SpatialGet);
+      precisions = strchr(precisions, ',');
+      if (precisions != nullptr) precisions++;
+    }
+  }
+
+  // Every query asks for a point and time some object was written at.  The
+  // found count is whatever DB::GetS returns for it: GetS does not use the
+  // coordinates for its lookup yet.
+  void SpatialGet(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    int found = 0;
+    for (int i = 0; i < reads_; i++) {
+      const Sample& sample =
+          samples_[thread->rand.Uniform(static_cast<int>(samples_.size()))];
+      if (db_->GetS(options, sample.time, sample.pos.x, sample.pos.y, &value,
+                    precision_)
+              .ok()) {
+        found++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Window and kNN queries have no index to use, so each scans the latest
+  // version of every object.
+  void Window(ThreadState* thread) {
+    const spatial::Linear side =
+        std::min<spatial::Linear>(FLAGS_window_size, kSpaceSize);
+    int64_t matches = 0;
+    for (int i = 0; i < FLAGS_scans; i++) {
+      const spatial::Linear x0 = thread->rand.Uniform(kSpaceSize - side + 1);
+      const spatial::Linear y0 = thread->rand.Uniform(kSpaceSize - side + 1);
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        Position pos;
+        if (DecodePosition(iter->value(), &pos) && pos.x >= x0 &&
+            pos.x < x0 + side && pos.y >= y0 && pos.y < y0 + side) {
+          matches++;
+        }
+      }
+      delete iter;
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.1f objects per window)",
+                  static_cast<double>(matches) / std::max(FLAGS_scans, 1));
+    thread->stats.AddMessage(msg);
+  }
+
+  void NearestNeighbours(ThreadState* thread) {
+    const size_t k = std::max(FLAGS_knn, 1);
+    double furthest = 0;
+    for (int i = 0; i < FLAGS_scans; i++) {
+      const Position query{thread->rand.Uniform(kSpaceSize),
+                           thread->rand.Uniform(kSpaceSize)};
+      // Max-heap of the k smallest squared distances seen so far.
+      std::priority_queue<spatial::Linear> nearest;
+      Iterator* iter = db_->NewIterator(ReadOptions());
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        Position pos;
+        if (!DecodePosition(iter->value(), &pos)) continue;
+        const spatial::Linear d = SquaredDistance(query, pos);
+        if (nearest.size() < k) {
+          nearest.push(d);
+        } else if (d < nearest.top()) {
+          nearest.pop();
+          nearest.push(d);
+        }
+      }
+      delete iter;
+      if (!nearest.empty()) furthest += nearest.top();
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(mean k-th squared distance %.3g)",
+                  furthest / std::max(FLAGS_scans, 1));
+    thread->stats.AddMessage(msg);
+  }
+
+  // One op reads FLAGS_trajectory_len consecutive ticks of one object.
+  void Trajectory(ThreadState* thread) {
+    ReadOptions options;
+    std::string value;
+    KeyBuffer key;
+    const int len = std::max(FLAGS_trajectory_len, 1);
+    const int queries = std::max(reads_ / len, 1);
+    int64_t found = 0;
+    for (int i = 0; i < queries; i++) {
+      key.Set(thread->rand.Uniform(FLAGS_objects));
+      const int span = std::max(ticks_ - len, 0);
+      const ValidTime start = span > 0 ? thread->rand.Uniform(span + 1) : 0;
+      for (int t = 0; t < len; t++) {
+        if (db_->Get(options, key.slice(), start + t, &value).ok()) {
+          found++;
+        }
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%.1f of %d points found)",
+                  static_cast<double>(found) / queries, len);
+    thread->stats.AddMessage(msg);
+  }
+
+  void Compact(ThreadState* /*thread*/) { db_->CompactRange(nullptr, nullptr); }
+
+  void PrintStats(const char* key) {
+    std::string stats;
+    if (!db_->GetProperty(key, &stats)) {
+      stats = "(failed)";
+    }
+    std::fprintf(stdout, "\n%s\n", stats.c_str());
+  }
+};
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
+  FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_block_size = leveldb::Options().block_size;
+  FLAGS_open_files = leveldb::Options().max_open_files;
+  std::string default_db_path;
+
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (leveldb::Slice(argv[i]).starts_with("--benchmarks=")) {
+      FLAGS_benchmarks = argv[i] + strlen("--benchmarks=");
+    } else if (leveldb::Slice(argv[i]).starts_with("--precisions=")) {
+      FLAGS_precisions = argv[i] + strlen("--precisions=");
+    } else if (sscanf(argv[i], "--use_existing_db=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_use_existing_db = n;
+    } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
+      FLAGS_num = n;
+    } else if (sscanf(argv[i], "--objects=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_objects = n;
+    } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
+      FLAGS_reads = n;
+    } else if (sscanf(argv[i], "--scans=%d%c", &n, &junk) == 1) {
+      FLAGS_scans = n;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--value_size=%d%c", &n, &junk) == 1) {
+      FLAGS_value_size = n;
+    } else if (sscanf(argv[i], "--step=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_step = n;
+    } else if (sscanf(argv[i], "--road_spacing=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_road_spacing = n;
+    } else if (sscanf(argv[i], "--hotspots=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_hotspots = n;
+    } else if (sscanf(argv[i], "--hotspot_radius=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_hotspot_radius = n;
+    } else if (sscanf(argv[i], "--window_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_window_size = n;
+    } else if (sscanf(argv[i], "--knn=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_knn = n;
+    } else if (sscanf(argv[i], "--trajectory_len=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_trajectory_len = n;
+    } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
+      FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
+      FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
+      FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--table_warmup_threads=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_table_warmup_threads = n;
+    } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--cache_shard_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_cache_shard_bits = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
+      FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--spatial_partition_order=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_spatial_partition_order = n;
+    } else if (strncmp(argv[i], "--db=", 5) == 0) {
+      FLAGS_db = argv[i] + 5;
+    } else {
+      std::fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      std::exit(1);
+    }
+  }
+
+  leveldb::g_env = leveldb::Env::Default();
+
+  // Choose a location for the test database if none given with --db=<path>
+  if (FLAGS_db == nullptr) {
+    leveldb::g_env->GetTestDirectory(&default_db_path);
+    default_db_path += "/dbspatialbench";
+    FLAGS_db = default_db_path.c_str();
+  }
+
+  leveldb::Benchmark benchmark;
+  benchmark.Run();
+  return 0;
+}
@@ -0,0 +1,250 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Microbenchmarks for the CPU work done on every write and lookup: mapping
+// coordinates onto the space-filling curves, ordering spatial index keys,
+// comparing internal keys, inserting into the memtable skiplist and
+// hitting the block cache.
+//
+//   micro_bench --benchmark_filter=Hilbert
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "db/dbformat.h"
+#include "db/skiplist.h"
+#include "leveldb/cache.h"
+#include "leveldb/comparator.h"
+#include "spatial/curve.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+namespace {
+
+// Number of precomputed inputs each benchmark cycles through.  A power of
+// two so that the index can be masked.
+constexpr int kNumInputs = 4096;
+
+std::string RandomUserKey(Random* rnd, int size) {
+  std::string key(size, ' ');
+  for (int i = 0; i < size; i++) {
+    key[i] = static_cast<char>(' ' + rnd->Uniform(95));
+  }
+  return key;
+}
+
+// range(0): order of the Hilbert grid.
+void BM_HilbertMapInverse(benchmark::State& state) {
+  const spatial::Order order = state.range(0);
+  const spatial::Hilbert curve(order);
+  Random rnd(301 + state.thread_index());
+  std::vector<spatial::Linear> xs, ys;
+  for (int i = 0; i < kNumInputs; i++) {
+    xs.push_back(rnd.Next() & ((spatial::Linear{1} << order) - 1));
+    ys.push_back(rnd.Next() & ((spatial::Linear{1} << order) - 1));
+  }
+
+  int i = 0;
+  for (auto _ : state) {
+    spatial::Linear t;
+    benchmark::DoNotOptimize(curve.MapInverse(xs[i], ys[i], &t));
+    benchmark::DoNotOptimize(t);
+    i = (i + 1) & (kNumInputs - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// range(0): number of bits per axis.
+void BM_GeohashMapInverse(benchmark::State& state) {
+  const spatial::Geohash curve(state.range(0));
+  Random rnd(301 + state.thread_index());
+  std::vector<spatial::Coordinate> coords;
+  for (int i = 0; i < kNumInputs; i++) {
+    coords.emplace_back(rnd.Uniform(180000000) / 1e6 - 90.0,
+                        rnd.Uniform(360000000) / 1e6 - 180.0);
+  }
+
+  int i = 0;
+  for (auto _ : state) {
+    spatial::Linear t;
+    benchmark::DoNotOptimize(curve.MapInverse(coords[i], &t));
+    benchmark::DoNotOptimize(t);
+    i = (i + 1) & (kNumInputs - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// range(0): prefix length in bits stored in the top byte of each index key.
+void BM_SpatialBitComparator(benchmark::State& state) {
+  const uint64_t length = state.range(0);
+  Random rnd(301 + state.thread_index());
+  std::vector<std::string> keys(kNumInputs, std::string(8, '\0'));
+  for (int i = 0; i < kNumInputs; i++) {
+    const uint64_t bits = (static_cast<uint64_t>(rnd.Next()) << 31) ^ rnd.Next();
+    EncodeFixed64(&keys[i][0], (length << 56) | (bits & ((1ull << 56) - 1)));
+  }
+  const spatial::SpatialBitComparator cmp;
+
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        cmp(keys[i].data(), keys[(i + 1) & (kNumInputs - 1)].data()));
+    i = (i + 1) & (kNumInputs - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// range(0): user key size.  range(1): 1 if both keys share the user key, so
+// that the comparison falls through to the 32-byte attribute suffix.
+void BM_InternalKeyCompare(benchmark::State& state) {
+  const int key_size = state.range(0);
+  const bool same_user_key = state.range(1) != 0;
+  Random rnd(301 + state.thread_index());
+  std::vector<std::string> a, b;
+  for (int i = 0; i < kNumInputs; i++) {
+    const std::string ukey = RandomUserKey(&rnd, key_size);
+    const std::string other =
+        same_user_key ? ukey : RandomUserKey(&rnd, key_size);
+    a.emplace_back();
+    b.emplace_back();
+    AppendInternalKey(&a.back(), ParsedInternalKey(ukey, rnd.Next(), kTypeValue,
+                                                   rnd.Next(), rnd.Next(),
+                                                   rnd.Next()));
+    AppendInternalKey(&b.back(), ParsedInternalKey(other, rnd.Next(),
+                                                   kTypeValue, rnd.Next(),
+                                                   rnd.Next(), rnd.Next()));
+  }
+  const InternalKeyComparator icmp(BytewiseComparator());
+
+  int i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(icmp.Compare(a[i], b[i]));
+    i = (i + 1) & (kNumInputs - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Orders length-prefixed internal keys the way the memtable does.
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+  explicit MemTableKeyComparator(const InternalKeyComparator& c)
+      : comparator(c) {}
+  int operator()(const char* a, const char* b) const {
+    uint32_t alen, blen;
+    const char* ap = GetVarint32Ptr(a, a + 5, &alen);
+    const char* bp = GetVarint32Ptr(b, b + 5, &blen);
+    return comparator.Compare(Slice(ap, alen), Slice(bp, blen));
+  }
+};
+
+// range(0): user key size.  range(1): 1 to allocate nodes from huge page
+// regions (see ArenaOptions).  Every thread fills its own skiplist, so
+// thread counts above one measure how memtable inserts scale across
+// independent memtables rather than contention on one.
+void BM_SkipListInsert(benchmark::State& state) {
+  typedef SkipList<const char*, MemTableKeyComparator> Table;
+  constexpr int kListSize = 1 << 16;
+  const int key_size = state.range(0);
+  ArenaOptions arena_options;
+  if (state.range(1) != 0) {
+    arena_options.huge_page_region_size = 64 << 20;
+  }
+  const MemTableKeyComparator cmp{InternalKeyComparator(BytewiseComparator())};
+  Random rnd(301 + state.thread_index());
+
+  std::vector<std::string> entries(kListSize);
+  for (int i = 0; i < kListSize; i++) {
+    std::string ikey;
+    AppendInternalKey(&ikey, ParsedInternalKey(RandomUserKey(&rnd, key_size),
+                                               i, kTypeValue, i, rnd.Next(),
+                                               rnd.Next()));
+    PutVarint32(&entries[i], ikey.size());
+    entries[i].append(ikey);
+  }
+
+  Arena* arena = new Arena(arena_options);
+  Table* list = new Table(cmp, arena);
+  int i = 0;
+  for (auto _ : state) {
+    if (i == kListSize) {
+      // Start over with an empty list so inserts never see duplicates.
+      state.PauseTiming();
+      delete list;
+      delete arena;
+      arena = new Arena(arena_options);
+      list = new Table(cmp, arena);
+      i = 0;
+      state.ResumeTiming();
+    }
+    list->Insert(entries[i++].data());
+  }
+  delete list;
+  delete arena;
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Lookup and Release of a resident entry, the block cache's hit path.  All
+// threads share one cache.
+// range(0): 0 for NewLRUCache(), 1 for NewClockCache().
+// range(1): num_shard_bits.
+void BM_CacheHit(benchmark::State& state) {
+  constexpr int kEntries = 1024;
+  static Cache* cache;
+  if (state.thread_index() == 0) {
+    // Leave room for uneven shards so every entry stays resident.
+    const size_t capacity = 4 * kEntries;
+    cache = state.range(0) == 0 ? NewLRUCache(capacity, state.range(1))
+                                : NewClockCache(capacity, state.range(1));
+    for (int i = 0; i < kEntries; i++) {
+      char key[4];
+      EncodeFixed32(key, i);
+      cache->Release(cache->Insert(Slice(key, sizeof(key)), nullptr, 1,
+                                   [](const Slice&, void*) {}));
+    }
+  }
+  Random rnd(301 + state.thread_index());
+  std::vector<std::string> keys;
+  for (int i = 0; i < kNumInputs; i++) {
+    char key[4];
+    EncodeFixed32(key, rnd.Uniform(kEntries));
+    keys.emplace_back(key, sizeof(key));
+  }
+
+  int i = 0;
+  for (auto _ : state) {
+    Cache::Handle* handle = cache->Lookup(keys[i]);
+    benchmark::DoNotOptimize(handle);
+    cache->Release(handle);
+    i = (i + 1) & (kNumInputs - 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) {
+    delete cache;
+  }
+}
+
+BENCHMARK(BM_HilbertMapInverse)->Arg(8)->Arg(16)->Arg(28)->ThreadRange(1, 8);
+BENCHMARK(BM_GeohashMapInverse)->Arg(8)->Arg(16)->Arg(28)->ThreadRange(1, 8);
+BENCHMARK(BM_SpatialBitComparator)
+    ->Arg(16)
+    ->Arg(32)
+    ->Arg(56)
+    ->ThreadRange(1, 8);
+BENCHMARK(BM_InternalKeyCompare)
+    ->ArgsProduct({{8, 16, 64, 256}, {0, 1}})
+    ->ThreadRange(1, 8);
+BENCHMARK(BM_SkipListInsert)
+    ->ArgsProduct({{16, 64, 256}, {0, 1}})
+    ->ThreadRange(1, 8);
+BENCHMARK(BM_CacheHit)->ArgsProduct({{0, 1}, {0, 4}})->ThreadRange(1, 8);
+
+}  // namespace
+
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
@@ -4,24 +4,167 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "spatial/curve.h"
 
 namespace leveldb {
 
+namespace {
+
+// Finish *builder, then sync and close *file and check that the result is
+// a usable table.  Deletes both builder and file.
+Status FinishTable(TableCache* table_cache, TableBuilder* builder,
+                   WritableFile* file, FileMetaData* meta) {
+  // Finish and check for builder errors
+  Status s = builder->Finish();
+  if (s.ok()) {
+    meta->file_size = builder->FileSize();
+    assert(meta->file_size > 0);
+  }
+  delete builder;
+
+  // Finish and check for file errors
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = file->Close();
+  }
+  delete file;
+
+  if (s.ok()) {
+    // Verify that the table is usable
+    Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
+                                            meta->file_size);
+    s = it->status();
+    delete it;
+  }
+  return s;
+}
+
+// An entry of the input of BuildPartitionedTables(), tagged with the grid
+// cell it falls into.
+struct PartitionedEntry {
+  uint64_t partition;
+  Slice key;
+  Slice value;
+  bool located;
+  spatial::Linear hilbert;
+};
+
+// Partition used for entries without a location.  Sorts after every cell.
+static const uint64_t kUnlocatedPartition = ~static_cast<uint64_t>(0);
+
+// Write the entries [begin, end) and the tombstones of "range_dels" (if
+// non-null) to the table named by meta->number.
+Status WritePartition(const std::string& dbname, Env* env,
+                      const Options& options, TableCache* table_cache,
+                      const PartitionedEntry* begin,
+                      const PartitionedEntry* end,
+                      const RangeTombstoneList* range_dels,
+                      FileMetaData* meta) {
+  assert(begin != end || range_dels != nullptr);
+  meta->file_size = 0;
+  std::string fname = TableFileName(dbname, meta->number);
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+
+  auto* builder = new TableBuilder(options, file);
+  ParsedInternalKey ikey;
+  for (const PartitionedEntry* e = begin; e != end; ++e) {
+    builder->Add(e->key, e->value);
+    if (e->located) {
+      meta->ExtendHilbert(e->hilbert);
+    }
+    if (ParseInternalKey(e->key, &ikey)) {
+      meta->AddEntryStats(ikey, e->located);
+    }
+  }
+  if (begin != end) {
+    meta->smallest.DecodeFrom(begin->key);
+    meta->largest.DecodeFrom((end - 1)->key);
+  }
+  if (range_dels != nullptr) {
+    AddRangeTombstones(*range_dels, begin != end, builder, meta);
+  }
+
+  s = FinishTable(table_cache, builder, file, meta);
+  if (!s.ok()) {
+    meta->file_size = 0;
+    env->RemoveFile(fname);
+  }
+  return s;
+}
+
+}  // namespace
+
+void AddRangeTombstones(const RangeTombstoneList& range_dels,
+                        bool has_entries, TableBuilder* builder,
+                        FileMetaData* meta) {
+  assert(!range_dels.empty());
+  std::string contents;
+  range_dels.EncodeTo(&contents);
+  builder->AddMetaBlock(kRangeTombstonesBlock, contents);
+  meta->has_range_tombstones = true;
+  if (!has_entries) {
+    std::string begin, end;
+    range_dels.GetKeyRange(&begin, &end);
+    meta->smallest = InternalKey(begin, kMaxSequenceNumber, kValueTypeForSeek,
+                                 0, spatial::kOmitCoordinate,
+                                 spatial::kOmitCoordinate);
+    meta->largest = InternalKey(end, 0, kTypeDeletion, 0,
+                                spatial::kOmitCoordinate,
+                                spatial::kOmitCoordinate);
+  }
+}
+
+bool ExtractHilbertIndex(const Slice& internal_key, spatial::Linear* t) {
+  static const spatial::Hilbert hilbert(spatial::kKeyOrder);
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_key, &ikey)) {
+    return false;
+  }
+  return hilbert.MapInverse(ikey.x, ikey.y, t);
+}
+
+void AddEntryToMetaData(const Slice& internal_key, FileMetaData* meta) {
+  static const spatial::Hilbert hilbert(spatial::kKeyOrder);
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(internal_key, &ikey)) {
+    return;
+  }
+  spatial::Linear t;
+  const bool located = hilbert.MapInverse(ikey.x, ikey.y, &t);
+  if (located) {
+    meta->ExtendHilbert(t);
+  }
+  meta->AddEntryStats(ikey, located);
+}
+
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  const RangeTombstoneList* range_dels) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
+  if (range_dels != nullptr && range_dels->empty()) {
+    range_dels = nullptr;
+  }
 
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || range_dels != nullptr) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -29,41 +172,23 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     }
 
     auto* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     Slice key;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
       builder->Add(key, iter->value());
+      AddEntryToMetaData(key, meta);
     }
     if (!key.empty()) {
       meta->largest.DecodeFrom(key);
     }
-
-    // Finish and check for builder errors
-    s = builder->Finish();
-    if (s.ok()) {
-      meta->file_size = builder->FileSize();
-      assert(meta->file_size > 0);
+    if (range_dels != nullptr) {
+      AddRangeTombstones(*range_dels, !key.empty(), builder, meta);
     }
-    delete builder;
 
-    // Finish and check for file errors
-    if (s.ok()) {
-      s = file->Sync();
-    }
-    if (s.ok()) {
-      s = file->Close();
-    }
-    delete file;
-    file = nullptr;
-
-    if (s.ok()) {
-      // Verify that the table is usable
-      Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
-      s = it->status();
-      delete it;
-    }
+    s = FinishTable(table_cache, builder, file, meta);
   }
 
   // Check for input iterator errors
@@ -79,4 +204,60 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   return s;
 }
 
+Status BuildPartitionedTables(const std::string& dbname, Env* env,
+                              const Options& options, TableCache* table_cache,
+                              Iterator* iter,
+                              uint64_t (*new_file_number)(void* arg),
+                              void* arg, std::vector<FileMetaData>* metas,
+                              const RangeTombstoneList* range_dels) {
+  assert(options.spatial_partition_order > 0 &&
+         static_cast<spatial::Order>(options.spatial_partition_order) <=
+             spatial::kKeyOrder);
+  metas->clear();
+  const int shift = 2 * (spatial::kKeyOrder - options.spatial_partition_order);
+
+  // Tag every entry with its cell.  A stable sort by cell keeps the entries
+  // of each cell in internal key order, ready to be written out.
+  std::vector<PartitionedEntry> entries;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    PartitionedEntry e;
+    e.key = iter->key();
+    e.value = iter->value();
+    e.located = ExtractHilbertIndex(e.key, &e.hilbert);
+    e.partition = e.located ? e.hilbert >> shift : kUnlocatedPartition;
+    entries.push_back(e);
+  }
+  Status s = iter->status();
+  if (!s.ok()) {
+    return s;
+  }
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const PartitionedEntry& a, const PartitionedEntry& b) {
+                     return a.partition < b.partition;
+                   });
+
+  if (range_dels != nullptr && range_dels->empty()) {
+    range_dels = nullptr;
+  }
+  size_t start = 0;
+  while (s.ok() && (start < entries.size() || range_dels != nullptr)) {
+    size_t limit = start;
+    while (limit < entries.size() &&
+           (limit == start ||
+            entries[limit].partition == entries[start].partition)) {
+      limit++;
+    }
+    metas->emplace_back();
+    FileMetaData* meta = &metas->back();
+    meta->number = (*new_file_number)(arg);
+    meta->recency = metas->front().number;
+    s = WritePartition(dbname, env, options, table_cache,
+                       entries.data() + start, entries.data() + limit,
+                       range_dels, meta);
+    range_dels = nullptr;
+    start = limit;
+  }
+  return s;
+}
+
 }  // namespace leveldb
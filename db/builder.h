@@ -5,7 +5,12 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include <cstdint>
+#include <string>
+#include <vector>
+
 #include "leveldb/status.h"
+#include "spatial/format.h"
 
 namespace leveldb {
 
@@ -14,6 +19,9 @@ struct FileMetaData;
 
 class Env;
 class Iterator;
+class RangeTombstoneList;
+class Slice;
+class TableBuilder;
 class TableCache;
 class VersionEdit;
 
@@ -22,8 +30,52 @@ class VersionEdit;
 // *meta will be filled with metadata about the generated table.
 // If no data is present in *iter, meta->file_size will be set to
 // zero, and no Table file will be produced.
+//
+// The range tombstones of "range_dels" (if non-null) are stored in the
+// table too; if there are any, a table is produced even without data.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  const RangeTombstoneList* range_dels = nullptr);
+
+// Like BuildTable(), but splits the contents of *iter into one Table file
+// per cell of the Hilbert grid of order options.spatial_partition_order, so
+// that every file covers a single region.  Entries without a location go
+// to a file of their own.  (*new_file_number)(arg) is called to name each
+// file just before it is created.
+//
+// The range tombstones of "range_dels" (if non-null) go to the first file.
+//
+// *metas receives one entry per file number drawn, in partition order.
+// The files share the recency of the first one: any of them may hold the
+// newest version of a key.
+// On success every entry describes a kept file; on failure the file being
+// built when the error occurred is removed and its file_size is zero.
+//
+// REQUIRES: options.spatial_partition_order > 0
+// REQUIRES: the keys and values of *iter stay valid until *iter is
+//           destroyed (as for memtable iterators).
+Status BuildPartitionedTables(const std::string& dbname, Env* env,
+                              const Options& options, TableCache* table_cache,
+                              Iterator* iter,
+                              uint64_t (*new_file_number)(void* arg),
+                              void* arg, std::vector<FileMetaData>* metas,
+                              const RangeTombstoneList* range_dels = nullptr);
+
+// Store "range_dels" in the range tombstone meta block of the table that
+// *builder builds and *meta describes.  A table without entries gets the
+// key range of the tombstones.
+// REQUIRES: !range_dels.empty()
+void AddRangeTombstones(const RangeTombstoneList& range_dels,
+                        bool has_entries, TableBuilder* builder,
+                        FileMetaData* meta);
+
+// Stores in *t the Hilbert index (order spatial::kKeyOrder) of the location
+// carried by "internal_key".  Returns false if the key has no location.
+bool ExtractHilbertIndex(const Slice& internal_key, spatial::Linear* t);
+
+// Widen the Hilbert extent and the entry statistics of the table described
+// by *meta to cover the entry "internal_key".
+void AddEntryToMetaData(const Slice& internal_key, FileMetaData* meta);
 
 }  // namespace leveldb
 
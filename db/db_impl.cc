@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <ctime>
+#include <limits>
 #include <set>
 #include <string>
 #include <vector>
@@ -20,6 +21,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/sst_file_properties.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
@@ -35,6 +37,7 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/thread_pool.h"
 
 namespace leveldb {
 
@@ -52,23 +55,45 @@ struct DBImpl::Writer {
   port::CondVar cv;
 };
 
+// A write group that has left the log stage of a pipelined write and is
+// queued in memtable_writers_ to sync the log and fill the memtable.
+struct DBImpl::PipelinedGroup {
+  explicit PipelinedGroup(port::Mutex* mu) : cv(mu) {}
+
+  std::vector<Writer*> writers;  // Including the leader
+  SequenceNumber last_sequence;  // Last sequence number of the group
+  port::CondVar cv;              // Signalled when the group reaches the front
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
-  struct Output {
-    uint64_t number;
-    uint64_t file_size;
-    InternalKey smallest, largest;
-    ValidTime earliest, latest;
-  };
+  // Files produced by compaction carry the same metadata as installed files:
+  // number, size, key range, valid-time range and Hilbert extent.
+  typedef FileMetaData Output;
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        earliest(kMaxValidTime),
+        latest(0),
+        has_begin(false),
+        has_end(false),
+        range_dels(nullptr),
+        kept_range_dels(nullptr),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        imm_micros(0) {
+    for (int which = 0; which < 2; which++) {
+      for (int i = 0; i < c->num_input_files(which); i++) {
+        const FileMetaData* f = c->input(which, i);
+        earliest = std::min(earliest, f->earliest);
+        latest = std::max(latest, f->latest);
+      }
+    }
+  }
 
   Compaction* const compaction;
 
@@ -78,13 +103,36 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Valid-time window covered by the inputs, and so by every output.
+  ValidTime earliest;
+  ValidTime latest;
+
+  // Smallest key of the input files, dropped ones included.
+  InternalKey smallest_input;
+
+  // User keys bounding the slice [begin, end) of the input processed by
+  // this state when the compaction is split into subcompactions.
+  bool has_begin;
+  bool has_end;
+  std::string begin;
+  std::string end;
+
   std::vector<Output> outputs;
 
+  // Range tombstones that hide input entries from every snapshot (shared by
+  // all slices), and the ones the first output of slice 0 carries over.
+  // Null if there are none; kept_range_dels is reset once an output holds
+  // them.
+  const RangeTombstoneView* range_dels;
+  const RangeTombstoneList* kept_range_dels;
+
   // State kept for output being generated
   WritableFile* outfile;
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  int64_t imm_micros;  // Micros spent doing imm_ compactions
+  Status status;       // Result of DoCompactionSlice()
 };
 
 // Fix user-supplied options to be reasonable
@@ -104,6 +152,16 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_parallel_l0_probes, 1, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.spatial_partition_order, 0,
+              static_cast<int>(spatial::kKeyOrder));
+  ClipToRange(&result.async_read_threads, 0, 1024);
+  if (result.max_total_memtable_bytes != 0) {
+    ClipToRange(&result.max_total_memtable_bytes, result.write_buffer_size,
+                std::numeric_limits<size_t>::max());
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -140,6 +198,18 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
       table_cache_(new TableCache(dbname_, options_, TableCacheSize(options_))),
+      compaction_pool_(options_.max_background_compactions > 1
+                           ? new ThreadPool(options_.max_background_compactions)
+                           : nullptr),
+      subcompaction_pool_(options_.max_subcompactions > 1
+                              ? new ThreadPool(options_.max_subcompactions - 1)
+                              : nullptr),
+      read_pool_(options_.async_read_threads > 0
+                     ? new ThreadPool(options_.async_read_threads)
+                     : nullptr),
+      warmup_pool_(options_.table_warmup_threads > 0
+                       ? new ThreadPool(options_.table_warmup_threads)
+                       : nullptr),
       db_lock_(nullptr),
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
@@ -150,25 +220,45 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
+      write_buffer_member_(nullptr),
+      mem_carry_over_bytes_(0),
+      log_records_appended_(0),
+      log_records_synced_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
-      manual_compaction_(nullptr),
+      background_flush_scheduled_(false),
+      flushing_imm_(false),
+      background_compactions_scheduled_(0),
+      applying_version_edit_(false),
+      table_warmup_running_(false),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {}
 
 DBImpl::~DBImpl() {
+  // Waits for a flush the manager may have asked of this DB.
+  if (write_buffer_member_ != nullptr) {
+    options_.write_buffer_manager->Unregister(write_buffer_member_);
+  }
+
+  // Finish outstanding asynchronous lookups while the DB is still usable.
+  delete read_pool_;
+
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_flush_scheduled_ || background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
 
+  // Table warm-up stops at the next file once shutting_down_ is set.
+  delete warmup_pool_;
+
   if (db_lock_ != nullptr) {
     env_->UnlockFile(db_lock_);
   }
 
+  delete compaction_pool_;
+  delete subcompaction_pool_;
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
   if (imm_ != nullptr) imm_->Unref();
@@ -389,22 +479,26 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   return Status::OK();
 }
 
+namespace {
+
+struct LogReporter : public log::Reader::Reporter {
+  Env* env;
+  Logger* info_log;
+  const char* fname;
+  Status* status;  // null if options_.paranoid_checks==false
+  void Corruption(size_t bytes, const Status& s) override {
+    Log(info_log, "%s%s: dropping %d bytes; %s",
+        (this->status == nullptr ? "(ignoring error) " : ""), fname,
+        static_cast<int>(bytes), s.ToString().c_str());
+    if (this->status != nullptr && this->status->ok()) *this->status = s;
+  }
+};
+
+}  // namespace
+
 Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
                               bool* save_manifest, VersionEdit* edit,
                               SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;  // null if options_.paranoid_checks==false
-    void Corruption(size_t bytes, const Status& s) override {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == nullptr ? "(ignoring error) " : ""), fname,
-          static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != nullptr && this->status->ok()) *this->status = s;
-    }
-  };
-
   mutex_.AssertHeld();
 
   // Open the log file
@@ -422,54 +516,68 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   reporter.info_log = options_.info_log;
   reporter.fname = fname.c_str();
   reporter.status = (options_.paranoid_checks ? &status : nullptr);
-  // We intentionally make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long)log_number);
 
-  // Read all the records and add to a memtable
-  std::string scratch;
-  Slice record;
-  WriteBatch batch;
   int compactions = 0;
   MemTable* mem = nullptr;
-  while (reader.ReadRecord(&record, &scratch) && status.ok()) {
-    if (record.size() < 12) {
-      reporter.Corruption(record.size(),
-                          Status::Corruption("log record too small"));
-      continue;
-    }
-    WriteBatchInternal::SetContents(&batch, record);
-
-    if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_, GetCurrentTime());
-      mem->Ref();
-    }
-    status = WriteBatchInternal::InsertInto(&batch, mem);
-    MaybeIgnoreError(&status);
-    if (!status.ok()) {
-      break;
+  if (options_.recovery_threads > 0) {
+    Status replay = ReplayLogFileInParallel(fname, &reporter, edit,
+                                            max_sequence, &mem, &compactions);
+    if (status.ok()) {
+      // Keep a corruption that the reporter recorded in "status".
+      status = replay;
     }
-    const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
-                                    WriteBatchInternal::Count(&batch) - 1;
-    if (last_seq > *max_sequence) {
-      *max_sequence = last_seq;
+    if (compactions > 0) {
+      *save_manifest = true;
     }
+  } else {
+    // We intentionally make log::Reader do checksumming even if
+    // paranoid_checks==false so that corruptions cause entire commits
+    // to be skipped instead of propagating bad information (like overly
+    // large sequence numbers).
+    log::Reader reader(file, &reporter, true /*checksum*/,
+                       0 /*initial_offset*/);
+
+    // Read all the records and add to a memtable
+    std::string scratch;
+    Slice record;
+    WriteBatch batch;
+    while (reader.ReadRecord(&record, &scratch) && status.ok()) {
+      if (record.size() < 12) {
+        reporter.Corruption(record.size(),
+                            Status::Corruption("log record too small"));
+        continue;
+      }
+      WriteBatchInternal::SetContents(&batch, record);
 
-    if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
-      compactions++;
-      *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
-      mem->Unref();
-      mem = nullptr;
+      if (mem == nullptr) {
+        mem = NewMemTable(GetCurrentTime());
+        mem->Ref();
+      }
+      status = WriteBatchInternal::InsertInto(&batch, mem);
+      MaybeIgnoreError(&status);
       if (!status.ok()) {
-        // Reflect errors immediately so that conditions like full
-        // file-systems cause the DB::Open() to fail.
         break;
       }
+      const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                      WriteBatchInternal::Count(&batch) - 1;
+      if (last_seq > *max_sequence) {
+        *max_sequence = last_seq;
+      }
+
+      if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
+        compactions++;
+        *save_manifest = true;
+        status = WriteLevel0Table(mem, edit, nullptr);
+        mem->Unref();
+        mem = nullptr;
+        if (!status.ok()) {
+          // Reflect errors immediately so that conditions like full
+          // file-systems cause the DB::Open() to fail.
+          break;
+        }
+      }
     }
   }
 
@@ -491,7 +599,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_, GetCurrentTime());
+        mem_ = NewMemTable(GetCurrentTime());
         mem_->Ref();
       }
     }
@@ -509,9 +617,256 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
+namespace {
+
+// Log files are replayed in chunks of this many bytes.  A multiple of the
+// log block size, so that every chunk starts on a block boundary where a
+// log::Reader can pick up the record stream.
+const uint64_t kRecoveryChunkSize = 128 * log::kBlockSize;
+
+// The records of the log file that start in [start, end), decoded and
+// checksummed by a recovery thread.
+struct RecoveryChunk {
+  uint64_t start;
+  uint64_t end;
+  bool last;  // Whether this chunk runs to the end of the file
+
+  std::string data;               // Concatenated records
+  std::vector<size_t> record_ends;  // End offset of each record in data
+  Status status;  // Error, or corruption if options_.paranoid_checks
+  bool done;
+};
+
+// Chunks of one log file shared between the recovery threads and the
+// thread applying them.
+struct RecoveryJob {
+  RecoveryJob() : cv(&mu) {}
+
+  Env* env;
+  Logger* info_log;
+  const std::string* fname;
+  bool paranoid_checks;
+
+  port::Mutex mu;
+  port::CondVar cv;  // Signalled when a chunk is done
+};
+
+struct RecoveryChunkTask {
+  RecoveryJob* job;
+  RecoveryChunk* chunk;
+};
+
+void DecodeRecoveryChunk(void* arg) {
+  RecoveryChunkTask* task = reinterpret_cast<RecoveryChunkTask*>(arg);
+  RecoveryJob* job = task->job;
+  RecoveryChunk* chunk = task->chunk;
+  delete task;
+
+  // Each chunk reads the file through its own handle.
+  Status status;
+  SequentialFile* file;
+  Status s = job->env->NewSequentialFile(*job->fname, &file);
+  if (s.ok()) {
+    LogReporter reporter;
+    reporter.env = job->env;
+    reporter.info_log = job->info_log;
+    reporter.fname = job->fname->c_str();
+    reporter.status = (job->paranoid_checks ? &status : nullptr);
+    // A reader that starts past the beginning of the file skips the
+    // fragments of a record that started in the previous chunk; the reader
+    // of that chunk reads the whole record instead.
+    log::Reader reader(file, &reporter, true /*checksum*/, chunk->start);
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch) && status.ok()) {
+      if (!chunk->last && reader.LastRecordOffset() >= chunk->end) {
+        break;  // Belongs to the next chunk.
+      }
+      chunk->data.append(record.data(), record.size());
+      chunk->record_ends.push_back(chunk->data.size());
+    }
+    delete file;
+    s = status;
+  }
+
+  job->mu.Lock();
+  chunk->status = s;
+  chunk->done = true;
+  job->cv.SignalAll();
+  job->mu.Unlock();
+}
+
+// Memtables filled by the replay, waiting to be written to level 0.
+struct RecoveryFlushJob {
+  RecoveryFlushJob() : cv(&mu), pending(0) {}
+
+  port::Mutex mu;
+  port::CondVar cv;  // Signalled when a flush finishes
+  int pending;       // Flushes scheduled but not finished
+};
+
+}  // namespace
+
+struct DBImpl::RecoveryFlushTask {
+  DBImpl* db;
+  MemTable* mem;
+  VersionEdit* edit;
+  Status* status;  // Guarded by db->mutex_
+  RecoveryFlushJob* job;
+};
+
+void DBImpl::BGRecoveryFlush(void* arg) {
+  RecoveryFlushTask* task = reinterpret_cast<RecoveryFlushTask*>(arg);
+  DBImpl* db = task->db;
+  db->mutex_.Lock();
+  if (task->status->ok()) {
+    *task->status = db->WriteLevel0Table(task->mem, task->edit, nullptr);
+  }
+  task->mem->Unref();
+  db->mutex_.Unlock();
+
+  RecoveryFlushJob* job = task->job;
+  delete task;
+  job->mu.Lock();
+  job->pending--;
+  job->cv.SignalAll();
+  job->mu.Unlock();
+}
+
+Status DBImpl::ReplayLogFileInParallel(const std::string& fname,
+                                       log::Reader::Reporter* reporter,
+                                       VersionEdit* edit,
+                                       SequenceNumber* max_sequence,
+                                       MemTable** mem, int* compactions) {
+  mutex_.AssertHeld();
+  uint64_t file_size;
+  Status status = env_->GetFileSize(fname, &file_size);
+  if (!status.ok()) {
+    return status;
+  }
+  const uint64_t num_chunks =
+      std::max<uint64_t>(1, (file_size + kRecoveryChunkSize - 1) /
+                                kRecoveryChunkSize);
+  // Decode at most this many chunks ahead of the one being applied, to
+  // bound the memory held by decoded records.
+  const uint64_t window = 2 * options_.recovery_threads;
+
+  RecoveryJob job;
+  job.env = env_;
+  job.info_log = options_.info_log;
+  job.fname = &fname;
+  job.paranoid_checks = options_.paranoid_checks;
+  std::vector<RecoveryChunk*> chunks(num_chunks);
+  for (uint64_t i = 0; i < num_chunks; i++) {
+    RecoveryChunk* chunk = new RecoveryChunk;
+    chunk->start = i * kRecoveryChunkSize;
+    chunk->end = chunk->start + kRecoveryChunkSize;
+    chunk->last = (i + 1 == num_chunks);
+    chunk->done = false;
+    chunks[i] = chunk;
+  }
+
+  Status flush_status;  // Guarded by mutex_
+  RecoveryFlushJob flush_job;
+  {
+    // Declared after the jobs so that both pools drain and join before
+    // the state their work refers to goes away.
+    ThreadPool decode_pool(options_.recovery_threads);
+    ThreadPool flush_pool(1);  // One thread keeps level-0 files in order
+    uint64_t scheduled = 0;
+    for (; scheduled < std::min(window, num_chunks); scheduled++) {
+      decode_pool.Schedule(&DecodeRecoveryChunk,
+                           new RecoveryChunkTask{&job, chunks[scheduled]});
+    }
+
+    // Apply the chunks in order.  The memtables being filled are private
+    // to this thread, so mutex_ is only needed by the flushes.
+    mutex_.Unlock();
+    WriteBatch batch;
+    for (uint64_t i = 0; i < num_chunks && status.ok(); i++) {
+      RecoveryChunk* chunk = chunks[i];
+      job.mu.Lock();
+      while (!chunk->done) {
+        job.cv.Wait();
+      }
+      job.mu.Unlock();
+      if (scheduled < num_chunks) {
+        decode_pool.Schedule(&DecodeRecoveryChunk,
+                             new RecoveryChunkTask{&job, chunks[scheduled]});
+        scheduled++;
+      }
+
+      size_t record_start = 0;
+      for (size_t r = 0; r < chunk->record_ends.size(); r++) {
+        Slice record(chunk->data.data() + record_start,
+                     chunk->record_ends[r] - record_start);
+        record_start = chunk->record_ends[r];
+        if (record.size() < 12) {
+          reporter->Corruption(record.size(),
+                               Status::Corruption("log record too small"));
+          continue;
+        }
+        WriteBatchInternal::SetContents(&batch, record);
+
+        if (*mem == nullptr) {
+          *mem = NewMemTable(GetCurrentTime());
+          (*mem)->Ref();
+        }
+        status = WriteBatchInternal::InsertInto(&batch, *mem);
+        MaybeIgnoreError(&status);
+        if (!status.ok()) {
+          break;
+        }
+        const SequenceNumber last_seq = WriteBatchInternal::Sequence(&batch) +
+                                        WriteBatchInternal::Count(&batch) - 1;
+        if (last_seq > *max_sequence) {
+          *max_sequence = last_seq;
+        }
+
+        if ((*mem)->ApproximateMemoryUsage() > options_.write_buffer_size) {
+          // Write the full memtable to level 0 while replay continues, but
+          // keep at most one more waiting behind the flush in progress.
+          (*compactions)++;
+          flush_job.mu.Lock();
+          while (flush_job.pending >= 2) {
+            flush_job.cv.Wait();
+          }
+          flush_job.pending++;
+          flush_job.mu.Unlock();
+          flush_pool.Schedule(
+              &DBImpl::BGRecoveryFlush,
+              new RecoveryFlushTask{this, *mem, edit, &flush_status,
+                                    &flush_job});
+          *mem = nullptr;
+        }
+      }
+      if (status.ok()) {
+        status = chunk->status;
+        MaybeIgnoreError(&status);
+      }
+      delete chunk;
+      chunks[i] = nullptr;
+    }
+  }
+  mutex_.Lock();
+  for (RecoveryChunk* chunk : chunks) {
+    delete chunk;  // Chunks skipped after an error
+  }
+
+  if (status.ok()) {
+    // Reflect flush errors so that conditions like full file-systems cause
+    // the DB::Open() to fail.
+    status = flush_status;
+  }
+  return status;
+}
+
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
                                 Version* base) {
   mutex_.AssertHeld();
+  if (options_.spatial_partition_order > 0) {
+    return WritePartitionedLevel0Tables(mem, edit);
+  }
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
@@ -523,7 +878,10 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    RangeTombstoneList range_dels(user_comparator());
+    mem->GetRangeTombstones(&range_dels);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                   &range_dels);
     meta.earliest = mem->GetStartValidTime();
     meta.latest = mem->GetEndValidTime();
     mutex_.Lock();
@@ -544,8 +902,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 //    if (base != nullptr) {
 //      level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
 //    }
-    edit->AddFile(level, meta.number, meta.file_size, meta.earliest,
-                  meta.latest, meta.smallest, meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
@@ -555,15 +912,70 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   return s;
 }
 
+Status DBImpl::WritePartitionedLevel0Tables(MemTable* mem, VersionEdit* edit) {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  Iterator* iter = mem->NewIterator();
+  Log(options_.info_log, "Level-0 tables: started, partition order %d",
+      options_.spatial_partition_order);
+
+  std::vector<FileMetaData> metas;
+  Status s;
+  {
+    mutex_.Unlock();
+    RangeTombstoneList range_dels(user_comparator());
+    mem->GetRangeTombstones(&range_dels);
+    s = BuildPartitionedTables(dbname_, env_, options_, table_cache_, iter,
+                               &DBImpl::NewPendingOutputNumber, this, &metas,
+                               &range_dels);
+    mutex_.Lock();
+  }
+  delete iter;
+
+  CompactionStats stats;
+  for (FileMetaData& meta : metas) {
+    pending_outputs_.erase(meta.number);
+    // Note that if file_size is zero, the file has been deleted and
+    // should not be added to the manifest.
+    if (s.ok() && meta.file_size > 0) {
+      meta.earliest = mem->GetStartValidTime();
+      meta.latest = mem->GetEndValidTime();
+      edit->AddFile(0, meta);
+    }
+    stats.bytes_written += meta.file_size;
+  }
+  Log(options_.info_log, "Level-0 tables: %d files, %lld bytes %s",
+      static_cast<int>(metas.size()),
+      static_cast<long long>(stats.bytes_written), s.ToString().c_str());
+
+  stats.micros = env_->NowMicros() - start_micros;
+  stats_[0].Add(stats);
+  return s;
+}
+
+uint64_t DBImpl::NewPendingOutputNumber(void* db) {
+  DBImpl* impl = reinterpret_cast<DBImpl*>(db);
+  MutexLock l(&impl->mutex_);
+  const uint64_t number = impl->versions_->NewFileNumber();
+  impl->pending_outputs_.insert(number);
+  return number;
+}
+
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
   assert(imm_ != nullptr);
+  assert(!flushing_imm_);
+  flushing_imm_ = true;
 
   // Save the contents of the memtable as a new Table
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  Status s;
+  {
+    LatencyTimer timer(env_, &latency_stats_, LatencyStats::kFlush);
+    s = WriteLevel0Table(imm_, &edit, base);
+  }
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -574,7 +986,7 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
 
   if (s.ok()) {
@@ -582,10 +994,12 @@ void DBImpl::CompactMemTable() {
     imm_->Unref();
     imm_ = nullptr;
     has_imm_.store(false, std::memory_order_release);
+    ReportMemTableUsage();
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
   }
+  flushing_imm_ = false;
 }
 
 void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
@@ -605,6 +1019,218 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+// Copy "src" to "dst" and sync the copy.
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  static const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (s.ok()) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+  }
+  delete[] buffer;
+  delete in;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  if (!s.ok()) {
+    env->RemoveFile(dst);
+  }
+  return s;
+}
+
+Status DBImpl::ReadExternalFile(const std::string& fname, FileMetaData* meta) {
+  uint64_t file_size;
+  Status s = env_->GetFileSize(fname, &file_size);
+  RandomAccessFile* file = nullptr;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  Table* table = nullptr;
+  if (s.ok()) {
+    s = Table::Open(options_, file, file_size, &table);
+  }
+  std::string properties;
+  if (s.ok()) {
+    s = table->ReadMetaBlock(kSstFilePropertiesBlock, &properties);
+    if (s.IsNotFound()) {
+      s = Status::InvalidArgument(fname, "not written by SstFileWriter");
+    }
+  }
+  if (s.ok()) {
+    meta->file_size = file_size;
+    if (!DecodeSstFileProperties(properties, meta)) {
+      s = Status::Corruption(fname, "bad SstFileWriter properties");
+    }
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+// Returns true iff the external file "f" holds versions for the valid
+// times from the start of "mem" on, and "mem" an entry for a user key in
+// the key range of "f".
+static bool MemTableOverlaps(MemTable* mem, const FileMetaData& f,
+                             const Comparator* ucmp) {
+  if (f.latest < mem->GetStartValidTime()) {
+    return false;
+  }
+  Iterator* iter = mem->NewIterator();
+  InternalKey start(f.smallest.user_key(), kMaxSequenceNumber,
+                    kValueTypeForSeek, 0, 0, 0);
+  iter->Seek(start.Encode());
+  const bool overlaps =
+      iter->Valid() &&
+      ucmp->Compare(ExtractUserKey(iter->key()), f.largest.user_key()) <= 0;
+  delete iter;
+  return overlaps;
+}
+
+// Add "offset" (modulo 2^64) to the sequence number of *key.
+static void ShiftSequence(InternalKey* key, SequenceNumber offset) {
+  ParsedInternalKey parsed;
+  if (ParseInternalKey(key->Encode(), &parsed)) {
+    parsed.sequence += offset;
+    std::string shifted;
+    AppendInternalKey(&shifted, parsed);
+    key->DecodeFrom(shifted);
+  }
+}
+
+Status DBImpl::IngestExternalFiles(const IngestExternalFileOptions& options,
+                                   const std::vector<std::string>& files) {
+  if (files.empty()) {
+    return Status::OK();
+  }
+  std::vector<FileMetaData> metas(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    Status s = ReadExternalFile(files[i], &metas[i]);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+
+  // Take the front of the writer queue, so that no write picks sequence
+  // numbers while the last sequence number is raised.
+  MutexLock l(&mutex_);
+  Writer w(&mutex_);
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_writers_.empty()) {
+    background_work_finished_signal_.Wait();
+  }
+
+  Status s = bg_error_;
+  // Ingested entries are newer than everything written before.  Lookups
+  // before the start of a memtable look for them in the files, but from
+  // its start on they trust the memtable's version of a key it holds.
+  const Comparator* ucmp = internal_comparator_.user_comparator();
+  for (size_t i = 0; s.ok() && i < metas.size(); i++) {
+    if (MemTableOverlaps(mem_, metas[i], ucmp) ||
+        (imm_ != nullptr && MemTableOverlaps(imm_, metas[i], ucmp))) {
+      s = Status::InvalidArgument(files[i],
+                                  "holds versions hidden by the memtable");
+    }
+  }
+
+  // The files store valid times as sequence numbers.  Shift them all by
+  // one offset, so that the ingested entries rise above the last sequence
+  // number and keep their order across the files.
+  ValidTime vt_min = kMaxValidTime;
+  ValidTime vt_max = 0;
+  for (const FileMetaData& meta : metas) {
+    vt_min = std::min(vt_min, meta.earliest);
+    vt_max = std::max(vt_max, meta.latest);
+  }
+  const SequenceNumber first = versions_->LastSequence() + 1;
+  if (s.ok() && vt_max - vt_min > kMaxSequenceNumber - first) {
+    s = Status::InvalidArgument(
+        "valid times of the ingested entries span too many sequence numbers");
+  }
+
+  size_t placed = 0;
+  for (FileMetaData& meta : metas) {
+    meta.number = versions_->NewFileNumber();
+    pending_outputs_.insert(meta.number);
+    meta.sequence_offset = first - vt_min;
+    ShiftSequence(&meta.smallest, meta.sequence_offset);
+    ShiftSequence(&meta.largest, meta.sequence_offset);
+    meta.largest_sequence += meta.sequence_offset;
+    // Like the tables of a partitioned flush, the files rank together and
+    // cover one valid-time range, which ends at the current time: however
+    // the entries were split into files, lookups see the same versions.
+    meta.recency = metas.front().number;
+    meta.earliest = vt_min;
+    meta.latest = std::max(vt_max, current_time_);
+  }
+  if (s.ok()) {
+    mutex_.Unlock();
+    for (; s.ok() && placed < files.size(); placed++) {
+      const std::string dst = TableFileName(dbname_, metas[placed].number);
+      s = options.move_files ? env_->RenameFile(files[placed], dst)
+                             : CopyFile(env_, files[placed], dst);
+      if (!s.ok()) {
+        break;
+      }
+    }
+    mutex_.Lock();
+  }
+
+  if (s.ok()) {
+    VersionEdit edit;
+    for (const FileMetaData& meta : metas) {
+      edit.AddFile(0, meta);
+    }
+    versions_->SetLastSequence(first + (vt_max - vt_min));
+    s = LogAndApply(&edit);
+  }
+  if (!s.ok()) {
+    // Put back the files placed so far.
+    for (size_t i = 0; i < placed; i++) {
+      const std::string dst = TableFileName(dbname_, metas[i].number);
+      if (options.move_files) {
+        env_->RenameFile(dst, files[i]);
+      } else {
+        env_->RemoveFile(dst);
+      }
+    }
+  }
+  for (const FileMetaData& meta : metas) {
+    pending_outputs_.erase(meta.number);
+  }
+  Log(options_.info_log, "Ingested %d files: %s",
+      static_cast<int>(files.size()), s.ToString().c_str());
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  MaybeScheduleCompaction();
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
@@ -615,6 +1241,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   ManualCompaction manual;
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -633,19 +1260,16 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   }
 
   MutexLock l(&mutex_);
-  while (!manual.done && !shutting_down_.load(std::memory_order_acquire) &&
-         bg_error_.ok()) {
-    if (manual_compaction_ == nullptr) {  // Idle
-      manual_compaction_ = &manual;
-      MaybeScheduleCompaction();
-    } else {  // Running either my compaction or another compaction.
-      background_work_finished_signal_.Wait();
-    }
-  }
-  if (manual_compaction_ == &manual) {
-    // Cancel my manual compaction since we aborted early for some reason.
-    manual_compaction_ = nullptr;
+  manual_compactions_.push_back(&manual);
+  MaybeScheduleCompaction();
+  while (manual.in_progress ||
+         (!manual.done && !shutting_down_.load(std::memory_order_acquire) &&
+          bg_error_.ok())) {
+    background_work_finished_signal_.Wait();
   }
+  // Done, or cancelled since we aborted early for some reason.
+  manual_compactions_.erase(std::find(manual_compactions_.begin(),
+                                      manual_compactions_.end(), &manual));
 }
 
 Status DBImpl::TEST_CompactMemTable() {
@@ -672,20 +1296,39 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (applying_version_edit_) {
+    background_work_finished_signal_.Wait();
+  }
+  applying_version_edit_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  applying_version_edit_ = false;
+  background_work_finished_signal_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
-    // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    if (imm_ != nullptr && !background_flush_scheduled_ && !flushing_imm_) {
+      background_flush_scheduled_ = true;
+      env_->ScheduleWithPriority(&DBImpl::BGFlushWork, this, Env::kHigh);
+    }
+    if (background_compactions_scheduled_ <
+            options_.max_background_compactions &&
+        (ManualCompactionPending() || versions_->NeedsCompaction())) {
+      background_compactions_scheduled_++;
+      if (compaction_pool_ != nullptr) {
+        compaction_pool_->Schedule(&DBImpl::BGWork, this);
+      } else {
+        env_->Schedule(&DBImpl::BGWork, this);
+      }
+    }
   }
 }
 
@@ -693,39 +1336,91 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr && !flushing_imm_) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The flush may have made room for another immutable memtable or added
+  // enough level-0 files to need a compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool made_progress = true;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    made_progress = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  A compaction that was
+  // skipped because of a conflict is retried once the conflicting
+  // compaction finishes and reschedules.
+  if (made_progress) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::ManualCompactionPending() {
   mutex_.AssertHeld();
-
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  for (ManualCompaction* m : manual_compactions_) {
+    if (!m->in_progress && !m->done) {
+      return true;
+    }
   }
+  return false;
+}
+
+bool DBImpl::BackgroundCompaction() {
+  mutex_.AssertHeld();
 
-  Compaction* c;
-  bool is_manual = (manual_compaction_ != nullptr);
+  Compaction* c = nullptr;
+  ManualCompaction* m = nullptr;
+  const bool is_manual = ManualCompactionPending();
   InternalKey manual_end;
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
-    c = versions_->CompactRange(m->level, m->begin, m->end);
+    // Start the first waiting manual compaction whose inputs are not
+    // being compacted; the others wait for the compactions holding them.
+    for (ManualCompaction* waiting : manual_compactions_) {
+      if (waiting->in_progress || waiting->done) {
+        continue;
+      }
+      c = versions_->CompactRange(waiting->level, waiting->begin,
+                                  waiting->end);
+      if (c != nullptr && c->InputsBeingCompacted()) {
+        delete c;
+        c = nullptr;
+        continue;
+      }
+      m = waiting;
+      break;
+    }
+    if (m == nullptr) {
+      return false;
+    }
+    m->in_progress = true;
     m->done = (c == nullptr);
     if (c != nullptr) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
@@ -737,6 +1432,13 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c != nullptr && c->InputsBeingCompacted()) {
+      delete c;
+      return false;
+    }
+  }
+  if (c != nullptr) {
+    c->MarkInputsBeingCompacted(true);
   }
 
   Status status;
@@ -747,12 +1449,12 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->earliest, f->latest,
-                       f->smallest, f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
+    c->MarkInputsBeingCompacted(false);
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
         static_cast<unsigned long long>(f->number), c->level() + 1,
@@ -760,11 +1462,15 @@ void DBImpl::BackgroundCompaction() {
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
     CompactionState* compact = new CompactionState(c);
-    status = DoCompactionWork(compact);
+    {
+      LatencyTimer timer(env_, &latency_stats_, LatencyStats::kCompaction);
+      status = DoCompactionWork(compact);
+    }
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     CleanupCompaction(compact);
+    c->MarkInputsBeingCompacted(false);
     c->ReleaseInputs();
     RemoveObsoleteFiles();
   }
@@ -779,7 +1485,6 @@ void DBImpl::BackgroundCompaction() {
   }
 
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
     if (!status.ok()) {
       m->done = true;
     }
@@ -789,8 +1494,9 @@ void DBImpl::BackgroundCompaction() {
       m->tmp_storage = manual_end;
       m->begin = &m->tmp_storage;
     }
-    manual_compaction_ = nullptr;
+    m->in_progress = false;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -822,15 +1528,24 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.earliest = compact->earliest;
+    out.latest = compact->latest;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  Status s = options_.use_direct_io_for_compaction
+                 ? env_->NewDirectWritableFile(fname, &compact->outfile)
+                 : env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile);
+    if (compact->kept_range_dels != nullptr) {
+      AddRangeTombstones(*compact->kept_range_dels, true, compact->builder,
+                         compact->current_output());
+      compact->kept_range_dels = nullptr;
+    }
   }
   return s;
 }
@@ -896,37 +1611,231 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   const int level = compact->compaction->level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.earliest, out.latest,
-                                         out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(level + 1, out);
+  }
+  return LogAndApply(compact->compaction->edit());
+}
+
+namespace {
+
+// Tracks the slices of one compaction that run on the subcompaction pool.
+struct SubcompactionJob {
+  explicit SubcompactionJob(int pending) : cv(&mu), pending(pending) {}
+
+  port::Mutex mu;
+  port::CondVar cv;
+  int pending;  // Slices not yet finished
+};
+
+}  // namespace
+
+struct DBImpl::SubcompactionTask {
+  DBImpl* db;
+  CompactionState* slice;
+  Iterator* input;
+  SubcompactionJob* job;
+};
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  SubcompactionTask* task = reinterpret_cast<SubcompactionTask*>(arg);
+  task->slice->status = task->db->DoCompactionSlice(task->slice, task->input);
+  SubcompactionJob* job = task->job;
+  delete task;
+  job->mu.Lock();
+  if (--job->pending == 0) {
+    job->cv.SignalAll();
+  }
+  job->mu.Unlock();
+}
+
+Status DBImpl::DoCompactionWork(CompactionState* compact) {
+  const uint64_t start_micros = env_->NowMicros();
+
+  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
+      compact->compaction->num_input_files(0), compact->compaction->level(),
+      compact->compaction->num_input_files(1),
+      compact->compaction->level() + 1);
+
+  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
+  assert(compact->builder == nullptr);
+  assert(compact->outfile == nullptr);
+  if (snapshots_.empty()) {
+    compact->smallest_snapshot = versions_->LastSequence();
+  } else {
+    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+  }
+
+  // Entries hidden by a range tombstone from every snapshot are dropped.
+  // The tombstones of the inputs are carried over unless they are in that
+  // case and no other file may hold entries they hide.
+  RangeTombstoneList input_range_dels(user_comparator());
+  RangeTombstoneList kept_range_dels(user_comparator());
+  RangeTombstoneView range_dels;
+  {
+    mutex_.Unlock();
+    Status s = compact->compaction->GetRangeTombstones(&input_range_dels,
+                                                       &range_dels.files);
+    mutex_.Lock();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  range_dels.snapshot = compact->smallest_snapshot;
+  Compaction* const c = compact->compaction;
+  compact->smallest_input = c->input(0, 0)->smallest;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < c->num_input_files(which); i++) {
+      const InternalKey& smallest = c->input(which, i)->smallest;
+      if (internal_comparator_.Compare(smallest, compact->smallest_input) <
+          0) {
+        compact->smallest_input = smallest;
+      }
+    }
+  }
+  for (const RangeTombstone& t : input_range_dels.tombstones()) {
+    if (t.sequence > compact->smallest_snapshot ||
+        c->OtherFilesOverlapRange(t.begin, t.end)) {
+      kept_range_dels.Add(t);
+    }
+  }
+  for (const RegionTombstone& t : input_range_dels.regions()) {
+    if (t.sequence > compact->smallest_snapshot ||
+        c->OtherFilesMayHoldRegion(t)) {
+      kept_range_dels.Add(t);
+    }
+  }
+  // Inputs whose every entry is hidden from every snapshot by a region
+  // tombstone are deleted without being read.
+  if (range_dels.files != nullptr && !range_dels.files->regions().empty()) {
+    const int dropped =
+        c->DropCoveredInputs(*range_dels.files, compact->smallest_snapshot);
+    if (dropped > 0) {
+      Log(options_.info_log, "Dropped %d files covered by region tombstones",
+          dropped);
+    }
+  }
+  if (!range_dels.empty()) {
+    compact->range_dels = &range_dels;
+  }
+  if (!kept_range_dels.empty()) {
+    compact->kept_range_dels = &kept_range_dels;
+  }
+
+  // Split the input into key ranges merged in parallel.  Slice 0 is
+  // processed by "compact" itself on this thread.
+  std::vector<std::string> boundaries;
+  if (subcompaction_pool_ != nullptr) {
+    versions_->GetSubcompactionBoundaries(
+        compact->compaction, options_.max_subcompactions, &boundaries);
+  }
+  std::vector<CompactionState*> slices;
+  slices.push_back(compact);
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    CompactionState* slice =
+        new CompactionState(compact->compaction->NewSubcompaction());
+    slice->smallest_snapshot = compact->smallest_snapshot;
+    slice->range_dels = compact->range_dels;
+    slice->has_begin = true;
+    slice->begin = boundaries[i];
+    slices.push_back(slice);
+  }
+  for (size_t i = 0; i + 1 < slices.size(); i++) {
+    slices[i]->has_end = true;
+    slices[i]->end = slices[i + 1]->begin;
+  }
+  std::vector<Iterator*> inputs;
+  for (size_t i = 0; i < slices.size(); i++) {
+    inputs.push_back(versions_->MakeInputIterator(compact->compaction));
+  }
+  if (slices.size() > 1) {
+    Log(options_.info_log, "Compaction split into %d subcompactions",
+        static_cast<int>(slices.size()));
+  }
+
+  // Release mutex while we're actually doing the compaction work
+  mutex_.Unlock();
+
+  SubcompactionJob job(static_cast<int>(slices.size()) - 1);
+  for (size_t i = 1; i < slices.size(); i++) {
+    subcompaction_pool_->Schedule(
+        &DBImpl::BGSubcompactionWork,
+        new SubcompactionTask{this, slices[i], inputs[i], &job});
+  }
+  Status status = DoCompactionSlice(compact, inputs[0]);
+  job.mu.Lock();
+  while (job.pending > 0) {
+    job.cv.Wait();
+  }
+  job.mu.Unlock();
+
+  mutex_.Lock();
+  // Collect the outputs of the other slices, in key order.
+  for (size_t i = 1; i < slices.size(); i++) {
+    CompactionState* slice = slices[i];
+    if (status.ok()) {
+      status = slice->status;
+    }
+    if (slice->builder != nullptr) {
+      slice->builder->Abandon();
+      delete slice->builder;
+    }
+    delete slice->outfile;
+    compact->outputs.insert(compact->outputs.end(), slice->outputs.begin(),
+                            slice->outputs.end());
+    compact->total_bytes += slice->total_bytes;
+    compact->imm_micros += slice->imm_micros;
+    delete slice->compaction;
+    delete slice;
+  }
+  if (status.ok() && compact->kept_range_dels != nullptr) {
+    // Slice 0 dropped all its entries, so no output holds the kept range
+    // tombstones: keep them in a table of their own, placed at the smallest
+    // input key so that it overlaps no other file of the output level.
+    mutex_.Unlock();
+    status = OpenCompactionOutputFile(compact);
+    if (status.ok()) {
+      compact->current_output()->smallest = compact->smallest_input;
+      compact->current_output()->largest = compact->smallest_input;
+      Iterator* empty = NewEmptyIterator();
+      status = FinishCompactionOutputFile(compact, empty);
+      delete empty;
+    }
+    mutex_.Lock();
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
 }
 
-Status DBImpl::DoCompactionWork(CompactionState* compact) {
-  const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
-
-  Log(options_.info_log, "Compacting %d@%d + %d@%d files",
-      compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
-
-  assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
-  assert(compact->builder == nullptr);
-  assert(compact->outfile == nullptr);
-  if (snapshots_.empty()) {
-    compact->smallest_snapshot = versions_->LastSequence();
+Status DBImpl::DoCompactionSlice(CompactionState* compact, Iterator* input) {
+  if (compact->has_begin) {
+    InternalKey start(compact->begin, kMaxSequenceNumber, kValueTypeForSeek,
+                      kMaxValidTime, spatial::kOmitCoordinate,
+                      spatial::kOmitCoordinate);
+    input->Seek(start.Encode());
   } else {
-    compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    input->SeekToFirst();
   }
-
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
-
-  // Release mutex while we're actually doing the compaction work
-  mutex_.Unlock();
-
-  input->SeekToFirst();
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
@@ -937,16 +1846,20 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     if (has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (imm_ != nullptr && !flushing_imm_) {
         CompactMemTable();
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      compact->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
+    if (compact->has_end && key.size() >= kInternalKeyAttributesLen &&
+        user_comparator()->Compare(ExtractUserKey(key), compact->end) >= 0) {
+      break;  // Rest of the input belongs to the next slice
+    }
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
@@ -972,23 +1885,31 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         last_sequence_for_key = kMaxSequenceNumber;
       }
 
-      if (last_sequence_for_key <= compact->smallest_snapshot) {
-        // Hidden by an newer entry for same user key
-        drop = true;  // (A)
-      } else if (ikey.type == kTypeDeletion &&
-                 ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
-        // For this user key:
-        // (1) there is no data in higher levels
-        // (2) data in lower levels will have larger sequence numbers
-        // (3) data in layers that are being compacted here and have
-        //     smaller sequence numbers will be dropped in the next
-        //     few iterations of this loop (by rule (A) above).
-        // Therefore this deletion marker is obsolete and can be dropped.
+      if (compact->range_dels != nullptr &&
+          compact->range_dels->Covers(ikey)) {
+        // Hidden by a range tombstone from every snapshot.  Older entries
+        // for the same user key are not hidden by this one, so
+        // last_sequence_for_key is left alone.
         drop = true;
-      }
+      } else {
+        if (last_sequence_for_key <= compact->smallest_snapshot) {
+          // Hidden by an newer entry for same user key
+          drop = true;  // (A)
+        } else if (ikey.type == kTypeDeletion &&
+                   ikey.sequence <= compact->smallest_snapshot &&
+                   compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+          // For this user key:
+          // (1) there is no data in higher levels
+          // (2) data in lower levels will have larger sequence numbers
+          // (3) data in layers that are being compacted here and have
+          //     smaller sequence numbers will be dropped in the next
+          //     few iterations of this loop (by rule (A) above).
+          // Therefore this deletion marker is obsolete and can be dropped.
+          drop = true;
+        }
 
-      last_sequence_for_key = ikey.sequence;
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1012,6 +1933,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         compact->current_output()->smallest.DecodeFrom(key);
       }
       compact->current_output()->largest.DecodeFrom(key);
+      AddEntryToMetaData(key, compact->current_output());
       compact->builder->Add(key, input->value());
 
       // Close output file if it is big enough
@@ -1037,30 +1959,6 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     status = input->status();
   }
   delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1090,7 +1988,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneView* range_dels) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1107,11 +2006,24 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
   versions_->current()->Ref();
 
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  Version* current = versions_->current();
+  IterState* cleanup = new IterState(&mutex_, mem_, imm_, current);
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  if (range_dels != nullptr) {
+    range_dels->mem = mem_;
+    range_dels->imm = imm_;
+  }
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_dels != nullptr) {
+    Status s = current->GetRangeTombstones(&range_dels->files);
+    if (!s.ok()) {
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+  }
   return internal_iter;
 }
 
@@ -1126,8 +2038,48 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+void DBImpl::TEST_WaitForTableWarmup() {
+  MutexLock l(&mutex_);
+  while (table_warmup_running_) {
+    background_work_finished_signal_.Wait();
+  }
+}
+
+// A memtable holds the newest version of each of its keys for the valid
+// times from its start on.  Returns true iff its answer to "lkey", a
+// version with sequence number "sequence", may still be superseded: for an
+// earlier valid time, a table ingested after the version was written may
+// hold a newer one.
+static bool MemTableAnswerMayBeStale(MemTable* mem, Version* current,
+                                     const LookupKey& lkey,
+                                     SequenceNumber sequence) {
+  return lkey.valid_time() < mem->GetStartValidTime() &&
+         current->HasNewerL0Version(lkey.user_key(), lkey.valid_time(),
+                                    sequence);
+}
+
+// Look "lkey" up in the tables of "current".  Returns their answer, stored
+// in *value, if it is a version newer than the memtable's answer "s" with
+// sequence number "sequence"; else the memtable's answer is kept.
+static Status GetNewerFromTables(const ReadOptions& options, Version* current,
+                                 const LookupKey& lkey,
+                                 SequenceNumber sequence, const Status& s,
+                                 std::string* value, Version::GetStats* stats,
+                                 const RangeTombstoneView* range_dels) {
+  std::string newer;
+  SequenceNumber newer_sequence;
+  Status newer_s =
+      current->Get(options, lkey, &newer, stats, range_dels, &newer_sequence);
+  if (newer_sequence > sequence) {
+    value->swap(newer);
+    return newer_s;
+  }
+  return (newer_s.ok() || newer_s.IsNotFound()) ? s : newer_s;
+}
+
 Status DBImpl::Get(const ReadOptions& options, const Slice& key, ValidTime vt,
                    std::string* value) {
+  LatencyTimer timer(env_, &latency_stats_, LatencyStats::kGet);
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1151,14 +2103,27 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key, ValidTime vt,
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
+    RangeTombstoneView range_dels{mem, imm, nullptr, snapshot};
+    s = current->GetRangeTombstones(&range_dels.files);
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot, vt);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    MemTable* answered = nullptr;  // The memtable that answered, if any
+    SequenceNumber sequence = 0;   // Of the version it answered with
+    if (!s.ok()) {
       // Done
+    } else if (mem->Get(lkey, value, &s, &range_dels, &sequence)) {
+      answered = mem;
+    } else if (imm != nullptr &&
+               imm->Get(lkey, value, &s, &range_dels, &sequence)) {
+      answered = imm;
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, &range_dels);
+      have_stat_update = true;
+    }
+    if (answered != nullptr &&
+        MemTableAnswerMayBeStale(answered, current, lkey, sequence)) {
+      s = GetNewerFromTables(options, current, lkey, sequence, s, value,
+                             &stats, &range_dels);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1173,8 +2138,267 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key, ValidTime vt,
   return s;
 }
 
+struct DBImpl::AsyncGet {
+  DBImpl* db;
+  ReadOptions options;
+  std::string key;
+  ValidTime vt;
+  std::string* value;
+  void (*done)(void* arg, const Status& s);
+  void* arg;
+};
+
+void DBImpl::GetAsync(const ReadOptions& options, const Slice& key,
+                      ValidTime vt, std::string* value,
+                      void (*done)(void* arg, const Status& s), void* arg) {
+  if (read_pool_ == nullptr) {
+    done(arg, Get(options, key, vt, value));
+    return;
+  }
+  read_pool_->Schedule(&DBImpl::BGAsyncGet,
+                       new AsyncGet{this, options, key.ToString(), vt, value,
+                                    done, arg});
+}
+
+void DBImpl::BGAsyncGet(void* arg) {
+  AsyncGet* get = reinterpret_cast<AsyncGet*>(arg);
+  Status s = get->db->Get(get->options, get->key, get->vt, get->value);
+  get->done(get->arg, s);
+  delete get;
+}
+
+// Files of one table warm-up, shared by the threads of warmup_pool_.
+struct DBImpl::TableWarmup {
+  DBImpl* db;
+  Version* version;                  // Keeps the files alive
+  std::vector<FileMetaData*> files;  // In the order they are opened
+  std::atomic<size_t> next;          // Index of the next file to open
+  std::atomic<int> running;          // Tasks that have not finished yet
+  uint64_t start_micros;
+};
+
+void DBImpl::StartTableWarmup() {
+  mutex_.AssertHeld();
+  if (warmup_pool_ == nullptr) {
+    return;
+  }
+
+  TableWarmup* warmup = new TableWarmup;
+  warmup->db = this;
+  warmup->version = versions_->current();
+  warmup->version->Ref();
+  warmup->version->GetFilesByLatest(&warmup->files);
+  std::vector<FileMetaData*>& files = warmup->files;
+  if (options_.table_warmup_time_window > 0 && !files.empty()) {
+    // Drop the files that end before the window; they are last in order.
+    const ValidTime newest = files.front()->latest;
+    const ValidTime window = options_.table_warmup_time_window;
+    while (newest - files.back()->latest > window) {
+      files.pop_back();
+    }
+  }
+  // Opening more tables than the cache has room for would evict the newest
+  // ones, or the tables of other DBs sharing the cache.
+  const size_t max_files = table_cache_->Room();
+  if (files.size() > max_files) {
+    files.resize(max_files);
+  }
+  table_warmup_running_ = true;
+  warmup->next.store(0, std::memory_order_relaxed);
+  warmup->running.store(options_.table_warmup_threads,
+                        std::memory_order_relaxed);
+  warmup->start_micros = env_->NowMicros();
+
+  for (int i = 0; i < options_.table_warmup_threads; i++) {
+    warmup_pool_->Schedule(&DBImpl::BGTableWarmup, warmup);
+  }
+}
+
+void DBImpl::BGTableWarmup(void* arg) {
+  TableWarmup* warmup = reinterpret_cast<TableWarmup*>(arg);
+  DBImpl* db = warmup->db;
+  while (!db->shutting_down_.load(std::memory_order_acquire)) {
+    const size_t i = warmup->next.fetch_add(1, std::memory_order_relaxed);
+    if (i >= warmup->files.size()) {
+      break;
+    }
+    const FileMetaData* f = warmup->files[i];
+    Status s = db->table_cache_->Warm(f->number, f->file_size);
+    if (!s.ok()) {
+      Log(db->options_.info_log, "Table warm-up of #%llu: %s",
+          static_cast<unsigned long long>(f->number), s.ToString().c_str());
+    }
+  }
+
+  if (warmup->running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    const size_t opened =
+        std::min(warmup->next.load(std::memory_order_relaxed),
+                 warmup->files.size());
+    Log(db->options_.info_log, "Warmed up %d of %d tables in %llu ms",
+        static_cast<int>(opened), static_cast<int>(warmup->files.size()),
+        static_cast<unsigned long long>(
+            (db->env_->NowMicros() - warmup->start_micros) / 1000));
+    db->mutex_.Lock();
+    warmup->version->Unref();
+    db->table_warmup_running_ = false;
+    db->background_work_finished_signal_.SignalAll();
+    db->mutex_.Unlock();
+    delete warmup;
+  }
+}
+
+// Table reads of one MultiGet() call, shared with the read threads.
+struct DBImpl::MultiGetState {
+  struct Read {
+    MultiGetState* state;
+    LookupKey lkey;
+    std::string* value;
+    Status* status;
+    Version::GetStats stats;
+
+    // Whether a memtable answered with a version of this sequence number,
+    // which the tables may supersede.
+    bool in_memtable = false;
+    SequenceNumber sequence = 0;
+
+    Read(MultiGetState* state, const Slice& key, SequenceNumber snapshot,
+         ValidTime vt, std::string* value, Status* status)
+        : state(state), lkey(key, snapshot, vt), value(value), status(status) {}
+  };
+
+  explicit MultiGetState(const ReadOptions& options, Version* current)
+      : options(options), current(current), cv(&mu), pending(0) {}
+
+  void Run(Read* read) {
+    if (read->in_memtable) {
+      *read->status =
+          GetNewerFromTables(options, current, read->lkey, read->sequence,
+                             *read->status, read->value, &read->stats,
+                             &range_dels);
+    } else {
+      *read->status = current->Get(options, read->lkey, read->value,
+                                   &read->stats, &range_dels);
+    }
+  }
+
+  const ReadOptions& options;
+  Version* const current;
+  RangeTombstoneView range_dels;
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  int pending GUARDED_BY(mu);  // Reads handed to read_pool_ not yet done
+};
+
+void DBImpl::BGMultiGetRead(void* arg) {
+  MultiGetState::Read* read = reinterpret_cast<MultiGetState::Read*>(arg);
+  MultiGetState* state = read->state;
+  state->Run(read);
+  MutexLock l(&state->mu);
+  if (--state->pending == 0) {
+    state->cv.Signal();
+  }
+}
+
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys, ValidTime vt,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  values->assign(keys.size(), std::string());
+  statuses->assign(keys.size(), Status());
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  MultiGetState state(options, current);
+  std::vector<MultiGetState::Read*> reads;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    state.range_dels = RangeTombstoneView{mem, imm, nullptr, snapshot};
+    Status range_dels_status =
+        current->GetRangeTombstones(&state.range_dels.files);
+    // Answer what we can from the memtables and collect the rest.
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::string* value = &(*values)[i];
+      Status* s = &(*statuses)[i];
+      LookupKey lkey(keys[i], snapshot, vt);
+      MemTable* answered = nullptr;
+      SequenceNumber sequence = 0;
+      if (!range_dels_status.ok()) {
+        *s = range_dels_status;
+      } else if (mem->Get(lkey, value, s, &state.range_dels, &sequence)) {
+        answered = mem;
+      } else if (imm != nullptr &&
+                 imm->Get(lkey, value, s, &state.range_dels, &sequence)) {
+        answered = imm;
+      } else {
+        reads.push_back(new MultiGetState::Read(&state, keys[i], snapshot, vt,
+                                                value, s));
+      }
+      if (answered != nullptr &&
+          MemTableAnswerMayBeStale(answered, current, lkey, sequence)) {
+        reads.push_back(new MultiGetState::Read(&state, keys[i], snapshot, vt,
+                                                value, s));
+        reads.back()->in_memtable = true;
+        reads.back()->sequence = sequence;
+      }
+    }
+
+    // Hand all but the first table lookup to the read threads and do the
+    // first one here.
+    if (read_pool_ != nullptr && reads.size() > 1) {
+      {
+        MutexLock sl(&state.mu);
+        state.pending = static_cast<int>(reads.size()) - 1;
+      }
+      for (size_t i = 1; i < reads.size(); i++) {
+        read_pool_->Schedule(&DBImpl::BGMultiGetRead, reads[i]);
+      }
+      state.Run(reads[0]);
+      MutexLock sl(&state.mu);
+      while (state.pending > 0) {
+        state.cv.Wait();
+      }
+    } else {
+      for (MultiGetState::Read* read : reads) {
+        state.Run(read);
+      }
+    }
+    mutex_.Lock();
+  }
+
+  bool schedule_compaction = false;
+  for (MultiGetState::Read* read : reads) {
+    if (current->UpdateStats(read->stats)) {
+      schedule_compaction = true;
+    }
+    delete read;
+  }
+  if (schedule_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Status DBImpl::GetS(const ReadOptions& options, ValidTime vt, spatial::Linear x,
                     spatial::Linear y, std::string* value, int precision) {
+  LatencyTimer timer(env_, &latency_stats_, LatencyStats::kGetS);
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1198,14 +2422,19 @@ Status DBImpl::GetS(const ReadOptions& options, ValidTime vt, spatial::Linear x,
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
+    RangeTombstoneView range_dels{mem, imm, nullptr, snapshot};
+    s = current->GetRangeTombstones(&range_dels.files);
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(Slice(), snapshot, vt);
-    if (mem->Get(lkey, value, &s)) {
+    if (!s.ok()) {
+      // Done
+    } else if (mem->Get(lkey, value, &s, &range_dels)) {
       // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    } else if (imm != nullptr && imm->Get(lkey, value, &s, &range_dels)) {
       // Done
     } else {
-      s = current->GetS(options, lkey, value, &stats, precision);
+      s = current->GetS(options, lkey, value, &stats, precision,
+                        &range_dels);
       have_stat_update = true;
     }
     mutex_.Lock();
@@ -1223,14 +2452,16 @@ Status DBImpl::GetS(const ReadOptions& options, ValidTime vt, spatial::Linear x,
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeTombstoneView range_dels;
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, &range_dels);
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
                        options.validtime,
-                       seed);
+                       seed, range_dels);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1261,7 +2492,22 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end, ValidTime vt_begin,
+                           ValidTime vt_end) {
+  return DB::DeleteRange(options, begin, end, vt_begin, vt_end);
+}
+
+Status DBImpl::DeleteRegion(const WriteOptions& options,
+                            spatial::Linear x_min, spatial::Linear y_min,
+                            spatial::Linear x_max, spatial::Linear y_max,
+                            ValidTime vt_begin, ValidTime vt_end) {
+  return DB::DeleteRegion(options, x_min, y_min, x_max, y_max, vt_begin,
+                          vt_end);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  LatencyTimer timer(env_, &latency_stats_, LatencyStats::kWrite);
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1278,10 +2524,13 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
+  if (status.ok() && updates != nullptr && options_.enable_pipelined_write) {
+    return PipelinedWriteGroup(&w);
+  }
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
 
@@ -1294,12 +2543,15 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
       status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
       bool sync_error = false;
       if (status.ok() && options.sync) {
+        LatencyTimer timer(env_, &latency_stats_, LatencyStats::kWalSync);
         status = logfile_->Sync();
         if (!status.ok()) {
           sync_error = true;
         }
       }
       if (status.ok()) {
+        LatencyTimer timer(env_, &latency_stats_,
+                           LatencyStats::kMemTableInsert);
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1334,9 +2586,104 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// REQUIRES: mutex_ is held
+// REQUIRES: *leader is at the front of the writer queue with a non-null batch
+Status DBImpl::PipelinedWriteGroup(Writer* leader) {
+  mutex_.AssertHeld();
+  PipelinedGroup group(&mutex_);
+  WriteBatch group_batch;
+  Writer* last_writer = leader;
+  WriteBatch* write_batch = BuildBatchGroup(&last_writer, &group_batch);
+
+  // Groups ahead of us in the memtable stage have already been given their
+  // sequence numbers but not published them yet.
+  SequenceNumber last_sequence = memtable_writers_.empty()
+                                     ? versions_->LastSequence()
+                                     : memtable_writers_.back()->last_sequence;
+  WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+  group.last_sequence = last_sequence + WriteBatchInternal::Count(write_batch);
+
+  // Log stage.  Being at the front of writers_ makes us the only appender.
+  Status status;
+  {
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    mutex_.Lock();
+  }
+  const uint64_t record = ++log_records_appended_;
+
+  // Hand the log over to the next group and queue for the memtable stage.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    group.writers.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  memtable_writers_.push_back(&group);
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  while (&group != memtable_writers_.front()) {
+    group.cv.Wait();
+  }
+
+  // Memtable stage.  Groups pass through it one at a time in sequence
+  // order, so the memtable has a single writer and LastSequence() only
+  // moves past fully applied groups.  Syncing here overlaps with the next
+  // group's append; a sync covers every record flushed before it.
+  if (status.ok()) {
+    const bool need_sync = leader->sync && log_records_synced_ < record;
+    // Every record appended so far has been flushed, so the sync covers
+    // them all.
+    const uint64_t sync_through = log_records_appended_;
+    mutex_.Unlock();
+    bool sync_error = false;
+    if (need_sync) {
+      LatencyTimer timer(env_, &latency_stats_, LatencyStats::kWalSync);
+      status = logfile_->SyncData();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    if (status.ok()) {
+      LatencyTimer timer(env_, &latency_stats_, LatencyStats::kMemTableInsert);
+      status = WriteBatchInternal::InsertInto(write_batch, mem_);
+    }
+    mutex_.Lock();
+    if (need_sync && !sync_error) {
+      log_records_synced_ = sync_through;
+    }
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
+  }
+  versions_->SetLastSequence(group.last_sequence);
+
+  memtable_writers_.pop_front();
+  if (!memtable_writers_.empty()) {
+    memtable_writers_.front()->cv.Signal();
+  } else {
+    // MakeRoomForWrite() may be waiting for the pipeline to drain.
+    background_work_finished_signal_.SignalAll();
+  }
+
+  for (Writer* ready : group.writers) {
+    if (ready != leader) {
+      ready->status = status;
+      ready->done = true;
+      ready->cv.Signal();
+    }
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* scratch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1363,22 +2710,25 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       break;
     }
 
-    if (w->batch != nullptr) {
-      size += WriteBatchInternal::ByteSize(w->batch);
-      if (size > max_size) {
-        // Do not make batch too big
-        break;
-      }
+    if (w->batch == nullptr) {
+      // Memtable switches and ingestions must not be absorbed by a write.
+      break;
+    }
 
-      // Append to *result
-      if (result == first->batch) {
-        // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
-        assert(WriteBatchInternal::Count(result) == 0);
-        WriteBatchInternal::Append(result, first->batch);
-      }
-      WriteBatchInternal::Append(result, w->batch);
+    size += WriteBatchInternal::ByteSize(w->batch);
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+
+    // Append to *result
+    if (result == first->batch) {
+      // Switch to temporary batch instead of disturbing caller's batch
+      result = scratch;
+      assert(WriteBatchInternal::Count(result) == 0);
+      WriteBatchInternal::Append(result, first->batch);
     }
+    WriteBatchInternal::Append(result, w->batch);
     *last_writer = w;
   }
   return result;
@@ -1391,6 +2741,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   assert(!writers_.empty());
   bool allow_delay = !force;
   Status s;
+  ReportMemTableUsage();
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
@@ -1409,7 +2760,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       allow_delay = false;  // Do not delay a single write more than once
       mutex_.Lock();
     } else if (!force &&
-               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
+               (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size) &&
+               !MemTableBudgetExceeded()) {
       // There is room in current memtable
       break;
     } else if (imm_ != nullptr) {
@@ -1421,6 +2773,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined write groups are still syncing log_ or filling mem_.
+      background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1442,7 +2797,13 @@ Status DBImpl::MakeRoomForWrite(bool force) {
 //      mem_ = new MemTable(internal_comparator_, GetCurrentTime());
 //      mem_->Ref();
       // MVLevelDB DvD method
-      CreateImmutableMemTable(current_time_);
+      {
+        LatencyTimer timer(env_, &latency_stats_,
+                           LatencyStats::kMemTableSwitch);
+        CreateImmutableMemTable(current_time_);
+      }
+      mem_carry_over_bytes_ = mem_->ApproximateMemoryUsage();
+      ReportMemTableUsage();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
     }
@@ -1450,6 +2811,52 @@ Status DBImpl::MakeRoomForWrite(bool force) {
   return s;
 }
 
+bool DBImpl::MemTableBudgetExceeded() {
+  mutex_.AssertHeld();
+  if (options_.max_total_memtable_bytes == 0 || imm_ == nullptr) {
+    // mem_ alone never outgrows a budget that is >= write_buffer_size.
+    return false;
+  }
+  return mem_->ApproximateMemoryUsage() + imm_->ApproximateMemoryUsage() >
+         options_.max_total_memtable_bytes;
+}
+
+void DBImpl::ReportMemTableUsage() {
+  mutex_.AssertHeld();
+  if (write_buffer_member_ == nullptr) {
+    return;
+  }
+  WriteBufferManager::Usage usage;
+  usage.mutable_bytes = mem_->ApproximateMemoryUsage();
+  usage.immutable_bytes = imm_ != nullptr ? imm_->ApproximateMemoryUsage() : 0;
+  usage.flushable_bytes =
+      usage.mutable_bytes - std::min(usage.mutable_bytes, mem_carry_over_bytes_);
+  options_.write_buffer_manager->ReportUsage(write_buffer_member_, usage);
+}
+
+void DBImpl::WriteBufferManagerFlush(void* db) {
+  DBImpl* impl = reinterpret_cast<DBImpl*>(db);
+  {
+    MutexLock l(&impl->mutex_);
+    // A memtable holding nothing but carried-over entries cannot be
+    // flushed, and a write may have switched memtables since the request.
+    if (impl->mem_->ApproximateMemoryUsage() <= impl->mem_carry_over_bytes_) {
+      return;
+    }
+  }
+  // Switch memtables through the writer queue, like TEST_CompactMemTable().
+  impl->Write(WriteOptions(), nullptr);
+}
+
+MemTable* DBImpl::NewMemTable(ValidTime vt) const {
+  ArenaOptions arena_options;
+  if (options_.memtable_huge_pages) {
+    arena_options.huge_page_region_size = options_.write_buffer_size;
+    arena_options.numa_node = options_.memtable_numa_node;
+  }
+  return new MemTable(internal_comparator_, vt, arena_options);
+}
+
 Status DBImpl::CreateImmutableMemTable(ValidTime vt) {
   Status s;
   mutex_.AssertHeld();
@@ -1458,42 +2865,48 @@ Status DBImpl::CreateImmutableMemTable(ValidTime vt) {
   imm_ = mem_;
   has_imm_.store(true, std::memory_order_release);
   imm_->SetEndValidTime(vt);
-  mem_ = new MemTable(internal_comparator_, vt);
+  mem_ = NewMemTable(vt);
   mem_->Ref();
 
   MemTable* imm = imm_;
   imm->Ref();
 
-  auto* batch = new WriteBatch();
+  // Entries carried over into the new memtable.
+  WriteBatch carry_over;
 
+  // Carry over the newest version of every key, skipping the versions
+  // hidden by a range tombstone of the old MemTable.
   Iterator* iter = imm->NewIterator();
-  iter->SeekToFirst();
-
-  // Put the very first key from the old MemTable
-  InternalKey last_key;
-  last_key.DecodeFrom(iter->key());
-  batch->Put(last_key.user_key(), vt, last_key.x(), last_key.y(), iter->value());
-  iter->Next();
-
-  for (; iter->Valid(); iter->Next()) {
-    InternalKey key;
-    key.DecodeFrom(iter->key());
-    if (!internal_comparator_.user_comparator()->Compare(key.user_key(),
-                                                         last_key.user_key()))
+  const bool has_range_dels = imm->HasRangeTombstones();
+  std::string last_user_key;
+  bool has_last_user_key = false;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey key;
+    if (!ParseInternalKey(iter->key(), &key)) {
+      continue;
+    }
+    if (has_last_user_key &&
+        !internal_comparator_.user_comparator()->Compare(key.user_key,
+                                                         last_user_key))
+      continue;
+    if (has_range_dels && key.type == kTypeValue &&
+        imm->RangeDeleted(key, kMaxSequenceNumber))
       continue;
-    batch->Put(key.user_key(), vt, key.x(), key.y(), iter->value());
-    last_key = key;
+    carry_over.Put(key.user_key, vt, key.x, key.y, iter->value());
+    last_user_key.assign(key.user_key.data(), key.user_key.size());
+    has_last_user_key = true;
   }
 
+  delete iter;
   imm->Unref();
 
   // Copy active data entries to new MemTable
   SequenceNumber last_sequence = versions_->LastSequence();
-  WriteBatchInternal::SetSequence(batch, last_sequence + 1);
-  last_sequence += WriteBatchInternal::Count(batch);
+  WriteBatchInternal::SetSequence(&carry_over, last_sequence + 1);
+  last_sequence += WriteBatchInternal::Count(&carry_over);
 
-  s = log_->AddRecord(WriteBatchInternal::Contents(batch));
-  s = WriteBatchInternal::InsertInto(batch, mem_);
+  s = log_->AddRecord(WriteBatchInternal::Contents(&carry_over));
+  s = WriteBatchInternal::InsertInto(&carry_over, mem_);
 
   versions_->SetLastSequence(last_sequence);
   MaybeScheduleCompaction();
@@ -1558,6 +2971,15 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "latency-histograms") {
+    latency_stats_.AppendTo(value, /*reset=*/false);
+    return true;
+  } else if (in == "latency-histograms.reset") {
+    latency_stats_.AppendTo(value, /*reset=*/true);
+    return true;
+  } else if (in == "block-cache-stats") {
+    *value = options_.block_cache->GetStats();
+    return true;
   }
 
   return false;
@@ -1599,6 +3021,39 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end, ValidTime vt_begin,
+                       ValidTime vt_end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end, vt_begin, vt_end);
+  return Write(opt, &batch);
+}
+
+Status DB::DeleteRegion(const WriteOptions& opt, spatial::Linear x_min,
+                        spatial::Linear y_min, spatial::Linear x_max,
+                        spatial::Linear y_max, ValidTime vt_begin,
+                        ValidTime vt_end) {
+  WriteBatch batch;
+  batch.DeleteRegion(x_min, y_min, x_max, y_max, vt_begin, vt_end);
+  return Write(opt, &batch);
+}
+
+void DB::GetAsync(const ReadOptions& options, const Slice& key, ValidTime vt,
+                  std::string* value, void (*done)(void* arg, const Status& s),
+                  void* arg) {
+  done(arg, Get(options, key, vt, value));
+}
+
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  ValidTime vt, std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->assign(keys.size(), std::string());
+  statuses->assign(keys.size(), Status());
+  for (size_t i = 0; i < keys.size(); i++) {
+    (*statuses)[i] = Get(options, keys[i], vt, &(*values)[i]);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1621,8 +3076,9 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_, GetCurrentTime());
+      impl->mem_ = impl->NewMemTable(GetCurrentTime());
       impl->mem_->Ref();
+      impl->mem_carry_over_bytes_ = impl->mem_->ApproximateMemoryUsage();
     }
   }
   if (s.ok() && save_manifest) {
@@ -1633,6 +3089,12 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok()) {
     impl->RemoveObsoleteFiles();
     impl->MaybeScheduleCompaction();
+    impl->StartTableWarmup();
+    if (options.write_buffer_manager != nullptr) {
+      impl->write_buffer_member_ = options.write_buffer_manager->Register(
+          &DBImpl::WriteBufferManagerFlush, impl);
+      impl->ReportMemTableUsage();
+    }
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
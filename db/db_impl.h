@@ -15,17 +15,23 @@
 #include <ctime>
 
 #include "db/dbformat.h"
+#include "db/latency_stats.h"
+#include "db/log_reader.h"
 #include "db/log_writer.h"
+#include "db/range_tombstone.h"
 #include "db/snapshot.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/write_buffer_manager.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 
 namespace leveldb {
 
+struct FileMetaData;
 class MemTable;
 class TableCache;
+class ThreadPool;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -45,6 +51,13 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key, ValidTime vt,
              spatial::Linear x, spatial::Linear y, const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end, ValidTime vt_begin,
+                     ValidTime vt_end) override;
+  Status DeleteRegion(const WriteOptions&, spatial::Linear x_min,
+                      spatial::Linear y_min, spatial::Linear x_max,
+                      spatial::Linear y_max, ValidTime vt_begin,
+                      ValidTime vt_end) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override { return Status::OK();};  // Deleted
@@ -52,12 +65,20 @@ class DBImpl : public DB {
              ValidTime vt, std::string* value) override;
   Status GetS(const ReadOptions& options, ValidTime vt, spatial::Linear x,
               spatial::Linear y, std::string* value, int p = 32) override;
+  void GetAsync(const ReadOptions& options, const Slice& key, ValidTime vt,
+                std::string* value, void (*done)(void* arg, const Status& s),
+                void* arg) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                ValidTime vt, std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status IngestExternalFiles(const IngestExternalFileOptions& options,
+                             const std::vector<std::string>& files) override;
 
   // Extra methods (for testing) that are not in the public DB interface
   void SetDBCurrentTime(ValidTime vt) { current_time_ = vt; }
@@ -78,6 +99,9 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Wait until the table warm-up started by DB::Open() is done.
+  void TEST_WaitForTableWarmup();
+
   // Record a sample of bytes read at the specified internal key.
   // Samples are taken approximately once every config::kReadBytesPeriod
   // bytes.
@@ -86,12 +110,19 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionTask;
+  struct RecoveryFlushTask;
   struct Writer;
+  struct PipelinedGroup;
+  struct AsyncGet;
+  struct MultiGetState;
+  struct TableWarmup;
 
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
     bool done;
+    bool in_progress;          // Picked up by a background thread
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
     InternalKey tmp_storage;   // Used to keep track of compaction progress
@@ -113,9 +144,12 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // If "range_dels" is non-null, stores in it the range tombstones of the
+  // sources of the returned iterator.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneView* range_dels = nullptr);
 
   Status NewDB();
 
@@ -138,27 +172,89 @@ class DBImpl : public DB {
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Replay the log file "fname" with options_.recovery_threads threads
+  // decoding and checksumming it in chunks, while the calling thread
+  // applies the records in order.  Full memtables are written to level 0
+  // by another thread as replay goes on.  Sets *mem to the last, partly
+  // filled memtable (if any) and *compactions to the number of memtables
+  // written.
+  Status ReplayLogFileInParallel(const std::string& fname,
+                                 log::Reader::Reporter* reporter,
+                                 VersionEdit* edit,
+                                 SequenceNumber* max_sequence, MemTable** mem,
+                                 int* compactions)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGRecoveryFlush(void* arg);
 
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Flush "mem" into one level-0 file per spatial partition
+  // (see Options::spatial_partition_order).
+  Status WritePartitionedLevel0Tables(MemTable* mem, VersionEdit* edit)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Allocate a file number and protect it as a pending output.
+  static uint64_t NewPendingOutputNumber(void* db);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  // Combine the batches at the front of writers_ into one.  Batches from
+  // more than one writer are gathered into *scratch.
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* scratch)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Write the group led by *leader (the front of writers_) with
+  // Options::enable_pipelined_write semantics.
+  Status PipelinedWriteGroup(Writer* leader) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns true if mem_ and imm_ together use more memory than
+  // options_.max_total_memtable_bytes.
+  bool MemTableBudgetExceeded() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Report the memory of mem_ and imm_ to options_.write_buffer_manager.
+  void ReportMemTableUsage() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Called by options_.write_buffer_manager to flush mem_.
+  static void WriteBufferManagerFlush(void* db);
+
+  // Return a new memtable whose arena follows options_.memtable_huge_pages.
+  MemTable* NewMemTable(ValidTime vt) const;
 
   Status CreateImmutableMemTable(ValidTime vt);
 
   void RecordBackgroundError(const Status& s);
 
+  // Versions_->LogAndApply() must not be called concurrently, but flushes
+  // and compactions install their edits from different threads.  Waits for
+  // any other thread's LogAndApply() to finish before calling it.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Is some manual compaction waiting for a background thread?
+  bool ManualCompactionPending() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlushWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Returns false if the picked compaction conflicted with one that is
+  // already running and was therefore skipped.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the slice [compact->begin, compact->end) of "input" into new
+  // output files.  Takes ownership of "input".
+  Status DoCompactionSlice(CompactionState* compact, Iterator* input);
+  static void BGSubcompactionWork(void* arg);
+  static void BGAsyncGet(void* arg);
+  static void BGMultiGetRead(void* arg);
+
+  // Open the tables of the current version on warmup_pool_, newest valid
+  // time first (see Options::table_warmup_threads).
+  void StartTableWarmup() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGTableWarmup(void* arg);
+
+  // Describe in *meta (all but the file number) the table "fname" written
+  // by SstFileWriter.
+  Status ReadExternalFile(const std::string& fname, FileMetaData* meta);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -181,6 +277,24 @@ class DBImpl : public DB {
   // table_cache_ provides its own synchronization
   TableCache* const table_cache_;
 
+  // Runs the background compactions of this DB.  nullptr unless
+  // options_.max_background_compactions > 1; compactions then run on the
+  // Env's low-priority thread.  The pool is the DB's own so that the
+  // threads of the Env, which other DBs share, are left as they are.
+  ThreadPool* const compaction_pool_;
+
+  // Runs all but the first slice of split compactions.  nullptr unless
+  // options_.max_subcompactions > 1.
+  ThreadPool* const subcompaction_pool_;
+
+  // Runs GetAsync() lookups and MultiGet() table reads.  nullptr unless
+  // options_.async_read_threads > 0.
+  ThreadPool* const read_pool_;
+
+  // Opens tables in the background after DB::Open().  nullptr unless
+  // options_.table_warmup_threads > 0.
+  ThreadPool* const warmup_pool_;
+
   // Lock over the persistent DB state.  Non-null iff successfully acquired.
   FileLock* db_lock_;
 
@@ -196,8 +310,24 @@ class DBImpl : public DB {
   log::Writer* log_;
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
 
+  // Membership in options_.write_buffer_manager.  nullptr if there is no
+  // manager or until DB::Open() succeeds.
+  WriteBufferManager::Member* write_buffer_member_ GUARDED_BY(mutex_);
+  // Memory of mem_ taken up by the entries carried over into it when it
+  // was created.  Flushing frees the rest.
+  size_t mem_carry_over_bytes_ GUARDED_BY(mutex_);
+
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
+  // Pipelined write groups that have appended to the log and are waiting
+  // to sync it and apply their batch to mem_, in sequence order.  While it
+  // is non-empty neither log_ nor mem_ may be switched.
+  std::deque<PipelinedGroup*> memtable_writers_ GUARDED_BY(mutex_);
+  // Number of records appended to the log by pipelined writes, and how
+  // many of them are known to be durable.  A group whose record is already
+  // covered by an earlier sync does not sync again.
+  uint64_t log_records_appended_ GUARDED_BY(mutex_);
+  uint64_t log_records_synced_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
@@ -206,10 +336,24 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Has a background memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some thread inside CompactMemTable()?
+  bool flushing_imm_ GUARDED_BY(mutex_);
 
-  ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
+  // Number of background compactions scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Is some thread inside versions_->LogAndApply()?
+  bool applying_version_edit_ GUARDED_BY(mutex_);
+
+  // Is the table warm-up running?
+  bool table_warmup_running_ GUARDED_BY(mutex_);
+
+  // Manual compactions waiting or running, in the order requested.  Those
+  // with disjoint inputs run at the same time.
+  std::deque<ManualCompaction*> manual_compactions_ GUARDED_BY(mutex_);
 
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
@@ -218,6 +362,9 @@ class DBImpl : public DB {
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
 
+  // Hot-path latencies; provides its own synchronization.
+  LatencyStats latency_stats_;
+
   ValidTime current_time_ = (ValidTime) 0;
 };
 
@@ -47,12 +47,14 @@ class DBIter : public Iterator {
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
          ValidTime vt,
-         uint32_t seed)
+         uint32_t seed, const RangeTombstoneView& range_dels)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
         sequence_(s),
         valid_time_(vt),
+        range_dels_(range_dels),
+        has_range_dels_(!range_dels.empty()),
         direction_(kForward),
         valid_(false),
         rnd_(seed),
@@ -90,6 +92,12 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // Returns true iff "ikey" is visible at sequence_.
+  bool IsVisible(const ParsedInternalKey& ikey) const {
+    return ikey.sequence <= sequence_ &&
+           !(has_range_dels_ && range_dels_.Covers(ikey));
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -113,6 +121,8 @@ class DBIter : public Iterator {
   Iterator* const iter_;
   SequenceNumber const sequence_;
   ValidTime const valid_time_;
+  RangeTombstoneView range_dels_;
+  bool const has_range_dels_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -183,7 +193,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   assert(direction_ == kForward);
   do {
     ParsedInternalKey ikey;
-    if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+    if (ParseKey(&ikey) && IsVisible(ikey)) {
       switch (ikey.type) {
         case kTypeDeletion:
           // Arrange to skip all upcoming entries for this key since
@@ -201,6 +211,9 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
             return;
           }
           break;
+        case kTypeRangeDeletion:
+        case kTypeRegionDeletion:
+          break;  // Never in an internal key
       }
     }
     iter_->Next();
@@ -243,7 +256,7 @@ void DBIter::FindPrevUserEntry() {
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
-      if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
+      if (ParseKey(&ikey) && IsVisible(ikey)) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
           // We encountered a non-deleted value in entries for previous keys,
@@ -316,8 +329,11 @@ void DBIter::SeekToLast() {
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
                         ValidTime vt,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, vt, seed);
+                        uint32_t seed, const RangeTombstoneView& range_dels) {
+  RangeTombstoneView view = range_dels;
+  view.snapshot = sequence;
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, vt, seed,
+                    view);
 }
 
 }  // namespace leveldb
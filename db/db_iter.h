@@ -8,6 +8,7 @@
 #include <cstdint>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "leveldb/db.h"
 
 namespace leveldb {
@@ -16,11 +17,14 @@ class DBImpl;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Versions hidden by a tombstone of
+// "range_dels" are skipped; its sources must outlive the iterator.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
                         ValidTime vt,
-                        uint32_t seed);
+                        uint32_t seed,
+                        const RangeTombstoneView& range_dels =
+                            RangeTombstoneView());
 
 }  // namespace leveldb
 
@@ -0,0 +1,1180 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/db.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/db_impl.h"
+#include "db/filename.h"
+#include "db/log_writer.h"
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/write_batch.h"
+#include "port/port.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+class DBTest : public testing::Test {
+ public:
+  // Valid time of the DB clock; later than the creation time of any
+  // memtable, so that flushed tables serve the valid times before it.
+  static constexpr ValidTime kNow = 3000000000;
+
+  DBTest() : env_(Env::Default()), db_(nullptr) {
+    env_->GetTestDirectory(&dbname_);
+    dbname_ += "/db_test";
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+  }
+
+  ~DBTest() override {
+    delete db_;
+    DestroyDB(dbname_, options_);
+  }
+
+  DBImpl* dbfull() { return reinterpret_cast<DBImpl*>(db_); }
+
+  void Reopen() {
+    delete db_;
+    db_ = nullptr;
+    ASSERT_TRUE(DB::Open(options_, dbname_, &db_).ok());
+    dbfull()->SetDBCurrentTime(kNow);
+  }
+
+  void Put(const std::string& key, ValidTime vt, const std::string& value) {
+    WriteBatch batch;
+    batch.Put(key, vt, 1, 2, value);
+    ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  }
+
+  void PutAt(const std::string& key, ValidTime vt, spatial::Linear x,
+             spatial::Linear y, const std::string& value) {
+    WriteBatch batch;
+    batch.Put(key, vt, x, y, value);
+    ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  }
+
+  void DeleteRange(const std::string& begin, const std::string& end,
+                   ValidTime vt_begin, ValidTime vt_end) {
+    ASSERT_TRUE(
+        db_->DeleteRange(WriteOptions(), begin, end, vt_begin, vt_end).ok());
+  }
+
+  void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                    spatial::Linear x_max, spatial::Linear y_max,
+                    ValidTime vt_begin, ValidTime vt_end) {
+    ASSERT_TRUE(db_->DeleteRegion(WriteOptions(), x_min, y_min, x_max, y_max,
+                                  vt_begin, vt_end)
+                    .ok());
+  }
+
+  std::string Get(const std::string& key, ValidTime vt) {
+    std::string value;
+    Status s = db_->Get(ReadOptions(), key, vt, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+
+  // Every key with its newest value visible to "snapshot", as "key=value"
+  // lines.  Unlike Get(), this also sees the tables replayed from the log by
+  // DB::Open().  Scanning backwards must give the same lines.
+  std::string Contents(const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(options);
+    std::string result;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result.append(iter->key().ToString());
+      result.push_back('=');
+      result.append(iter->value().ToString());
+      result.push_back('\n');
+    }
+    EXPECT_TRUE(iter->status().ok());
+    std::string reversed;
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      reversed.insert(0, iter->key().ToString() + "=" +
+                             iter->value().ToString() + "\n");
+    }
+    EXPECT_TRUE(iter->status().ok());
+    EXPECT_EQ(result, reversed);
+    delete iter;
+    return result;
+  }
+
+  int NumTableFiles() {
+    int total = 0;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::string property;
+      EXPECT_TRUE(db_->GetProperty(
+          "leveldb.num-files-at-level" + std::to_string(level), &property));
+      total += std::stoi(property);
+    }
+    return total;
+  }
+
+  // Returns true iff some stored version, hidden or not, holds "value".
+  bool IsStored(const std::string& value) {
+    Iterator* iter = dbfull()->TEST_NewInternalIterator();
+    bool found = false;
+    for (iter->SeekToFirst(); iter->Valid() && !found; iter->Next()) {
+      found = (iter->value() == Slice(value));
+    }
+    delete iter;
+    return found;
+  }
+
+  Env* env_;
+  Options options_;
+  std::string dbname_;
+  DB* db_;
+};
+
+TEST_F(DBTest, PipelinedWritesKeepOrderAndSurviveReopen) {
+  options_.enable_pipelined_write = true;
+  Reopen();
+
+  const int kThreads = 4;
+  const int kWrites = 200;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t]() {
+      WriteOptions write_options;
+      write_options.sync = (t % 2 == 0);
+      const std::string key = "thread" + std::to_string(t);
+      for (int i = 0; i < kWrites; i++) {
+        // Every write of a thread goes to the same version, so only the
+        // thread's last write may be visible if groups apply in order.
+        WriteBatch batch;
+        batch.Put(key, 100, t, t, std::to_string(i));
+        batch.Put(key + "-" + std::to_string(i), 100, t, t, "v");
+        ASSERT_TRUE(db_->Write(write_options, &batch).ok());
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (int t = 0; t < kThreads; t++) {
+    const std::string key = "thread" + std::to_string(t);
+    ASSERT_EQ(std::to_string(kWrites - 1), Get(key, 100));
+    for (int i = 0; i < kWrites; i++) {
+      ASSERT_EQ("v", Get(key + "-" + std::to_string(i), 100));
+    }
+  }
+
+  // Synced and unsynced groups alike are replayed from the log.
+  const std::string contents = Contents();
+  ASSERT_EQ(kThreads * (kWrites + 1),
+            std::count(contents.begin(), contents.end(), '\n'));
+  Reopen();
+  ASSERT_EQ(contents, Contents());
+}
+
+namespace {
+
+// Keeps a copy of what is appended to the current log file and how much of
+// it had been synced, to check what a write could lose in a crash.
+class SyncTrackingEnv : public EnvWrapper {
+ public:
+  explicit SyncTrackingEnv(Env* base) : EnvWrapper(base) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    Status s = target()->NewWritableFile(fname, result);
+    if (s.ok() && fname.size() > 4 &&
+        fname.compare(fname.size() - 4, 4, ".log") == 0) {
+      *result = new TrackedFile(this, *result);
+    }
+    return s;
+  }
+
+  // Whether "data" lies in the synced part of the current log file.
+  bool IsSynced(const std::string& data) {
+    std::lock_guard<std::mutex> l(mu_);
+    return log_.substr(0, synced_).find(data) != std::string::npos;
+  }
+
+ private:
+  class TrackedFile : public WritableFile {
+   public:
+    TrackedFile(SyncTrackingEnv* env, WritableFile* base)
+        : env_(env), base_(base) {
+      std::lock_guard<std::mutex> l(env_->mu_);
+      env_->log_.clear();
+      env_->synced_ = 0;
+    }
+    ~TrackedFile() override { delete base_; }
+
+    Status Append(const Slice& data) override {
+      Status s = base_->Append(data);
+      std::lock_guard<std::mutex> l(env_->mu_);
+      env_->log_.append(data.data(), data.size());
+      return s;
+    }
+    Status Close() override { return base_->Close(); }
+    Status Flush() override { return base_->Flush(); }
+    Status Sync() override {
+      const size_t appended = Appended();
+      return Synced(base_->Sync(), appended);
+    }
+    Status SyncData() override {
+      // Appends may run concurrently with the sync, so only the bytes
+      // appended before it started are known to be durable.
+      const size_t appended = Appended();
+      return Synced(base_->SyncData(), appended);
+    }
+
+   private:
+    size_t Appended() {
+      std::lock_guard<std::mutex> l(env_->mu_);
+      return env_->log_.size();
+    }
+
+    Status Synced(const Status& s, size_t appended) {
+      std::lock_guard<std::mutex> l(env_->mu_);
+      if (s.ok() && appended > env_->synced_) env_->synced_ = appended;
+      return s;
+    }
+
+    SyncTrackingEnv* const env_;
+    WritableFile* const base_;
+  };
+
+  std::mutex mu_;
+  std::string log_;
+  size_t synced_ = 0;
+};
+
+}  // namespace
+
+TEST_F(DBTest, PipelinedSyncWriteIsDurableBeforeReturn) {
+  SyncTrackingEnv env(env_);
+  options_.env = &env;
+  options_.enable_pipelined_write = true;
+  Reopen();
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([this, &env, t]() {
+      for (int i = 0; i < 100; i++) {
+        WriteOptions write_options;
+        write_options.sync = (i % 2 == 0);
+        const std::string key =
+            "key" + std::to_string(t) + "-" + std::to_string(i);
+        WriteBatch batch;
+        batch.Put(key, 100, t, t, "v");
+        ASSERT_TRUE(db_->Write(write_options, &batch).ok());
+        if (write_options.sync) {
+          ASSERT_TRUE(env.IsSynced(key));
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  const std::string contents = Contents();
+  delete db_;
+  db_ = nullptr;
+  options_.env = env_;
+  Reopen();
+  ASSERT_EQ(contents, Contents());
+}
+
+namespace {
+
+// Completion of one DB::GetAsync() call.
+struct AsyncResult {
+  AsyncResult() : cv(&mu), done(false) {}
+
+  static void Done(void* arg, const Status& s) {
+    AsyncResult* result = reinterpret_cast<AsyncResult*>(arg);
+    MutexLock l(&result->mu);
+    result->status = s;
+    result->thread = std::this_thread::get_id();
+    result->done = true;
+    result->cv.SignalAll();
+  }
+
+  void Wait() {
+    MutexLock l(&mu);
+    while (!done) {
+      cv.Wait();
+    }
+  }
+
+  port::Mutex mu;
+  port::CondVar cv;
+  bool done;
+  Status status;
+  std::thread::id thread;
+  std::string value;
+};
+
+}  // namespace
+
+TEST_F(DBTest, GetAsyncCallsBackWithResult) {
+  for (int threads : {0, 2}) {
+    options_.async_read_threads = threads;
+    DestroyDB(dbname_, options_);
+    Reopen();
+    Put("car1", 100, "car1@100");
+    ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+    Put("car2", 200, "car2@200");
+
+    const char* keys[] = {"car1", "car2", "car3"};
+    AsyncResult results[3];
+    for (int i = 0; i < 3; i++) {
+      db_->GetAsync(ReadOptions(), keys[i], kNow - 1, &results[i].value,
+                    &AsyncResult::Done, &results[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+      results[i].Wait();
+      // Without read threads the lookup runs on the calling thread.
+      ASSERT_EQ(threads == 0,
+                results[i].thread == std::this_thread::get_id());
+    }
+    ASSERT_TRUE(results[0].status.ok());
+    ASSERT_EQ("car1@100", results[0].value);
+    ASSERT_TRUE(results[1].status.ok());
+    ASSERT_EQ("car2@200", results[1].value);
+    ASSERT_TRUE(results[2].status.IsNotFound());
+  }
+}
+
+TEST_F(DBTest, GetAsyncRunsOnBoundedPool) {
+  options_.async_read_threads = 2;
+  Reopen();
+  Put("car", 100, "car@100");
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+
+  // Far more lookups than read threads queue up for the same two threads.
+  const int kLookups = 200;
+  std::vector<AsyncResult> results(kLookups);
+  for (int i = 0; i < kLookups; i++) {
+    db_->GetAsync(ReadOptions(), "car", kNow - 1, &results[i].value,
+                  &AsyncResult::Done, &results[i]);
+  }
+  std::vector<std::thread::id> threads;
+  for (int i = 0; i < kLookups; i++) {
+    results[i].Wait();
+    ASSERT_TRUE(results[i].status.ok());
+    ASSERT_EQ("car@100", results[i].value);
+    if (std::find(threads.begin(), threads.end(), results[i].thread) ==
+        threads.end()) {
+      threads.push_back(results[i].thread);
+    }
+  }
+  ASSERT_LE(threads.size(), 2);
+}
+
+TEST_F(DBTest, MultiGetMatchesGet) {
+  for (int threads : {0, 4}) {
+    options_.async_read_threads = threads;
+    DestroyDB(dbname_, options_);
+    Reopen();
+
+    // Spread the versions over two tables and the memtable.
+    std::vector<std::string> keys;
+    for (int i = 0; i < 30; i++) {
+      keys.push_back("key" + std::to_string(i));
+      if (i % 3 != 2) {
+        Put(keys.back(), 100, keys.back() + "@100");
+      }
+      if (i % 10 == 9) {
+        ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+      }
+    }
+    Put("key0", 200, "key0@200");
+    keys.push_back("missing");
+
+    for (ValidTime vt : {ValidTime(150), kNow - 1}) {
+      std::vector<Slice> slices(keys.begin(), keys.end());
+      std::vector<std::string> values;
+      std::vector<Status> statuses;
+      db_->MultiGet(ReadOptions(), slices, vt, &values, &statuses);
+      ASSERT_EQ(keys.size(), values.size());
+      ASSERT_EQ(keys.size(), statuses.size());
+      int found = 0;
+      for (size_t i = 0; i < keys.size(); i++) {
+        const std::string expected = Get(keys[i], vt);
+        if (expected == "NOT_FOUND") {
+          ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i];
+        } else {
+          ASSERT_TRUE(statuses[i].ok()) << keys[i];
+          ASSERT_EQ(expected, values[i]) << keys[i];
+          found++;
+        }
+      }
+      if (vt == kNow - 1) {
+        ASSERT_EQ(20, found);
+      }
+    }
+  }
+}
+
+namespace {
+
+// Name of the only log file of the DB in "dbname".
+std::string FindLogFile(Env* env, const std::string& dbname) {
+  std::vector<std::string> filenames;
+  EXPECT_TRUE(env->GetChildren(dbname, &filenames).ok());
+  std::string result;
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kLogFile) {
+      EXPECT_TRUE(result.empty());
+      result = dbname + "/" + filename;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+class DBRecoveryTest : public DBTest {
+ public:
+  // Fill the log with records larger than a log block, so that some cross
+  // the boundaries of the chunks replayed in parallel, then close the DB.
+  // Returns the contents of the DB.
+  std::string FillLogAndClose() {
+    options_.write_buffer_size = 64 << 20;  // Keep everything in the log
+    Reopen();
+    Random rnd(301);
+    for (int i = 0; i < 200; i++) {
+      WriteBatch batch;
+      batch.Put("key" + std::to_string(i), 100, 1, 2,
+                std::string(40000 + rnd.Uniform(40000), 'a' + i % 26));
+      // Versions of one key spread over the whole log.
+      batch.Put("hot", 100, 1, 2, std::to_string(i));
+      EXPECT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+    }
+    const std::string contents = Contents();
+    delete db_;
+    db_ = nullptr;
+    return contents;
+  }
+
+  Status Open() {
+    delete db_;
+    db_ = nullptr;
+    return DB::Open(options_, dbname_, &db_);
+  }
+};
+
+TEST_F(DBRecoveryTest, ParallelReplayMatchesWrites) {
+  const std::string contents = FillLogAndClose();
+  uint64_t log_size;
+  ASSERT_TRUE(env_->GetFileSize(FindLogFile(env_, dbname_), &log_size).ok());
+  ASSERT_GT(log_size, 2 * 128 * log::kBlockSize);  // Several chunks
+
+  // Memtables fill up and are flushed while the replay goes on.
+  options_.recovery_threads = 4;
+  options_.write_buffer_size = 1 << 20;
+  ASSERT_TRUE(Open().ok());
+  std::string num_files;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &num_files));
+  ASSERT_GT(std::stoi(num_files), 1);
+  ASSERT_EQ(contents, Contents());
+}
+
+TEST_F(DBRecoveryTest, ParallelReplayReportsShortRecord) {
+  const std::string contents = FillLogAndClose();
+  {
+    // A record with a good checksum but too short for a write batch.
+    const std::string fname = FindLogFile(env_, dbname_);
+    uint64_t size;
+    ASSERT_TRUE(env_->GetFileSize(fname, &size).ok());
+    WritableFile* file;
+    ASSERT_TRUE(env_->NewAppendableFile(fname, &file).ok());
+    log::Writer writer(file, size);
+    ASSERT_TRUE(writer.AddRecord("short").ok());
+    ASSERT_TRUE(file->Close().ok());
+    delete file;
+  }
+
+  options_.recovery_threads = 4;
+  options_.paranoid_checks = true;
+  ASSERT_TRUE(Open().IsCorruption());
+  options_.paranoid_checks = false;
+  ASSERT_TRUE(Open().ok());
+  ASSERT_EQ(contents, Contents());
+}
+
+TEST_F(DBRecoveryTest, ParallelReplayReportsBadChecksum) {
+  const std::string contents = FillLogAndClose();
+  {
+    // Flip a byte in the middle of the log.
+    const std::string fname = FindLogFile(env_, dbname_);
+    std::string data;
+    ASSERT_TRUE(ReadFileToString(env_, fname, &data).ok());
+    data[data.size() / 2] ^= 0x40;
+    ASSERT_TRUE(WriteStringToFile(env_, data, fname).ok());
+  }
+
+  options_.recovery_threads = 4;
+  options_.paranoid_checks = true;
+  ASSERT_TRUE(Open().IsCorruption());
+  // Without paranoid checks the damaged records are dropped.
+  options_.paranoid_checks = false;
+  ASSERT_TRUE(Open().ok());
+  const std::string recovered = Contents();
+  ASSERT_NE(contents, recovered);
+  ASSERT_NE(std::string::npos, recovered.find("hot=199\n"));
+}
+
+TEST_F(DBTest, PartitionedFlushServesNewestVersion) {
+  // A cell far from (1, 1): its table is written after the table of the
+  // cell holding (1, 1), so it gets the larger file number.
+  const spatial::Linear kFar = (spatial::Linear(1) << 27) + 5;
+  for (int probes : {1, 4}) {
+    options_.spatial_partition_order = 8;
+    options_.max_parallel_l0_probes = probes;
+    delete db_;
+    db_ = nullptr;
+    DestroyDB(dbname_, options_);
+    Reopen();
+
+    WriteBatch batch;
+    batch.Put("car", 100, kFar, kFar, "old");
+    // Versions without a location go to the last table.
+    batch.Put("bike", 100, spatial::kOmitCoordinate, spatial::kOmitCoordinate,
+              "bike@100");
+    ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+    const Snapshot* before = db_->GetSnapshot();
+    batch.Clear();
+    batch.Put("car", 200, 1, 1, "new");
+    batch.Put("bike", 200, 1, 1, "bike@200");
+    batch.Put("bus", 100, 1, 1, "bus@100");
+    batch.Put("bus", 200, spatial::kOmitCoordinate, spatial::kOmitCoordinate,
+              "bus@200");
+    ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+    const Snapshot* after = db_->GetSnapshot();
+    ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+    std::string files;
+    ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &files));
+    ASSERT_EQ("3", files);
+
+    // Switching memtables carried the newest versions over, so read the
+    // tables through snapshots taken before the flush.
+    ReadOptions options;
+    std::string value;
+    options.snapshot = after;
+    ASSERT_TRUE(db_->Get(options, "car", kNow - 1, &value).ok());
+    ASSERT_EQ("new", value);
+    ASSERT_TRUE(db_->Get(options, "bike", kNow - 1, &value).ok());
+    ASSERT_EQ("bike@200", value);
+    ASSERT_TRUE(db_->Get(options, "bus", kNow - 1, &value).ok());
+    ASSERT_EQ("bus@200", value);
+    options.snapshot = before;
+    ASSERT_TRUE(db_->Get(options, "car", kNow - 1, &value).ok());
+    ASSERT_EQ("old", value);
+    ASSERT_TRUE(db_->Get(options, "bike", kNow - 1, &value).ok());
+    ASSERT_EQ("bike@100", value);
+    ASSERT_TRUE(db_->Get(options, "bus", kNow - 1, &value).IsNotFound());
+    db_->ReleaseSnapshot(before);
+    db_->ReleaseSnapshot(after);
+
+    Reopen();
+    ASSERT_EQ("new", Get("car", kNow - 1));
+    ASSERT_EQ("bike@200", Get("bike", kNow - 1));
+    ASSERT_EQ("bus@200", Get("bus", kNow - 1));
+  }
+}
+
+namespace {
+
+// Counts the table files open for writing at the same time.  Once armed,
+// each table file waits (for a few seconds at most) until two have been
+// open at once, so compactions that can overlap in time do.
+class TableWriteCountingEnv : public EnvWrapper {
+ public:
+  explicit TableWriteCountingEnv(Env* base) : EnvWrapper(base) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    Status s = target()->NewWritableFile(fname, result);
+    if (s.ok() && armed_.load() && fname.size() > 4 &&
+        fname.compare(fname.size() - 4, 4, ".ldb") == 0) {
+      *result = new CountedFile(this, *result);
+      for (int i = 0; i < 500 && max_open_.load() < 2; i++) {
+        SleepForMicroseconds(10000);
+      }
+    }
+    return s;
+  }
+
+  void Arm() { armed_.store(true); }
+  int MaxOpen() const { return max_open_.load(); }
+
+ private:
+  class CountedFile : public WritableFile {
+   public:
+    CountedFile(TableWriteCountingEnv* env, WritableFile* base)
+        : env_(env), base_(base) {
+      const int open = ++env_->open_;
+      int max_open = env_->max_open_.load();
+      while (open > max_open &&
+             !env_->max_open_.compare_exchange_weak(max_open, open)) {
+      }
+    }
+    ~CountedFile() override {
+      delete base_;
+      --env_->open_;
+    }
+
+    Status Append(const Slice& data) override { return base_->Append(data); }
+    Status Close() override { return base_->Close(); }
+    Status Flush() override { return base_->Flush(); }
+    Status Sync() override { return base_->Sync(); }
+
+   private:
+    TableWriteCountingEnv* const env_;
+    WritableFile* const base_;
+  };
+
+  std::atomic<bool> armed_{false};
+  std::atomic<int> open_{0};
+  std::atomic<int> max_open_{0};
+};
+
+}  // namespace
+
+TEST_F(DBTest, DisjointManualCompactionsRunConcurrently) {
+  TableWriteCountingEnv env(env_);
+  options_.env = &env;
+  options_.max_background_compactions = 2;
+  options_.write_buffer_size = 32 << 20;
+  options_.max_file_size = 1 << 20;
+  Reopen();
+
+  // About 4MB of data, compacted into level-1 files of about 1MB each.
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 400; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    Put(key, 100, test::RandomString(&rnd, 10000, &value).ToString());
+  }
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  std::string files;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level1", &files));
+  ASSERT_LE(3, std::stoi(files));
+
+  // The first and the last level-1 file share no input, so both
+  // compactions are started without waiting for the other.
+  env.Arm();
+  auto compact = [this](const std::string& first, const std::string& last) {
+    const Slice begin(first), end(last);
+    dbfull()->TEST_CompactRange(1, &begin, &end);
+  };
+  std::thread low(compact, "key000000", "key000001");
+  std::thread high(compact, "key000398", "key000399");
+  low.join();
+  high.join();
+  ASSERT_EQ(2, env.MaxOpen());
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level2", &files));
+  ASSERT_EQ("2", files);
+
+  delete db_;
+  db_ = nullptr;
+  options_.env = env_;
+}
+
+namespace {
+
+// Counts the files opened for random reads.
+class FileOpenCountingEnv : public EnvWrapper {
+ public:
+  explicit FileOpenCountingEnv(Env* base) : EnvWrapper(base) {}
+
+  Status NewRandomAccessFile(const std::string& fname,
+                             RandomAccessFile** result) override {
+    ++opens_;
+    return target()->NewRandomAccessFile(fname, result);
+  }
+
+  Status NewDirectRandomAccessFile(const std::string& fname,
+                                   RandomAccessFile** result) override {
+    ++direct_opens_;
+    return target()->NewDirectRandomAccessFile(fname, result);
+  }
+
+  int Opens() const { return opens_.load(); }
+  int DirectOpens() const { return direct_opens_.load(); }
+
+ private:
+  std::atomic<int> opens_{0};
+  std::atomic<int> direct_opens_{0};
+};
+
+}  // namespace
+
+TEST_F(DBTest, DirectIOCompactionOpensEachInputOnce) {
+  FileOpenCountingEnv env(env_);
+  options_.env = &env;
+  options_.use_direct_io_for_compaction = true;
+  options_.compaction_readahead_size = 64 << 10;
+  options_.max_subcompactions = 4;
+  options_.write_buffer_size = 32 << 20;
+  Reopen();
+
+  Random rnd(301);
+  std::string value;
+  for (int i = 0; i < 400; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    Put(key, 100, test::RandomString(&rnd, 10000, &value).ToString());
+  }
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  const std::string contents = Contents();
+  std::string files;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &files));
+  ASSERT_EQ("1", files);
+
+  // Every slice of the compaction reads the input through the same handle.
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &files));
+  ASSERT_EQ("0", files);
+  ASSERT_EQ(1, env.DirectOpens());
+  ASSERT_EQ(contents, Contents());
+
+  delete db_;
+  db_ = nullptr;
+  options_.env = env_;
+}
+
+TEST_F(DBTest, ReadaheadScanUsesCachedTable) {
+  FileOpenCountingEnv env(env_);
+  options_.env = &env;
+  Reopen();
+  for (int i = 0; i < 1000; i++) {
+    Put("key" + std::to_string(i), 100, std::string(100, 'a' + i % 26));
+  }
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+
+  ReadOptions options;
+  options.fill_cache = false;
+  auto scan = [this](const ReadOptions& options) {
+    std::string result;
+    Iterator* iter = db_->NewIterator(options);
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      result.append(iter->key().ToString());
+      result.append(iter->value().ToString());
+    }
+    EXPECT_TRUE(iter->status().ok());
+    delete iter;
+    return result;
+  };
+  const std::string expected = scan(options);
+
+  // The scan reads the blocks of the table opened above through a buffer
+  // of its own instead of opening the file again.
+  options.readahead_size = 64 << 10;
+  const int opens = env.Opens();
+  GetPerfContext()->Reset();
+  ASSERT_EQ(expected, scan(options));
+  ASSERT_EQ(opens, env.Opens());
+  ASSERT_LT(0, GetPerfContext()->block_reads);
+
+  delete db_;
+  db_ = nullptr;
+  options_.env = env_;
+}
+
+TEST_F(DBTest, SharedTableCacheKeepsEachDBsTables) {
+  Cache* table_cache = NewLRUCache(6, /*num_shard_bits=*/0);
+  options_.table_cache = table_cache;
+  const std::string other_name = dbname_ + "_other";
+  DestroyDB(other_name, options_);
+  Reopen();
+  // Each flush leaves one more table open in the shared cache.
+  auto flush = [](DB* db, int tables) {
+    for (int t = 0; t < tables; t++) {
+      WriteBatch batch;
+      for (int i = 0; i < 10; i++) {
+        batch.Put("key" + std::to_string(i), 100 + t, 1, 2, "v");
+      }
+      ASSERT_TRUE(db->Write(WriteOptions(), &batch).ok());
+      ASSERT_TRUE(reinterpret_cast<DBImpl*>(db)->TEST_CompactMemTable().ok());
+    }
+  };
+  auto opens = [this]() {
+    GetPerfContext()->Reset();
+    Contents();
+    return GetPerfContext()->table_opens;
+  };
+
+  flush(db_, 3);
+  DB* other;
+  ASSERT_TRUE(DB::Open(options_, other_name, &other).ok());
+  flush(other, 3);
+  ASSERT_EQ(6, table_cache->TotalCharge());
+
+  // Closing one DB takes its tables, and only those, out of the cache.
+  delete other;
+  ASSERT_EQ(3, table_cache->TotalCharge());
+  ASSERT_EQ(0, opens());
+
+  // The warm-up of a DB only fills the room left in the shared cache, so
+  // the other DB keeps all of its tables open.
+  flush(db_, 1);
+  Options options = options_;
+  options.table_warmup_threads = 2;
+  ASSERT_TRUE(DB::Open(options, other_name, &other).ok());
+  reinterpret_cast<DBImpl*>(other)->TEST_WaitForTableWarmup();
+  ASSERT_EQ(0, opens());
+
+  delete other;
+  delete db_;
+  db_ = nullptr;
+  DestroyDB(other_name, options_);
+  options_.table_cache = nullptr;
+  delete table_cache;
+}
+
+TEST_F(DBTest, SubcompactionsMatchSingleThreadedCompaction) {
+  // Compact the same writes with and without subcompactions.
+  struct Result {
+    std::string entries;  // Internal keys and values left after compacting
+    std::string reads;    // Get() of every key at several valid times
+    std::string stats;    // Level 1 size, read and write MB in leveldb.stats
+    int files;
+  };
+  auto run = [this](int max_subcompactions, Result* result) {
+    Options options = options_;
+    options.max_subcompactions = max_subcompactions;
+    options.write_buffer_size = 32 << 20;
+    const std::string name =
+        dbname_ + "_subcompactions" + std::to_string(max_subcompactions);
+    DestroyDB(name, options);
+    DB* db;
+    ASSERT_TRUE(DB::Open(options, name, &db).ok());
+    DBImpl* impl = reinterpret_cast<DBImpl*>(db);
+    impl->SetDBCurrentTime(kNow);
+
+    Random rnd(301);
+    std::string value;
+    for (ValidTime vt : {100, 200}) {
+      WriteBatch batch;
+      for (int i = 0; i < 400; i++) {
+        char key[20];
+        std::snprintf(key, sizeof(key), "key%06d", i);
+        batch.Put(key, vt, 1, 2,
+                  test::RandomString(&rnd, 5000, &value).ToString());
+      }
+      ASSERT_TRUE(db->Write(WriteOptions(), &batch).ok());
+      ASSERT_TRUE(impl->TEST_CompactMemTable().ok());
+    }
+    // Range tombstones across the likely slice edges, and one across all.
+    // Together they hide every version of the keys at the edges.
+    for (int begin : {95, 195, 295}) {
+      char b[20], e[20];
+      std::snprintf(b, sizeof(b), "key%06d", begin);
+      std::snprintf(e, sizeof(e), "key%06d", begin + 10);
+      ASSERT_TRUE(
+          db->DeleteRange(WriteOptions(), b, e, 150, kMaxValidTime).ok());
+    }
+    ASSERT_TRUE(
+        db->DeleteRange(WriteOptions(), "key000050", "key000350", 0, 150)
+            .ok());
+    ASSERT_TRUE(impl->TEST_CompactMemTable().ok());
+    impl->TEST_CompactRange(0, nullptr, nullptr);
+
+    std::string files;
+    ASSERT_TRUE(db->GetProperty("leveldb.num-files-at-level0", &files));
+    ASSERT_EQ("0", files);
+    ASSERT_TRUE(db->GetProperty("leveldb.num-files-at-level1", &files));
+    result->files = std::stoi(files);
+
+    Iterator* iter = impl->TEST_NewInternalIterator();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ParsedInternalKey ikey;
+      ASSERT_TRUE(ParseInternalKey(iter->key(), &ikey));
+      result->entries.append(ikey.DebugString());
+      result->entries.append(std::to_string(Hash(
+          iter->value().data(), iter->value().size(), 0)));
+      result->entries.push_back('\n');
+    }
+    ASSERT_TRUE(iter->status().ok());
+    delete iter;
+
+    for (int i = 0; i < 400; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "key%06d", i);
+      for (ValidTime vt : {ValidTime(120), ValidTime(220), kNow}) {
+        Status s = db->Get(ReadOptions(), key, vt, &value);
+        result->reads.append(s.ok() ? std::to_string(Hash(value.data(),
+                                                          value.size(), 0))
+                                    : s.ToString());
+        result->reads.push_back(' ');
+      }
+    }
+
+    std::string stats;
+    ASSERT_TRUE(db->GetProperty("leveldb.stats", &stats));
+    const size_t line = stats.find("\n  1 ");
+    ASSERT_NE(std::string::npos, line);
+    int level, level_files;
+    double size, seconds, read, written;
+    ASSERT_EQ(6, std::sscanf(stats.c_str() + line, "%d %d %lf %lf %lf %lf",
+                             &level, &level_files, &size, &seconds, &read,
+                             &written));
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "%.0f %.0f %.0f", size, read, written);
+    result->stats = buf;
+    delete db;
+    DestroyDB(name, options);
+  };
+
+  Result single, split;
+  run(1, &single);
+  run(4, &split);
+  ASSERT_EQ(1, single.files);
+  ASSERT_LT(1, split.files);  // One output file at least per slice
+  ASSERT_EQ(single.entries, split.entries);
+  ASSERT_EQ(single.reads, split.reads);
+  ASSERT_NE(std::string::npos, single.reads.find("NotFound"));
+  // The read and written bytes of every slice are counted.
+  ASSERT_EQ(single.stats, split.stats);
+  ASSERT_NE("0 0 0", single.stats);
+}
+
+TEST_F(DBTest, TableWarmupOpensNewestTables) {
+  // Five tables whose valid-time ranges end 1000 apart.
+  Reopen();
+  for (int t = 0; t < 5; t++) {
+    dbfull()->SetDBCurrentTime(kNow + 1000 * t);
+    for (int i = 0; i < 10; i++) {
+      Put("key" + std::to_string(i), 100 + t, "v" + std::to_string(t));
+    }
+    ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  }
+  const std::string contents = Contents();
+  auto opens = [this]() {
+    GetPerfContext()->Reset();
+    Contents();
+    return GetPerfContext()->table_opens;
+  };
+
+  // Without the warm-up the first scan opens every table.
+  Reopen();
+  const uint64_t tables = opens();
+  ASSERT_LE(5, tables);
+
+  // With it the scan finds all of them open.
+  options_.table_warmup_threads = 2;
+  Reopen();
+  dbfull()->TEST_WaitForTableWarmup();
+  ASSERT_EQ(0, opens());
+  ASSERT_EQ(contents, Contents());
+
+  // A window keeps the warm-up to the tables ending within it of the
+  // newest one.
+  options_.table_warmup_time_window = 1500;
+  Reopen();
+  dbfull()->TEST_WaitForTableWarmup();
+  const uint64_t window_opens = opens();
+  ASSERT_LT(0, window_opens);
+  ASSERT_GT(tables, window_opens);
+}
+
+TEST_F(DBTest, DeleteRangeHidesMemTableVersions) {
+  Reopen();
+  Put("car1", 100, "car1@100");
+  Put("car1", 200, "car1@200");
+  Put("car2", 200, "car2@200");
+  Put("car3", 200, "car3@200");
+  ASSERT_EQ("car1@200", Get("car1", 200));
+
+  // The newest version of car1 and car2 is erased; car1 falls back to its
+  // older version.
+  DeleteRange("car1", "car3", 150, 250);
+  ASSERT_EQ("car1@100", Get("car1", 200));
+  ASSERT_EQ("NOT_FOUND", Get("car2", 200));
+  ASSERT_EQ("car3@200", Get("car3", 200));
+  ASSERT_EQ("car1=car1@100\ncar3=car3@200\n", Contents());
+
+  // Later writes are not hidden.
+  Put("car2", 220, "car2@220");
+  ASSERT_EQ("car2@220", Get("car2", 220));
+  ASSERT_EQ("car1=car1@100\ncar2=car2@220\ncar3=car3@200\n", Contents());
+}
+
+TEST_F(DBTest, SnapshotsSeeStateBeforeDeleteRange) {
+  Reopen();
+  Put("car1", 100, "car1@100");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  DeleteRange("car", "cas", 0, kMaxValidTime);
+  ASSERT_EQ("", Contents());
+  ASSERT_EQ("car1=car1@100\n", Contents(snapshot));
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, DeleteRangeHidesTableVersions) {
+  Reopen();
+  Put("car1", 100, "car1@100");
+  Put("car1", 200, "car1@200");
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+
+  // Hides the flushed car1@200 and its copy carried into the memtable.
+  DeleteRange("car1", "car2", 150, kMaxValidTime);
+  ASSERT_EQ("car1@100", Get("car1", kNow - 1));
+  ASSERT_EQ("car1=car1@100\n", Contents());
+
+  // The tombstone is flushed with the memtable.
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  ASSERT_EQ("car1@100", Get("car1", kNow - 1));
+  ASSERT_EQ("car1=car1@100\n", Contents());
+
+  Reopen();
+  ASSERT_EQ("car1=car1@100\n", Contents());
+}
+
+TEST_F(DBTest, ParallelProbesSkipDeletedVersions) {
+  options_.max_parallel_l0_probes = 4;
+  Reopen();
+  Put("car1", 100, "car1@100");
+  Put("car1", 200, "car1@200");
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  Put("car2", 200, "car2@200");
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+
+  // Every version of car1 but the oldest is hidden: the copies carried
+  // into the memtable and the newer table, and car1@200 in the table that
+  // also holds car1@100.  The tables of later memtables start at kNow, so
+  // only reads at kNow probe more than one of them.
+  DeleteRange("car1", "car2", 150, kMaxValidTime);
+  ASSERT_EQ("car1@100", Get("car1", kNow));
+  ASSERT_EQ("car2@200", Get("car2", kNow));
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  ASSERT_EQ("car1@100", Get("car1", kNow));
+  ASSERT_EQ("car2@200", Get("car2", kNow));
+
+  DeleteRange("car1", "car3", 0, kMaxValidTime);
+  ASSERT_EQ("NOT_FOUND", Get("car1", kNow));
+  ASSERT_EQ("NOT_FOUND", Get("car2", kNow));
+}
+
+TEST_F(DBTest, CompactionDropsDeletedVersions) {
+  Reopen();
+  Put("car1", 100, "car1@100");
+  Put("car1", 200, "car1@200");
+  Put("car2", 200, "car2@200");
+  DeleteRange("car1", "car3", 150, kMaxValidTime);
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  ASSERT_TRUE(IsStored("car1@200"));
+  ASSERT_TRUE(IsStored("car2@200"));
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_FALSE(IsStored("car1@200"));
+  ASSERT_FALSE(IsStored("car2@200"));
+  ASSERT_EQ("car1=car1@100\n", Contents());
+}
+
+TEST_F(DBTest, CompactionKeepsDeletedVersionsOfSnapshots) {
+  Reopen();
+  Put("car1", 100, "car1@100");
+  Put("car1", 200, "car1@200");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  DeleteRange("car1", "car2", 150, kMaxValidTime);
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_TRUE(IsStored("car1@200"));
+  ASSERT_EQ("car1=car1@200\n", Contents(snapshot));
+  ASSERT_EQ("car1=car1@100\n", Contents());
+
+  // Once the snapshot is gone the tombstone is applied and dropped.
+  db_->ReleaseSnapshot(snapshot);
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_FALSE(IsStored("car1@200"));
+  ASSERT_EQ("car1=car1@100\n", Contents());
+}
+
+TEST_F(DBTest, DeleteRegionHidesLocatedVersions) {
+  Reopen();
+  PutAt("car1", 100, 10, 10, "car1@100");
+  PutAt("car1", 200, 10, 10, "car1@200");
+  PutAt("car2", 200, 50, 10, "car2@200");
+  PutAt("car3", 200, spatial::kOmitCoordinate, spatial::kOmitCoordinate,
+        "car3@200");
+  const Snapshot* snapshot = db_->GetSnapshot();
+
+  // Only the versions located in the region and valid in the interval are
+  // erased.
+  DeleteRegion(0, 0, 20, 20, 150, kMaxValidTime);
+  ASSERT_EQ("car1@100", Get("car1", 200));
+  ASSERT_EQ("car2@200", Get("car2", 200));
+  ASSERT_EQ("car3@200", Get("car3", 200));
+  ASSERT_EQ("car1=car1@100\ncar2=car2@200\ncar3=car3@200\n", Contents());
+  ASSERT_EQ("car1=car1@200\ncar2=car2@200\ncar3=car3@200\n", Contents(snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  // Later writes are not hidden.
+  PutAt("car1", 220, 10, 10, "car1@220");
+  ASSERT_EQ("car1@220", Get("car1", 220));
+
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  Reopen();
+  ASSERT_EQ("car1=car1@220\ncar2=car2@200\ncar3=car3@200\n", Contents());
+}
+
+TEST_F(DBTest, CompactionDropsFilesCoveredByDeleteRegion) {
+  Reopen();
+  PutAt("car1", 100, 0, 0, "car1@100");
+  PutAt("car2", 100, 1, 1, "car2@100");
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  std::vector<std::string> covered;
+  std::vector<std::string> children;
+  ASSERT_TRUE(env_->GetChildren(dbname_, &children).ok());
+  for (const std::string& child : children) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(child, &number, &type) && type == kTableFile) {
+      covered.push_back(dbname_ + "/" + child);
+    }
+  }
+  ASSERT_EQ(1, covered.size());
+
+  // The tombstone goes to a table of its own.
+  DeleteRegion(0, 0, 3, 3, 0, kMaxValidTime);
+  ASSERT_TRUE(dbfull()->TEST_CompactMemTable().ok());
+  ASSERT_EQ("", Contents());
+
+  // The covered table is dropped without being read.
+  Reopen();
+  ASSERT_TRUE(env_->RemoveFile(covered[0]).ok());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFiles());
+  ASSERT_EQ("", Contents());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
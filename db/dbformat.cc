@@ -144,8 +144,7 @@ LookupKey::LookupKey(const Slice& user_key, SequenceNumber s, ValidTime vt) {
     dst = new char[needed];
   }
   start_ = dst;
-  // internal key size = usize + 16
-  dst = EncodeVarint32(dst, usize + 8 + 8);
+  dst = EncodeVarint32(dst, usize + kInternalKeyAttributesLen);
   kstart_ = dst;
   std::memcpy(dst, user_key.data(), usize);
   dst += usize;
@@ -153,6 +152,12 @@ LookupKey::LookupKey(const Slice& user_key, SequenceNumber s, ValidTime vt) {
   dst += 8;
   vtstart_ = dst;
   EncodeFixed64(dst, vt);
+  dst += 8;
+  // The coordinates do not take part in ordering; they only pad the key out
+  // to the internal key layout.
+  EncodeFixed64(dst, 0);
+  dst += 8;
+  EncodeFixed64(dst, 0);
   end_ = dst + 8;
 }
 
@@ -163,6 +163,25 @@ TEST(FormatTest, InternalKeyShortSeparator) {
 //  ASSERT_EQ("(bad)", invalid_key.DebugString());
 //}
 
+TEST(FormatTest, LookupKey) {
+  LookupKey lkey("hello", 77, 1234);
+  ParsedInternalKey decoded;
+  ASSERT_TRUE(ParseInternalKey(lkey.internal_key(), &decoded));
+  ASSERT_EQ("hello", decoded.user_key.ToString());
+  ASSERT_EQ(77, decoded.sequence);
+  ASSERT_EQ(kValueTypeForSeek, decoded.type);
+  ASSERT_EQ(1234, decoded.time);
+  ASSERT_EQ("hello", lkey.user_key().ToString());
+  ASSERT_EQ(1234, lkey.valid_time());
+
+  // The memtable key is the internal key with a length prefix.
+  Slice memkey = lkey.memtable_key();
+  Slice internal_key;
+  ASSERT_TRUE(GetLengthPrefixedSlice(&memkey, &internal_key));
+  ASSERT_TRUE(memkey.empty());
+  ASSERT_EQ(lkey.internal_key().ToString(), internal_key.ToString());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
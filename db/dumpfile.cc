@@ -89,6 +89,37 @@ class WriteBatchItemPrinter : public WriteBatch::Handler {
     r += "'\n";
     dst_->Append(r);
   }
+  void DeleteRange(const Slice& begin, const Slice& end, ValidTime vt_begin,
+                   ValidTime vt_end) override {
+    std::string r = "  del-range ['";
+    AppendEscapedStringTo(&r, begin);
+    r += "', '";
+    AppendEscapedStringTo(&r, end);
+    r += "') valid time [";
+    AppendNumberTo(&r, vt_begin);
+    r += ", ";
+    AppendNumberTo(&r, vt_end);
+    r += ")\n";
+    dst_->Append(r);
+  }
+  void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                    spatial::Linear x_max, spatial::Linear y_max,
+                    ValidTime vt_begin, ValidTime vt_end) override {
+    std::string r = "  del-region [";
+    AppendNumberTo(&r, x_min);
+    r += ", ";
+    AppendNumberTo(&r, x_max);
+    r += "] x [";
+    AppendNumberTo(&r, y_min);
+    r += ", ";
+    AppendNumberTo(&r, y_max);
+    r += "] valid time [";
+    AppendNumberTo(&r, vt_begin);
+    r += ", ";
+    AppendNumberTo(&r, vt_end);
+    r += ")\n";
+    dst_->Append(r);
+  }
 
   WritableFile* dst_;
 };
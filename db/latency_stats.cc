@@ -0,0 +1,71 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/latency_stats.h"
+
+#include <atomic>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+const char* const kTypeNames[LatencyStats::kNumTypes] = {
+    "get",   "get-spatial",     "write", "wal-sync",
+    "memtable-insert", "memtable-switch", "flush", "compaction"};
+
+// Shard used by the calling thread; threads are spread round-robin.
+int ThreadShard(int num_shards) {
+  static std::atomic<unsigned> next_shard{0};
+  thread_local const unsigned shard =
+      next_shard.fetch_add(1, std::memory_order_relaxed);
+  return static_cast<int>(shard % num_shards);
+}
+
+}  // namespace
+
+LatencyStats::LatencyStats() {
+  for (Shard& shard : shards_) {
+    MutexLock l(&shard.mu);
+    for (Histogram& histogram : shard.histograms) {
+      histogram.Clear();
+    }
+  }
+}
+
+void LatencyStats::Record(Type type, uint64_t micros) {
+  Shard& shard = shards_[ThreadShard(kNumShards)];
+  MutexLock l(&shard.mu);
+  shard.histograms[type].Add(static_cast<double>(micros));
+}
+
+void LatencyStats::AppendTo(std::string* out, bool reset) {
+  Histogram merged[kNumTypes];
+  for (Histogram& histogram : merged) {
+    histogram.Clear();
+  }
+  for (Shard& shard : shards_) {
+    MutexLock l(&shard.mu);
+    for (int type = 0; type < kNumTypes; type++) {
+      merged[type].Merge(shard.histograms[type]);
+      if (reset) {
+        shard.histograms[type].Clear();
+      }
+    }
+  }
+
+  for (int type = 0; type < kNumTypes; type++) {
+    if (merged[type].Count() == 0) {
+      continue;
+    }
+    out->append("Microseconds per ");
+    out->append(kTypeNames[type]);
+    out->append(":\n");
+    out->append(merged[type].ToString());
+    out->append("\n");
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,79 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_LATENCY_STATS_H_
+#define STORAGE_LEVELDB_DB_LATENCY_STATS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/histogram.h"
+
+namespace leveldb {
+
+// Latency histograms (in microseconds) for the DB's hot paths.
+//
+// Recording is cheap enough to stay on: each thread records into one of
+// several independently locked shards, so concurrent threads rarely
+// contend.  Reading merges the shards.
+class LatencyStats {
+ public:
+  enum Type {
+    kGet,
+    kGetS,
+    kWrite,
+    kWalSync,
+    kMemTableInsert,
+    kMemTableSwitch,  // Including the DvD copy into the new memtable
+    kFlush,
+    kCompaction,
+    kNumTypes
+  };
+
+  LatencyStats();
+
+  LatencyStats(const LatencyStats&) = delete;
+  LatencyStats& operator=(const LatencyStats&) = delete;
+
+  void Record(Type type, uint64_t micros);
+
+  // Append a description of every non-empty histogram to *out.  If
+  // "reset" is true, clear the histograms in the same pass.
+  void AppendTo(std::string* out, bool reset);
+
+ private:
+  enum { kNumShards = 16 };
+
+  struct Shard {
+    port::Mutex mu;
+    Histogram histograms[kNumTypes] GUARDED_BY(mu);
+  };
+
+  Shard shards_[kNumShards];
+};
+
+// Records the lifetime of the object in a LatencyStats histogram.
+class LatencyTimer {
+ public:
+  LatencyTimer(Env* env, LatencyStats* stats, LatencyStats::Type type)
+      : env_(env), stats_(stats), type_(type), start_(env->NowMicros()) {}
+
+  LatencyTimer(const LatencyTimer&) = delete;
+  LatencyTimer& operator=(const LatencyTimer&) = delete;
+
+  ~LatencyTimer() { stats_->Record(type_, env_->NowMicros() - start_); }
+
+ private:
+  Env* const env_;
+  LatencyStats* const stats_;
+  const LatencyStats::Type type_;
+  const uint64_t start_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_LATENCY_STATS_H_
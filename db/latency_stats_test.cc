@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/latency_stats.h"
+
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+TEST(LatencyStatsTest, EmptyByDefault) {
+  LatencyStats stats;
+  std::string out;
+  stats.AppendTo(&out, /*reset=*/false);
+  ASSERT_TRUE(out.empty());
+}
+
+TEST(LatencyStatsTest, MergesThreadsAndResets) {
+  LatencyStats stats;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&stats]() {
+      for (int i = 0; i < 100; i++) {
+        stats.Record(LatencyStats::kGet, i);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  stats.Record(LatencyStats::kMemTableSwitch, 5000);
+
+  std::string out;
+  stats.AppendTo(&out, /*reset=*/true);
+  ASSERT_NE(std::string::npos, out.find("Microseconds per get:\nCount: 400 "));
+  ASSERT_NE(std::string::npos,
+            out.find("Microseconds per memtable-switch:\nCount: 1 "));
+  ASSERT_EQ(std::string::npos, out.find("flush"));
+
+  out.clear();
+  stats.AppendTo(&out, /*reset=*/false);
+  ASSERT_TRUE(out.empty());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -9,6 +9,7 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,17 +20,26 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return {p, len};
 }
 
+// Heap bytes of a std::map node besides its value: the color and the parent
+// and child links.
+static const size_t kMapNodeOverhead = 4 * sizeof(void*);
+
 MemTable::MemTable(const InternalKeyComparator& comparator, ValidTime vt,
-                   spatial::Order n)
+                   const ArenaOptions& arena_options, spatial::Order n)
     : comparator_(comparator),
       refs_(0),
+      arena_(arena_options),
       table_(comparator_, &arena_),
+      range_tombstones_(comparator.user_comparator()),
       hilbert_(n),
       start_valid_time_(vt) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
-size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
+size_t MemTable::ApproximateMemoryUsage() {
+  return arena_.MemoryUsage() +
+         spatial_index_bytes_.load(std::memory_order_relaxed);
+}
 
 int MemTable::KeyComparator::operator()(const char* aptr,
                                         const char* bptr) const {
@@ -153,35 +163,100 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
 
   // Insert the data entry and return the address
   auto loc = reinterpret_cast<uint64_t>(table_.Insert(buf));
-  char* encoded_loc = new char[8];
+  char* encoded_loc = arena_.AllocateAligned(8);
   EncodeFixed64(encoded_loc, loc);
 
   spatial::Linear t;
   hilbert_.MapInverse(x, y, &t);
-  char* spatial_key = new char[8];
-  EncodeFixed64(spatial_key, (0x1cull << 56) | t);  // default key length is 28
+  char lookup_key[8];
+  EncodeFixed64(lookup_key, (0x1cull << 56) | t);  // default key length is 28
 
-  if (spatial_table_.count(spatial_key)) {
+  size_t index_bytes;
+  auto bucket = spatial_table_.find(lookup_key);
+  if (bucket != spatial_table_.end()) {
     // Key exists
-    spatial_table_[spatial_key].emplace_back(encoded_loc);
+    const size_t old_capacity = bucket->second.capacity();
+    bucket->second.emplace_back(encoded_loc);
+    index_bytes = (bucket->second.capacity() - old_capacity) * sizeof(char*);
   } else {
-    spatial_table_.emplace(spatial_key, IndexPointerBucket{encoded_loc});
+    // Index keys live in the arena next to the entries they point to.
+    char* spatial_key = arena_.AllocateAligned(8);
+    std::memcpy(spatial_key, lookup_key, 8);
+    bucket = spatial_table_
+                 .emplace(spatial_key, IndexPointerBucket{encoded_loc})
+                 .first;
+    index_bytes = kMapNodeOverhead + sizeof(SpatialTable::value_type) +
+                  bucket->second.capacity() * sizeof(char*);
   }
+  spatial_index_bytes_.fetch_add(index_bytes, std::memory_order_relaxed);
   //  char* spatial_buf = arena_.Allocate(16);
   //  EncodeFixed64(spatial_buf, t);
   //  EncodeFixed64(spatial_buf + 8, loc);
   //  spatial_table_.Insert(spatial_buf);
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+void MemTable::AddRangeTombstone(SequenceNumber seq, const Slice& begin,
+                                 const Slice& end, ValidTime vt_begin,
+                                 ValidTime vt_end) {
+  MutexLock l(&range_tombstones_mu_);
+  range_tombstones_.Add(RangeTombstone{begin.ToString(), end.ToString(),
+                                       vt_begin, vt_end, seq});
+  spatial_index_bytes_.fetch_add(
+      sizeof(RangeTombstone) + begin.size() + end.size(),
+      std::memory_order_relaxed);
+  has_range_tombstones_.store(true, std::memory_order_release);
+}
+
+void MemTable::AddRegionTombstone(SequenceNumber seq,
+                                  const RegionTombstone& t) {
+  MutexLock l(&range_tombstones_mu_);
+  RegionTombstone region = t;
+  region.sequence = seq;
+  range_tombstones_.Add(region);
+  spatial_index_bytes_.fetch_add(sizeof(RegionTombstone),
+                                 std::memory_order_relaxed);
+  has_range_tombstones_.store(true, std::memory_order_release);
+}
+
+bool MemTable::RangeDeleted(const ParsedInternalKey& ikey,
+                            SequenceNumber snapshot) const {
+  if (!HasRangeTombstones()) {
+    return false;
+  }
+  MutexLock l(&range_tombstones_mu_);
+  return range_tombstones_.Covers(ikey, snapshot);
+}
+
+void MemTable::GetRangeTombstones(RangeTombstoneList* list) const {
+  MutexLock l(&range_tombstones_mu_);
+  list->Append(range_tombstones_);
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   const RangeTombstoneView* range_dels,
+                   SequenceNumber* sequence) {
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
+  if (range_dels != nullptr && !range_dels->empty()) {
+    // Skip the versions of the key hidden by a range tombstone.
+    ParsedInternalKey ikey;
+    while (iter.Valid() &&
+           ParseInternalKey(GetLengthPrefixedSlice(iter.key()), &ikey) &&
+           comparator_.comparator.user_comparator()->Compare(
+               ikey.user_key, key.user_key()) == 0 &&
+           range_dels->Covers(ikey)) {
+      iter.Next();
+    }
+  }
   if (iter.Valid()) {
     // entry format is:
     //    klength  varint32
-    //    userkey  char[klength]
+    //    userkey  char[klength - 32]
     //    tag      uint64
+    //    vt       uint64
+    //    x        uint64
+    //    y        uint64
     //    vlength  varint32
     //    value    char[vlength]
     // Check that it belongs to same user key.  We do not check the
@@ -191,9 +266,14 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
+            Slice(key_ptr, key_length - kInternalKeyAttributesLen),
+            key.user_key()) == 0) {
       // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+      const uint64_t tag =
+          DecodeFixed64(key_ptr + key_length - kInternalKeyAttributesLen);
+      if (sequence != nullptr) {
+        *sequence = tag >> 8;
+      }
       switch (static_cast<ValueType>(tag & 0xff)) {
         case kTypeValue: {
           Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
@@ -203,6 +283,9 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
         case kTypeDeletion:
           *s = Status::NotFound(Slice());
           return true;
+        case kTypeRangeDeletion:
+        case kTypeRegionDeletion:
+          break;  // Never in an internal key
       }
     }
   }
@@ -219,7 +302,7 @@ bool MemTable::Get(const LookupKey& key, spatial::Linear x, spatial::Linear y,
   Slice memkey = key.memtable_key();
   // Build spatial index target
   spatial::Linear i;
-  char* spatial_idx = new char[8];
+  char spatial_idx[8];
   hilbert_.MapInverse(x, y, &i);
   EncodeFixed64(spatial_idx, (((uint64_t)(min_level * 2)) << 56) | i);
   // Search spatial index
@@ -253,6 +336,9 @@ bool MemTable::Get(const LookupKey& key, spatial::Linear x, spatial::Linear y,
             case kTypeDeletion:
               *s = Status::NotFound(Slice());
               return true;
+            case kTypeRangeDeletion:
+            case kTypeRegionDeletion:
+              break;  // Never in an internal key
           }
           // TODO: this is incorrect.
         }
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <cmath>
 #include <map>
 #include <string>
@@ -12,9 +13,12 @@
 #include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
 #include "leveldb/format.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "spatial/curve.h"
 #include "spatial/format.h"
 #include "util/arena.h"
@@ -28,7 +32,9 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
+  // "arena_options" says where the memory of the entries comes from.
   explicit MemTable(const InternalKeyComparator& comparator, ValidTime vt,
+                    const ArenaOptions& arena_options = ArenaOptions(),
                     spatial::Order n = 28);
 
   MemTable(const MemTable&) = delete;
@@ -47,7 +53,8 @@ class MemTable {
   }
 
   // Returns an estimate of the number of bytes of data in use by this
-  // data structure. It is safe to call when MemTable is being modified.
+  // data structure, including the spatial index. It is safe to call when
+  // MemTable is being modified.
   size_t ApproximateMemoryUsage();
 
   // Return an iterator that yields the contents of the memtable.
@@ -66,11 +73,38 @@ class MemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key, ValidTime vt,
            spatial::Linear x, spatial::Linear y, const Slice& value);
 
+  // Add a range tombstone (see db/range_tombstone.h) with sequence number
+  // "seq".  Safe to call while the memtable is being read or written.
+  void AddRangeTombstone(SequenceNumber seq, const Slice& begin,
+                         const Slice& end, ValidTime vt_begin,
+                         ValidTime vt_end);
+
+  // Add a region tombstone with sequence number "seq", likewise.
+  void AddRegionTombstone(SequenceNumber seq, const RegionTombstone& t);
+
+  // Returns true iff the memtable holds range or region tombstones.
+  bool HasRangeTombstones() const {
+    return has_range_tombstones_.load(std::memory_order_acquire);
+  }
+
+  // Returns true iff a tombstone of this memtable written after "ikey" but
+  // no later than "snapshot" hides the version "ikey".
+  bool RangeDeleted(const ParsedInternalKey& ikey,
+                    SequenceNumber snapshot) const;
+
+  // Append the range tombstones of this memtable to *list.
+  void GetRangeTombstones(RangeTombstoneList* list) const;
+
   // If memtable contains a value for key, store it in *value and return true.
   // If memtable contains a deletion for key, store a NotFound() error
   // in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // Versions hidden by a tombstone of "range_dels" (if non-null) are
+  // skipped.  If "sequence" is non-null, the sequence number of the value
+  // or deletion found is stored in *sequence.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           const RangeTombstoneView* range_dels = nullptr,
+           SequenceNumber* sequence = nullptr);
   bool Get(const LookupKey& key, spatial::Linear x, spatial::Linear y,
            std::string* value, spatial::Linear* res_x, spatial::Linear* res_y,
            Status* s, int min_level = 4);
@@ -110,6 +144,14 @@ class MemTable {
   Arena arena_;
   Table table_;
   SpatialTable spatial_table_;
+  // Approximate heap bytes held by spatial_table_'s nodes and buckets, and
+  // by range_tombstones_.
+  std::atomic<size_t> spatial_index_bytes_{0};
+
+  mutable port::Mutex range_tombstones_mu_;
+  RangeTombstoneList range_tombstones_ GUARDED_BY(range_tombstones_mu_);
+  std::atomic<bool> has_range_tombstones_{false};
+
   spatial::Hilbert hilbert_;  // default n = 28
 
   ValidTime start_valid_time_;
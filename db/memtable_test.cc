@@ -3,6 +3,9 @@
 //
 
 #include "db/memtable.h"
+
+#include <cstdio>
+#include <cstring>
 #include "db/dbformat.h"
 #include "spatial/format.h"
 
@@ -34,6 +37,51 @@ InternalKeyComparator cmp(BytewiseComparator());
 //  mem->Unref();
 //}
 
+TEST(MemTableTest, GetWithLookupKey) {
+  MemTable* mem = new MemTable(cmp, 0);
+  mem->Ref();
+  mem->Add(1, kTypeValue, Slice("k1"), 100, 8, 12, Slice("v1"));
+  mem->Add(2, kTypeValue, Slice("k1"), 200, 8, 12, Slice("v2"));
+  mem->Add(3, kTypeDeletion, Slice("k2"), 300, 4, 9, Slice());
+
+  std::string value;
+  Status s;
+  ASSERT_TRUE(mem->Get(LookupKey("k1", 2, 200), &value, &s));
+  ASSERT_EQ("v2", value);
+  // An older snapshot sees the older version.
+  ASSERT_TRUE(mem->Get(LookupKey("k1", 1, 100), &value, &s));
+  ASSERT_EQ("v1", value);
+  ASSERT_TRUE(mem->Get(LookupKey("k2", 3, 300), &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+  // Keys written after the snapshot, and absent keys, are not found.
+  s = Status::OK();
+  ASSERT_FALSE(mem->Get(LookupKey("k2", 2, 300), &value, &s));
+  ASSERT_FALSE(mem->Get(LookupKey("k0", 3, 100), &value, &s));
+  ASSERT_FALSE(mem->Get(LookupKey("k3", 3, 100), &value, &s));
+  ASSERT_TRUE(s.ok());
+  mem->Unref();
+}
+
+TEST(MemTableTest, SpatialIndexIsAccounted) {
+  MemTable* mem = new MemTable(cmp, 0);
+  mem->Ref();
+  const size_t empty_usage = mem->ApproximateMemoryUsage();
+  const int kEntries = 10000;
+  size_t entry_bytes = 0;
+  for (int i = 0; i < kEntries; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "key%06d", i);
+    mem->Add(i + 1, kTypeValue, Slice(key), i, i * 7919, i * 104729,
+             Slice("value"));
+    // Key, attributes and value of the entry, plus the spatial index key,
+    // the entry pointer and the index bucket holding it.
+    entry_bytes += std::strlen(key) + kInternalKeyAttributesLen + 5 + 8 + 8 +
+                   sizeof(std::vector<char*>);
+  }
+  ASSERT_GE(mem->ApproximateMemoryUsage() - empty_usage, entry_bytes);
+  mem->Unref();
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -0,0 +1,193 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <cassert>
+#include <utility>
+
+#include "db/memtable.h"
+#include "db/version_edit.h"
+#include "spatial/curve.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+const char kRangeTombstonesBlock[] = "spatial.range_tombstones";
+
+namespace {
+
+// Tags of the records of a kRangeTombstonesBlock.
+enum TombstoneKind { kRangeTombstone = 1, kRegionTombstone = 2 };
+
+bool RegionCovers(const RegionTombstone& t, const ParsedInternalKey& ikey) {
+  return ikey.x != spatial::kOmitCoordinate &&
+         ikey.y != spatial::kOmitCoordinate && ikey.x >= t.x_min &&
+         ikey.x <= t.x_max && ikey.y >= t.y_min && ikey.y <= t.y_max;
+}
+
+}  // namespace
+
+void RangeTombstoneList::Append(const RangeTombstoneList& other) {
+  tombstones_.insert(tombstones_.end(), other.tombstones_.begin(),
+                     other.tombstones_.end());
+  regions_.insert(regions_.end(), other.regions_.begin(),
+                  other.regions_.end());
+}
+
+bool RangeTombstoneList::Covers(const ParsedInternalKey& ikey,
+                                SequenceNumber snapshot) const {
+  for (const RangeTombstone& t : tombstones_) {
+    if (t.sequence > ikey.sequence && t.sequence <= snapshot &&
+        ikey.time >= t.vt_begin && ikey.time < t.vt_end &&
+        user_comparator_->Compare(ikey.user_key, t.begin) >= 0 &&
+        user_comparator_->Compare(ikey.user_key, t.end) < 0) {
+      return true;
+    }
+  }
+  for (const RegionTombstone& t : regions_) {
+    if (t.sequence > ikey.sequence && t.sequence <= snapshot &&
+        ikey.time >= t.vt_begin && ikey.time < t.vt_end &&
+        RegionCovers(t, ikey)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RangeTombstoneList::CoversFile(const FileMetaData& f,
+                                    SequenceNumber snapshot) const {
+  if (!f.has_entry_stats || !f.all_located_values || !f.HasHilbertExtent()) {
+    return false;
+  }
+  static const spatial::Hilbert hilbert(spatial::kKeyOrder);
+  for (const RegionTombstone& t : regions_) {
+    if (t.sequence > f.largest_sequence && t.sequence <= snapshot &&
+        f.min_valid_time >= t.vt_begin && f.max_valid_time < t.vt_end &&
+        hilbert.RangeWithin(f.hilbert_min, f.hilbert_max, t.x_min, t.y_min,
+                            t.x_max, t.y_max)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RangeTombstoneList::Overlaps(const Slice& begin, const Slice& end) const {
+  for (const RangeTombstone& t : tombstones_) {
+    if (user_comparator_->Compare(end, t.begin) >= 0 &&
+        user_comparator_->Compare(begin, t.end) < 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RangeTombstoneList::GetKeyRange(std::string* begin,
+                                     std::string* end) const {
+  assert(!empty());
+  if (tombstones_.empty()) {
+    begin->clear();
+    end->clear();
+    return;
+  }
+  *begin = tombstones_[0].begin;
+  *end = tombstones_[0].end;
+  for (const RangeTombstone& t : tombstones_) {
+    if (user_comparator_->Compare(t.begin, *begin) < 0) *begin = t.begin;
+    if (user_comparator_->Compare(t.end, *end) > 0) *end = t.end;
+  }
+}
+
+// kRangeTombstonesBlock contents:
+//    tombstone*
+// tombstone :=
+//    kRangeTombstone: varint32
+//    begin: varstring
+//    end: varstring
+//    vt_begin: varint64
+//    vt_end: varint64
+//    sequence: varint64
+//  | kRegionTombstone: varint32
+//    x_min, y_min, x_max, y_max: varint64
+//    vt_begin: varint64
+//    vt_end: varint64
+//    sequence: varint64
+void RangeTombstoneList::EncodeTo(std::string* dst) const {
+  for (const RangeTombstone& t : tombstones_) {
+    PutVarint32(dst, kRangeTombstone);
+    PutLengthPrefixedSlice(dst, t.begin);
+    PutLengthPrefixedSlice(dst, t.end);
+    PutVarint64(dst, t.vt_begin);
+    PutVarint64(dst, t.vt_end);
+    PutVarint64(dst, t.sequence);
+  }
+  for (const RegionTombstone& t : regions_) {
+    PutVarint32(dst, kRegionTombstone);
+    PutVarint64(dst, t.x_min);
+    PutVarint64(dst, t.y_min);
+    PutVarint64(dst, t.x_max);
+    PutVarint64(dst, t.y_max);
+    PutVarint64(dst, t.vt_begin);
+    PutVarint64(dst, t.vt_end);
+    PutVarint64(dst, t.sequence);
+  }
+}
+
+Status RangeTombstoneList::DecodeFrom(Slice input) {
+  uint32_t kind;
+  while (GetVarint32(&input, &kind)) {
+    switch (kind) {
+      case kRangeTombstone: {
+        Slice begin, end;
+        RangeTombstone t;
+        if (!GetLengthPrefixedSlice(&input, &begin) ||
+            !GetLengthPrefixedSlice(&input, &end) ||
+            !GetVarint64(&input, &t.vt_begin) ||
+            !GetVarint64(&input, &t.vt_end) ||
+            !GetVarint64(&input, &t.sequence)) {
+          return Status::Corruption("bad range tombstone block");
+        }
+        t.begin = begin.ToString();
+        t.end = end.ToString();
+        tombstones_.push_back(std::move(t));
+        break;
+      }
+      case kRegionTombstone: {
+        RegionTombstone t;
+        if (!GetVarint64(&input, &t.x_min) || !GetVarint64(&input, &t.y_min) ||
+            !GetVarint64(&input, &t.x_max) || !GetVarint64(&input, &t.y_max) ||
+            !GetVarint64(&input, &t.vt_begin) ||
+            !GetVarint64(&input, &t.vt_end) ||
+            !GetVarint64(&input, &t.sequence)) {
+          return Status::Corruption("bad region tombstone");
+        }
+        regions_.push_back(t);
+        break;
+      }
+      default:
+        return Status::Corruption("unknown range tombstone kind");
+    }
+  }
+  if (!input.empty()) {
+    return Status::Corruption("bad range tombstone block");
+  }
+  return Status::OK();
+}
+
+bool RangeTombstoneView::empty() const {
+  return (mem == nullptr || !mem->HasRangeTombstones()) &&
+         (imm == nullptr || !imm->HasRangeTombstones()) &&
+         (files == nullptr || files->empty());
+}
+
+bool RangeTombstoneView::Covers(const ParsedInternalKey& ikey) const {
+  if (ikey.type != kTypeValue) {
+    return false;
+  }
+  return (mem != nullptr && mem->RangeDeleted(ikey, snapshot)) ||
+         (imm != nullptr && imm->RangeDeleted(ikey, snapshot)) ||
+         (files != nullptr && files->Covers(ikey, snapshot));
+}
+
+}  // namespace leveldb
@@ -0,0 +1,131 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by DB::DeleteRange(), hides the versions of
+// the user keys in [begin, end) whose valid time lies in [vt_begin, vt_end)
+// and that were written before it, i.e. that have a smaller sequence
+// number.  Hidden versions are skipped by reads as if they had never been
+// written, and dropped by compactions once no snapshot can see them.
+//
+// A region tombstone, written by DB::DeleteRegion(), does the same for the
+// versions of every user key located in the rectangle of grid cells
+// [x_min, x_max] x [y_min, y_max].  Versions without a location are never
+// hidden by it.  A compaction drops a whole input file without reading it
+// once a region tombstone hides every entry the file's statistics allow
+// (see RangeTombstoneList::CoversFile()).
+//
+// Tombstones are kept apart from the entries: in a list next to the skip
+// list of a memtable, and in the kRangeTombstonesBlock meta block of the
+// tables.  A version collects the tombstones of all its files, so a read
+// checks every tombstone of the DB whatever file it finds a version in.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/comparator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "spatial/format.h"
+
+namespace leveldb {
+
+class MemTable;
+struct FileMetaData;
+
+struct RangeTombstone {
+  std::string begin;        // First user key deleted
+  std::string end;          // First user key past the deleted range
+  ValidTime vt_begin;       // Earliest valid time deleted
+  ValidTime vt_end;         // First valid time past the deleted interval
+  SequenceNumber sequence;  // Hides versions with smaller sequence numbers
+};
+
+struct RegionTombstone {
+  // Rectangle of the grid cells deleted, bounds included.
+  spatial::Linear x_min;
+  spatial::Linear y_min;
+  spatial::Linear x_max;
+  spatial::Linear y_max;
+  ValidTime vt_begin;       // Earliest valid time deleted
+  ValidTime vt_end;         // First valid time past the deleted interval
+  SequenceNumber sequence;  // Hides versions with smaller sequence numbers
+};
+
+// Name of the meta block holding the range tombstones of a table.
+extern const char kRangeTombstonesBlock[];
+
+// A set of range tombstones.  Lookups scan the whole set; tombstones are
+// meant for erasing large ranges at once, so there are few of them.
+//
+// Not thread-safe: a list that may change needs external synchronization.
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator)
+      : user_comparator_(user_comparator) {}
+
+  bool empty() const { return tombstones_.empty() && regions_.empty(); }
+  size_t size() const { return tombstones_.size() + regions_.size(); }
+  const std::vector<RangeTombstone>& tombstones() const { return tombstones_; }
+  const std::vector<RegionTombstone>& regions() const { return regions_; }
+
+  void Add(const RangeTombstone& t) { tombstones_.push_back(t); }
+  void Add(const RegionTombstone& t) { regions_.push_back(t); }
+  void Append(const RangeTombstoneList& other);
+
+  // Returns true iff a tombstone written after "ikey" but no later than
+  // "snapshot" hides the version "ikey".
+  bool Covers(const ParsedInternalKey& ikey, SequenceNumber snapshot) const;
+
+  // Returns true iff a region tombstone no later than "snapshot" hides
+  // every entry of the table "f", as far as its Hilbert extent, valid-time
+  // range and largest sequence number tell.  Tables without entry
+  // statistics, or holding deletion markers or entries without a location,
+  // are never covered.
+  bool CoversFile(const FileMetaData& f, SequenceNumber snapshot) const;
+
+  // Returns true iff some range tombstone deletes part of the user key
+  // range [begin, end].
+  bool Overlaps(const Slice& begin, const Slice& end) const;
+
+  // Store in *begin the smallest first key and in *end the largest limit
+  // key of the range tombstones.  Both are empty if there are only region
+  // tombstones, which do not depend on the user key.
+  // REQUIRES: !empty()
+  void GetKeyRange(std::string* begin, std::string* end) const;
+
+  // Contents of the kRangeTombstonesBlock meta block.
+  void EncodeTo(std::string* dst) const;
+  // Appends the tombstones of a kRangeTombstonesBlock meta block.
+  Status DecodeFrom(Slice input);
+
+ private:
+  const Comparator* const user_comparator_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<RegionTombstone> regions_;
+};
+
+// The range tombstones a read at sequence number "snapshot" respects: those
+// of the memtables it reads and of the files of the version it reads.
+// Unused sources are null.  The sources must outlive the view.
+struct RangeTombstoneView {
+  const MemTable* mem = nullptr;
+  const MemTable* imm = nullptr;
+  const RangeTombstoneList* files = nullptr;
+  SequenceNumber snapshot = kMaxSequenceNumber;
+
+  // Returns true iff there is no tombstone to check.
+  bool empty() const;
+
+  // Returns true iff a tombstone hides the version "ikey".  Only versions
+  // holding a value can be hidden; deletion markers are left alone.
+  bool Covers(const ParsedInternalKey& ikey) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
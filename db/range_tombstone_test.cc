@@ -0,0 +1,159 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "db/dbformat.h"
+#include "db/version_edit.h"
+#include "leveldb/comparator.h"
+#include "spatial/curve.h"
+
+namespace leveldb {
+
+// The version of "user_key" valid from "vt", located in cell (x, y).
+static ParsedInternalKey Entry(const char* user_key, ValidTime vt,
+                          SequenceNumber seq, spatial::Linear x = 1,
+                          spatial::Linear y = 2) {
+  return ParsedInternalKey(user_key, seq, kTypeValue, vt, x, y);
+}
+
+TEST(RangeTombstoneListTest, Covers) {
+  RangeTombstoneList list(BytewiseComparator());
+  ASSERT_TRUE(list.empty());
+  list.Add(RangeTombstone{"b", "d", 100, 200, 10});
+
+  ASSERT_TRUE(list.Covers(Entry("b", 100, 9), kMaxSequenceNumber));
+  ASSERT_TRUE(list.Covers(Entry("c", 199, 0), kMaxSequenceNumber));
+  // Key and valid-time ranges are half-open.
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 9), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("d", 150, 9), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("c", 99, 9), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("c", 200, 9), kMaxSequenceNumber));
+  // Only older versions are hidden, and only from later snapshots.
+  ASSERT_FALSE(list.Covers(Entry("c", 150, 10), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("c", 150, 11), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("c", 150, 5), 9));
+  ASSERT_TRUE(list.Covers(Entry("c", 150, 5), 10));
+
+  ASSERT_TRUE(list.Overlaps("a", "b"));
+  ASSERT_TRUE(list.Overlaps("c", "z"));
+  ASSERT_FALSE(list.Overlaps("d", "z"));
+}
+
+TEST(RangeTombstoneListTest, RegionCovers) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add(RegionTombstone{10, 20, 19, 29, 100, 200, 10});
+  ASSERT_FALSE(list.empty());
+  ASSERT_EQ(1, list.size());
+
+  // Any key located in the rectangle, bounds included.
+  ASSERT_TRUE(list.Covers(Entry("a", 150, 9, 10, 20), kMaxSequenceNumber));
+  ASSERT_TRUE(list.Covers(Entry("z", 150, 9, 19, 29), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 9, 9, 25), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 9, 15, 30), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("a", 200, 9, 15, 25), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 10, 15, 25), kMaxSequenceNumber));
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 9, 15, 25), 9));
+  // Versions without a location are never hidden.
+  ASSERT_FALSE(list.Covers(Entry("a", 150, 9, spatial::kOmitCoordinate,
+                                   spatial::kOmitCoordinate),
+                           kMaxSequenceNumber));
+  // Region tombstones span no user key range.
+  ASSERT_FALSE(list.Overlaps("a", "z"));
+  std::string begin, end;
+  list.GetKeyRange(&begin, &end);
+  ASSERT_EQ("", begin);
+  ASSERT_EQ("", end);
+}
+
+TEST(RangeTombstoneListTest, CoversFile) {
+  static const spatial::Hilbert hilbert(spatial::kKeyOrder);
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add(RegionTombstone{0, 0, 7, 7, 100, 200, 10});
+
+  // A table of located values in the cells (0, 0) .. (1, 1).
+  FileMetaData f;
+  spatial::Linear t;
+  for (spatial::Linear x = 0; x < 2; x++) {
+    for (spatial::Linear y = 0; y < 2; y++) {
+      ASSERT_TRUE(hilbert.MapInverse(x, y, &t));
+      f.ExtendHilbert(t);
+      f.AddEntryStats(Entry("k", 100 + x + y, 9, x, y), true);
+    }
+  }
+  ASSERT_TRUE(list.CoversFile(f, kMaxSequenceNumber));
+  ASSERT_FALSE(list.CoversFile(f, 9));
+
+  FileMetaData newer = f;
+  newer.AddEntryStats(Entry("k", 150, 10, 0, 0), true);
+  ASSERT_FALSE(list.CoversFile(newer, kMaxSequenceNumber));
+
+  FileMetaData later = f;
+  later.AddEntryStats(Entry("k", 200, 9, 0, 0), true);
+  ASSERT_FALSE(list.CoversFile(later, kMaxSequenceNumber));
+
+  FileMetaData unlocated = f;
+  unlocated.AddEntryStats(Entry("k", 150, 9, spatial::kOmitCoordinate,
+                                  spatial::kOmitCoordinate),
+                          false);
+  ASSERT_FALSE(list.CoversFile(unlocated, kMaxSequenceNumber));
+
+  FileMetaData outside = f;
+  ASSERT_TRUE(hilbert.MapInverse(8, 0, &t));
+  outside.ExtendHilbert(t);
+  ASSERT_FALSE(list.CoversFile(outside, kMaxSequenceNumber));
+
+  // Tables without statistics are never covered.
+  FileMetaData unknown;
+  unknown.hilbert_min = f.hilbert_min;
+  unknown.hilbert_max = f.hilbert_max;
+  ASSERT_FALSE(list.CoversFile(unknown, kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneListTest, EncodeDecode) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add(RangeTombstone{"car1", "car5", 0, kMaxValidTime, 7});
+  list.Add(RangeTombstone{"a", "b", 12, 34, 1ull << 40});
+  list.Add(RegionTombstone{1, 2, 3, 4, 5, 6, 8});
+  std::string encoded;
+  list.EncodeTo(&encoded);
+
+  RangeTombstoneList decoded(BytewiseComparator());
+  ASSERT_TRUE(decoded.DecodeFrom(encoded).ok());
+  ASSERT_EQ(3, decoded.size());
+  const RangeTombstone& t = decoded.tombstones()[1];
+  ASSERT_EQ("a", t.begin);
+  ASSERT_EQ("b", t.end);
+  ASSERT_EQ(12, t.vt_begin);
+  ASSERT_EQ(34, t.vt_end);
+  ASSERT_EQ(1ull << 40, t.sequence);
+  ASSERT_EQ(1, decoded.regions().size());
+  const RegionTombstone& r = decoded.regions()[0];
+  ASSERT_EQ(1, r.x_min);
+  ASSERT_EQ(2, r.y_min);
+  ASSERT_EQ(3, r.x_max);
+  ASSERT_EQ(4, r.y_max);
+  ASSERT_EQ(5, r.vt_begin);
+  ASSERT_EQ(6, r.vt_end);
+  ASSERT_EQ(8, r.sequence);
+
+  std::string begin, end;
+  decoded.GetKeyRange(&begin, &end);
+  ASSERT_EQ("a", begin);
+  ASSERT_EQ("car5", end);
+
+  RangeTombstoneList truncated(BytewiseComparator());
+  ASSERT_TRUE(truncated.DecodeFrom(Slice(encoded.data(), encoded.size() - 1))
+                  .IsCorruption());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
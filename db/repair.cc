@@ -273,6 +273,7 @@ class Repairer {
         t.meta.smallest.DecodeFrom(key);
       }
       t.meta.largest.DecodeFrom(key);
+      AddEntryToMetaData(key, &t.meta);
       if (parsed.sequence > t.max_sequence) {
         t.max_sequence = parsed.sequence;
       }
@@ -368,8 +369,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.earliest, t.meta.latest,
-                    t.meta.smallest, t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     // std::fprintf(stderr,
@@ -0,0 +1,30 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_SST_FILE_PROPERTIES_H_
+#define STORAGE_LEVELDB_DB_SST_FILE_PROPERTIES_H_
+
+#include <string>
+
+#include "db/version_edit.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+// Name of the meta block in which SstFileWriter records the key range,
+// valid-time range and Hilbert extent of a table, so that
+// DB::IngestExternalFiles() can add the table to a version without reading
+// its entries.
+extern const char kSstFilePropertiesBlock[];
+
+// Append to *dst the key range, valid-time range and Hilbert extent of "f".
+void EncodeSstFileProperties(const FileMetaData& f, std::string* dst);
+
+// Set the fields of *f stored by EncodeSstFileProperties().  Returns false
+// if "input" is malformed.
+bool DecodeSstFileProperties(Slice input, FileMetaData* f);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_SST_FILE_PROPERTIES_H_
@@ -0,0 +1,179 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include <algorithm>
+
+#include "db/builder.h"
+#include "db/dbformat.h"
+#include "db/sst_file_properties.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+const char kSstFilePropertiesBlock[] = "spatial.sst_file_properties";
+
+void EncodeSstFileProperties(const FileMetaData& f, std::string* dst) {
+  PutLengthPrefixedSlice(dst, f.smallest.Encode());
+  PutLengthPrefixedSlice(dst, f.largest.Encode());
+  PutVarint64(dst, f.earliest);
+  PutVarint64(dst, f.latest);
+  PutVarint64(dst, f.hilbert_min);
+  PutVarint64(dst, f.hilbert_max);
+}
+
+bool DecodeSstFileProperties(Slice input, FileMetaData* f) {
+  Slice smallest, largest;
+  return GetLengthPrefixedSlice(&input, &smallest) &&
+         f->smallest.DecodeFrom(smallest) &&
+         GetLengthPrefixedSlice(&input, &largest) &&
+         f->largest.DecodeFrom(largest) && GetVarint64(&input, &f->earliest) &&
+         GetVarint64(&input, &f->latest) &&
+         GetVarint64(&input, &f->hilbert_min) &&
+         GetVarint64(&input, &f->hilbert_max);
+}
+
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& raw_options)
+      : env(raw_options.env),
+        icmp(raw_options.comparator),
+        ipolicy(raw_options.filter_policy),
+        options(raw_options),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0) {
+    options.comparator = &icmp;
+    options.filter_policy =
+        raw_options.filter_policy != nullptr ? &ipolicy : nullptr;
+  }
+
+  // Close and remove the file being written, if any.
+  void Abandon() {
+    if (builder != nullptr) {
+      builder->Abandon();
+      delete builder;
+      builder = nullptr;
+      delete file;
+      file = nullptr;
+      env->RemoveFile(fname);
+    }
+  }
+
+  Env* const env;
+  const InternalKeyComparator icmp;
+  const InternalFilterPolicy ipolicy;
+  Options options;  // options.comparator == &icmp
+
+  std::string fname;
+  WritableFile* file;
+  TableBuilder* builder;
+  uint64_t file_size;
+
+  // Key range, valid-time range and Hilbert extent of the entries so far.
+  FileMetaData meta;
+  std::string last_key;  // Internal key of the last entry
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  rep_->Abandon();
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  Rep* r = rep_;
+  assert(r->builder == nullptr);
+  Status s = r->env->NewWritableFile(fname, &r->file);
+  if (!s.ok()) {
+    return s;
+  }
+  r->fname = fname;
+  r->builder = new TableBuilder(r->options, r->file);
+  r->file_size = 0;
+  r->meta = FileMetaData();
+  r->meta.earliest = kMaxValidTime;
+  r->meta.latest = 0;
+  r->last_key.clear();
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, ValidTime vt, uint64_t x,
+                          uint64_t y, const Slice& value) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  if (vt > kMaxSequenceNumber) {
+    return Status::InvalidArgument("valid time does not fit a sequence number");
+  }
+  std::string ikey;
+  AppendInternalKey(&ikey, ParsedInternalKey(key, vt, kTypeValue, vt, x, y));
+  if (!r->last_key.empty() && r->icmp.Compare(r->last_key, ikey) >= 0) {
+    return Status::InvalidArgument(
+        "entries out of order: keys must increase, and valid times of the "
+        "versions of a key decrease",
+        key);
+  }
+
+  r->builder->Add(ikey, value);
+  if (!r->builder->status().ok()) {
+    return r->builder->status();
+  }
+  if (r->last_key.empty()) {
+    r->meta.smallest.DecodeFrom(ikey);
+  }
+  r->last_key.swap(ikey);
+  r->meta.earliest = std::min(r->meta.earliest, vt);
+  r->meta.latest = std::max(r->meta.latest, vt);
+  AddEntryToMetaData(r->last_key, &r->meta);
+  return Status::OK();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("no file open");
+  }
+  if (r->builder->NumEntries() == 0) {
+    r->Abandon();
+    return Status::InvalidArgument("no entries added", r->fname);
+  }
+
+  r->meta.largest.DecodeFrom(r->last_key);
+  std::string properties;
+  EncodeSstFileProperties(r->meta, &properties);
+  r->builder->AddMetaBlock(kSstFilePropertiesBlock, properties);
+  Status s = r->builder->Finish();
+  r->file_size = r->builder->FileSize();
+  delete r->builder;
+  r->builder = nullptr;
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->file;
+  r->file = nullptr;
+  if (!s.ok()) {
+    r->env->RemoveFile(r->fname);
+  }
+  return s;
+}
+
+uint64_t SstFileWriter::NumEntries() const {
+  return rep_->builder != nullptr ? rep_->builder->NumEntries() : 0;
+}
+
+uint64_t SstFileWriter::FileSize() const {
+  return rep_->builder != nullptr ? rep_->builder->FileSize()
+                                  : rep_->file_size;
+}
+
+}  // namespace leveldb
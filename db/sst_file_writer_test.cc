@@ -0,0 +1,378 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include <string>
+#include <vector>
+
+#include "db/db_impl.h"
+#include "gtest/gtest.h"
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+#include "leveldb/write_batch.h"
+
+namespace leveldb {
+
+class SstFileWriterTest : public testing::Test {
+ public:
+  SstFileWriterTest() : env_(Env::Default()), db_(nullptr) {
+    env_->GetTestDirectory(&dir_);
+    dir_ += "/sst_file_writer_test";
+    dbname_ = dir_ + "/db";
+    options_.create_if_missing = true;
+    DestroyDB(dbname_, options_);
+    env_->CreateDir(dir_);
+  }
+
+  ~SstFileWriterTest() override {
+    delete db_;
+    DestroyDB(dbname_, options_);
+    std::vector<std::string> files;
+    env_->GetChildren(dir_, &files);
+    for (const std::string& f : files) {
+      env_->RemoveFile(dir_ + "/" + f);
+    }
+    env_->RemoveDir(dir_);
+  }
+
+  void Reopen() {
+    delete db_;
+    db_ = nullptr;
+    ASSERT_TRUE(DB::Open(options_, dbname_, &db_).ok());
+  }
+
+  std::string Get(const std::string& key, ValidTime vt) {
+    std::string value;
+    Status s = db_->Get(ReadOptions(), key, vt, &value);
+    if (s.IsNotFound()) {
+      return "NOT_FOUND";
+    } else if (!s.ok()) {
+      return s.ToString();
+    }
+    return value;
+  }
+
+  Env* env_;
+  Options options_;
+  std::string dir_;
+  std::string dbname_;
+  DB* db_;
+};
+
+TEST_F(SstFileWriterTest, RejectsOutOfOrderEntries) {
+  SstFileWriter writer(options_);
+  const std::string fname = dir_ + "/out_of_order.ldb";
+  ASSERT_TRUE(writer.Put("a", 1, 0, 0, "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Open(fname).ok());
+  ASSERT_TRUE(writer.Put("b", 20, 0, 0, "v").ok());
+  ASSERT_TRUE(writer.Put("b", 10, 0, 0, "v").ok());
+  // Versions of a key must come newest first, and keys in order.
+  ASSERT_TRUE(writer.Put("b", 10, 0, 0, "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("b", 30, 0, 0, "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("a", 40, 0, 0, "v").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("c", kMaxValidTime, 0, 0, "v").IsInvalidArgument());
+  ASSERT_EQ(2, writer.NumEntries());
+  ASSERT_TRUE(writer.Finish().ok());
+  ASSERT_GT(writer.FileSize(), 0);
+
+  // A file without entries is not kept.
+  const std::string empty = dir_ + "/empty.ldb";
+  ASSERT_TRUE(writer.Open(empty).ok());
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+  ASSERT_FALSE(env_->FileExists(empty));
+}
+
+TEST_F(SstFileWriterTest, Ingest) {
+  Reopen();
+  const std::string fname = dir_ + "/history.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(fname).ok());
+    ASSERT_TRUE(writer.Put("car1", 1200, 10, 20, "car1@1200").ok());
+    ASSERT_TRUE(writer.Put("car1", 1100, 11, 21, "car1@1100").ok());
+    ASSERT_TRUE(writer.Put("car2", 1150, 30, 40, "car2@1150").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {fname})
+                  .ok());
+  ASSERT_TRUE(env_->FileExists(fname));
+
+  std::string num_files;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &num_files));
+  ASSERT_EQ("1", num_files);
+  // The newest version in the file serves its whole valid-time range.
+  ASSERT_EQ("car1@1200", Get("car1", 1150));
+  ASSERT_EQ("car2@1150", Get("car2", 1200));
+  ASSERT_EQ("NOT_FOUND", Get("car1", 1000));
+  ASSERT_EQ("NOT_FOUND", Get("car3", 1150));
+
+  // Later writes order after the ingested versions.
+  WriteBatch batch;
+  batch.Put("car1", 1300, 12, 22, "car1@1300");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_EQ("car1@1300", Get("car1", 1300));
+
+  Reopen();
+  ASSERT_EQ("car2@1150", Get("car2", 1200));
+}
+
+TEST_F(SstFileWriterTest, IngestedEntriesAreNewerThanSnapshots) {
+  Reopen();
+  WriteBatch batch;
+  batch.Put("bus", 500, 1, 2, "bus@500");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  const Snapshot* before = db_->GetSnapshot();
+
+  const std::string fname = dir_ + "/history.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(fname).ok());
+    ASSERT_TRUE(writer.Put("car", 200, 10, 20, "new").ok());
+    ASSERT_TRUE(writer.Put("car", 100, 11, 21, "old").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {fname})
+                  .ok());
+  const Snapshot* after = db_->GetSnapshot();
+
+  ReadOptions options;
+  std::string value;
+  options.snapshot = before;
+  ASSERT_TRUE(db_->Get(options, "car", 150, &value).IsNotFound());
+  options.snapshot = after;
+  ASSERT_TRUE(db_->Get(options, "car", 150, &value).ok());
+  ASSERT_EQ("new", value);
+
+  // Writes after the ingestion are newer still.
+  batch.Clear();
+  batch.Put("car", 300, 12, 22, "newer");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_EQ("newer", Get("car", 300));
+  ASSERT_TRUE(db_->Get(options, "car", 150, &value).ok());
+  ASSERT_EQ("new", value);
+
+  db_->ReleaseSnapshot(before);
+  db_->ReleaseSnapshot(after);
+  Reopen();
+  ASSERT_EQ("new", Get("car", 150));
+}
+
+TEST_F(SstFileWriterTest, IngestMatchesPutAndFlush) {
+  static constexpr ValidTime kNow = 3000000000;
+
+  // Write two versions of "car" through the memtable and flush them ...
+  Reopen();
+  reinterpret_cast<DBImpl*>(db_)->SetDBCurrentTime(kNow);
+  WriteBatch batch;
+  batch.Put("car", 100, 11, 21, "old");
+  batch.Put("car", 200, 10, 20, "new");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_TRUE(reinterpret_cast<DBImpl*>(db_)->TEST_CompactMemTable().ok());
+  std::vector<std::string> written;
+  for (ValidTime vt : {ValidTime(150), ValidTime(250), kNow - 1}) {
+    written.push_back(Get("car", vt));
+  }
+
+  // ... and ingest the same versions into a fresh DB.
+  delete db_;
+  db_ = nullptr;
+  DestroyDB(dbname_, options_);
+  Reopen();
+  reinterpret_cast<DBImpl*>(db_)->SetDBCurrentTime(kNow);
+  const std::string fname = dir_ + "/history.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(fname).ok());
+    ASSERT_TRUE(writer.Put("car", 200, 10, 20, "new").ok());
+    ASSERT_TRUE(writer.Put("car", 100, 11, 21, "old").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {fname})
+                  .ok());
+  std::vector<std::string> ingested;
+  for (ValidTime vt : {ValidTime(150), ValidTime(250), kNow - 1}) {
+    ingested.push_back(Get("car", vt));
+  }
+  ASSERT_EQ(std::vector<std::string>({"new", "new", "new"}), written);
+  ASSERT_EQ(written, ingested);
+}
+
+TEST_F(SstFileWriterTest, SplitIntoFilesDoesNotChangeReads) {
+  static constexpr ValidTime kNow = 3000000000;
+  struct Entry {
+    const char* key;
+    ValidTime vt;
+    uint64_t x;
+    const char* value;
+  };
+  // The versions of "car" lie in different cells, as bulk_load
+  // --partition_order splits them; the file with the older version comes
+  // last and so gets the larger file number.
+  const std::vector<std::vector<Entry>> layouts[] = {
+      {{{"bike", 300, 5, "bike@300"},
+        {"car", 200, 7 << 24, "new"},
+        {"car", 100, 5, "old"}}},
+      {{{"car", 200, 7 << 24, "new"}},
+       {{"bike", 300, 5, "bike@300"}, {"car", 100, 5, "old"}}},
+  };
+
+  std::vector<std::string> reads[2];
+  for (int i = 0; i < 2; i++) {
+    delete db_;
+    db_ = nullptr;
+    DestroyDB(dbname_, options_);
+    Reopen();
+    reinterpret_cast<DBImpl*>(db_)->SetDBCurrentTime(kNow);
+    std::vector<std::string> files;
+    for (const std::vector<Entry>& entries : layouts[i]) {
+      files.push_back(dir_ + "/cell" + std::to_string(files.size()) + ".ldb");
+      SstFileWriter writer(options_);
+      ASSERT_TRUE(writer.Open(files.back()).ok());
+      for (const Entry& e : entries) {
+        ASSERT_TRUE(writer.Put(e.key, e.vt, e.x, 9, e.value).ok());
+      }
+      ASSERT_TRUE(writer.Finish().ok());
+    }
+    ASSERT_TRUE(
+        db_->IngestExternalFiles(IngestExternalFileOptions(), files).ok());
+    for (const char* key : {"car", "bike"}) {
+      for (ValidTime vt : {ValidTime(150), ValidTime(250), kNow - 1}) {
+        reads[i].push_back(Get(key, vt));
+      }
+    }
+  }
+  ASSERT_EQ(std::vector<std::string>(
+                {"new", "new", "new", "bike@300", "bike@300", "bike@300"}),
+            reads[0]);
+  ASSERT_EQ(reads[0], reads[1]);
+}
+
+TEST_F(SstFileWriterTest, IngestHistoryOfKeysInMemTable) {
+  static constexpr ValidTime kNow = 3000000000;
+  Reopen();
+  DBImpl* impl = reinterpret_cast<DBImpl*>(db_);
+  impl->SetDBCurrentTime(kNow);
+  WriteBatch batch;
+  batch.Put("car", 500, 1, 2, "current");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  // The switch carries "current" into a memtable that starts at kNow.
+  ASSERT_TRUE(impl->TEST_CompactMemTable().ok());
+
+  const std::string fname = dir_ + "/history.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(fname).ok());
+    ASSERT_TRUE(writer.Put("car", 200, 10, 20, "car@200").ok());
+    ASSERT_TRUE(writer.Put("car", 100, 11, 21, "car@100").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {fname})
+                  .ok());
+
+  // Before the memtable's start the ingested, newer versions win; from it
+  // on the memtable's.
+  ASSERT_EQ("car@200", Get("car", 150));
+  ASSERT_EQ("current", Get("car", kNow));
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), {"car"}, 150, &values, &statuses);
+  ASSERT_TRUE(statuses[0].ok());
+  ASSERT_EQ("car@200", values[0]);
+  db_->MultiGet(ReadOptions(), {"car"}, kNow, &values, &statuses);
+  ASSERT_TRUE(statuses[0].ok());
+  ASSERT_EQ("current", values[0]);
+
+  // Later writes are newer than the ingested versions.
+  batch.Clear();
+  batch.Put("car", 300, 12, 22, "car@300");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_EQ("car@300", Get("car", 150));
+}
+
+TEST_F(SstFileWriterTest, RejectsVersionsHiddenByMemTable) {
+  static constexpr ValidTime kNow = 3000000000;
+  Reopen();
+  DBImpl* impl = reinterpret_cast<DBImpl*>(db_);
+  impl->SetDBCurrentTime(kNow);
+  WriteBatch batch;
+  batch.Put("car2", 500, 1, 2, "car2@500");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch).ok());
+  ASSERT_TRUE(impl->TEST_CompactMemTable().ok());
+
+  const std::string fname = dir_ + "/history.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(fname).ok());
+    ASSERT_TRUE(writer.Put("car1", kNow, 10, 20, "car1@now").ok());
+    ASSERT_TRUE(writer.Put("car3", 200, 10, 20, "car3@200").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  // Lookups from the memtable's start on would take its version of car2
+  // over the newer, ingested ones.
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(), {fname})
+                  .IsInvalidArgument());
+  ASSERT_EQ("NOT_FOUND", Get("car1", kNow));
+  ASSERT_EQ("car2@500", Get("car2", kNow));
+}
+
+TEST_F(SstFileWriterTest, IngestMovesFiles) {
+  Reopen();
+  std::vector<std::string> files;
+  for (int i = 0; i < 3; i++) {
+    files.push_back(dir_ + "/part" + std::to_string(i) + ".ldb");
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(files.back()).ok());
+    ASSERT_TRUE(writer
+                    .Put("key" + std::to_string(i), 100 + i, i, i,
+                         "value" + std::to_string(i))
+                    .ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+  ASSERT_TRUE(db_->IngestExternalFiles(ingest_options, files).ok());
+  for (int i = 0; i < 3; i++) {
+    ASSERT_FALSE(env_->FileExists(files[i]));
+    ASSERT_EQ("value" + std::to_string(i),
+              Get("key" + std::to_string(i), 100 + i));
+  }
+}
+
+TEST_F(SstFileWriterTest, RejectsForeignFiles) {
+  Reopen();
+  const std::string good = dir_ + "/good.ldb";
+  {
+    SstFileWriter writer(options_);
+    ASSERT_TRUE(writer.Open(good).ok());
+    ASSERT_TRUE(writer.Put("a", 5, 0, 0, "v").ok());
+    ASSERT_TRUE(writer.Finish().ok());
+  }
+  const std::string foreign = dir_ + "/foreign.ldb";
+  {
+    WritableFile* file;
+    ASSERT_TRUE(env_->NewWritableFile(foreign, &file).ok());
+    TableBuilder builder(options_, file);
+    builder.Add("a", "v");
+    ASSERT_TRUE(builder.Finish().ok());
+    ASSERT_TRUE(file->Close().ok());
+    delete file;
+  }
+
+  // Nothing is ingested if one of the files is not usable.
+  ASSERT_TRUE(db_->IngestExternalFiles(IngestExternalFileOptions(),
+                                       {good, foreign})
+                  .IsInvalidArgument());
+  std::string num_files;
+  ASSERT_TRUE(db_->GetProperty("leveldb.num-files-at-level0", &num_files));
+  ASSERT_EQ("0", num_files);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
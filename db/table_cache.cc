@@ -6,16 +6,106 @@
 
 #include "db/filename.h"
 #include "leveldb/env.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/readahead_file.h"
 
 namespace leveldb {
 
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  SequenceNumber sequence_offset;  // See FileMetaData::sequence_offset
 };
 
+// Add "delta" (modulo 2^64) to the sequence number of internal key *ikey.
+// A lookup key whose sequence number falls below zero gets the smallest
+// tag instead, which orders after every entry of its user key, and one
+// that rises past kMaxSequenceNumber gets the largest.
+static void ShiftSequence(std::string* ikey, uint64_t delta) {
+  char* tag = &(*ikey)[ikey->size() - kInternalKeyAttributesLen];
+  const uint64_t packed = DecodeFixed64(tag);
+  const uint64_t sequence = (packed >> 8) + delta;
+  uint64_t shifted;
+  if (static_cast<int64_t>(sequence) < 0) {
+    shifted = 0;
+  } else if (sequence > kMaxSequenceNumber) {
+    shifted = (kMaxSequenceNumber << 8) | kValueTypeForSeek;
+  } else {
+    shifted = (sequence << 8) | (packed & 0xff);
+  }
+  EncodeFixed64(tag, shifted);
+}
+
+namespace {
+
+// Serves the entries of an ingested table with the sequence numbers of the
+// DB, "offset" above the ones stored in the table.
+class SequenceShiftingIterator : public Iterator {
+ public:
+  SequenceShiftingIterator(Iterator* iter, SequenceNumber offset)
+      : iter_(iter), offset_(offset) {}
+  ~SequenceShiftingIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    std::string key = target.ToString();
+    ShiftSequence(&key, -offset_);
+    iter_->Seek(key);
+    Update();
+  }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    Update();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    Update();
+  }
+  void Next() override {
+    iter_->Next();
+    Update();
+  }
+  void Prev() override {
+    iter_->Prev();
+    Update();
+  }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  void Update() {
+    if (iter_->Valid()) {
+      key_ = iter_->key().ToString();
+      ShiftSequence(&key_, offset_);
+    }
+  }
+
+  Iterator* const iter_;
+  const SequenceNumber offset_;
+  std::string key_;
+};
+
+// Passes the entry found in an ingested table on to the caller's handler
+// with the sequence number of the DB.
+struct ShiftedHandler {
+  void* arg;
+  void (*handle_result)(void*, const Slice&, const Slice&);
+  SequenceNumber offset;
+};
+
+void HandleShiftedResult(void* arg, const Slice& k, const Slice& v) {
+  ShiftedHandler* h = reinterpret_cast<ShiftedHandler*>(arg);
+  std::string key = k.ToString();
+  ShiftSequence(&key, h->offset);
+  (*h->handle_result)(h->arg, key, v);
+}
+
+}  // namespace
+
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
   delete tf->table;
@@ -29,35 +119,109 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+static void DeleteFile(void* arg1, void* arg2) {
+  delete reinterpret_cast<RandomAccessFile*>(arg1);
+}
+
+// Return an iterator over the table of "tf", which is "file_size" bytes
+// long.  If options.readahead_size is positive, the iterator reads the file
+// through a buffer of its own, so iterators that share the table do not
+// take each other's readahead.
+static Iterator* NewTableIterator(const TableAndFile* tf, uint64_t file_size,
+                                  const ReadOptions& options) {
+  Iterator* result;
+  if (options.readahead_size > 0) {
+    RandomAccessFile* file = NewReadaheadRandomAccessFile(
+        tf->file, file_size, options.readahead_size);
+    result = tf->table->NewIterator(options, file);
+    result->RegisterCleanup(&DeleteFile, file, nullptr);
+  } else {
+    result = tf->table->NewIterator(options);
+  }
+  if (tf->sequence_offset != 0) {
+    result = new SequenceShiftingIterator(result, tf->sequence_offset);
+  }
+  return result;
+}
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
       dbname_(dbname),
       options_(options),
-      cache_(NewLRUCache(entries)) {}
+      owns_cache_(options.table_cache == nullptr),
+      cache_(owns_cache_ ? NewLRUCache(entries) : options.table_cache),
+      capacity_(owns_cache_ ? entries : cache_->GetCapacity()),
+      direct_cache_(NewLRUCache(entries)),
+      cache_id_(cache_->NewId()),
+      block_cache_id_(options.block_cache != nullptr
+                          ? options.block_cache->NewId()
+                          : 0) {}
 
-TableCache::~TableCache() { delete cache_; }
+TableCache::~TableCache() {
+  delete direct_cache_;
+  if (owns_cache_) {
+    delete cache_;
+    return;
+  }
+  // The tables refer to options_, so they must leave a shared cache with
+  // this DB.
+  std::set<uint64_t> numbers;
+  {
+    MutexLock l(&mutex_);
+    numbers.swap(shared_tables_);
+  }
+  char buf[16];
+  for (uint64_t number : numbers) {
+    cache_->Erase(TableCacheKey(number, buf));
+  }
+}
+
+Slice TableCache::TableCacheKey(uint64_t file_number, char* buf) const {
+  EncodeFixed64(buf, cache_id_);
+  EncodeFixed64(buf + 8, file_number);
+  return Slice(buf, 16);
+}
+
+Slice TableCache::BlockCacheKeyPrefix(uint64_t file_number, char* buf) const {
+  EncodeFixed64(buf, block_cache_id_);
+  EncodeFixed64(buf + 8, file_number);
+  return Slice(buf, 16);
+}
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
                              Cache::Handle** handle) {
+  return FindTable(cache_, /*direct_io=*/false, file_number, file_size,
+                   handle);
+}
+
+Status TableCache::FindTable(Cache* cache, bool direct_io,
+                             uint64_t file_number, uint64_t file_size,
+                             Cache::Handle** handle) {
   Status s;
-  char buf[sizeof(file_number)];
-  EncodeFixed64(buf, file_number);
-  Slice key(buf, sizeof(buf));
-  *handle = cache_->Lookup(key);
+  char buf[16];
+  const Slice key = TableCacheKey(file_number, buf);
+  *handle = cache->Lookup(key);
   if (*handle == nullptr) {
+    PerfContext* perf = GetPerfContext();
+    const uint64_t start_micros = env_->NowMicros();
     std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
+    s = direct_io ? env_->NewDirectRandomAccessFile(fname, &file)
+                  : env_->NewRandomAccessFile(fname, &file);
     if (!s.ok()) {
       std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
+      if ((direct_io ? env_->NewDirectRandomAccessFile(old_fname, &file)
+                     : env_->NewRandomAccessFile(old_fname, &file))
+              .ok()) {
         s = Status::OK();
       }
     }
     if (s.ok()) {
-      s = Table::Open(options_, file, file_size, &table);
+      char prefix[16];
+      s = Table::Open(options_, file, file_size,
+                      BlockCacheKeyPrefix(file_number, prefix), &table);
     }
 
     if (!s.ok()) {
@@ -69,7 +233,14 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
-      *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
+      tf->sequence_offset = SequenceOffset(file_number);
+      *handle = cache->Insert(key, tf, 1, &DeleteEntry);
+      if (cache == cache_ && !owns_cache_) {
+        MutexLock l(&mutex_);
+        shared_tables_.insert(file_number);
+      }
+      perf->table_opens++;
+      perf->table_open_micros += env_->NowMicros() - start_micros;
     }
   }
   return s;
@@ -81,19 +252,35 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
-
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
 
-  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-  Iterator* result = table->NewIterator(options);
+  TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+  Iterator* result = NewTableIterator(tf, file_size, options);
   result->RegisterCleanup(&UnrefEntry, cache_, handle);
   if (tableptr != nullptr) {
-    *tableptr = table;
+    *tableptr = tf->table;
+  }
+  return result;
+}
+
+Iterator* TableCache::NewDirectIterator(const ReadOptions& options,
+                                        uint64_t file_number,
+                                        uint64_t file_size) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(direct_cache_, /*direct_io=*/true, file_number,
+                       file_size, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
+
+  TableAndFile* tf =
+      reinterpret_cast<TableAndFile*>(direct_cache_->Value(handle));
+  Iterator* result = NewTableIterator(tf, file_size, options);
+  result->RegisterCleanup(&UnrefEntry, direct_cache_, handle);
   return result;
 }
 
@@ -101,11 +288,31 @@ Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&)) {
+  GetPerfContext()->table_probes++;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->sequence_offset == 0) {
+      s = tf->table->InternalGet(options, k, arg, handle_result);
+    } else {
+      std::string key = k.ToString();
+      ShiftSequence(&key, -tf->sequence_offset);
+      ShiftedHandler shifted{arg, handle_result, tf->sequence_offset};
+      s = tf->table->InternalGet(options, key, &shifted, &HandleShiftedResult);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                                std::vector<std::string>* keys) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    t->GetIndexKeys(keys);
     cache_->Release(handle);
   }
   return s;
@@ -115,20 +322,72 @@ Status TableCache::GetS(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
                                              const Slice&), int precision) {
+  GetPerfContext()->table_probes++;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    TableAndFile* tf = reinterpret_cast<TableAndFile*>(cache_->Value(handle));
+    if (tf->sequence_offset == 0) {
+      s = tf->table->InternalGetS(options, k, arg, handle_result, precision);
+    } else {
+      std::string key = k.ToString();
+      ShiftSequence(&key, -tf->sequence_offset);
+      ShiftedHandler shifted{arg, handle_result, tf->sequence_offset};
+      s = tf->table->InternalGetS(options, key, &shifted, &HandleShiftedResult,
+                                  precision);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::Warm(uint64_t file_number, uint64_t file_size) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGetS(options, k, arg, handle_result, precision);
+    t->WarmMetaBlocks();
     cache_->Release(handle);
   }
   return s;
 }
 
+Status TableCache::ReadMetaBlock(uint64_t file_number, uint64_t file_size,
+                                 const Slice& name, std::string* contents) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->ReadMetaBlock(name, contents);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+void TableCache::SetSequenceOffset(uint64_t file_number,
+                                   SequenceNumber offset) {
+  MutexLock l(&mutex_);
+  sequence_offsets_[file_number] = offset;
+}
+
+SequenceNumber TableCache::SequenceOffset(uint64_t file_number) {
+  MutexLock l(&mutex_);
+  auto it = sequence_offsets_.find(file_number);
+  return it != sequence_offsets_.end() ? it->second : 0;
+}
+
 void TableCache::Evict(uint64_t file_number) {
-  char buf[sizeof(file_number)];
-  EncodeFixed64(buf, file_number);
-  cache_->Erase(Slice(buf, sizeof(buf)));
+  char buf[16];
+  cache_->Erase(TableCacheKey(file_number, buf));
+  direct_cache_->Erase(TableCacheKey(file_number, buf));
+  MutexLock l(&mutex_);
+  sequence_offsets_.erase(file_number);
+  shared_tables_.erase(file_number);
+}
+
+size_t TableCache::Room() const {
+  const size_t charge = cache_->TotalCharge();
+  return charge < capacity_ ? capacity_ - charge : 0;
 }
 
 }  // namespace leveldb
@@ -8,12 +8,16 @@
 #define STORAGE_LEVELDB_DB_TABLE_CACHE_H_
 
 #include <cstdint>
+#include <map>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
+#include "port/thread_annotations.h"
 
 namespace leveldb {
 
@@ -21,6 +25,8 @@ class Env;
 
 class TableCache {
  public:
+  // Keeps the tables in options.table_cache if it is non-null, and in a
+  // cache of its own with room for "entries" tables otherwise.
   TableCache(const std::string& dbname, const Options& options, int entries);
   ~TableCache();
 
@@ -31,9 +37,23 @@ class TableCache {
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
   // returned iterator is live.
+  //
+  // If options.readahead_size is positive the iterator reads the data
+  // blocks of the cached table through a buffer of its own that fetches
+  // that many bytes at a time (see NewReadaheadRandomAccessFile()).
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
                         uint64_t file_size, Table** tableptr = nullptr);
 
+  // Like NewIterator(), but reads the file through a handle opened with
+  // Env::NewDirectRandomAccessFile() instead of the cached one, so a single
+  // pass over the file (e.g. by a compaction) bypasses the operating
+  // system's page cache.  These tables are kept apart from the others,
+  // until Evict(), so that the slices of a compaction share one handle per
+  // input file.  Honors options.readahead_size like NewIterator(), with a
+  // buffer per iterator.
+  Iterator* NewDirectIterator(const ReadOptions& options, uint64_t file_number,
+                              uint64_t file_size);
+
   // If a seek to internal key "k" in specified file finds an entry,
   // call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options, uint64_t file_number,
@@ -44,16 +64,66 @@ class TableCache {
              void (*handle_result)(void*, const Slice&, const Slice&),
               int precision);
 
+  // Append to *keys the index keys of the specified file (see
+  // Table::GetIndexKeys()).
+  Status GetIndexKeys(uint64_t file_number, uint64_t file_size,
+                      std::vector<std::string>* keys);
+
+  // Open the specified file unless it is already in the cache, and load
+  // its index and filter blocks into the block cache if they are kept
+  // there, so that the next read of the file does not have to.
+  Status Warm(uint64_t file_number, uint64_t file_size);
+
+  // Store in *contents the meta block named "name" of the specified file
+  // (see Table::ReadMetaBlock()).
+  Status ReadMetaBlock(uint64_t file_number, uint64_t file_size,
+                       const Slice& name, std::string* contents);
+
+  // Serve the entries of the specified file with "offset" added (modulo
+  // 2^64) to the sequence numbers stored in it; see
+  // FileMetaData::sequence_offset.  Must be called before the file is
+  // first read.
+  void SetSequenceOffset(uint64_t file_number, SequenceNumber offset);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Return the number of tables that can still be opened before the cache
+  // evicts any, counting the tables of every DB sharing the cache.
+  size_t Room() const;
+
  private:
   Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // Find the table of the specified file in "cache", opening the file with
+  // Env::NewDirectRandomAccessFile() if "direct_io" is set and with
+  // Env::NewRandomAccessFile() otherwise.
+  Status FindTable(Cache* cache, bool direct_io, uint64_t file_number,
+                   uint64_t file_size, Cache::Handle**);
+  // Store in "buf" (16 bytes) the prefix of the block cache keys of the
+  // specified file.  It is the same every time the file is opened, so the
+  // file's blocks stay reachable after its table is evicted from cache_.
+  Slice BlockCacheKeyPrefix(uint64_t file_number, char* buf) const;
+  // Store in "buf" (16 bytes) the key of the specified file in cache_,
+  // which may hold the tables of other DBs as well.
+  Slice TableCacheKey(uint64_t file_number, char* buf) const;
+  SequenceNumber SequenceOffset(uint64_t file_number);
 
   Env* const env_;
   const std::string dbname_;
   const Options& options_;
-  Cache* cache_;
+  const bool owns_cache_;
+  Cache* const cache_;
+  const size_t capacity_;  // Of cache_
+  Cache* const direct_cache_;  // Tables of NewDirectIterator()
+  const uint64_t cache_id_;
+  const uint64_t block_cache_id_;
+
+  port::Mutex mutex_;
+  // Nonzero sequence offsets by file number
+  std::map<uint64_t, SequenceNumber> sequence_offsets_ GUARDED_BY(mutex_);
+  // File numbers of the tables this TableCache has put in a shared cache_
+  // and not evicted since.  Some may have been evicted by the cache.
+  std::set<uint64_t> shared_tables_ GUARDED_BY(mutex_);
 };
 
 }  // namespace leveldb
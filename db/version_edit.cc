@@ -20,7 +20,17 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  // Valid-time range and Hilbert extent of the preceding kNewFile entry
+  kFileExtents = 10,
+  // The preceding kNewFile entry holds range tombstones
+  kFileRangeTombstones = 11,
+  // Entry statistics of the preceding kNewFile entry
+  kFileEntryStats = 12,
+  // Recency of the preceding kNewFile entry, if not its own number
+  kFileRecency = 13,
+  // Sequence offset of the preceding kNewFile entry, if nonzero
+  kFileSequenceOffset = 14
 };
 
 void VersionEdit::Clear() {
@@ -80,6 +90,29 @@ void VersionEdit::EncodeTo(std::string* dst) const {
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    PutVarint32(dst, kFileExtents);
+    PutVarint64(dst, f.earliest);
+    PutVarint64(dst, f.latest);
+    PutVarint64(dst, f.hilbert_min);
+    PutVarint64(dst, f.hilbert_max);
+    if (f.has_range_tombstones) {
+      PutVarint32(dst, kFileRangeTombstones);
+    }
+    if (f.has_entry_stats) {
+      PutVarint32(dst, kFileEntryStats);
+      PutVarint64(dst, f.largest_sequence);
+      PutVarint64(dst, f.min_valid_time);
+      PutVarint64(dst, f.max_valid_time);
+      PutVarint32(dst, f.all_located_values ? 1 : 0);
+    }
+    if (f.Recency() != f.number) {
+      PutVarint32(dst, kFileRecency);
+      PutVarint64(dst, f.recency);
+    }
+    if (f.sequence_offset != 0) {
+      PutVarint32(dst, kFileSequenceOffset);
+      PutVarint64(dst, f.sequence_offset);
+    }
   }
 }
 
@@ -114,6 +147,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   FileMetaData f;
   Slice str;
   InternalKey key;
+  uint32_t located;
 
   while (msg == nullptr && GetVarint32(&input, &tag)) {
     switch (tag) {
@@ -185,6 +219,58 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         }
         break;
 
+      case kFileExtents:
+        if (!new_files_.empty() &&
+            GetVarint64(&input, &new_files_.back().second.earliest) &&
+            GetVarint64(&input, &new_files_.back().second.latest) &&
+            GetVarint64(&input, &new_files_.back().second.hilbert_min) &&
+            GetVarint64(&input, &new_files_.back().second.hilbert_max)) {
+          // Attached to the preceding file
+        } else {
+          msg = "file extents";
+        }
+        break;
+
+      case kFileRangeTombstones:
+        if (!new_files_.empty()) {
+          new_files_.back().second.has_range_tombstones = true;
+        } else {
+          msg = "file range tombstones";
+        }
+        break;
+
+      case kFileEntryStats:
+        if (!new_files_.empty() &&
+            GetVarint64(&input, &new_files_.back().second.largest_sequence) &&
+            GetVarint64(&input, &new_files_.back().second.min_valid_time) &&
+            GetVarint64(&input, &new_files_.back().second.max_valid_time) &&
+            GetVarint32(&input, &located)) {
+          new_files_.back().second.has_entry_stats = true;
+          new_files_.back().second.all_located_values = (located != 0);
+        } else {
+          msg = "file entry stats";
+        }
+        break;
+
+      case kFileRecency:
+        if (!new_files_.empty() &&
+            GetVarint64(&input, &new_files_.back().second.recency)) {
+          // Attached to the preceding file
+        } else {
+          msg = "file recency";
+        }
+        break;
+
+      case kFileSequenceOffset:
+        if (!new_files_.empty() &&
+            GetVarint64(&input,
+                        &new_files_.back().second.sequence_offset)) {
+          // Attached to the preceding file
+        } else {
+          msg = "file sequence offset";
+        }
+        break;
+
       default:
         msg = "unknown tag";
         break;
@@ -249,6 +335,38 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    r.append(" time ");
+    AppendNumberTo(&r, f.earliest);
+    r.append(" .. ");
+    AppendNumberTo(&r, f.latest);
+    if (f.HasHilbertExtent()) {
+      r.append(" hilbert ");
+      AppendNumberTo(&r, f.hilbert_min);
+      r.append(" .. ");
+      AppendNumberTo(&r, f.hilbert_max);
+    }
+    if (f.has_range_tombstones) {
+      r.append(" range-tombstones");
+    }
+    if (f.has_entry_stats) {
+      r.append(" seq ");
+      AppendNumberTo(&r, f.largest_sequence);
+      r.append(" entries ");
+      AppendNumberTo(&r, f.min_valid_time);
+      r.append(" .. ");
+      AppendNumberTo(&r, f.max_valid_time);
+      if (f.all_located_values) {
+        r.append(" located");
+      }
+    }
+    if (f.Recency() != f.number) {
+      r.append(" recency ");
+      AppendNumberTo(&r, f.recency);
+    }
+    if (f.sequence_offset != 0) {
+      r.append(" sequence-offset ");
+      AppendNumberTo(&r, f.sequence_offset);
+    }
   }
   r.append("\n}\n");
   return r;
@@ -10,13 +10,57 @@
 #include <vector>
 
 #include "db/dbformat.h"
+#include "spatial/format.h"
 
 namespace leveldb {
 
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        hilbert_min(spatial::kOmitCoordinate),
+        hilbert_max(0),
+        has_range_tombstones(false),
+        has_entry_stats(false),
+        largest_sequence(0),
+        min_valid_time(0),
+        max_valid_time(0),
+        all_located_values(false),
+        recency(0),
+        sequence_offset(0),
+        being_compacted(false) {}
+
+  // Place of the table in newest-first order.  The tables of one
+  // partitioned flush, or of one ingestion, share the number of the
+  // first one.
+  uint64_t Recency() const { return recency != 0 ? recency : number; }
+
+  // Returns true iff the table holds at least one entry with a location.
+  bool HasHilbertExtent() const { return hilbert_min <= hilbert_max; }
+
+  // Widen the Hilbert extent to cover index "t".
+  void ExtendHilbert(spatial::Linear t) {
+    if (t < hilbert_min) hilbert_min = t;
+    if (t > hilbert_max) hilbert_max = t;
+  }
+
+  // Widen the entry statistics to cover the entry "ikey", which has a
+  // location iff "located".
+  void AddEntryStats(const ParsedInternalKey& ikey, bool located) {
+    if (!has_entry_stats) {
+      has_entry_stats = true;
+      largest_sequence = ikey.sequence;
+      min_valid_time = max_valid_time = ikey.time;
+      all_located_values = true;
+    }
+    if (ikey.sequence > largest_sequence) largest_sequence = ikey.sequence;
+    if (ikey.time < min_valid_time) min_valid_time = ikey.time;
+    if (ikey.time > max_valid_time) max_valid_time = ikey.time;
+    if (ikey.type != kTypeValue || !located) all_located_values = false;
+  }
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -26,6 +70,25 @@ struct FileMetaData {
   InternalKey largest;   // Largest internal key served by table
   ValidTime earliest;    // Start valid time of the component
   ValidTime latest;      // End valid time of the component
+  // Range of Hilbert indices (order spatial::kKeyOrder) of the located
+  // entries in the table.  Empty (min > max) if there are none.
+  spatial::Linear hilbert_min;
+  spatial::Linear hilbert_max;
+  bool has_range_tombstones;  // Table has a kRangeTombstonesBlock meta block
+  // Statistics of the entries of the table, known iff has_entry_stats:
+  // their largest sequence number and valid-time range, and whether they
+  // are all values with a location.
+  bool has_entry_stats;
+  SequenceNumber largest_sequence;
+  ValidTime min_valid_time;
+  ValidTime max_valid_time;
+  bool all_located_values;
+  uint64_t recency;      // Zero if the table ranks by its own number
+  // Added (modulo 2^64) to the sequence numbers stored in the table to get
+  // the ones it serves; nonzero for tables added by
+  // DB::IngestExternalFiles(), which store valid times instead.
+  SequenceNumber sequence_offset;
+  bool being_compacted;  // Input of a running compaction (guarded by DB mutex)
 };
 
 class VersionEdit {
@@ -75,6 +138,31 @@ class VersionEdit {
     new_files_.emplace_back(level, f);
   }
 
+  // Add the file described by "f" (number, size, key range, valid-time
+  // range, Hilbert extent, range tombstone flag, entry statistics,
+  // recency and sequence offset) at the specified level.
+  // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
+  void AddFile(int level, const FileMetaData& f) {
+    FileMetaData copy;
+    copy.number = f.number;
+    copy.file_size = f.file_size;
+    copy.earliest = f.earliest;
+    copy.latest = f.latest;
+    copy.hilbert_min = f.hilbert_min;
+    copy.hilbert_max = f.hilbert_max;
+    copy.has_range_tombstones = f.has_range_tombstones;
+    copy.has_entry_stats = f.has_entry_stats;
+    copy.largest_sequence = f.largest_sequence;
+    copy.min_valid_time = f.min_valid_time;
+    copy.max_valid_time = f.max_valid_time;
+    copy.all_located_values = f.all_located_values;
+    copy.recency = f.recency;
+    copy.sequence_offset = f.sequence_offset;
+    copy.smallest = f.smallest;
+    copy.largest = f.largest;
+    new_files_.emplace_back(level, copy);
+  }
+
   // Delete the specified "file" from the specified "level".
   void RemoveFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
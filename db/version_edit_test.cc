@@ -24,11 +24,12 @@ TEST(VersionEditTest, EncodeDecode) {
   VersionEdit edit;
   for (int i = 0; i < 4; i++) {
     TestEncodeDecode(edit);
-    edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
-                 InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+    edit.AddFile(3, kBig + 300 + i, kBig + 400 + i, 10 + i, 20 + i,
+                 InternalKey("foo", kBig + 500 + i, kTypeValue, 1, 2, 3),
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion, 4, 5, 6));
     edit.RemoveFile(4, kBig + 700 + i);
-    edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
+    edit.SetCompactPointer(
+        i, InternalKey("x", kBig + 900 + i, kTypeValue, 7, 8, 9));
   }
 
   edit.SetComparatorName("foo");
@@ -38,6 +39,107 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, FileExtents) {
+  FileMetaData f;
+  ASSERT_FALSE(f.HasHilbertExtent());
+  f.number = 5;
+  f.file_size = 100;
+  f.earliest = 1000;
+  f.latest = 2000;
+  f.ExtendHilbert(42);
+  f.ExtendHilbert(7);
+  ASSERT_TRUE(f.HasHilbertExtent());
+  f.smallest = InternalKey("a", 1, kTypeValue, 1000, 1, 1);
+  f.largest = InternalKey("b", 2, kTypeValue, 2000, 2, 2);
+
+  VersionEdit edit;
+  edit.AddFile(0, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find("time 1000 .. 2000 hilbert 7 .. 42"));
+}
+
+TEST(VersionEditTest, EntryStats) {
+  FileMetaData f;
+  f.number = 6;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue, 1000, 1, 1);
+  f.largest = InternalKey("b", 2, kTypeValue, 2000, 2, 2);
+  f.AddEntryStats(ParsedInternalKey("a", 7, kTypeValue, 1500, 1, 1), true);
+  f.AddEntryStats(ParsedInternalKey("b", 9, kTypeValue, 1200, 2, 2), true);
+  f.has_range_tombstones = true;
+  ASSERT_TRUE(f.all_located_values);
+
+  VersionEdit edit;
+  edit.AddFile(0, f);
+  TestEncodeDecode(edit);
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  ASSERT_NE(std::string::npos,
+            parsed.DebugString().find(
+                "range-tombstones seq 9 entries 1200 .. 1500 located"));
+
+  // Deletions and entries without a location clear all_located_values.
+  f.AddEntryStats(ParsedInternalKey("c", 3, kTypeDeletion, 1300, 3, 3), true);
+  ASSERT_FALSE(f.all_located_values);
+  ASSERT_EQ(9, f.largest_sequence);
+}
+
+TEST(VersionEditTest, Recency) {
+  FileMetaData f;
+  f.number = 8;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue, 1000, 1, 1);
+  f.largest = InternalKey("b", 2, kTypeValue, 2000, 2, 2);
+  ASSERT_EQ(8, f.Recency());
+
+  VersionEdit edit;
+  edit.AddFile(0, f);
+  f.number = 9;
+  f.recency = 8;
+  edit.AddFile(0, f);
+  TestEncodeDecode(edit);
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  const std::string debug = parsed.DebugString();
+  // Only the second file ranks by another file's number.
+  ASSERT_NE(std::string::npos, debug.find(" recency 8"));
+  ASSERT_EQ(debug.find(" recency "), debug.rfind(" recency "));
+}
+
+TEST(VersionEditTest, SequenceOffset) {
+  FileMetaData f;
+  f.number = 8;
+  f.file_size = 100;
+  f.smallest = InternalKey("a", 1, kTypeValue, 1000, 1, 1);
+  f.largest = InternalKey("b", 2, kTypeValue, 2000, 2, 2);
+
+  VersionEdit edit;
+  edit.AddFile(0, f);
+  f.number = 9;
+  f.sequence_offset = -SequenceNumber{500};  // Stored valid times were larger
+  edit.AddFile(0, f);
+  TestEncodeDecode(edit);
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  const std::string debug = parsed.DebugString();
+  ASSERT_NE(std::string::npos,
+            debug.find(" sequence-offset " +
+                       std::to_string(-SequenceNumber{500})));
+  ASSERT_EQ(debug.find(" sequence-offset "), debug.rfind(" sequence-offset "));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
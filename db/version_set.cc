@@ -5,7 +5,9 @@
 #include "db/version_set.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <unordered_map>
 
 #include "db/filename.h"
 #include "db/log_reader.h"
@@ -13,11 +15,14 @@
 #include "db/memtable.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/thread_pool.h"
 
 namespace leveldb {
 
@@ -66,6 +71,7 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
 
 Version::~Version() {
   assert(refs_ == 0);
+  delete range_tombstones_.load(std::memory_order_relaxed);
 
   // Remove from linked list
   prev_->next_ = next_;
@@ -220,6 +226,19 @@ static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
   }
 }
 
+// Like GetFileIterator(), but reads the file with direct I/O.
+static Iterator* GetDirectFileIterator(void* arg, const ReadOptions& options,
+                                       const Slice& file_value) {
+  TableCache* cache = reinterpret_cast<TableCache*>(arg);
+  if (file_value.size() != 16) {
+    return NewErrorIterator(
+        Status::Corruption("FileReader invoked with unexpected value"));
+  } else {
+    return cache->NewDirectIterator(options, DecodeFixed64(file_value.data()),
+                                    DecodeFixed64(file_value.data() + 8));
+  }
+}
+
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
   return NewTwoLevelIterator(
@@ -252,12 +271,15 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kCovered,  // The version found is hidden by a range tombstone
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  const RangeTombstoneView* range_dels = nullptr;
+  SequenceNumber sequence = 0;  // Of the version found or deleted
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -267,7 +289,12 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
+      if (s->range_dels != nullptr && s->range_dels->Covers(parsed_key)) {
+        s->state = kCovered;
+        return;
+      }
       s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      s->sequence = parsed_key.sequence;
       if (s->state == kFound) {
         s->value->assign(v.data(), v.size());
       }
@@ -276,30 +303,94 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
+  if (a->Recency() != b->Recency()) {
+    return a->Recency() > b->Recency();
+  }
   return a->number > b->number;
 }
 
-void Version::ForEachOverlapping(Slice user_key, ValidTime vt, Slice internal_key, void* arg,
-                                 bool (*func)(void*, int, FileMetaData*)) {
-  const Comparator* ucmp = vset_->icmp_.user_comparator();
+// The tables of one partitioned flush share a recency, and any of them may
+// hold the newest version of a key.  Once files[i] has answered a lookup
+// into *saver, probe the other tables of its flush with "probe" and keep
+// the answer with the largest sequence number.
+template <typename Probe>
+static Status ProbeRestOfFlush(const std::vector<FileMetaData*>& files,
+                               size_t i, Version::GetStats* stats,
+                               Saver* saver, Probe&& probe) {
+  std::string value;
+  for (size_t j = i + 1;
+       j < files.size() && files[j]->Recency() == files[i]->Recency(); j++) {
+    if (stats->seek_file == nullptr) {
+      // We have had more than one seek for this read.  Charge the 1st file.
+      stats->seek_file = files[i];
+      stats->seek_file_level = 0;
+    }
+    Saver other = *saver;
+    other.state = kNotFound;
+    other.value = &value;
+    Status s = probe(files[j], &other);
+    if (!s.ok()) {
+      return s;
+    }
+    if (other.state == kCorrupt) {
+      return Status::Corruption("corrupted key for ", saver->user_key);
+    }
+    if ((other.state == kFound || other.state == kDeleted) &&
+        other.sequence > saver->sequence) {
+      saver->state = other.state;
+      saver->sequence = other.sequence;
+      if (other.state == kFound) {
+        saver->value->swap(value);
+      }
+    }
+  }
+  return Status::OK();
+}
 
-  // Search level-0 in order from newest to oldest.
-  std::vector<FileMetaData*> tmp;
-  tmp.reserve(files_[0].size());
+void Version::GetOverlappingL0Files(Slice user_key, ValidTime vt,
+                                    std::vector<FileMetaData*>* files) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  files->clear();
+  files->reserve(files_[0].size());
   for (uint32_t i = 0; i < files_[0].size(); i++) {
     FileMetaData* f = files_[0][i];
     if (ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
         ucmp->Compare(user_key, f->largest.user_key()) <= 0 &&
         f->earliest <= vt && f->latest >= vt) {
-      tmp.push_back(f);
+      files->push_back(f);
     }
   }
-  if (!tmp.empty()) {
-    std::sort(tmp.begin(), tmp.end(), NewestFirst);
-    for (uint32_t i = 0; i < tmp.size(); i++) {
-      if (!(*func)(arg, 0, tmp[i])) {
-        return;
-      }
+  std::sort(files->begin(), files->end(), NewestFirst);
+}
+
+bool Version::HasNewerL0Version(Slice user_key, ValidTime vt,
+                                SequenceNumber sequence) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  for (FileMetaData* f : files_[0]) {
+    if (ucmp->Compare(user_key, f->smallest.user_key()) < 0 ||
+        ucmp->Compare(user_key, f->largest.user_key()) > 0 ||
+        f->earliest > vt || f->latest < vt) {
+      continue;
+    }
+    // The entries of an ingested table all got their sequence numbers at
+    // once, the smallest being its offset plus its earliest valid time.
+    if ((f->sequence_offset != 0 &&
+         f->sequence_offset + f->earliest > sequence) ||
+        (f->has_entry_stats && f->largest_sequence > sequence)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Version::ForEachOverlapping(Slice user_key, ValidTime vt, Slice internal_key, void* arg,
+                                 bool (*func)(void*, int, FileMetaData*)) {
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp;
+  GetOverlappingL0Files(user_key, vt, &tmp);
+  for (uint32_t i = 0; i < tmp.size(); i++) {
+    if (!(*func)(arg, 0, tmp[i])) {
+      return;
     }
   }
 
@@ -324,8 +415,307 @@ void Version::ForEachOverlapping(Slice user_key, ValidTime vt, Slice internal_ke
 //  }
 }
 
+// Store in saver->state the answer of the newest version of
+// saver->user_key in the specified file not hidden by saver->range_dels,
+// scanning the versions from "ikey" on.
+static Status SaveUncoveredValue(TableCache* table_cache,
+                                 const ReadOptions& options,
+                                 uint64_t file_number, uint64_t file_size,
+                                 const Slice& ikey, Saver* saver) {
+  Iterator* iter = table_cache->NewIterator(options, file_number, file_size);
+  saver->state = kNotFound;
+  for (iter->Seek(ikey); iter->Valid(); iter->Next()) {
+    SaveValue(saver, iter->key(), iter->value());
+    if (saver->state != kCovered) {
+      break;
+    }
+    saver->state = kNotFound;
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+namespace {
+// State shared between a lookup and the pool threads probing one window of
+// its level-0 candidates.  Reference counted so that the lookup can return
+// as soon as the newest answer is known while probes of older files are
+// still in flight.
+struct ParallelProbe {
+  struct Slot {
+    uint64_t number;
+    uint64_t file_size;
+    int flush_limit;  // Index past the last slot of the same flush
+    Saver saver;
+    std::string value;
+    Status s;
+    bool done;
+    PerfContext perf;  // Work of a probe run on a pool thread
+  };
+
+  ParallelProbe(const ReadOptions& options, const LookupKey& k,
+                TableCache* table_cache, const Comparator* ucmp, bool spatial,
+                int precision, const RangeTombstoneView* range_dels,
+                FileMetaData* const* files, size_t n)
+      : cv(&mu),
+        refs(static_cast<int>(n) + 1),
+        cutoff(static_cast<int>(n)),
+        slots(n),
+        options(options),
+        ikey(k.internal_key().ToString()),
+        user_key(k.user_key().ToString()),
+        table_cache(table_cache),
+        spatial(spatial),
+        precision(precision) {
+    for (size_t i = 0; i < n; i++) {
+      Slot* slot = &slots[i];
+      slot->number = files[i]->number;
+      slot->file_size = files[i]->file_size;
+      slot->flush_limit = static_cast<int>(i) + 1;
+      while (slot->flush_limit < static_cast<int>(n) &&
+             files[slot->flush_limit]->Recency() == files[i]->Recency()) {
+        slot->flush_limit++;
+      }
+      slot->saver.state = kNotFound;
+      slot->saver.ucmp = ucmp;
+      slot->saver.user_key = user_key;
+      slot->saver.value = &slot->value;
+      slot->saver.range_dels = range_dels;
+      slot->done = false;
+    }
+  }
+
+  // Drop a reference; the last one deletes *this.
+  void Unref() {
+    mu.Lock();
+    const bool last = (--refs == 0);
+    mu.Unlock();
+    if (last) {
+      delete this;
+    }
+  }
+
+  port::Mutex mu;
+  port::CondVar cv;
+  int refs;  // One per scheduled probe plus one for the lookup
+
+  // Index past the slots of the newest flush known to hold an answer, or
+  // slots.size().  Probes of older slots are skipped once this drops to
+  // their index.
+  std::atomic<int> cutoff;
+
+  std::vector<Slot> slots;  // Slot::done and Slot::s are guarded by mu
+  const ReadOptions options;
+  const std::string ikey;
+  const std::string user_key;
+  TableCache* const table_cache;
+  const bool spatial;
+  const int precision;
+};
+
+struct ProbeTask {
+  ParallelProbe* probe;
+  int index;
+};
+
+// Probe the file of slot "index".  "on_pool" is true on a pool thread,
+// whose PerfContext the probe then records in the slot for the lookup.
+void RunProbe(ParallelProbe* probe, int index, bool on_pool) {
+  ParallelProbe::Slot* slot = &probe->slots[index];
+  if (on_pool) {
+    GetPerfContext()->Reset();
+  }
+  Status s;
+  if (index < probe->cutoff.load(std::memory_order_acquire)) {
+    if (probe->spatial) {
+      s = probe->table_cache->GetS(probe->options, slot->number,
+                                   slot->file_size, probe->ikey, &slot->saver,
+                                   SaveValue, probe->precision);
+    } else {
+      s = probe->table_cache->Get(probe->options, slot->number,
+                                  slot->file_size, probe->ikey, &slot->saver,
+                                  SaveValue);
+      if (s.ok() && slot->saver.state == kCovered) {
+        // Look past the hidden versions for an older one.
+        s = SaveUncoveredValue(probe->table_cache, probe->options,
+                               slot->number, slot->file_size, probe->ikey,
+                               &slot->saver);
+      }
+    }
+    if (slot->saver.state == kCovered) {
+      slot->saver.state = kNotFound;  // Keep looking at older files
+    }
+  }
+  {
+    MutexLock l(&probe->mu);
+    if (on_pool) {
+      slot->perf = *GetPerfContext();
+    }
+    slot->s = s;
+    slot->done = true;
+    if ((!s.ok() || slot->saver.state != kNotFound) &&
+        slot->flush_limit < probe->cutoff.load(std::memory_order_relaxed)) {
+      probe->cutoff.store(slot->flush_limit, std::memory_order_release);
+    }
+    probe->cv.SignalAll();
+  }
+  probe->Unref();
+}
+
+void RunProbeTask(void* arg) {
+  ProbeTask* task = reinterpret_cast<ProbeTask*>(arg);
+  RunProbe(task->probe, task->index, /*on_pool=*/true);
+  delete task;
+}
+}  // namespace
+
+Status Version::ProbeL0InParallel(const ReadOptions& options,
+                                  const LookupKey& k, bool spatial,
+                                  int precision,
+                                  const std::vector<FileMetaData*>& files,
+                                  const RangeTombstoneView* range_dels,
+                                  std::string* value, GetStats* stats,
+                                  SequenceNumber* sequence) {
+  if (sequence != nullptr) {
+    *sequence = 0;
+  }
+  const size_t window = vset_->options_->max_parallel_l0_probes;
+  // Files the lookup needed, in newest-first order; the probes of older
+  // files that ran ahead do not count.
+  size_t examined = 0;
+
+  size_t n;
+  for (size_t start = 0; start < files.size(); start += n) {
+    // Keep the tables of one flush in one window.
+    n = std::min(window, files.size() - start);
+    while (start + n < files.size() &&
+           files[start + n]->Recency() == files[start + n - 1]->Recency()) {
+      n++;
+    }
+    ParallelProbe* probe = new ParallelProbe(
+        options, k, vset_->table_cache_, vset_->icmp_.user_comparator(), spatial,
+        precision, range_dels, &files[start], n);
+    for (size_t i = 1; i < n; i++) {
+      vset_->probe_pool_->Schedule(&RunProbeTask,
+                                   new ProbeTask{probe, static_cast<int>(i)});
+    }
+    // Probe the newest candidate on the calling thread.
+    RunProbe(probe, 0, /*on_pool=*/false);
+
+    // Wait for candidates in newest-first order until one has an answer,
+    // then for the rest of its flush: the largest sequence number wins.
+    Status s;
+    bool decided = false;
+    ParallelProbe::Slot* answer = nullptr;
+    {
+      MutexLock l(&probe->mu);
+      int limit = static_cast<int>(n);
+      for (int i = 0; i < limit && !decided; i++) {
+        ParallelProbe::Slot* slot = &probe->slots[i];
+        while (!slot->done) {
+          probe->cv.Wait();
+        }
+        examined++;
+        if (!slot->s.ok()) {
+          s = slot->s;
+          decided = true;
+          continue;
+        }
+        switch (slot->saver.state) {
+          case kNotFound:
+          case kCovered:  // Not reached: RunProbe() looks past those
+            break;        // Keep looking at older files
+          case kFound:
+          case kDeleted:
+            if (answer == nullptr ||
+                slot->saver.sequence > answer->saver.sequence) {
+              answer = slot;
+            }
+            limit = slot->flush_limit;
+            break;
+          case kCorrupt:
+            s = Status::Corruption("corrupted key for ", k.user_key());
+            decided = true;
+            break;
+        }
+      }
+      if (!decided && answer != nullptr) {
+        decided = true;
+        if (sequence != nullptr) {
+          *sequence = answer->saver.sequence;
+        }
+        if (answer->saver.state == kFound) {
+          value->swap(answer->value);
+        } else {
+          s = Status::NotFound(Slice());
+        }
+      }
+      if (range_dels != nullptr) {
+        // Probes still in flight check the caller's tombstones, which only
+        // live as long as this lookup.
+        for (size_t i = 0; i < n; i++) {
+          while (!probe->slots[i].done) {
+            probe->cv.Wait();
+          }
+        }
+      }
+      // Count the work of the pool threads as the caller's.
+      PerfContext* perf = GetPerfContext();
+      for (size_t i = 1; i < n; i++) {
+        if (probe->slots[i].done) {
+          perf->Add(probe->slots[i].perf);
+        }
+      }
+    }
+    probe->Unref();
+    if (decided || start + n == files.size()) {
+      if (examined > 1) {
+        // The sequential path would have had more than one seek for this
+        // read.  Charge the 1st file.
+        stats->seek_file = files[0];
+        stats->seek_file_level = 0;
+      }
+      return decided ? s : Status::NotFound(Slice());
+    }
+  }
+  return Status::NotFound(Slice());
+}
+
+Status Version::GetRangeTombstones(const RangeTombstoneList** list) {
+  RangeTombstoneList* result = range_tombstones_.load(std::memory_order_acquire);
+  if (result == nullptr) {
+    MutexLock l(&range_tombstones_mu_);
+    result = range_tombstones_.load(std::memory_order_relaxed);
+    if (result == nullptr) {
+      result = new RangeTombstoneList(vset_->icmp_.user_comparator());
+      for (int level = 0; level < config::kNumLevels; level++) {
+        for (FileMetaData* f : files_[level]) {
+          if (!f->has_range_tombstones) {
+            continue;
+          }
+          std::string contents;
+          Status s = vset_->table_cache_->ReadMetaBlock(
+              f->number, f->file_size, kRangeTombstonesBlock, &contents);
+          if (s.ok()) {
+            s = result->DecodeFrom(contents);
+          }
+          if (!s.ok()) {
+            delete result;
+            return s;
+          }
+        }
+      }
+      range_tombstones_.store(result, std::memory_order_release);
+    }
+  }
+  *list = result;
+  return Status::OK();
+}
+
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats,
+                    const RangeTombstoneView* range_dels,
+                    SequenceNumber* sequence) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -357,12 +747,21 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
                                                 &state->saver, SaveValue);
+      if (state->s.ok() && state->saver.state == kCovered) {
+        // Look past the hidden versions for an older one.
+        state->s = SaveUncoveredValue(state->vset->table_cache_,
+                                      *state->options, f->number,
+                                      f->file_size, state->ikey,
+                                      &state->saver);
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
       switch (state->saver.state) {
         case kNotFound:
+        case kCovered:
+          state->saver.state = kNotFound;
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -396,15 +795,51 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  if (range_dels != nullptr && !range_dels->empty()) {
+    state.saver.range_dels = range_dels;
+  }
 
-  ForEachOverlapping(state.saver.user_key, k.valid_time(), state.ikey, &state,
-                     &State::Match);
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> files;
+  GetOverlappingL0Files(state.saver.user_key, k.valid_time(), &files);
+  GetPerfContext()->l0_files_considered += files.size();
+  if (vset_->probe_pool_ != nullptr && files.size() > 1) {
+    return ProbeL0InParallel(options, k, false, 0, files,
+                             state.saver.range_dels, value, stats, sequence);
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!State::Match(&state, 0, files[i])) {
+      if (state.s.ok()) {
+        state.s = ProbeRestOfFlush(
+            files, i, stats, &state.saver,
+            [&](FileMetaData* f, Saver* saver) {
+              Status s = vset_->table_cache_->Get(options, f->number,
+                                                  f->file_size, state.ikey,
+                                                  saver, SaveValue);
+              if (s.ok() && saver->state == kCovered) {
+                s = SaveUncoveredValue(vset_->table_cache_, options,
+                                       f->number, f->file_size, state.ikey,
+                                       saver);
+              }
+              return s;
+            });
+        state.found = !state.s.ok() || state.saver.state == kFound;
+      }
+      break;
+    }
+  }
 
+  if (sequence != nullptr) {
+    *sequence = (state.saver.state == kFound || state.saver.state == kDeleted)
+                    ? state.saver.sequence
+                    : 0;
+  }
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
 Status Version::GetS(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats, int precision) {
+                    std::string* value, GetStats* stats, int precision,
+                    const RangeTombstoneView* range_dels) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
@@ -413,6 +848,7 @@ Status Version::GetS(const ReadOptions& options, const LookupKey& k,
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
+    int precision;
     FileMetaData* last_file_read;
     int last_file_read_level;
 
@@ -435,13 +871,16 @@ Status Version::GetS(const ReadOptions& options, const LookupKey& k,
 
       state->s = state->vset->table_cache_->GetS(*state->options, f->number,
                                                 f->file_size, state->ikey,
-                                                &state->saver, SaveValue, 6);
+                                                &state->saver, SaveValue,
+                                                state->precision);
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
       switch (state->saver.state) {
         case kNotFound:
+        case kCovered:
+          state->saver.state = kNotFound;
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -469,15 +908,40 @@ Status Version::GetS(const ReadOptions& options, const LookupKey& k,
 
   state.options = &options;
   state.ikey = k.internal_key();
+  state.precision = precision;
   state.vset = vset_;
 
   state.saver.state = kNotFound;
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  if (range_dels != nullptr && !range_dels->empty()) {
+    state.saver.range_dels = range_dels;
+  }
 
-  ForEachOverlapping(state.saver.user_key, k.valid_time(), state.ikey, &state,
-                     &State::Match);
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> files;
+  GetOverlappingL0Files(state.saver.user_key, k.valid_time(), &files);
+  GetPerfContext()->l0_files_considered += files.size();
+  if (vset_->probe_pool_ != nullptr && files.size() > 1) {
+    return ProbeL0InParallel(options, k, true, precision, files,
+                             state.saver.range_dels, value, stats, nullptr);
+  }
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!State::Match(&state, 0, files[i])) {
+      if (state.s.ok()) {
+        state.s = ProbeRestOfFlush(
+            files, i, stats, &state.saver,
+            [&](FileMetaData* f, Saver* saver) {
+              return vset_->table_cache_->GetS(options, f->number,
+                                               f->file_size, state.ikey, saver,
+                                               SaveValue, precision);
+            });
+        state.found = !state.s.ok() || state.saver.state == kFound;
+      }
+      break;
+    }
+  }
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
@@ -624,6 +1088,20 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
   }
 }
 
+void Version::GetFilesByLatest(std::vector<FileMetaData*>* files) const {
+  files->clear();
+  for (int level = 0; level < config::kNumLevels; level++) {
+    files->insert(files->end(), files_[level].begin(), files_[level].end());
+  }
+  std::sort(files->begin(), files->end(),
+            [](const FileMetaData* a, const FileMetaData* b) {
+              if (a->latest != b->latest) {
+                return a->latest > b->latest;
+              }
+              return a->number > b->number;  // Newer file first
+            });
+}
+
 std::string Version::DebugString() const {
   std::string r;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -650,26 +1128,76 @@ std::string Version::DebugString() const {
   return r;
 }
 
+namespace {
+
+// Helper to sort by v->files_[file_number].smallest
+struct BySmallestKey {
+  const InternalKeyComparator* internal_comparator;
+
+  bool operator()(FileMetaData* f1, FileMetaData* f2) const {
+    int r = internal_comparator->Compare(f1->smallest, f2->smallest);
+    if (r != 0) {
+      return (r < 0);
+    } else {
+      // Break ties by file number
+      return (f1->number < f2->number);
+    }
+  }
+};
+
+// Return a new FileMetaData for a file added by a VersionEdit.
+FileMetaData* NewAddedFile(const FileMetaData& meta) {
+  FileMetaData* f = new FileMetaData(meta);
+  f->refs = 1;
+
+  // We arrange to automatically compact this file after
+  // a certain number of seeks.  Let's assume:
+  //   (1) One seek costs 10ms
+  //   (2) Writing or reading 1MB costs 10ms (100MB/s)
+  //   (3) A compaction of 1MB does 25MB of IO:
+  //         1MB read from this level
+  //         10-12MB read from next level (boundaries may be misaligned)
+  //         10-12MB written to next level
+  // This implies that 25 seeks cost the same as the compaction
+  // of 1MB of data.  I.e., one seek costs approximately the
+  // same as the compaction of 40KB of data.  We are a little
+  // conservative and allow approximately one seek for every 16KB
+  // of data before triggering a compaction.
+  f->allowed_seeks = static_cast<int>((f->file_size / 16384U));
+  if (f->allowed_seeks < 100) f->allowed_seeks = 100;
+  return f;
+}
+
+// Abort if any two files of a level > 0 overlap.
+void CheckNoOverlap(const InternalKeyComparator& icmp, int level,
+                    const std::vector<FileMetaData*>& files) {
+#ifndef NDEBUG
+  if (level > 0) {
+    for (uint32_t i = 1; i < files.size(); i++) {
+      const InternalKey& prev_end = files[i - 1]->largest;
+      const InternalKey& this_begin = files[i]->smallest;
+      if (icmp.Compare(prev_end, this_begin) >= 0) {
+        std::fprintf(stderr, "overlapping ranges in same level %s vs. %s\n",
+                     prev_end.DebugString().c_str(),
+                     this_begin.DebugString().c_str());
+        std::abort();
+      }
+    }
+  }
+#else
+  (void)icmp;
+  (void)level;
+  (void)files;
+#endif
+}
+
+}  // namespace
+
 // A helper class so we can efficiently apply a whole sequence
 // of edits to a particular state without creating intermediate
 // Versions that contain full copies of the intermediate state.
 class VersionSet::Builder {
  private:
-  // Helper to sort by v->files_[file_number].smallest
-  struct BySmallestKey {
-    const InternalKeyComparator* internal_comparator;
-
-    bool operator()(FileMetaData* f1, FileMetaData* f2) const {
-      int r = internal_comparator->Compare(f1->smallest, f2->smallest);
-      if (r != 0) {
-        return (r < 0);
-      } else {
-        // Break ties by file number
-        return (f1->number < f2->number);
-      }
-    }
-  };
-
   typedef std::set<FileMetaData*, BySmallestKey> FileSet;
   struct LevelState {
     std::set<uint64_t> deleted_files;
@@ -731,25 +1259,10 @@ class VersionSet::Builder {
     // Add new files
     for (size_t i = 0; i < edit->new_files_.size(); i++) {
       const int level = edit->new_files_[i].first;
-      FileMetaData* f = new FileMetaData(edit->new_files_[i].second);
-      f->refs = 1;
-
-      // We arrange to automatically compact this file after
-      // a certain number of seeks.  Let's assume:
-      //   (1) One seek costs 10ms
-      //   (2) Writing or reading 1MB costs 10ms (100MB/s)
-      //   (3) A compaction of 1MB does 25MB of IO:
-      //         1MB read from this level
-      //         10-12MB read from next level (boundaries may be misaligned)
-      //         10-12MB written to next level
-      // This implies that 25 seeks cost the same as the compaction
-      // of 1MB of data.  I.e., one seek costs approximately the
-      // same as the compaction of 40KB of data.  We are a little
-      // conservative and allow approximately one seek for every 16KB
-      // of data before triggering a compaction.
-      f->allowed_seeks = static_cast<int>((f->file_size / 16384U));
-      if (f->allowed_seeks < 100) f->allowed_seeks = 100;
-
+      FileMetaData* f = NewAddedFile(edit->new_files_[i].second);
+      if (f->sequence_offset != 0) {
+        vset_->table_cache_->SetSequenceOffset(f->number, f->sequence_offset);
+      }
       levels_[level].deleted_files.erase(f->number);
       levels_[level].added_files->insert(f);
     }
@@ -783,21 +1296,8 @@ class VersionSet::Builder {
         MaybeAddFile(v, level, *base_iter);
       }
 
-#ifndef NDEBUG
       // Make sure there is no overlap in levels > 0
-      if (level > 0) {
-        for (uint32_t i = 1; i < v->files_[level].size(); i++) {
-          const InternalKey& prev_end = v->files_[level][i - 1]->largest;
-          const InternalKey& this_begin = v->files_[level][i]->smallest;
-          if (vset_->icmp_.Compare(prev_end, this_begin) >= 0) {
-            std::fprintf(stderr, "overlapping ranges in same level %s vs. %s\n",
-                         prev_end.DebugString().c_str(),
-                         this_begin.DebugString().c_str());
-            std::abort();
-          }
-        }
-      }
-#endif
+      CheckNoOverlap(vset_->icmp_, level, v->files_[level]);
     }
   }
 
@@ -817,6 +1317,107 @@ class VersionSet::Builder {
   }
 };
 
+// Builds the version described by a MANIFEST during recovery.  Builder
+// keeps the files added to each level in a sorted set so that edits can be
+// merged into a live version; with hundreds of thousands of level-0 files
+// that costs a tree insert per file.  Recovery always starts from an empty
+// version, so this builder appends files to a vector per level, finds them
+// again by file number when an edit deletes them, and sorts each level once
+// at the end.  A MANIFEST opens with a snapshot whose files are already in
+// order, so only the files added by later edits need sorting.
+class VersionSet::BulkBuilder {
+ public:
+  explicit BulkBuilder(VersionSet* vset) : vset_(vset) {}
+
+  BulkBuilder(const BulkBuilder&) = delete;
+  BulkBuilder& operator=(const BulkBuilder&) = delete;
+
+  ~BulkBuilder() {
+    for (int level = 0; level < config::kNumLevels; level++) {
+      for (FileMetaData* f : files_[level]) {
+        delete f;
+      }
+    }
+  }
+
+  // Apply all of the edits in *edit to the current state.
+  void Apply(const VersionEdit& edit) {
+    // Update compaction pointers
+    for (size_t i = 0; i < edit.compact_pointers_.size(); i++) {
+      const int level = edit.compact_pointers_[i].first;
+      vset_->compact_pointer_[level] =
+          edit.compact_pointers_[i].second.Encode().ToString();
+    }
+
+    // Delete files
+    for (const auto& deleted_file_set_kvp : edit.deleted_files_) {
+      Remove(deleted_file_set_kvp.first, deleted_file_set_kvp.second);
+    }
+
+    // Add new files
+    for (size_t i = 0; i < edit.new_files_.size(); i++) {
+      const int level = edit.new_files_[i].first;
+      FileMetaData* f = NewAddedFile(edit.new_files_[i].second);
+      if (f->sequence_offset != 0) {
+        vset_->table_cache_->SetSequenceOffset(f->number, f->sequence_offset);
+      }
+      Remove(level, f->number);
+      index_[f->number] = Location{level, files_[level].size()};
+      files_[level].push_back(f);
+    }
+  }
+
+  // Save the current state in *v, which must be empty.  The builder is
+  // left empty.
+  void SaveTo(Version* v) {
+    BySmallestKey cmp;
+    cmp.internal_comparator = &vset_->icmp_;
+    for (int level = 0; level < config::kNumLevels; level++) {
+      std::vector<FileMetaData*>* files = &v->files_[level];
+      assert(files->empty());
+      files->reserve(files_[level].size());
+      for (FileMetaData* f : files_[level]) {
+        if (f != nullptr) {
+          files->push_back(f);  // Takes over the builder's reference
+        }
+      }
+      files_[level].clear();
+
+      auto sorted_end = std::is_sorted_until(files->begin(), files->end(), cmp);
+      if (sorted_end != files->end()) {
+        std::sort(sorted_end, files->end(), cmp);
+        std::inplace_merge(files->begin(), sorted_end, files->end(), cmp);
+      }
+
+      // Make sure there is no overlap in levels > 0
+      CheckNoOverlap(vset_->icmp_, level, *files);
+    }
+    index_.clear();
+  }
+
+ private:
+  struct Location {
+    int level;
+    size_t index;  // Position in files_[level]
+  };
+
+  // Drop file "number" if it is currently in "level".
+  void Remove(int level, uint64_t number) {
+    auto it = index_.find(number);
+    if (it != index_.end() && it->second.level == level) {
+      FileMetaData*& f = files_[level][it->second.index];
+      delete f;
+      f = nullptr;
+      index_.erase(it);
+    }
+  }
+
+  VersionSet* vset_;
+  // Files in the order they were added; deleted files leave a nullptr.
+  std::vector<FileMetaData*> files_[config::kNumLevels];
+  std::unordered_map<uint64_t, Location> index_;
+};
+
 VersionSet::VersionSet(const std::string& dbname, const Options* options,
                        TableCache* table_cache,
                        const InternalKeyComparator* cmp)
@@ -832,12 +1433,17 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       prev_log_number_(0),
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
+      descriptor_size_(0),
       dummy_versions_(this),
-      current_(nullptr) {
+      current_(nullptr),
+      probe_pool_(options->max_parallel_l0_probes > 1
+                      ? new ThreadPool(options->max_parallel_l0_probes - 1)
+                      : nullptr) {
   AppendVersion(new Version(this));
 }
 
 VersionSet::~VersionSet() {
+  delete probe_pool_;  // Waits for abandoned probes still in flight
   current_->Unref();
   assert(dummy_versions_.next_ == &dummy_versions_);  // List must be empty
   delete descriptor_log_;
@@ -886,32 +1492,57 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
 
   // Initialize new descriptor log file if necessary by creating
   // a temporary file that contains a snapshot of the current version.
+  // Besides the first call to LogAndApply (when opening the database), this
+  // happens whenever the MANIFEST has outgrown max_manifest_file_size, so
+  // that recovery reads a snapshot instead of replaying every edit.
   std::string new_manifest_file;
-  Status s;
-  if (descriptor_log_ == nullptr) {
-    // No reason to unlock *mu here since we only hit this path in the
-    // first call to LogAndApply (when opening the database).
-    assert(descriptor_file_ == nullptr);
-    new_manifest_file = DescriptorFileName(dbname_, manifest_file_number_);
-    edit->SetNextFile(next_file_number_);
-    s = env_->NewWritableFile(new_manifest_file, &descriptor_file_);
-    if (s.ok()) {
-      descriptor_log_ = new log::Writer(descriptor_file_);
-      s = WriteSnapshot(descriptor_log_);
+  uint64_t new_manifest_number = manifest_file_number_;
+  std::vector<std::string> snapshot;
+  if (descriptor_log_ == nullptr ||
+      descriptor_size_ >= options_->max_manifest_file_size) {
+    if (descriptor_log_ != nullptr) {
+      // Keep manifest_file_number_ at the old MANIFEST, which CURRENT still
+      // names, until the new one is installed.
+      new_manifest_number = NewFileNumber();
     }
+    new_manifest_file = DescriptorFileName(dbname_, new_manifest_number);
+    edit->SetNextFile(next_file_number_);
+    EncodeSnapshot(&snapshot);
   }
 
-  // Unlock during expensive MANIFEST log write
+  WritableFile* descriptor_file = descriptor_file_;
+  log::Writer* descriptor_log = descriptor_log_;
+  uint64_t descriptor_size = descriptor_size_;
+  Status s;
+
+  // Unlock during expensive MANIFEST log write.  Calls to LogAndApply are
+  // serialized by the caller, so nothing else touches the descriptor.
   {
     mu->Unlock();
 
+    if (!new_manifest_file.empty()) {
+      descriptor_log = nullptr;
+      descriptor_size = 0;
+      s = env_->NewWritableFile(new_manifest_file, &descriptor_file);
+      if (s.ok()) {
+        descriptor_log = new log::Writer(descriptor_file);
+        for (size_t i = 0; i < snapshot.size() && s.ok(); i++) {
+          s = descriptor_log->AddRecord(snapshot[i]);
+          descriptor_size += snapshot[i].size();
+        }
+      } else {
+        descriptor_file = nullptr;
+      }
+    }
+
     // Write new record to MANIFEST log
     if (s.ok()) {
       std::string record;
       edit->EncodeTo(&record);
-      s = descriptor_log_->AddRecord(record);
+      s = descriptor_log->AddRecord(record);
+      descriptor_size += record.size();
       if (s.ok()) {
-        s = descriptor_file_->Sync();
+        s = descriptor_file->Sync();
       }
       if (!s.ok()) {
         Log(options_->info_log, "MANIFEST write: %s\n", s.ToString().c_str());
@@ -921,26 +1552,38 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     // If we just created a new descriptor file, install it by writing a
     // new CURRENT file that points to it.
     if (s.ok() && !new_manifest_file.empty()) {
-      s = SetCurrentFile(env_, dbname_, manifest_file_number_);
+      s = SetCurrentFile(env_, dbname_, new_manifest_number);
     }
 
     mu->Lock();
   }
 
+  if (!new_manifest_file.empty()) {
+    if (s.ok()) {
+      if (descriptor_log_ != nullptr) {
+        Log(options_->info_log, "Started MANIFEST #%llu\n",
+            static_cast<unsigned long long>(new_manifest_number));
+      }
+      delete descriptor_log_;
+      delete descriptor_file_;
+      descriptor_file_ = descriptor_file;
+      descriptor_log_ = descriptor_log;
+      manifest_file_number_ = new_manifest_number;
+    } else {
+      delete descriptor_log;
+      delete descriptor_file;
+      env_->RemoveFile(new_manifest_file);
+    }
+  }
+
   // Install the new version
   if (s.ok()) {
+    descriptor_size_ = descriptor_size;
     AppendVersion(v);
     log_number_ = edit->log_number_;
     prev_log_number_ = edit->prev_log_number_;
   } else {
     delete v;
-    if (!new_manifest_file.empty()) {
-      delete descriptor_log_;
-      delete descriptor_file_;
-      descriptor_log_ = nullptr;
-      descriptor_file_ = nullptr;
-      env_->RemoveFile(new_manifest_file);
-    }
   }
 
   return s;
@@ -984,7 +1627,7 @@ Status VersionSet::Recover(bool* save_manifest) {
   uint64_t last_sequence = 0;
   uint64_t log_number = 0;
   uint64_t prev_log_number = 0;
-  Builder builder(this, current_);
+  BulkBuilder builder(this);
   int read_records = 0;
 
   {
@@ -1008,7 +1651,7 @@ Status VersionSet::Recover(bool* save_manifest) {
       }
 
       if (s.ok()) {
-        builder.Apply(&edit);
+        builder.Apply(edit);
       }
 
       if (edit.has_log_number_) {
@@ -1106,6 +1749,7 @@ bool VersionSet::ReuseManifest(const std::string& dscname,
 
   Log(options_->info_log, "Reusing MANIFEST %s\n", dscname.c_str());
   descriptor_log_ = new log::Writer(descriptor_file_, manifest_size);
+  descriptor_size_ = manifest_size;
   manifest_file_number_ = manifest_number;
   return true;
 }
@@ -1154,8 +1798,10 @@ void VersionSet::Finalize(Version* v) {
   v->compaction_score_ = best_score;
 }
 
-Status VersionSet::WriteSnapshot(log::Writer* log) {
-  // TODO: Break up into multiple records to reduce memory usage on recovery?
+void VersionSet::EncodeSnapshot(std::vector<std::string>* records) {
+  // Files are spread over several records so that no single record (and
+  // the buffer recovery reads it into) grows with the number of files.
+  static const size_t kFilesPerRecord = 4096;
 
   // Save metadata
   VersionEdit edit;
@@ -1170,19 +1816,25 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     }
   }
 
-  // Save files
+  // Save files, in the order of each level
+  size_t files_in_record = 0;
   for (int level = 0; level < config::kNumLevels; level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
+      if (files_in_record == kFilesPerRecord) {
+        records->emplace_back();
+        edit.EncodeTo(&records->back());
+        edit.Clear();
+        files_in_record = 0;
+      }
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->earliest, f->latest,
-                   f->smallest, f->largest);
+      edit.AddFile(level, *f);
+      files_in_record++;
     }
   }
 
-  std::string record;
-  edit.EncodeTo(&record);
-  return log->AddRecord(record);
+  records->emplace_back();
+  edit.EncodeTo(&records->back());
 }
 
 int VersionSet::NumLevelFiles(int level) const {
@@ -1309,6 +1961,8 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
+  options.readahead_size = options_->compaction_readahead_size;
+  const bool direct_io = options_->use_direct_io_for_compaction;
 
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
@@ -1321,14 +1975,18 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
       if (c->level() + which == 0) {
         const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] =
+              direct_io ? table_cache_->NewDirectIterator(
+                              options, files[i]->number, files[i]->file_size)
+                        : table_cache_->NewIterator(options, files[i]->number,
+                                                    files[i]->file_size);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
             new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
-            &GetFileIterator, table_cache_, options);
+            direct_io ? &GetDirectFileIterator : &GetFileIterator,
+            table_cache_, options);
       }
     }
   }
@@ -1338,41 +1996,91 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
-Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+void VersionSet::GetSubcompactionBoundaries(
+    Compaction* c, int max_slices, std::vector<std::string>* boundaries) {
+  boundaries->clear();
+  if (max_slices <= 1) {
+    return;
+  }
+
+  std::vector<std::string> index_keys;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < c->inputs_[which].size(); i++) {
+      FileMetaData* f = c->inputs_[which][i];
+      // A file that cannot be read only loses its split points; the
+      // compaction itself will report the error.
+      table_cache_->GetIndexKeys(f->number, f->file_size, &index_keys);
+    }
+  }
+
+  // Slices must not split the entries of one user key, so split on
+  // distinct user keys only.
+  const Comparator* ucmp = icmp_.user_comparator();
+  std::vector<std::string> user_keys;
+  user_keys.reserve(index_keys.size());
+  for (size_t i = 0; i < index_keys.size(); i++) {
+    if (index_keys[i].size() >= kInternalKeyAttributesLen) {
+      user_keys.push_back(ExtractUserKey(index_keys[i]).ToString());
+    }
+  }
+  std::sort(user_keys.begin(), user_keys.end(),
+            [ucmp](const std::string& a, const std::string& b) {
+              return ucmp->Compare(a, b) < 0;
+            });
+
+  // Every index key ends a block, so picking evenly spaced keys gives
+  // slices with about the same number of blocks.
+  const size_t n = user_keys.size();
+  const size_t slices = std::min(static_cast<size_t>(max_slices), n);
+  for (size_t i = 1; i < slices; i++) {
+    const std::string& key = user_keys[i * n / slices];
+    if (boundaries->empty() || ucmp->Compare(boundaries->back(), key) < 0) {
+      boundaries->push_back(key);
+    }
+  }
+}
 
+Compaction* VersionSet::PickCompaction() {
   // We prefer compactions triggered by too much data in a level over
   // the compactions triggered by seeks.
   const bool size_compaction = (current_->compaction_score_ >= 1);
   const bool seek_compaction = (current_->file_to_compact_ != nullptr);
   if (size_compaction) {
-    level = current_->compaction_level_;
+    const int level = current_->compaction_level_;
     assert(level >= 0);
     assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
+    const std::vector<FileMetaData*>& files = current_->files_[level];
 
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+    // Start from the first file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space.  Skip the files
+    // whose compaction would share an input with a running compaction.
+    size_t start = 0;
+    while (start < files.size() && !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[(start + i) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = SetupCompaction(level, f);
+      if (c != nullptr) {
+        return c;
+      }
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
+  if (seek_compaction && !current_->file_to_compact_->being_compacted) {
+    return SetupCompaction(current_->file_to_compact_level_,
+                           current_->file_to_compact_);
+  }
+  return nullptr;
+}
 
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1387,8 +2095,14 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
+  const std::string compact_pointer = compact_pointer_[level];
   SetupOtherInputs(c);
-
+  if (c->InputsBeingCompacted()) {
+    // Leave the key range to the running compaction.
+    compact_pointer_[level] = compact_pointer;
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
@@ -1600,7 +2314,28 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
       edit->RemoveFile(level_ + which, inputs_[which][i]->number);
     }
+    for (size_t i = 0; i < dropped_inputs_[which].size(); i++) {
+      edit->RemoveFile(level_ + which, dropped_inputs_[which][i]->number);
+    }
+  }
+}
+
+int Compaction::DropCoveredInputs(const RangeTombstoneList& range_dels,
+                                  SequenceNumber snapshot) {
+  int dropped = 0;
+  for (int which = 0; which < 2; which++) {
+    std::vector<FileMetaData*> kept;
+    for (FileMetaData* f : inputs_[which]) {
+      if (range_dels.CoversFile(*f, snapshot)) {
+        dropped_inputs_[which].push_back(f);
+        dropped++;
+      } else {
+        kept.push_back(f);
+      }
+    }
+    inputs_[which].swap(kept);
   }
+  return dropped;
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
@@ -1624,6 +2359,73 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+Status Compaction::GetRangeTombstones(RangeTombstoneList* inputs,
+                                      const RangeTombstoneList** all) {
+  Status s = input_version_->GetRangeTombstones(all);
+  TableCache* table_cache = input_version_->vset_->table_cache_;
+  for (int which = 0; s.ok() && which < 2; which++) {
+    for (size_t i = 0; s.ok() && i < inputs_[which].size(); i++) {
+      const FileMetaData* f = inputs_[which][i];
+      if (f->has_range_tombstones) {
+        std::string contents;
+        s = table_cache->ReadMetaBlock(f->number, f->file_size,
+                                       kRangeTombstonesBlock, &contents);
+        if (s.ok()) {
+          s = inputs->DecodeFrom(contents);
+        }
+      }
+    }
+  }
+  return s;
+}
+
+bool Compaction::OtherFilesOverlapRange(const Slice& begin,
+                                        const Slice& end) const {
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  for (int lvl = 0; lvl < config::kNumLevels; lvl++) {
+    for (const FileMetaData* f : input_version_->files_[lvl]) {
+      if (user_cmp->Compare(f->largest.user_key(), begin) < 0 ||
+          user_cmp->Compare(f->smallest.user_key(), end) >= 0) {
+        continue;  // No overlap
+      }
+      if (!IsInput(lvl, f)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Compaction::OtherFilesMayHoldRegion(const RegionTombstone& t) const {
+  for (int lvl = 0; lvl < config::kNumLevels; lvl++) {
+    for (const FileMetaData* f : input_version_->files_[lvl]) {
+      if (!f->HasHilbertExtent() ||
+          (f->has_entry_stats && (f->max_valid_time < t.vt_begin ||
+                                  f->min_valid_time >= t.vt_end))) {
+        continue;  // No located entry in the deleted valid-time interval
+      }
+      if (!IsInput(lvl, f)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool Compaction::IsInput(int lvl, const FileMetaData* f) const {
+  const int which = lvl - level_;
+  if (which != 0 && which != 1) {
+    return false;
+  }
+  for (const std::vector<FileMetaData*>* inputs :
+       {&inputs_[which], &dropped_inputs_[which]}) {
+    if (std::find(inputs->begin(), inputs->end(), f) != inputs->end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
@@ -1648,6 +2450,48 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
 }
 
+Compaction* Compaction::NewSubcompaction() const {
+  Compaction* sub = new Compaction(*this);
+  sub->edit_.Clear();
+  sub->grandparent_index_ = 0;
+  sub->seen_key_ = false;
+  sub->overlapped_bytes_ = 0;
+  for (int i = 0; i < config::kNumLevels; i++) {
+    sub->level_ptrs_[i] = 0;
+  }
+  if (sub->input_version_ != nullptr) {
+    sub->input_version_->Ref();
+  }
+  return sub;
+}
+
+bool Compaction::InputsBeingCompacted() const {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+    for (size_t i = 0; i < dropped_inputs_[which].size(); i++) {
+      if (dropped_inputs_[which][i]->being_compacted) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      inputs_[which][i]->being_compacted = value;
+    }
+    for (size_t i = 0; i < dropped_inputs_[which].size(); i++) {
+      dropped_inputs_[which][i]->being_compacted = value;
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
     input_version_->Unref();
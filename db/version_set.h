@@ -15,11 +15,13 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/version_edit.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -35,6 +37,7 @@ class Iterator;
 class MemTable;
 class TableBuilder;
 class TableCache;
+class ThreadPool;
 class Version;
 class VersionSet;
 class WritableFile;
@@ -72,11 +75,23 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Versions hidden by a tombstone of "range_dels" (if non-null) are
+  // skipped.  If "sequence" is non-null, the sequence number of the value
+  // or deletion found is stored in *sequence, and zero if there is none.
   Status Get(const ReadOptions&, const LookupKey& key,
-             std::string* val, GetStats* stats);
+             std::string* val, GetStats* stats,
+             const RangeTombstoneView* range_dels = nullptr,
+             SequenceNumber* sequence = nullptr);
 
   Status GetS(const ReadOptions&, const LookupKey& key,
-             std::string* val, GetStats* stats, int precision);
+             std::string* val, GetStats* stats, int precision,
+             const RangeTombstoneView* range_dels = nullptr);
+
+  // Returns true iff a level-0 file whose key range and valid-time window
+  // cover (user_key, vt) may hold a version with a sequence number larger
+  // than "sequence".
+  bool HasNewerL0Version(Slice user_key, ValidTime vt,
+                         SequenceNumber sequence);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -114,6 +129,16 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Store in *list the range tombstones of all files of this version,
+  // reading them from the files on first use.  *list is valid as long as
+  // this version is live.
+  // REQUIRES: lock is not held
+  Status GetRangeTombstones(const RangeTombstoneList** list);
+
+  // Store in *files every file of this version, ordered by the end of
+  // their valid-time range, latest first.
+  void GetFilesByLatest(std::vector<FileMetaData*>* files) const;
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -131,7 +156,8 @@ class Version {
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        range_tombstones_(nullptr) {}
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -148,6 +174,24 @@ class Version {
   void ForEachOverlapping(Slice user_key, ValidTime vt, Slice internal_key, void* arg,
                           bool (*func)(void*, int, FileMetaData*));
 
+  // Store in *files the level-0 files whose key range and valid-time window
+  // cover (user_key, vt), ordered from newest to oldest.
+  void GetOverlappingL0Files(Slice user_key, ValidTime vt,
+                             std::vector<FileMetaData*>* files);
+
+  // Probe "files" (newest first) for key, up to
+  // options_->max_parallel_l0_probes files at a time, and return the answer
+  // from the newest file that has one.  If "spatial" is true the files are
+  // probed with TableCache::GetS() at the given precision.  Versions
+  // hidden by "range_dels" (if non-null) are skipped, and the sequence
+  // number of the answer is stored in *sequence (if non-null), as in Get().
+  Status ProbeL0InParallel(const ReadOptions& options, const LookupKey& key,
+                           bool spatial, int precision,
+                           const std::vector<FileMetaData*>& files,
+                           const RangeTombstoneView* range_dels,
+                           std::string* val, GetStats* stats,
+                           SequenceNumber* sequence);
+
   VersionSet* vset_;  // VersionSet to which this Version belongs
   Version* next_;     // Next version in linked list
   Version* prev_;     // Previous version in linked list
@@ -165,6 +209,10 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Range tombstones of all files, loaded by GetRangeTombstones().
+  port::Mutex range_tombstones_mu_;
+  std::atomic<RangeTombstoneList*> range_tombstones_;
 };
 
 class VersionSet {
@@ -230,7 +278,8 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction.  Files that are inputs of
+  // a running compaction are left out.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
@@ -251,6 +300,13 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Store in *boundaries up to max_slices-1 increasing user keys that split
+  // the input of "*c" into slices of roughly equal size, using the index
+  // block keys of the input files.  Leaves *boundaries empty if the input
+  // cannot be split.
+  void GetSubcompactionBoundaries(Compaction* c, int max_slices,
+                                  std::vector<std::string>* boundaries);
+
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
 //    Version* v = current_;
@@ -275,6 +331,7 @@ class VersionSet {
 
  private:
   class Builder;
+  class BulkBuilder;
 
   friend class Compaction;
   friend class Version;
@@ -290,10 +347,14 @@ class VersionSet {
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
+  // Return a new compaction of "f" at "level" and the files it pulls in,
+  // or nullptr if one of them is an input of a running compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
   void SetupOtherInputs(Compaction* c);
 
-  // Save current contents to *log
-  Status WriteSnapshot(log::Writer* log);
+  // Encode the current contents as a sequence of MANIFEST records.
+  void EncodeSnapshot(std::vector<std::string>* records);
 
   void AppendVersion(Version* v);
 
@@ -311,9 +372,14 @@ class VersionSet {
   // Opened lazily
   WritableFile* descriptor_file_;
   log::Writer* descriptor_log_;
+  uint64_t descriptor_size_;  // Bytes of records in the current MANIFEST
   Version dummy_versions_;  // Head of circular doubly-linked list of versions.
   Version* current_;        // == dummy_versions_.prev_
 
+  // Workers for parallel level-0 probes.  nullptr unless
+  // options_->max_parallel_l0_probes > 1.
+  ThreadPool* probe_pool_;
+
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
   std::string compact_pointer_[config::kNumLevels];
@@ -345,18 +411,52 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
-  // Add all inputs to this compaction as delete operations to *edit.
+  // Add all inputs to this compaction, dropped ones included, as delete
+  // operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Remove from the inputs the files "range_dels" covers from "snapshot"
+  // on (see RangeTombstoneList::CoversFile()), so that they are deleted
+  // without being read.  Returns the number of files dropped.
+  int DropCoveredInputs(const RangeTombstoneList& range_dels,
+                        SequenceNumber snapshot);
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Store in *inputs the range tombstones of the input files, and in *all
+  // those of every file of the input version.  *all is valid until the
+  // inputs are released.
+  // REQUIRES: lock is not held
+  Status GetRangeTombstones(RangeTombstoneList* inputs,
+                            const RangeTombstoneList** all);
+
+  // Returns true iff some file of the input version that is not an input
+  // of this compaction overlaps the user key range [begin, end).
+  bool OtherFilesOverlapRange(const Slice& begin, const Slice& end) const;
+
+  // Returns true iff some file of the input version that is not an input
+  // of this compaction may hold entries the region tombstone "t" hides.
+  bool OtherFilesMayHoldRegion(const RegionTombstone& t) const;
+
+  // Return a new compaction over the same inputs for processing one key
+  // range of this compaction on another thread.  The result keeps its own
+  // IsBaseLevelForKey()/ShouldStopBefore() progress.  Its edit() is unused.
+  Compaction* NewSubcompaction() const;
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
 
+  // Returns true iff some input file is already an input of another
+  // compaction that is still running.
+  bool InputsBeingCompacted() const;
+
+  // Mark (or unmark) every input file as an input of a running compaction.
+  void MarkInputsBeingCompacted(bool value);
+
   // Release the input version for the compaction, once the compaction
   // is successful.
   void ReleaseInputs();
@@ -375,6 +475,12 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
+  // Inputs removed by DropCoveredInputs(): deleted, but not read.
+  std::vector<FileMetaData*> dropped_inputs_[2];
+
+  // Returns true iff "f" is an input, dropped or not, of this compaction.
+  bool IsInput(int lvl, const FileMetaData* f) const;
+
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
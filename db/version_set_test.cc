@@ -0,0 +1,368 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/version_set.h"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "db/filename.h"
+#include "db/log_writer.h"
+#include "db/table_cache.h"
+#include "leveldb/env.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/table_builder.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+class VersionSetTest : public testing::Test {
+ public:
+  VersionSetTest() : env_(Env::Default()), icmp_(BytewiseComparator()) {
+    options_.env = env_;
+    env_->GetTestDirectory(&dbname_);
+    dbname_ += "/version_set_test";
+    DestroyFiles();
+    env_->CreateDir(dbname_);
+    table_cache_ = new TableCache(dbname_, options_, 10);
+  }
+
+  ~VersionSetTest() override {
+    delete table_cache_;
+    DestroyFiles();
+  }
+
+  void DestroyFiles() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    for (const std::string& f : files) {
+      env_->RemoveFile(dbname_ + "/" + f);
+    }
+    env_->RemoveDir(dbname_);
+  }
+
+  // Write the MANIFEST of an empty database, as DB::Open() does.
+  void NewDB() {
+    VersionEdit new_db;
+    new_db.SetComparatorName(icmp_.user_comparator()->Name());
+    new_db.SetLogNumber(0);
+    new_db.SetNextFile(2);
+    new_db.SetLastSequence(0);
+
+    WritableFile* file;
+    ASSERT_TRUE(
+        env_->NewWritableFile(DescriptorFileName(dbname_, 1), &file).ok());
+    {
+      log::Writer log(file);
+      std::string record;
+      new_db.EncodeTo(&record);
+      ASSERT_TRUE(log.AddRecord(record).ok());
+      ASSERT_TRUE(file->Close().ok());
+    }
+    delete file;
+    ASSERT_TRUE(SetCurrentFile(env_, dbname_, 1).ok());
+  }
+
+  // Add a level-0 file covering "key" and, if "deleted" is non-zero, drop
+  // file number "deleted" from level 0 in the same edit.  Stores the number
+  // of the new file in *number.
+  Status AddFile(VersionSet* vset, port::Mutex* mu, const std::string& key,
+                 uint64_t deleted, uint64_t* number) {
+    VersionEdit edit;
+    FileMetaData f;
+    f.number = *number = vset->NewFileNumber();
+    f.file_size = 1000;
+    f.earliest = f.number * 10;
+    f.latest = f.number * 10 + 5;
+    f.ExtendHilbert(f.number);
+    f.smallest = InternalKey(key, f.number, kTypeValue, f.earliest, 1, 2);
+    f.largest = InternalKey(key + "z", f.number, kTypeValue, f.latest, 3, 4);
+    edit.AddFile(0, f);
+    if (deleted != 0) {
+      edit.RemoveFile(0, deleted);
+    }
+    return vset->LogAndApply(&edit, mu);
+  }
+
+  // Add a level-1 file of "size" bytes holding the keys [key, key + "z"].
+  Status AddLevel1File(VersionSet* vset, port::Mutex* mu,
+                       const std::string& key, uint64_t size) {
+    VersionEdit edit;
+    FileMetaData f;
+    f.number = vset->NewFileNumber();
+    f.file_size = size;
+    f.smallest = InternalKey(key, 1, kTypeValue, 0, 1, 2);
+    f.largest = InternalKey(key + "z", 1, kTypeValue, 0, 1, 2);
+    edit.AddFile(1, f);
+    return vset->LogAndApply(&edit, mu);
+  }
+
+  // Write table "number" holding one version (sequence number, type) of
+  // each key of "entries" at valid time 100, and describe it in *f as a
+  // level-0 file covering valid times [0, 1000].
+  void WriteTable(
+      uint64_t number,
+      const std::map<std::string, std::pair<SequenceNumber, ValueType>>&
+          entries,
+      FileMetaData* f) {
+    WritableFile* file;
+    ASSERT_TRUE(
+        env_->NewWritableFile(TableFileName(dbname_, number), &file).ok());
+    Options options = options_;
+    options.comparator = &icmp_;
+    TableBuilder builder(options, file);
+    for (const auto& entry : entries) {
+      InternalKey key(entry.first, entry.second.first, entry.second.second,
+                      100, 1, 2);
+      builder.Add(key.Encode(), "v" + std::to_string(number));
+      if (entry.first == entries.begin()->first) {
+        f->smallest = key;
+      }
+      f->largest = key;
+    }
+    ASSERT_TRUE(builder.Finish().ok());
+    ASSERT_TRUE(file->Close().ok());
+    delete file;
+    f->number = number;
+    f->file_size = builder.FileSize();
+    f->earliest = 0;
+    f->latest = 1000;
+  }
+
+  int CountManifests() {
+    std::vector<std::string> files;
+    env_->GetChildren(dbname_, &files);
+    int count = 0;
+    for (const std::string& f : files) {
+      uint64_t number;
+      FileType type;
+      if (ParseFileName(f, &number, &type) && type == kDescriptorFile) {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  Env* env_;
+  Options options_;
+  InternalKeyComparator icmp_;
+  std::string dbname_;
+  TableCache* table_cache_;
+};
+
+TEST_F(VersionSetTest, RecoverAfterManifestRollover) {
+  NewDB();
+  options_.max_manifest_file_size = 4096;
+
+  std::string expected;
+  uint64_t first_manifest;
+  {
+    port::Mutex mu;
+    VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+    bool save_manifest = false;
+    ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+    MutexLock l(&mu);
+    first_manifest = vset.ManifestFileNumber();
+    uint64_t last_added = 0;
+    for (int i = 0; i < 2000; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "%08d", (i * 7919) % 2000);
+      // Every third edit also drops the file added just before it.
+      const uint64_t deleted = (i % 3 == 2) ? last_added : 0;
+      ASSERT_TRUE(AddFile(&vset, &mu, key, deleted, &last_added).ok());
+    }
+    ASSERT_LT(first_manifest, vset.ManifestFileNumber());
+    ASSERT_EQ(2000 - 2000 / 3, vset.NumLevelFiles(0));
+    expected = vset.current()->DebugString();
+  }
+
+  // Obsolete manifests are left for DBImpl::RemoveObsoleteFiles().
+  ASSERT_GT(CountManifests(), 2);
+
+  port::Mutex mu;
+  VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+  bool save_manifest = false;
+  ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+  ASSERT_EQ(expected, vset.current()->DebugString());
+}
+
+TEST_F(VersionSetTest, PickCompactionSkipsRunningInputs) {
+  NewDB();
+  port::Mutex mu;
+  VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+  bool save_manifest = false;
+  ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+  MutexLock l(&mu);
+  // Two disjoint files, together over the 10MB size limit of level 1.
+  ASSERT_TRUE(AddLevel1File(&vset, &mu, "a", 8 << 20).ok());
+  ASSERT_TRUE(AddLevel1File(&vset, &mu, "b", 8 << 20).ok());
+
+  // Two compactions run at once, on different files.
+  Compaction* first = vset.PickCompaction();
+  ASSERT_TRUE(first != nullptr);
+  ASSERT_EQ(1, first->num_input_files(0));
+  first->MarkInputsBeingCompacted(true);
+  Compaction* second = vset.PickCompaction();
+  ASSERT_TRUE(second != nullptr);
+  ASSERT_EQ(1, second->num_input_files(0));
+  ASSERT_NE(first->input(0, 0), second->input(0, 0));
+  ASSERT_FALSE(second->InputsBeingCompacted());
+  second->MarkInputsBeingCompacted(true);
+  ASSERT_TRUE(vset.PickCompaction() == nullptr);
+
+  // Once the second one is done, the next pick wraps around past the
+  // file of the first one, which is still running.
+  second->MarkInputsBeingCompacted(false);
+  Compaction* third = vset.PickCompaction();
+  ASSERT_TRUE(third != nullptr);
+  ASSERT_EQ(second->input(0, 0), third->input(0, 0));
+
+  first->MarkInputsBeingCompacted(false);
+  delete first;
+  delete second;
+  delete third;
+}
+
+TEST_F(VersionSetTest, SnapshotSpansRecords) {
+  NewDB();
+
+  // Write more files than fit in one snapshot record.
+  std::string expected;
+  {
+    port::Mutex mu;
+    VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+    bool save_manifest = false;
+    ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+    MutexLock l(&mu);
+    VersionEdit edit;
+    for (int i = 0; i < 10000; i++) {
+      char key[20];
+      std::snprintf(key, sizeof(key), "%08d", 9999 - i);
+      FileMetaData f;
+      f.number = vset.NewFileNumber();
+      f.file_size = 1000;
+      f.smallest = InternalKey(key, 1, kTypeValue, 1, 1, 2);
+      f.largest = InternalKey(key, 1, kTypeValue, 2, 3, 4);
+      edit.AddFile(0, f);
+    }
+    ASSERT_TRUE(vset.LogAndApply(&edit, &mu).ok());
+    expected = vset.current()->DebugString();
+  }
+
+  // The next open rewrites the MANIFEST as a snapshot.
+  for (int i = 0; i < 2; i++) {
+    port::Mutex mu;
+    VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+    bool save_manifest = false;
+    ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+    ASSERT_EQ(expected, vset.current()->DebugString());
+    ASSERT_EQ(10000, vset.NumLevelFiles(0));
+    MutexLock l(&mu);
+    VersionEdit edit;
+    ASSERT_TRUE(vset.LogAndApply(&edit, &mu).ok());
+  }
+}
+
+TEST_F(VersionSetTest, ParallelL0ProbesMatchSequential) {
+  NewDB();
+  // The tables hold internal keys.  table_cache_ refers to options_.
+  options_.comparator = &icmp_;
+
+  // Eight overlapping level-0 files with values and deletions.  Files 4
+  // and 5 are one flush, as are 7, 8 and 9: among them the largest
+  // sequence number wins, whichever file holds it.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 60; i++) {
+    char key[20];
+    std::snprintf(key, sizeof(key), "k%02d", i);
+    keys.push_back(key);
+  }
+  {
+    port::Mutex mu;
+    VersionSet vset(dbname_, &options_, table_cache_, &icmp_);
+    bool save_manifest = false;
+    ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+    MutexLock l(&mu);
+    Random rnd(301);
+    VersionEdit edit;
+    for (int i = 0; i < 8; i++) {
+      const uint64_t number = vset.NewFileNumber();
+      std::map<std::string, std::pair<SequenceNumber, ValueType>> entries;
+      for (int k = 0; k < 60; k++) {
+        // Every seventh key is in no file.
+        if (k % 7 != 6 && rnd.OneIn(3)) {
+          entries[keys[k]] = {number * 100 + rnd.Uniform(150),
+                              rnd.OneIn(4) ? kTypeDeletion : kTypeValue};
+        }
+      }
+      FileMetaData f;
+      WriteTable(number, entries, &f);
+      if (number == 5 || number == 8 || number == 9) {
+        f.recency = number - 1;
+        if (number == 9) f.recency = 7;
+      }
+      edit.AddFile(0, f);
+    }
+    ASSERT_TRUE(vset.LogAndApply(&edit, &mu).ok());
+  }
+
+  // Answer every lookup with each VersionSet.
+  struct Answer {
+    std::string result;
+    uint64_t seek_file;
+    uint64_t table_probes;
+  };
+  auto lookup = [&](int probes, std::vector<Answer>* answers) {
+    Options options = options_;
+    options.max_parallel_l0_probes = probes;
+    VersionSet vset(dbname_, &options, table_cache_, &icmp_);
+    bool save_manifest = false;
+    ASSERT_TRUE(vset.Recover(&save_manifest).ok());
+    for (SequenceNumber snapshot : {kMaxSequenceNumber, SequenceNumber(700)}) {
+      for (const std::string& key : keys) {
+        LookupKey lkey(key, snapshot, 500);
+        std::string value;
+        Version::GetStats stats;
+        GetPerfContext()->Reset();
+        Status s = vset.current()->Get(ReadOptions(), lkey, &value, &stats);
+        Answer answer;
+        answer.result = s.ok() ? value : s.ToString();
+        answer.seek_file = stats.seek_file ? stats.seek_file->number : 0;
+        answer.table_probes = GetPerfContext()->table_probes;
+        answers->push_back(answer);
+      }
+    }
+  };
+  std::vector<Answer> sequential, parallel;
+  lookup(1, &sequential);
+  lookup(3, &parallel);
+
+  ASSERT_EQ(sequential.size(), parallel.size());
+  int found = 0, deleted = 0, charged = 0;
+  for (size_t i = 0; i < sequential.size(); i++) {
+    ASSERT_EQ(sequential[i].result, parallel[i].result) << i;
+    ASSERT_EQ(sequential[i].seek_file, parallel[i].seek_file) << i;
+    // Probes on the pool count for the caller too.
+    ASSERT_LE(sequential[i].table_probes, parallel[i].table_probes) << i;
+    found += (sequential[i].result[0] == 'v');
+    deleted += (sequential[i].result == "NotFound: ");
+    charged += (sequential[i].seek_file != 0);
+  }
+  ASSERT_LT(0, found);
+  ASSERT_LT(0, deleted);
+  ASSERT_LT(0, charged);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -8,7 +8,9 @@
 //    data: record[count]
 // record :=
 //    kTypeValue varstring fixed64 fixed64 fixed64 varstring         |
-//    kTypeDeletion varstring fixed64 fixed64 fixed64
+//    kTypeDeletion varstring fixed64 fixed64 fixed64                  |
+//    kTypeRangeDeletion varstring varstring fixed64 fixed64         |
+//    kTypeRegionDeletion fixed64 fixed64 fixed64 fixed64 fixed64 fixed64
 // varstring :=
 //    len: varint32
 //    data: uint8[len]
@@ -33,6 +35,15 @@ WriteBatch::~WriteBatch() = default;
 
 WriteBatch::Handler::~Handler() = default;
 
+void WriteBatch::Handler::DeleteRange(const Slice& begin, const Slice& end,
+                                      ValidTime vt_begin, ValidTime vt_end) {}
+
+void WriteBatch::Handler::DeleteRegion(spatial::Linear x_min,
+                                       spatial::Linear y_min,
+                                       spatial::Linear x_max,
+                                       spatial::Linear y_max,
+                                       ValidTime vt_begin, ValidTime vt_end) {}
+
 void WriteBatch::Clear() {
   rep_.clear();
   rep_.resize(kHeader);
@@ -48,8 +59,8 @@ Status WriteBatch::Iterate(Handler* handler) const {
 
   input.remove_prefix(kHeader);
   Slice key, value;
-  ValidTime vt;
-  spatial::Linear x, y;
+  ValidTime vt, vt_end;
+  spatial::Linear x, y, x_max, y_max;
   int found = 0;
   while (!input.empty()) {
     found++;
@@ -72,6 +83,24 @@ Status WriteBatch::Iterate(Handler* handler) const {
           return Status::Corruption("bad WriteBatch Delete");
         }
         break;
+      case kTypeRangeDeletion:
+        if (GetLengthPrefixedSlice(&input, &key) &&
+            GetLengthPrefixedSlice(&input, &value) &&
+            GetFixed64(&input, &vt) && GetFixed64(&input, &vt_end)) {
+          handler->DeleteRange(key, value, vt, vt_end);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRange");
+        }
+        break;
+      case kTypeRegionDeletion:
+        if (GetFixed64(&input, &x) && GetFixed64(&input, &y) &&
+            GetFixed64(&input, &x_max) && GetFixed64(&input, &y_max) &&
+            GetFixed64(&input, &vt) && GetFixed64(&input, &vt_end)) {
+          handler->DeleteRegion(x, y, x_max, y_max, vt, vt_end);
+        } else {
+          return Status::Corruption("bad WriteBatch DeleteRegion");
+        }
+        break;
       default:
         return Status::Corruption("unknown WriteBatch tag");
     }
@@ -135,6 +164,29 @@ void WriteBatch::Delete(const Slice& key) {
   PutLengthPrefixedSlice(&rep_, key);
 }
 
+void WriteBatch::DeleteRange(const Slice& begin, const Slice& end,
+                             ValidTime vt_begin, ValidTime vt_end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRangeDeletion));
+  PutLengthPrefixedSlice(&rep_, begin);
+  PutLengthPrefixedSlice(&rep_, end);
+  PutFixed64(&rep_, vt_begin);
+  PutFixed64(&rep_, vt_end);
+}
+
+void WriteBatch::DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                              spatial::Linear x_max, spatial::Linear y_max,
+                              ValidTime vt_begin, ValidTime vt_end) {
+  WriteBatchInternal::SetCount(this, WriteBatchInternal::Count(this) + 1);
+  rep_.push_back(static_cast<char>(kTypeRegionDeletion));
+  PutFixed64(&rep_, x_min);
+  PutFixed64(&rep_, y_min);
+  PutFixed64(&rep_, x_max);
+  PutFixed64(&rep_, y_max);
+  PutFixed64(&rep_, vt_begin);
+  PutFixed64(&rep_, vt_end);
+}
+
 void WriteBatch::Append(const WriteBatch& source) {
   WriteBatchInternal::Append(this, &source);
 }
@@ -154,6 +206,19 @@ class MemTableInserter : public WriteBatch::Handler {
     mem_->Add(sequence_, kTypeDeletion, key, Slice());
     sequence_++;
   }
+  void DeleteRange(const Slice& begin, const Slice& end, ValidTime vt_begin,
+                   ValidTime vt_end) override {
+    mem_->AddRangeTombstone(sequence_, begin, end, vt_begin, vt_end);
+    sequence_++;
+  }
+  void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                    spatial::Linear x_max, spatial::Linear y_max,
+                    ValidTime vt_begin, ValidTime vt_end) override {
+    mem_->AddRegionTombstone(
+        sequence_,
+        RegionTombstone{x_min, y_min, x_max, y_max, vt_begin, vt_end, 0});
+    sequence_++;
+  }
 };
 }  // namespace
 
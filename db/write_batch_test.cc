@@ -39,6 +39,9 @@ static std::string PrintContents(WriteBatch* b) {
         state.append(")");
         count++;
         break;
+      case kTypeRangeDeletion:
+      case kTypeRegionDeletion:
+        break;  // Never in an internal key
     }
     state.append("@");
     state.append(NumberToString(ikey.sequence));
@@ -53,6 +56,35 @@ static std::string PrintContents(WriteBatch* b) {
   return state;
 }
 
+// Records the operations a batch hands to it, in order.
+class RecordingHandler : public WriteBatch::Handler {
+ public:
+  void Put(const Slice& key, ValidTime vt, spatial::Linear x,
+           spatial::Linear y, const Slice& value) override {
+    ops.append("Put(" + key.ToString() + "@" + std::to_string(vt) + ", " +
+               value.ToString() + ")");
+  }
+  void Delete(const Slice& key) override {
+    ops.append("Delete(" + key.ToString() + ")");
+  }
+  void DeleteRange(const Slice& begin, const Slice& end, ValidTime vt_begin,
+                   ValidTime vt_end) override {
+    ops.append("DeleteRange([" + begin.ToString() + ", " + end.ToString() +
+               ")@[" + std::to_string(vt_begin) + ", " +
+               std::to_string(vt_end) + "))");
+  }
+  void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                    spatial::Linear x_max, spatial::Linear y_max,
+                    ValidTime vt_begin, ValidTime vt_end) override {
+    ops.append("DeleteRegion([" + std::to_string(x_min) + ", " +
+               std::to_string(x_max) + "]x[" + std::to_string(y_min) + ", " +
+               std::to_string(y_max) + "]@[" + std::to_string(vt_begin) +
+               ", " + std::to_string(vt_end) + "))");
+  }
+
+  std::string ops;
+};
+
 TEST(WriteBatchTest, Empty) {
   WriteBatch batch;
   ASSERT_EQ("", PrintContents(&batch));
@@ -71,7 +103,48 @@ TEST(WriteBatchTest, Multiple) {
       "Put(foo@0, bar)@100",
       PrintContents(&batch));
 }
-//
+
+TEST(WriteBatchTest, Tombstones) {
+  WriteBatch batch;
+  batch.Put(Slice("car1"), 100, 1, 2, Slice("v1"));
+  batch.DeleteRange(Slice("car1"), Slice("car3"), 150, 250);
+  batch.DeleteRegion(3, 4, 5, 6, 0, kMaxValidTime);
+  ASSERT_EQ(3, WriteBatchInternal::Count(&batch));
+
+  RecordingHandler handler;
+  ASSERT_TRUE(batch.Iterate(&handler).ok());
+  ASSERT_EQ(
+      "Put(car1@100, v1)"
+      "DeleteRange([car1, car3)@[150, 250))"
+      "DeleteRegion([3, 5]x[4, 6]@[0, " +
+          std::to_string(kMaxValidTime) + "))",
+      handler.ops);
+
+  // A truncated record stops the iteration after the records before it.
+  for (int cut : {1, 30}) {
+    WriteBatch truncated;
+    truncated.DeleteRange(Slice("car1"), Slice("car3"), 150, 250);
+    truncated.DeleteRegion(3, 4, 5, 6, 0, kMaxValidTime);
+    Slice contents = WriteBatchInternal::Contents(&truncated);
+    WriteBatchInternal::SetContents(
+        &truncated, Slice(contents.data(), contents.size() - cut));
+    RecordingHandler partial;
+    Status s = truncated.Iterate(&partial);
+    ASSERT_TRUE(s.IsCorruption());
+    ASSERT_EQ("Corruption: bad WriteBatch DeleteRegion", s.ToString());
+    ASSERT_EQ("DeleteRange([car1, car3)@[150, 250))", partial.ops);
+  }
+  WriteBatch truncated;
+  truncated.DeleteRange(Slice("car1"), Slice("car3"), 150, 250);
+  Slice contents = WriteBatchInternal::Contents(&truncated);
+  WriteBatchInternal::SetContents(&truncated,
+                                  Slice(contents.data(), contents.size() - 1));
+  RecordingHandler partial;
+  ASSERT_EQ("Corruption: bad WriteBatch DeleteRange",
+            truncated.Iterate(&partial).ToString());
+  ASSERT_EQ("", partial.ops);
+}
+
 //TEST(WriteBatchTest, Corruption) {
 //  WriteBatch batch;
 //  batch.Put(Slice("foo"), Slice("bar"));
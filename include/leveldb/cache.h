@@ -19,6 +19,7 @@
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <cstdint>
+#include <string>
 
 #include "leveldb/export.h"
 #include "leveldb/slice.h"
@@ -31,6 +32,32 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but splits the cache into 2^num_shard_bits
+// independently locked shards.  More shards mean less lock contention
+// between concurrent readers, at the cost of a less exact eviction order.
+// A negative value picks the default (16 shards); values above 16 are
+// treated as 16.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits);
+
+// Like NewLRUCache(capacity, num_shard_bits), but reserves the fraction
+// "high_pri_pool_ratio" (in [0, 1]) of the capacity for entries inserted with
+// Priority::kHigh.  Low priority entries are evicted first as long as the
+// high priority entries fit in their share.  The two-argument overload uses
+// a ratio of 0.5.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                                  double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity that evicts with the CLOCK
+// (second chance) policy and is split into shards as for NewLRUCache().
+// Cache hits do not reorder any list and take their shard's lock only in
+// shared mode, so hits do not wait for one another, only for inserts and
+// evictions, which take the shard exclusively.  Hits are not lock-free:
+// each one still writes the shard's lock and hit counter and the entry's
+// reference count, so hot shards keep some cross-core traffic.  High
+// priority entries get one extra pass of the clock hand before they can be
+// evicted.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +72,10 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Eviction priority of an entry.  Caches evict kLow entries before kHigh
+  // ones where their policy allows it (see NewLRUCache()).
+  enum class Priority { kHigh, kLow };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +88,12 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but with the specified eviction priority.  The
+  // default implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority);
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -97,6 +134,14 @@ class LEVELDB_EXPORT Cache {
   // cache.
   virtual size_t TotalCharge() const = 0;
 
+  // Return the combined charge the cache holds before it evicts entries.
+  virtual size_t GetCapacity() const = 0;
+
+  // Return a human-readable table of hit, miss, lock contention and charge
+  // counters for each shard of the cache.  The default implementation
+  // returns an empty string.
+  virtual std::string GetStats() const;
+
  private:
   void LRU_Remove(Handle* e);
   void LRU_Append(Handle* e);
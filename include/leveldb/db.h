@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/format.h"
@@ -80,6 +82,26 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Erase the versions of the keys in ["begin", "end") whose valid time
+  // lies in ["vt_begin", "vt_end"), with one range tombstone instead of a
+  // deletion per version.  Versions written afterwards are not affected.
+  // Reads skip erased versions at once; compactions drop them from disk
+  // once no snapshot can see them.  Returns OK on success, and a non-OK
+  // status on error.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end, ValidTime vt_begin,
+                             ValidTime vt_end) = 0;
+
+  // Erase the versions of every key located in the grid cells
+  // ["x_min", "x_max"] x ["y_min", "y_max"] whose valid time lies in
+  // ["vt_begin", "vt_end"), like DeleteRange().  Versions without a
+  // location are not affected.  Compactions drop a whole table without
+  // reading it when every entry it holds is erased.
+  virtual Status DeleteRegion(const WriteOptions& options,
+                              spatial::Linear x_min, spatial::Linear y_min,
+                              spatial::Linear x_max, spatial::Linear y_max,
+                              ValidTime vt_begin, ValidTime vt_end) = 0;
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -101,6 +123,26 @@ class LEVELDB_EXPORT DB {
   virtual Status GetS(const ReadOptions& options, ValidTime vt, spatial::Linear x,
                       spatial::Linear y, std::string* value, int p) = 0;
 
+  // Like Get(), but does not block the caller: the lookup runs on one of
+  // the DB's read threads (see Options::async_read_threads) and
+  // "(*done)(arg, s)" is called there once *value has been filled in.
+  // "key" is copied; "*value" must stay live until "done" runs.  Without
+  // read threads the lookup and the callback run on the calling thread.
+  // All outstanding lookups complete before the DB is deleted.
+  virtual void GetAsync(const ReadOptions& options, const Slice& key,
+                        ValidTime vt, std::string* value,
+                        void (*done)(void* arg, const Status& s), void* arg);
+
+  // Look up every key in "keys" at valid time "vt" against one consistent
+  // view of the DB.  (*values)[i] and (*statuses)[i] receive what Get()
+  // would have returned for keys[i].  Lookups that miss the memtables are
+  // spread over the DB's read threads so their table reads are in flight
+  // together.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys, ValidTime vt,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -135,6 +177,13 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.latency-histograms" - returns latency histograms (in
+  //     microseconds) of Get, GetS, Write, WAL sync, memtable insert,
+  //     memtable switch, flush and compaction.
+  //  "leveldb.latency-histograms.reset" - same, and clears the histograms
+  //     so the next call covers only the time since this one.
+  //  "leveldb.block-cache-stats" - returns the hit, miss, lock contention
+  //     and charge counters of each block cache shard.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -159,6 +208,26 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Add the tables in "files", written by SstFileWriter, to level 0 of the
+  // DB in one step, without passing their entries through the log or the
+  // memtable.  Each file's spatial extent comes from the file itself.  The
+  // files act like the tables of one flushed memtable: they share a
+  // valid-time range, from the earliest ingested entry to the DB's current
+  // time, and lookups take the newest version any of them holds, so how
+  // the entries are split into files does not matter.  The ingested
+  // entries get sequence numbers above the DB's last one, in the order of
+  // their valid times: they are hidden from snapshots taken before, and
+  // writes made after order as newer.
+  //
+  // Either all files are added or none is.  Returns an InvalidArgument
+  // status for a file that was not written by SstFileWriter, or that holds
+  // versions for valid times from the start of the memtable on and whose
+  // key range holds keys in the memtable: lookups for those valid times
+  // take the memtable's version and would not see the ingested ones.
+  // History older than the memtable can be ingested for any key.
+  virtual Status IngestExternalFiles(const IngestExternalFileOptions& options,
+                                     const std::vector<std::string>& files) = 0;
 };
 
 // Destroy the contents of the specified database.
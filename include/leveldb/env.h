@@ -110,6 +110,24 @@ class LEVELDB_EXPORT Env {
   virtual Status NewAppendableFile(const std::string& fname,
                                    WritableFile** result);
 
+  // Like NewRandomAccessFile(), but reads bypass the operating system's
+  // page cache where the platform and file system allow it, so that a
+  // single pass over a large file does not evict data other readers
+  // depend on.
+  //
+  // The default implementation calls NewRandomAccessFile().
+  virtual Status NewDirectRandomAccessFile(const std::string& fname,
+                                           RandomAccessFile** result);
+
+  // Like NewWritableFile(), but writes bypass the operating system's page
+  // cache where the platform and file system allow it.  Data reaches the
+  // file in large aligned chunks; Sync() and Close() also write any
+  // buffered tail, after which the file has its exact logical size.
+  //
+  // The default implementation calls NewWritableFile().
+  virtual Status NewDirectWritableFile(const std::string& fname,
+                                       WritableFile** result);
+
   // Returns true iff the named file exists.
   virtual bool FileExists(const std::string& fname) = 0;
 
@@ -197,6 +215,29 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Priority of a background work item.  Each priority is served by its
+  // own set of threads, so kHigh work (e.g. memtable flushes) never waits
+  // behind long-running kLow work (e.g. compactions).
+  enum Priority { kLow, kHigh };
+
+  // Like Schedule(), but run "(*function)(arg)" on a thread serving "pri".
+  // Schedule(function, arg) is equivalent to kLow priority.
+  //
+  // The default implementation ignores "pri" and calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority pri);
+
+  // Allow up to "number" threads to run work scheduled at priority "pri".
+  // Threads are started lazily and never torn down, so a call with a
+  // smaller number than a previous call has no effect.  An Env is usually
+  // shared by every DB in the process (see Default()), and each priority
+  // starts with a single thread, so work scheduled by different DBs runs
+  // one item at a time unless the application calls this.  DB itself
+  // never does.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -287,6 +328,16 @@ class LEVELDB_EXPORT WritableFile {
   virtual Status Close() = 0;
   virtual Status Flush() = 0;
   virtual Status Sync() = 0;
+
+  // Make the data already passed to the operating system by Flush()
+  // durable, leaving any buffered data alone.  Unlike Sync(), this may be
+  // called by one thread while another thread is inside Append() or
+  // Flush(), which lets a log writer sync one record while the next one
+  // is being appended.
+  //
+  // The default implementation calls Sync() and is therefore only safe
+  // when no other thread is writing to the file.
+  virtual Status SyncData();
 };
 
 // An interface for writing log messages.
@@ -355,6 +406,14 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status NewAppendableFile(const std::string& f, WritableFile** r) override {
     return target_->NewAppendableFile(f, r);
   }
+  Status NewDirectRandomAccessFile(const std::string& f,
+                                   RandomAccessFile** r) override {
+    return target_->NewDirectRandomAccessFile(f, r);
+  }
+  Status NewDirectWritableFile(const std::string& f,
+                               WritableFile** r) override {
+    return target_->NewDirectWritableFile(f, r);
+  }
   bool FileExists(const std::string& f) override {
     return target_->FileExists(f);
   }
@@ -384,6 +443,12 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a, Priority pri) override {
+    return target_->ScheduleWithPriority(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
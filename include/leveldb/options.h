@@ -19,6 +19,7 @@ class Env;
 class FilterPolicy;
 class Logger;
 class Snapshot;
+class WriteBufferManager;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -83,6 +84,32 @@ struct LEVELDB_EXPORT Options {
   // the next time the database is opened.
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // If non-zero, caps the memory of the memtable being written and the one
+  // being flushed together.  Writes that would push the two past this many
+  // bytes wait until the flush finishes, instead of only once the current
+  // memtable reaches write_buffer_size.  Raised to write_buffer_size if
+  // smaller.
+  size_t max_total_memtable_bytes = 0;
+
+  // If true, each memtable takes its memory from regions of about
+  // write_buffer_size bytes mapped with mmap() and advised to use
+  // transparent huge pages, instead of from 4KB heap blocks.  Lookups in
+  // large memtables then take far fewer TLB misses.  Falls back to heap
+  // blocks where huge pages are not supported.
+  bool memtable_huge_pages = false;
+
+  // If >= 0 and memtable_huge_pages is set, memtable regions are placed on
+  // this NUMA node where the OS supports it, e.g. the node whose CPUs run
+  // the writers and readers.
+  int memtable_numa_node = -1;
+
+  // If non-null, the memtables of this DB count against the memory cap of
+  // "write_buffer_manager", which may be shared with other DBs in the same
+  // process.  While the memtables of all of them take up most of the cap,
+  // the one whose flush frees the most memory is flushed early.  The
+  // manager must outlive the DB.
+  WriteBufferManager* write_buffer_manager = nullptr;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -93,8 +120,24 @@ struct LEVELDB_EXPORT Options {
 
   // If non-null, use the specified cache for blocks.
   // If null, leveldb will automatically create and use an 8MB internal cache.
+  // A cache may be shared by several DBs, which then share its capacity.
   Cache* block_cache = nullptr;
 
+  // If non-null, keep the open tables of the DB in this cache, with a
+  // charge of 1 per table, instead of in one of its own sized after
+  // max_open_files.  DBs sharing it then share one budget of open files.
+  // Create it with NewLRUCache(number of open tables); it must outlive
+  // the DB.
+  Cache* table_cache = nullptr;
+
+  // If true, the index and filter blocks of tables are kept in block_cache
+  // at high priority (see Cache::Priority) instead of in the open tables of
+  // the table cache.  They then count against the block cache capacity, but
+  // survive a table being closed to stay within max_open_files, so reopening
+  // it does not read them again.  Worth it when the DB has many more tables
+  // than max_open_files.
+  bool cache_index_and_filter_blocks = false;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -106,6 +149,15 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // If positive, the index of a table is split into partitions of about
+  // this many bytes, with a small top-level index over the partitions.
+  // Opening a table then only reads the top-level index, and lookups read
+  // the partitions they need through block_cache, so large tables cost
+  // less to open and keep open.  Tables whose index fits in one partition
+  // are written with a single index block as usual.  Zero keeps every
+  // index in one block.
+  size_t index_partition_size = 0;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -142,6 +194,87 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // Maximum number of overlapping level-0 files that a point lookup probes
+  // concurrently.  Candidates are still ordered newest first and the newest
+  // hit wins; probes of older files are abandoned once a newer file has
+  // produced an answer.  Helps tail latency of cold lookups when many
+  // time-partitioned files overlap a key.  A value <= 1 probes files one
+  // at a time.
+  int max_parallel_l0_probes = 1;
+
+  // Maximum number of compactions that may run at the same time.  Memtable
+  // flushes run at Env::kHigh priority on their own thread and do not count
+  // against this limit.  Compactions only run concurrently when their input
+  // files do not overlap.  A value > 1 gives the DB a pool of that many
+  // threads of its own; the threads of the Env are left unchanged.
+  int max_background_compactions = 1;
+
+  // Maximum number of key ranges a single compaction is split into.  The
+  // ranges are merged in parallel, each into its own output files, and
+  // installed together.  Split points come from the index blocks of the
+  // input files.  A value <= 1 merges the whole input on one thread.
+  int max_subcompactions = 1;
+
+  // If positive, memtable flushes write one level-0 file per cell of the
+  // Hilbert grid of this order (e.g. 8 gives a 256 x 256 grid) instead of a
+  // single file, so each file covers one spatial region.  Entries without
+  // a location are written to a file of their own.  Must be at most 28, the
+  // order of key coordinates.  0 disables partitioning.
+  int spatial_partition_order = 0;
+
+  // If true, a write group hands the log over to the next group as soon as
+  // its record is appended, and syncs the log and applies its batch to the
+  // memtable while the next group appends.  Groups still become visible in
+  // sequence order.  Requires an Env whose WritableFile::SyncData() may run
+  // concurrently with Append() (true for the default Env).
+  bool enable_pipelined_write = false;
+
+  // Number of threads that run DB::GetAsync() lookups and the table reads
+  // of DB::MultiGet().  Env offers no asynchronous reads, so each lookup
+  // holds one of these threads while it blocks on its reads; lookups beyond
+  // that many wait in a queue rather than start threads of their own.  More
+  // threads keep more lookups in flight.  0 runs them on the calling thread.
+  int async_read_threads = 0;
+
+  // Number of threads DB::Open() uses to read the log files left by the
+  // previous incarnation.  Each log is split into chunks that these threads
+  // decode and checksum in parallel, while the opening thread applies the
+  // records in order; memtables that fill up are written to level 0 on one
+  // more thread as replay goes on.  0 replays each log on the opening
+  // thread alone.
+  int recovery_threads = 0;
+
+  // Once the MANIFEST grows past this many bytes, the next change to the
+  // set of files starts a new MANIFEST with a snapshot of the current
+  // files.  DB::Open() then reads one snapshot and the edits made since,
+  // rather than every edit made since the database was created, which
+  // matters when level 0 holds a very large number of files.
+  size_t max_manifest_file_size = 64 * 1024 * 1024;
+
+  // Number of threads that open table files in the background right after
+  // DB::Open(), so that the first reads after a restart find the tables in
+  // the table cache, and their index and filter blocks in block_cache if
+  // cache_index_and_filter_blocks is set.  Files whose valid-time range
+  // ends latest are opened first, and no more files are opened than the
+  // table cache has room for, so that the warm-up evicts no open table of
+  // this DB or, with a shared table_cache, of another one.  0 disables the
+  // warm-up.
+  int table_warmup_threads = 0;
+
+  // If non-zero, the warm-up only opens files whose valid-time range ends
+  // no more than this far before the end of the newest file's range.
+  ValidTime table_warmup_time_window = 0;
+
+  // If true, compactions read their input tables and write their output
+  // tables with direct I/O (see Env::NewDirectRandomAccessFile() and
+  // Env::NewDirectWritableFile()), so that merging large inputs does not
+  // push the blocks foreground reads depend on out of the page cache.
+  bool use_direct_io_for_compaction = false;
+
+  // If positive, compactions read each input table in chunks of this many
+  // bytes (see ReadOptions::readahead_size).  0 reads one block at a time.
+  size_t compaction_readahead_size = 0;
 };
 
 // Options that control read operations
@@ -162,6 +295,14 @@ struct LEVELDB_EXPORT ReadOptions {
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
 
+  // If positive, iterators read the data blocks of each table through a
+  // buffer of their own that fetches this many bytes at a time instead of
+  // one block per read.  The tables still come from the table cache, and
+  // the blocks read go into the block cache if fill_cache is set.  Useful
+  // for long sequential scans, especially on storage where small reads are
+  // expensive.
+  size_t readahead_size = 0;
+
   // 
   const ValidTime validtime = kMaxValidTime;
 };
@@ -187,6 +328,15 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFiles()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the files are renamed into the DB directory, which must then
+  // be on the same file system, instead of copied.
+  bool move_files = false;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
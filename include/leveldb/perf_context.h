@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// PerfContext is a set of per-thread counters describing the work done by
+// the reads issued from the calling thread.  A typical use is:
+//
+//   leveldb::GetPerfContext()->Reset();
+//   db->GetS(options, key, vt, x, y, &value, precision);
+//   fprintf(stderr, "%s\n", leveldb::GetPerfContext()->ToString().c_str());
+//
+// Counters accumulate until Reset() is called.  The table reads of parallel
+// level-0 probes (see Options::max_parallel_l0_probes) are added to the
+// caller's context, except those of older files still in flight when the
+// lookup returns.  Other work that the database hands to helper threads
+// (e.g. the reads behind GetAsync/MultiGet) is recorded in the context of
+// the helper thread, not the caller's.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT PerfContext {
+  PerfContext() { Reset(); }
+
+  // Set every counter to zero.
+  void Reset();
+
+  // Add every counter of "other" to the counter of *this.
+  void Add(const PerfContext& other);
+
+  // Return a human-readable "name = value" listing of the non-zero counters.
+  std::string ToString() const;
+
+  // Number of level-0 files whose key and valid-time range covered a lookup.
+  uint64_t l0_files_considered;
+
+  // Number of table files probed by point and spatial lookups.
+  uint64_t table_probes;
+
+  // Number of tables that were not in the table cache and had to be opened,
+  // and the total time spent opening them.
+  uint64_t table_opens;
+  uint64_t table_open_micros;
+
+  // Number of data blocks served from the block cache.
+  uint64_t block_cache_hits;
+
+  // Number of data blocks read from a file, their total size and the total
+  // time spent reading them.
+  uint64_t block_reads;
+  uint64_t block_read_bytes;
+  uint64_t block_read_micros;
+
+  // Number of filter block checks, and how many of them ruled out a block.
+  uint64_t filter_checks;
+  uint64_t filter_negatives;
+};
+
+// Return the PerfContext of the calling thread.  The result is never null
+// and stays valid for the lifetime of the thread.
+LEVELDB_EXPORT PerfContext* GetPerfContext();
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -0,0 +1,83 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any DB, for example from an
+// archive of historical observations, that DB::IngestExternalFiles() then
+// adds to a DB without passing its entries through the log, the memtable
+// and the carry-over of memtable switches.
+//
+//   SstFileWriter writer(options);
+//   Status s = writer.Open("/tmp/history-000001.ldb");
+//   for (...) s = writer.Put(key, vt, x, y, value);  // In order, see Put()
+//   s = writer.Finish();
+//   s = db->IngestExternalFiles(IngestExternalFileOptions(),
+//                               {"/tmp/history-000001.ldb"});
+//
+// An SstFileWriter is not thread-safe; build separate files from separate
+// threads with separate writers.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/format.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // "options" must have the comparator, filter_policy and block format
+  // settings of the DB the file will be ingested into.
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Removes the file if it was opened but not finished.
+  ~SstFileWriter();
+
+  // Start a new file named "fname".
+  // REQUIRES: No file is open, i.e. Open() was never called or the
+  // previous file was finished.
+  Status Open(const std::string& fname);
+
+  // Add an entry for "key" valid from "vt" at location (x, y); pass
+  // spatial::kOmitCoordinate for both coordinates if it has none.
+  //
+  // Keys must be added in increasing order, and the versions of a key in
+  // decreasing order of valid time.  Each entry is stored with its valid
+  // time as its sequence number, which orders the versions of a key the
+  // way the DB does, so "vt" must be at most kMaxSequenceNumber (2^56 - 1).
+  // DB::IngestExternalFiles() shifts these above the DB's sequence numbers.
+  // Returns an InvalidArgument status if an entry breaks these rules; the
+  // file can still be finished with the entries added before it.
+  Status Put(const Slice& key, ValidTime vt, uint64_t x, uint64_t y,
+             const Slice& value);
+
+  // Write out the rest of the file, including the key range, valid-time
+  // range and spatial extent that DB::IngestExternalFiles() reads, and
+  // sync and close it.  A file without entries is removed and an
+  // InvalidArgument status returned.
+  Status Finish();
+
+  // Number of entries added to the current file.
+  uint64_t NumEntries() const;
+
+  // Size of the file written so far, or of the finished file.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+  Rep* const rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
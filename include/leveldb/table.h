@@ -6,7 +6,10 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -14,6 +17,7 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+class FilterBlockReader;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -40,6 +44,21 @@ class LEVELDB_EXPORT Table {
   static Status Open(const Options& options, RandomAccessFile* file,
                      uint64_t file_size, Table** table);
 
+  // Maximum length of the "cache_key_prefix" passed to Open().
+  static constexpr size_t kMaxCacheKeyPrefixLength = 16;
+
+  // Like Open(), but the blocks of the table are stored in
+  // options.block_cache under keys that start with "cache_key_prefix"
+  // instead of a prefix allocated by the cache.  A prefix that stays the
+  // same when the same file is opened again lets the new Table find the
+  // blocks, including the index and filter blocks if
+  // options.cache_index_and_filter_blocks is set, that an earlier Table of
+  // the file left in the cache.  The prefix must identify the file among
+  // all users of the cache.  An empty prefix behaves like Open() above.
+  static Status Open(const Options& options, RandomAccessFile* file,
+                     uint64_t file_size, const Slice& cache_key_prefix,
+                     Table** table);
+
   Table(const Table&) = delete;
   Table& operator=(const Table&) = delete;
 
@@ -50,6 +69,12 @@ class LEVELDB_EXPORT Table {
   // call one of the Seek methods on the iterator before using it).
   Iterator* NewIterator(const ReadOptions&) const;
 
+  // Like NewIterator(), but read the data blocks from "file" instead of
+  // the file the table was opened on.  "file" must have the same contents,
+  // e.g. be the same file opened another way or read through a buffer of
+  // its own, and must remain live while the iterator is in use.
+  Iterator* NewIterator(const ReadOptions&, RandomAccessFile* file) const;
+
   // Given a key, return an approximate byte offset in the file where
   // the data for that key begins (or would begin if the key were
   // present in the file).  The returned value is in terms of file
@@ -58,11 +83,23 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Store in *contents the meta block named "name" (see
+  // TableBuilder::AddMetaBlock()).  Returns a NotFound status if the table
+  // has no such block.
+  Status ReadMetaBlock(const Slice& name, std::string* contents) const;
+
  private:
   friend class TableCache;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* FileBlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+  Iterator* NewBlockIterator(const ReadOptions& options,
+                             const Slice& handle_value,
+                             Cache::Priority priority,
+                             RandomAccessFile* file) const;
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
@@ -77,6 +114,32 @@ class LEVELDB_EXPORT Table {
                                            const Slice& v),
                       int precision);
 
+  // Append to *keys the index entry key of every data block, in order.
+  // Each key is >= every key in its block and < every key in the next
+  // block, so the keys split the table into ranges of about a block each.
+  void GetIndexKeys(std::vector<std::string>* keys) const;
+
+  // Returns an iterator over the index entries of the data blocks.  The
+  // index block is fetched from the block cache if
+  // options.cache_index_and_filter_blocks is set, and the partitions of a
+  // partitioned index always are.
+  Iterator* NewIndexIterator(const ReadOptions& options) const;
+  // Returns an iterator over the index block alone.
+  Iterator* NewTopLevelIndexIterator(const ReadOptions& options) const;
+
+  // Returns the filter of the table, or nullptr if it has none.  Sets
+  // *cache_handle to the block cache handle that pins the filter, or to
+  // nullptr if the table owns it; either way the caller must pass it to
+  // ReleaseFilter() once done with the filter.
+  FilterBlockReader* GetFilter(const ReadOptions& options,
+                               Cache::Handle** cache_handle) const;
+  void ReleaseFilter(Cache::Handle* cache_handle) const;
+
+  // Load the index and filter blocks into the block cache if
+  // options.cache_index_and_filter_blocks is set.  Otherwise the table
+  // read them when it was opened and this does nothing.
+  void WarmMetaBlocks() const;
+
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
 
@@ -51,6 +51,12 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Store "contents" in a meta block of the table named "name", which
+  // Table::ReadMetaBlock() returns.  The name must not be used by the table
+  // format itself, i.e. must not start with "filter." or "index.".
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddMetaBlock(const Slice& name, const Slice& contents);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -82,7 +88,9 @@ class LEVELDB_EXPORT TableBuilder {
  private:
   [[nodiscard]] bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);
+  void CompressAndWriteBlock(const Slice& raw, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);
+  void FinishIndexPartition();
 
   struct Rep;
   Rep* rep_;
@@ -42,6 +42,13 @@ class LEVELDB_EXPORT WriteBatch {
                      spatial::Linear x, spatial::Linear y,
                      const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // Called for DeleteRange() records.  Does nothing by default.
+    virtual void DeleteRange(const Slice& begin, const Slice& end,
+                             ValidTime vt_begin, ValidTime vt_end);
+    // Called for DeleteRegion() records.  Does nothing by default.
+    virtual void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                              spatial::Linear x_max, spatial::Linear y_max,
+                              ValidTime vt_begin, ValidTime vt_end);
   };
 
   WriteBatch();
@@ -61,6 +68,21 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase the versions of the keys in ["begin", "end") whose valid time
+  // lies in ["vt_begin", "vt_end") and that were written before this call,
+  // including those added earlier to this batch.  Versions written later
+  // are kept.
+  void DeleteRange(const Slice& begin, const Slice& end, ValidTime vt_begin,
+                   ValidTime vt_end);
+
+  // Erase the versions of every key located in the grid cells
+  // ["x_min", "x_max"] x ["y_min", "y_max"] whose valid time lies in
+  // ["vt_begin", "vt_end") and that were written before this call.
+  // Versions without a location are kept.
+  void DeleteRegion(spatial::Linear x_min, spatial::Linear y_min,
+                    spatial::Linear x_max, spatial::Linear y_max,
+                    ValidTime vt_begin, ValidTime vt_end);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -0,0 +1,75 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A WriteBufferManager caps the memory of the memtables of every DB opened
+// with it (see Options::write_buffer_manager), e.g. the shards of a data
+// set that a process keeps in separate DBs.  Each DB still switches to a
+// new memtable once its own reaches write_buffer_size; in addition,
+// whenever the memtables of all the DBs together approach the cap, the DB
+// whose memtable would free the most memory is asked to flush it, on a
+// thread owned by the manager.
+//
+// A WriteBufferManager is thread-safe.  It must outlive every DB that uses
+// it.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+#define STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
+
+#include <cstddef>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT WriteBufferManager {
+ public:
+  WriteBufferManager() = default;
+
+  WriteBufferManager(const WriteBufferManager&) = delete;
+  WriteBufferManager& operator=(const WriteBufferManager&) = delete;
+
+  // REQUIRES: No DB uses the manager any more.
+  virtual ~WriteBufferManager();
+
+  // Return the cap on the memtable memory of all DBs using the manager.
+  virtual size_t buffer_size() const = 0;
+
+  // Return the memtable memory of all DBs using the manager.
+  virtual size_t memory_usage() const = 0;
+
+  // The rest of the interface is used by the DB implementation.
+
+  // Handle for one DB using the manager.
+  struct Member;
+
+  // Memtable memory of one DB.
+  struct Usage {
+    size_t mutable_bytes = 0;    // Memtable being written
+    size_t immutable_bytes = 0;  // Memtables being flushed
+    // Part of mutable_bytes that flushing the memtable would free, i.e.
+    // the memory not taken by entries carried over into the next memtable.
+    size_t flushable_bytes = 0;
+  };
+
+  // Start accounting for a DB.  When its memtable should be flushed,
+  // "(*flush)(arg)" is called on a thread of the manager.
+  virtual Member* Register(void (*flush)(void* arg), void* arg) = 0;
+
+  // Stop accounting for "member", after waiting for any flush requested of
+  // it to return.
+  virtual void Unregister(Member* member) = 0;
+
+  // Record the memtable memory of "member".  May ask one of the DBs to
+  // flush.  Must not be called from the flush callback of another member
+  // while holding a lock that the other member's flush needs.
+  virtual void ReportUsage(Member* member, const Usage& usage) = 0;
+};
+
+// Create a manager that keeps the memtables of the DBs using it at about
+// "buffer_size" bytes in total.
+LEVELDB_EXPORT WriteBufferManager* NewWriteBufferManager(size_t buffer_size);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_WRITE_BUFFER_MANAGER_H_
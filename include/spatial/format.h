@@ -27,6 +27,10 @@ struct Coordinate {
 // TODO: use explicit tags
 static const Linear kOmitCoordinate = std::numeric_limits<uint64_t>::max();
 
+// Order of the Hilbert grid that the (x, y) attributes of keys live on.
+// Indices on this grid are 2 * kKeyOrder bits wide.
+static const Order kKeyOrder = 28;
+
 }  // namespace spatial
 
 #endif  // STORAGE_LEVELDB_INCLUDE_SPATIAL_FORMAT_H_
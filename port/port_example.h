@@ -30,6 +30,10 @@ class LOCKABLE Mutex {
   // Will deadlock if the mutex is already locked by this thread.
   void Lock() EXCLUSIVE_LOCK_FUNCTION();
 
+  // Lock the mutex if no other thread holds it, without waiting.
+  // Returns true iff the mutex is now held by this thread.
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true);
+
   // Unlock the mutex.
   // REQUIRES: This mutex was locked by this thread.
   void Unlock() UNLOCK_FUNCTION();
@@ -88,6 +92,15 @@ bool Snappy_Uncompress(const char* input_data, size_t input_length,
 // The concatenation of all "data[0,n-1]" fragments is the heap profile.
 bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg);
 
+// Map "size" bytes of zeroed memory that the OS is asked to back with huge
+// pages, placed on NUMA node "numa_node" if it is >= 0 and the OS supports
+// it.  Returns nullptr if such mappings are not supported or fail.
+// REQUIRES: size is a multiple of 2MB
+char* MapHugePages(size_t size, int numa_node);
+
+// Release a region returned by MapHugePages(size, ...).
+void UnmapHugePages(char* region, size_t size);
+
 // Extend the CRC to include the first n bytes of buf.
 //
 // Returns zero if the CRC cannot be extended using acceleration, else returns
@@ -28,6 +28,11 @@
 #if HAVE_SNAPPY
 #include <snappy.h>
 #endif  // HAVE_SNAPPY
+#if HAVE_MADV_HUGEPAGE
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // HAVE_MADV_HUGEPAGE
 
 #include <cassert>
 #include <condition_variable>  // NOLINT
@@ -53,6 +58,7 @@ class LOCKABLE Mutex {
   Mutex& operator=(const Mutex&) = delete;
 
   void Lock() EXCLUSIVE_LOCK_FUNCTION() { mu_.lock(); }
+  bool TryLock() EXCLUSIVE_TRYLOCK_FUNCTION(true) { return mu_.try_lock(); }
   void Unlock() UNLOCK_FUNCTION() { mu_.unlock(); }
   void AssertHeld() ASSERT_EXCLUSIVE_LOCK() {}
 
@@ -133,6 +139,58 @@ inline bool GetHeapProfile(void (*func)(void*, const char*, int), void* arg) {
   return false;
 }
 
+inline char* MapHugePages(size_t size, int numa_node) {
+#if HAVE_MADV_HUGEPAGE
+  // Map 2MB more than asked for, so that the region can start on a 2MB
+  // boundary, where the kernel can back it with huge pages.
+  static constexpr size_t kHugePageSize = 2 << 20;
+  const size_t mapped_size = size + kHugePageSize;
+  void* mapped = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  char* const start = reinterpret_cast<char*>(mapped);
+  char* const region = reinterpret_cast<char*>(
+      (reinterpret_cast<uintptr_t>(start) + kHugePageSize - 1) &
+      ~(kHugePageSize - 1));
+  if (region > start) {
+    ::munmap(start, region - start);
+  }
+  char* const end = start + mapped_size;
+  if (region + size < end) {
+    ::munmap(region + size, end - (region + size));
+  }
+
+  // Both requests are advice: the region works without them.
+  ::madvise(region, size, MADV_HUGEPAGE);
+#if defined(SYS_mbind)
+  if (numa_node >= 0 && numa_node < 64) {
+    const unsigned long nodemask = 1ul << numa_node;
+    static constexpr int kMemoryPolicyPreferred = 1;  // MPOL_PREFERRED
+    ::syscall(SYS_mbind, region, size, kMemoryPolicyPreferred, &nodemask,
+              sizeof(nodemask) * 8, 0);
+  }
+#endif  // defined(SYS_mbind)
+  return region;
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)size;
+  (void)numa_node;
+  return nullptr;
+#endif  // HAVE_MADV_HUGEPAGE
+}
+
+inline void UnmapHugePages(char* region, size_t size) {
+#if HAVE_MADV_HUGEPAGE
+  ::munmap(region, size);
+#else
+  // Silence compiler warnings about unused arguments.
+  (void)region;
+  (void)size;
+#endif  // HAVE_MADV_HUGEPAGE
+}
+
 inline uint32_t AcceleratedCRC32C(uint32_t crc, const char* buf, size_t size) {
 #if HAVE_CRC32C
   return ::crc32c::Extend(crc, reinterpret_cast<const uint8_t*>(buf), size);
@@ -129,6 +129,36 @@ bool Hilbert::Rotate(Order l, bool rx, bool ry, Order &x, Order &y) {
   return true;
 }
 
+bool Hilbert::RangeWithin(Linear t_min, Linear t_max, Linear lat_min,
+                          Linear lon_min, Linear lat_max,
+                          Linear lon_max) const {
+  assert(t_min <= t_max && t_max < (1ull << 2 * n_));
+  // Split [t_min, t_max] into aligned runs of 4^k indices; each one fills
+  // an aligned square of 2^k x 2^k cells.
+  Linear t = t_min;
+  while (true) {
+    Order k = 0;
+    while (k < n_ && (t & ((1ull << 2 * (k + 1)) - 1)) == 0 &&
+           t_max - t >= (1ull << 2 * (k + 1)) - 1) {
+      k++;
+    }
+    Linear x, y;
+    Map(t, &x, &y);
+    const Linear side = 1ull << k;
+    x &= ~(side - 1);
+    y &= ~(side - 1);
+    if (x < lat_min || x + side - 1 > lat_max || y < lon_min ||
+        y + side - 1 > lon_max) {
+      return false;
+    }
+    const Linear run = 1ull << 2 * k;
+    if (t_max - t < run) {
+      return true;
+    }
+    t += run;
+  }
+}
+
 bool Hilbert::Rectangle(const Coordinate &top_left,
                         const Coordinate &bottom_right,
                         std::vector<Linear> *cells) const {
@@ -89,6 +89,12 @@ class Hilbert : public SpaceCurve {
   bool Rectangle(const Coordinate &top_left, const Coordinate &bottom_right,
                  std::vector<Linear> *cells) const override;
 
+  // Returns true iff every cell with an index in [t_min, t_max] lies in
+  // the rectangle of cells [lat_min, lat_max] x [lon_min, lon_max].
+  // REQUIRES: t_min <= t_max < (1 << 2 * n_)
+  bool RangeWithin(Linear t_min, Linear t_max, Linear lat_min,
+                   Linear lon_min, Linear lat_max, Linear lon_max) const;
+
   // Helper function for Mapping(Inverse) to/from Hilbert Curve
   // Input l is the length of a side of the square.
   // l must be a power of 2.
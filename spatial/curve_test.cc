@@ -6,6 +6,7 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <string>
 
 namespace spatial {
@@ -106,6 +107,40 @@ TEST(SpaceCurveTest, HilbertDecode) {
   ASSERT_EQ(x, 8);
 }
 
+TEST(SpaceCurveTest, HilbertRangeWithin) {
+  Hilbert hilbert(4);
+  // Indices 0..3 fill the cells [0, 1] x [0, 1].
+  ASSERT_TRUE(hilbert.RangeWithin(0, 3, 0, 0, 1, 1));
+  ASSERT_FALSE(hilbert.RangeWithin(0, 4, 0, 0, 1, 1));
+  ASSERT_TRUE(hilbert.RangeWithin(0, 255, 0, 0, 15, 15));
+  ASSERT_FALSE(hilbert.RangeWithin(0, 255, 0, 0, 15, 14));
+
+  // Compare with a cell-by-cell check.
+  for (Linear t_min = 0; t_min < 256; t_min += 7) {
+    for (Linear t_max = t_min; t_max < 256; t_max += 5) {
+      Linear lat_min = 15, lon_min = 15, lat_max = 0, lon_max = 0;
+      for (Linear t = t_min; t <= t_max; t++) {
+        Linear x, y;
+        ASSERT_TRUE(hilbert.Map(t, &x, &y));
+        lat_min = std::min(lat_min, x);
+        lat_max = std::max(lat_max, x);
+        lon_min = std::min(lon_min, y);
+        lon_max = std::max(lon_max, y);
+      }
+      ASSERT_TRUE(hilbert.RangeWithin(t_min, t_max, lat_min, lon_min,
+                                      lat_max, lon_max));
+      if (lat_min < lat_max) {
+        ASSERT_FALSE(hilbert.RangeWithin(t_min, t_max, lat_min + 1, lon_min,
+                                         lat_max, lon_max));
+      }
+      if (lon_min < lon_max) {
+        ASSERT_FALSE(hilbert.RangeWithin(t_min, t_max, lat_min, lon_min,
+                                         lat_max, lon_max - 1));
+      }
+    }
+  }
+}
+
 TEST(SpaceCurveTest, GeohashEncode) {
   Geohash geohash(15);
   Linear t_int;
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/perf_context.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -88,15 +89,22 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  PerfContext* perf = GetPerfContext();
+  perf->filter_checks++;
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
     uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
     if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
       Slice filter = Slice(data_ + start, limit - start);
-      return policy_->KeyMayMatch(key, filter);
+      if (!policy_->KeyMayMatch(key, filter)) {
+        perf->filter_negatives++;
+        return false;
+      }
+      return true;
     } else if (start == limit) {
       // Empty filters do not match any keys
+      perf->filter_negatives++;
       return false;
     }
   }
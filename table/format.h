@@ -62,12 +62,19 @@ class Footer {
   const BlockHandle& index_handle() const { return index_handle_; }
   void set_index_handle(const BlockHandle& h) { index_handle_ = h; }
 
+  // Whether the index block is a top-level index over index partitions
+  // (see Options::index_partition_size).  Recorded in the magic number, so
+  // that opening a table need not read its metaindex to find out.
+  bool partitioned_index() const { return partitioned_index_; }
+  void set_partitioned_index(bool p) { partitioned_index_ = p; }
+
   void EncodeTo(std::string* dst) const;
   Status DecodeFrom(Slice* input);
 
  private:
   BlockHandle metaindex_handle_;
   BlockHandle index_handle_;
+  bool partitioned_index_ = false;
 };
 
 // kTableMagicNumber was picked by running
@@ -75,6 +82,10 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Magic number of tables whose index block is partitioned: the low bit of
+// kTableMagicNumber flipped.
+static const uint64_t kPartitionedTableMagicNumber = kTableMagicNumber ^ 1;
+
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
@@ -4,11 +4,14 @@
 
 #include "leveldb/table.h"
 
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/perf_context.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -27,17 +30,56 @@ struct Table::Rep {
   Options options;
   Status status;
   RandomAccessFile* file;
-  uint64_t cache_id;
+  std::string cache_key_prefix;  // Block cache keys are prefix + offset
   FilterBlockReader* filter;
   const char* filter_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+
+  // If true, the index and filter blocks are not held above but looked up
+  // in options.block_cache (see Options::cache_index_and_filter_blocks).
+  bool cache_meta_blocks;
+  BlockHandle index_handle;
+  bool has_filter;
+  BlockHandle filter_handle;
+
+  // If true, index_block is a top-level index over index partitions.
+  bool partitioned_index;
+};
+
+// A filter block kept in the block cache.
+struct CachedFilter {
+  CachedFilter(const FilterPolicy* policy, const Slice& contents)
+      : reader(policy, contents), data(contents.data()) {}
+  ~CachedFilter() { delete[] data; }
+
+  FilterBlockReader reader;
+  const char* data;  // Heap-allocated contents that "reader" refers to
 };
 
+// Blocks that are read straight out of a memory-mapped file point into the
+// mapping, which goes away with the file.  Copy them to the heap so that
+// they can outlive the table in the block cache.
+static void MakeHeapAllocated(BlockContents* contents) {
+  if (!contents->heap_allocated) {
+    char* buf = new char[contents->data.size()];
+    std::memcpy(buf, contents->data.data(), contents->data.size());
+    contents->data = Slice(buf, contents->data.size());
+    contents->heap_allocated = true;
+  }
+}
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
+  return Open(options, file, size, Slice(), table);
+}
+
+Status Table::Open(const Options& options, RandomAccessFile* file,
+                   uint64_t size, const Slice& cache_key_prefix,
+                   Table** table) {
   *table = nullptr;
+  assert(cache_key_prefix.size() <= kMaxCacheKeyPrefixLength);
   if (size < Footer::kEncodedLength) {
     return Status::Corruption("file is too short to be an sstable");
   }
@@ -52,28 +94,51 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
 
-  // Read the index block
-  BlockContents index_block_contents;
-  ReadOptions opt;
-  if (options.paranoid_checks) {
-    opt.verify_checksums = true;
+  Rep* rep = new Table::Rep;
+  rep->options = options;
+  rep->file = file;
+  rep->metaindex_handle = footer.metaindex_handle();
+  rep->index_block = nullptr;
+  if (!cache_key_prefix.empty()) {
+    rep->cache_key_prefix = cache_key_prefix.ToString();
+  } else if (options.block_cache != nullptr) {
+    char buf[8];
+    EncodeFixed64(buf, options.block_cache->NewId());
+    rep->cache_key_prefix.assign(buf, sizeof(buf));
+  }
+  rep->filter_data = nullptr;
+  rep->filter = nullptr;
+  rep->cache_meta_blocks =
+      options.cache_index_and_filter_blocks && options.block_cache != nullptr;
+  rep->index_handle = footer.index_handle();
+  rep->has_filter = false;
+  rep->partitioned_index = footer.partitioned_index();
+  *table = new Table(rep);
+
+  // Read the index block, or make sure that it is in the block cache.
+  if (rep->cache_meta_blocks) {
+    Iterator* index_iter = (*table)->NewTopLevelIndexIterator(ReadOptions());
+    s = index_iter->status();
+    delete index_iter;
+  } else {
+    BlockContents index_block_contents;
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
+    if (s.ok()) {
+      rep->index_block = new Block(index_block_contents);
+    }
   }
-  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
 
   if (s.ok()) {
     // We've successfully read the footer and the index block: we're
     // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
-    Rep* rep = new Table::Rep;
-    rep->options = options;
-    rep->file = file;
-    rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
-    rep->filter = nullptr;
-    *table = new Table(rep);
     (*table)->ReadMeta(footer);
+  } else {
+    delete *table;
+    *table = nullptr;
   }
 
   return s;
@@ -121,6 +186,12 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
+  if (rep_->cache_meta_blocks) {
+    // Read on demand by GetFilter().
+    rep_->has_filter = true;
+    rep_->filter_handle = filter_handle;
+    return;
+  }
   BlockContents block;
   if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
     return;
@@ -142,18 +213,83 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedFilter*>(value);
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+// Store in "buf" the block cache key of the block at "offset" in the table.
+static Slice BlockCacheKey(const std::string& prefix, uint64_t offset,
+                           char* buf) {
+  std::memcpy(buf, prefix.data(), prefix.size());
+  EncodeFixed64(buf + prefix.size(), offset);
+  return Slice(buf, prefix.size() + 8);
+}
+
+// ReadBlock() that also charges the read to the calling thread's PerfContext.
+static Status ReadDataBlock(Env* env, RandomAccessFile* file,
+                            const ReadOptions& options,
+                            const BlockHandle& handle, BlockContents* result) {
+  PerfContext* perf = GetPerfContext();
+  const uint64_t start_micros = env->NowMicros();
+  Status s = ReadBlock(file, options, handle, result);
+  perf->block_reads++;
+  perf->block_read_bytes += handle.size();
+  perf->block_read_micros += env->NowMicros() - start_micros;
+  return s;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->NewBlockIterator(options, index_value, Cache::Priority::kLow,
+                                 table->rep_->file);
+}
+
+namespace {
+
+// The table and the file that an iterator created by
+// Table::NewIterator(options, file) reads data blocks from.
+struct BlockSource {
+  const Table* table;
+  RandomAccessFile* file;
+};
+
+void DeleteBlockSource(void* arg, void* ignored) {
+  delete reinterpret_cast<BlockSource*>(arg);
+}
+
+}  // namespace
+
+// Like BlockReader(), but "arg" is a BlockSource.
+Iterator* Table::FileBlockReader(void* arg, const ReadOptions& options,
+                                 const Slice& index_value) {
+  BlockSource* source = reinterpret_cast<BlockSource*>(arg);
+  return source->table->NewBlockIterator(options, index_value,
+                                         Cache::Priority::kLow, source->file);
+}
+
+// Convert a top-level index value into an iterator over the corresponding
+// index partition.
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return table->NewBlockIterator(options, index_value, Cache::Priority::kHigh,
+                                 table->rep_->file);
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const Slice& index_value,
+                                  Cache::Priority priority,
+                                  RandomAccessFile* file) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -166,25 +302,25 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   if (s.ok()) {
     BlockContents contents;
     if (block_cache != nullptr) {
-      char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-      EncodeFixed64(cache_key_buffer + 8, handle.offset());
-      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      char cache_key_buffer[kMaxCacheKeyPrefixLength + 8];
+      Slice key = BlockCacheKey(rep_->cache_key_prefix, handle.offset(),
+                                cache_key_buffer);
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        GetPerfContext()->block_cache_hits++;
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadDataBlock(rep_->options.env, file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+                                               &DeleteCachedBlock, priority);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadDataBlock(rep_->options.env, file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -193,7 +329,7 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(rep_->options.comparator);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -205,21 +341,137 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter = NewTopLevelIndexIterator(options);
+  if (!rep_->partitioned_index) {
+    return iter;
+  }
+  return NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                             const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewTopLevelIndexIterator(const ReadOptions& options) const {
+  if (!rep_->cache_meta_blocks) {
+    return rep_->index_block->NewIterator(rep_->options.comparator);
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[kMaxCacheKeyPrefixLength + 8];
+  Slice key = BlockCacheKey(rep_->cache_key_prefix, rep_->index_handle.offset(),
+                            cache_key_buffer);
+  Cache::Handle* cache_handle = block_cache->Lookup(key);
+  Block* block;
+  if (cache_handle != nullptr) {
+    block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+  } else {
+    ReadOptions opt;
+    opt.verify_checksums =
+        options.verify_checksums || rep_->options.paranoid_checks;
+    BlockContents contents;
+    Status s = ReadBlock(rep_->file, opt, rep_->index_handle, &contents);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    if (options.fill_cache) {
+      MakeHeapAllocated(&contents);
+    }
+    block = new Block(contents);
+    if (options.fill_cache) {
+      cache_handle = block_cache->Insert(key, block, block->size(),
+                                         &DeleteCachedBlock,
+                                         Cache::Priority::kHigh);
+    }
+  }
+
+  Iterator* iter = block->NewIterator(rep_->options.comparator);
+  if (cache_handle == nullptr) {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  } else {
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  }
+  return iter;
+}
+
+FilterBlockReader* Table::GetFilter(const ReadOptions& options,
+                                    Cache::Handle** cache_handle) const {
+  *cache_handle = nullptr;
+  if (!rep_->cache_meta_blocks) {
+    return rep_->filter;
+  }
+  if (!rep_->has_filter) {
+    return nullptr;
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[kMaxCacheKeyPrefixLength + 8];
+  Slice key = BlockCacheKey(rep_->cache_key_prefix,
+                            rep_->filter_handle.offset(), cache_key_buffer);
+  *cache_handle = block_cache->Lookup(key);
+  if (*cache_handle == nullptr) {
+    if (!options.fill_cache) {
+      // Not worth reading a whole filter to serve a scan that does not want
+      // to disturb the cache; go without.
+      return nullptr;
+    }
+    ReadOptions opt;
+    opt.verify_checksums = rep_->options.paranoid_checks;
+    BlockContents contents;
+    if (!ReadBlock(rep_->file, opt, rep_->filter_handle, &contents).ok()) {
+      // Like ReadMeta(), do without the filter on errors.
+      return nullptr;
+    }
+    MakeHeapAllocated(&contents);
+    CachedFilter* filter =
+        new CachedFilter(rep_->options.filter_policy, contents.data);
+    *cache_handle =
+        block_cache->Insert(key, filter, contents.data.size(),
+                            &DeleteCachedFilter, Cache::Priority::kHigh);
+  }
+  return &reinterpret_cast<CachedFilter*>(block_cache->Value(*cache_handle))
+              ->reader;
+}
+
+void Table::ReleaseFilter(Cache::Handle* cache_handle) const {
+  if (cache_handle != nullptr) {
+    rep_->options.block_cache->Release(cache_handle);
+  }
+}
+
+void Table::WarmMetaBlocks() const {
+  if (!rep_->cache_meta_blocks) {
+    return;
+  }
+  ReadOptions options;
+  delete NewTopLevelIndexIterator(options);
+  Cache::Handle* filter_handle;
+  GetFilter(options, &filter_handle);
+  ReleaseFilter(filter_handle);
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options);
+}
+
+Iterator* Table::NewIterator(const ReadOptions& options,
+                             RandomAccessFile* file) const {
+  BlockSource* source = new BlockSource{this, file};
+  Iterator* iter = NewTwoLevelIterator(
+      NewIndexIterator(options), &Table::FileBlockReader, source, options);
+  iter->RegisterCleanup(&DeleteBlockSource, source, nullptr);
+  return iter;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
+  Cache::Handle* filter_handle;
+  FilterBlockReader* filter = GetFilter(options, &filter_handle);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
     if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
@@ -237,6 +489,7 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
   if (s.ok()) {
     s = iiter->status();
   }
+  ReleaseFilter(filter_handle);
   delete iiter;
   return s;
 }
@@ -246,13 +499,14 @@ Status Table::InternalGetS(const ReadOptions& options, const Slice& k, void* arg
                                                 const Slice&),
                            int precision) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
+  Cache::Handle* filter_handle;
+  FilterBlockReader* filter = GetFilter(options, &filter_handle);
 //  iiter->Seek(k);
   iiter->SeekToFirst();
   for (int i = 0; i < 50; ++i) {
     if (iiter->Valid()) {
       Slice handle_value = iiter->value();
-      FilterBlockReader* filter = rep_->filter;
       BlockHandle handle;
       if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
           !filter->KeyMayMatch(handle.offset(), k)) {
@@ -272,13 +526,55 @@ Status Table::InternalGetS(const ReadOptions& options, const Slice& k, void* arg
   if (s.ok()) {
     s = iiter->status();
   }
+  ReleaseFilter(filter_handle);
   delete iiter;
   return s;
 }
 
+void Table::GetIndexKeys(std::vector<std::string>* keys) const {
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
+  for (index_iter->SeekToFirst(); index_iter->Valid(); index_iter->Next()) {
+    keys->push_back(index_iter->key().ToString());
+  }
+  delete index_iter;
+}
+
+Status Table::ReadMetaBlock(const Slice& name, std::string* contents) const {
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents meta_contents;
+  Status s = ReadBlock(rep_->file, opt, rep_->metaindex_handle, &meta_contents);
+  if (!s.ok()) {
+    return s;
+  }
+  Block* meta = new Block(meta_contents);
+  Iterator* iter = meta->NewIterator(BytewiseComparator());
+  iter->Seek(name);
+  BlockHandle handle;
+  if (!iter->Valid() || iter->key() != name) {
+    s = iter->status().ok() ? Status::NotFound(name) : iter->status();
+  } else {
+    Slice handle_value = iter->value();
+    s = handle.DecodeFrom(&handle_value);
+  }
+  delete iter;
+  delete meta;
+
+  BlockContents block;
+  if (s.ok()) {
+    s = ReadBlock(rep_->file, opt, handle, &block);
+  }
+  if (s.ok()) {
+    contents->assign(block.data.data(), block.data.size());
+    if (block.heap_allocated) {
+      delete[] block.data.data();
+    }
+  }
+  return s;
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
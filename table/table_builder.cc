@@ -5,6 +5,9 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <map>
+#include <utility>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -59,6 +62,15 @@ struct TableBuilder::Rep {
   bool pending_index_entry;
   BlockHandle pending_handle;  // Handle to add to index block
 
+  // Index partitions finished so far, as (last index key, raw block
+  // contents) pairs, if options.index_partition_size is positive.  They are
+  // written next to each other by Finish(), so that the index stays
+  // together at the end of the file.
+  std::vector<std::pair<std::string, std::string>> index_partitions;
+
+  // Meta blocks added with AddMetaBlock(), as (name, contents) pairs.
+  std::vector<std::pair<std::string, std::string>> meta_blocks;
+
   std::string compressed_output;
 };
 
@@ -106,6 +118,11 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.index_partition_size > 0 &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.index_partition_size) {
+      FinishIndexPartition();
+    }
   }
 
   if (r->filter_block != nullptr) {
@@ -138,14 +155,28 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::FinishIndexPartition() {
+  Rep* r = rep_;
+  // The last key of the partition is >= every key of its data blocks and
+  // < every key of the following ones, so it separates partitions too.
+  r->index_partitions.emplace_back(r->last_key,
+                                   r->index_block.Finish().ToString());
+  r->index_block.Reset();
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
+  CompressAndWriteBlock(block->Finish(), handle);
+  block->Reset();
+}
+
+void TableBuilder::CompressAndWriteBlock(const Slice& raw,
+                                         BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
   //    type: uint8
   //    crc: uint32
   assert(ok());
   Rep* r = rep_;
-  Slice raw = block->Finish();
 
   Slice block_contents;
   CompressionType type = r->options.compression;
@@ -171,7 +202,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -193,6 +223,13 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
   }
 }
 
+void TableBuilder::AddMetaBlock(const Slice& name, const Slice& contents) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  assert(!name.starts_with("filter.") && !name.starts_with("index."));
+  r->meta_blocks.emplace_back(name.ToString(), contents.ToString());
+}
+
 Status TableBuilder::status() const { return rep_->status; }
 
 Status TableBuilder::Finish() {
@@ -202,6 +239,7 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  const bool partitioned_index = !r->index_partitions.empty();
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
@@ -209,19 +247,25 @@ Status TableBuilder::Finish() {
                   &filter_block_handle);
   }
 
-  // Write metaindex block
+  // Write meta blocks, and the metaindex block mapping their names (which
+  // must be added in order) to their locations.
+  std::map<std::string, std::string> meta_index;
+  if (ok() && r->filter_block != nullptr) {
+    // Add mapping from "filter.Name" to location of filter data
+    std::string key = "filter.";
+    key.append(r->options.filter_policy->Name());
+    filter_block_handle.EncodeTo(&meta_index[key]);
+  }
+  for (size_t i = 0; ok() && i < r->meta_blocks.size(); i++) {
+    BlockHandle handle;
+    WriteRawBlock(r->meta_blocks[i].second, kNoCompression, &handle);
+    handle.EncodeTo(&meta_index[r->meta_blocks[i].first]);
+  }
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
-      key.append(r->options.filter_policy->Name());
-      std::string handle_encoding;
-      filter_block_handle.EncodeTo(&handle_encoding);
-      meta_index_block.Add(key, handle_encoding);
+    for (const auto& entry : meta_index) {
+      meta_index_block.Add(entry.first, entry.second);
     }
-
-    // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
@@ -234,7 +278,25 @@ Status TableBuilder::Finish() {
       r->index_block.Add(r->last_key, Slice(handle_encoding));
       r->pending_index_entry = false;
     }
-    WriteBlock(&r->index_block, &index_block_handle);
+    if (partitioned_index) {
+      if (!r->index_block.empty()) {
+        FinishIndexPartition();
+      }
+      BlockBuilder top_level_index(&r->index_block_options);
+      for (size_t i = 0; ok() && i < r->index_partitions.size(); i++) {
+        BlockHandle partition_handle;
+        CompressAndWriteBlock(r->index_partitions[i].second,
+                              &partition_handle);
+        std::string handle_encoding;
+        partition_handle.EncodeTo(&handle_encoding);
+        top_level_index.Add(r->index_partitions[i].first, handle_encoding);
+      }
+      if (ok()) {
+        WriteBlock(&top_level_index, &index_block_handle);
+      }
+    } else {
+      WriteBlock(&r->index_block, &index_block_handle);
+    }
   }
 
   // Write footer
@@ -242,6 +304,7 @@ Status TableBuilder::Finish() {
     Footer footer;
     footer.set_metaindex_handle(metaindex_block_handle);
     footer.set_index_handle(index_block_handle);
+    footer.set_partitioned_index(partitioned_index);
     std::string footer_encoding;
     footer.EncodeTo(&footer_encoding);
     r->status = r->file->Append(footer_encoding);
@@ -0,0 +1,235 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table.h"
+
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "db/filename.h"
+#include "db/table_cache.h"
+#include "leveldb/env.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/perf_context.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "key%06d", i);
+  return buf;
+}
+
+static std::string Value(int i) { return Key(i) + std::string(40, 'v'); }
+
+// Counts the reads served by the file it wraps.
+class CountingFile : public RandomAccessFile {
+ public:
+  explicit CountingFile(RandomAccessFile* target)
+      : target_(target), reads_(0) {}
+  ~CountingFile() override { delete target_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    reads_++;
+    return target_->Read(offset, n, result, scratch);
+  }
+
+  int reads() const { return reads_; }
+
+ private:
+  RandomAccessFile* const target_;
+  mutable int reads_;
+};
+
+// Stores the entry found by TableCache::Get().
+static void SaveEntry(void* arg, const Slice& key, const Slice& value) {
+  std::string* result = reinterpret_cast<std::string*>(arg);
+  result->assign(key.data(), key.size());
+  result->push_back('=');
+  result->append(value.data(), value.size());
+}
+
+class TableTest : public testing::Test {
+ public:
+  TableTest() : env_(Env::Default()), table_cache_(nullptr), file_size_(0) {
+    dir_ = testing::TempDir() + "table_test";
+    env_->CreateDir(dir_);
+    options_.compression = kNoCompression;
+    options_.block_size = 256;
+  }
+
+  ~TableTest() override {
+    delete table_cache_;
+    env_->RemoveFile(TableFileName(dir_, 1));
+    env_->RemoveDir(dir_);
+  }
+
+  // Write a table holding Key(0..n-1) and open it through a TableCache.
+  void Build(int n) {
+    WritableFile* file;
+    ASSERT_TRUE(env_->NewWritableFile(TableFileName(dir_, 1), &file).ok());
+    TableBuilder builder(options_, file);
+    for (int i = 0; i < n; i++) {
+      builder.Add(Key(i), Value(i));
+    }
+    ASSERT_TRUE(builder.Finish().ok());
+    ASSERT_TRUE(file->Close().ok());
+    file_size_ = builder.FileSize();
+    delete file;
+    table_cache_ = new TableCache(dir_, options_, 10);
+  }
+
+  // The entry at or after "key", as "key=value", and the number of blocks
+  // read to find it.
+  std::string Get(const std::string& key, uint64_t* block_reads = nullptr) {
+    std::string result = "NOT_FOUND";
+    PerfContext* perf = GetPerfContext();
+    perf->Reset();
+    Status s =
+        table_cache_->Get(ReadOptions(), 1, file_size_, key, &result,
+                          &SaveEntry);
+    if (!s.ok()) {
+      return s.ToString();
+    }
+    if (block_reads != nullptr) {
+      *block_reads = perf->block_reads;
+    }
+    return result;
+  }
+
+  // The number of file reads Table::Open() issues for the table.
+  int OpenReads() {
+    RandomAccessFile* base;
+    EXPECT_TRUE(
+        env_->NewRandomAccessFile(TableFileName(dir_, 1), &base).ok());
+    CountingFile file(base);
+    Table* table;
+    EXPECT_TRUE(Table::Open(options_, &file, file_size_, &table).ok());
+    delete table;
+    return file.reads();
+  }
+
+  Iterator* NewIterator(Table** table = nullptr) {
+    return table_cache_->NewIterator(ReadOptions(), 1, file_size_, table);
+  }
+
+  Env* env_;
+  Options options_;
+  std::string dir_;
+  TableCache* table_cache_;
+  uint64_t file_size_;
+};
+
+TEST_F(TableTest, PartitionedIndex) {
+  const int kNum = 2000;
+  options_.index_partition_size = 128;
+  Build(kNum);
+
+  // Without a block cache, a lookup reads an index partition and then a
+  // data block.
+  uint64_t block_reads;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_EQ(Key(i) + "=" + Value(i), Get(Key(i), &block_reads));
+    ASSERT_EQ(2, block_reads);
+  }
+  // Keys between two entries land on the next one, also when that one
+  // starts the next partition.
+  for (int i = 0; i + 1 < kNum; i += 13) {
+    ASSERT_EQ(Key(i + 1) + "=" + Value(i + 1), Get(Key(i) + "!"));
+  }
+  ASSERT_EQ("NOT_FOUND", Get(Key(kNum)));
+  ASSERT_EQ(Key(0) + "=" + Value(0), Get(""));
+
+  Iterator* iter = NewIterator();
+  for (int i = 0; i < kNum; i += 7) {
+    iter->Seek(Key(i));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    iter->Seek(Key(i) + "!");
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i + 1), iter->key().ToString());
+  }
+  iter->Seek(Key(kNum));
+  ASSERT_FALSE(iter->Valid());
+
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(Value(i), iter->value().ToString());
+  }
+  ASSERT_EQ(kNum, i);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    i--;
+    ASSERT_EQ(Key(i), iter->key().ToString());
+  }
+  ASSERT_EQ(0, i);
+  ASSERT_TRUE(iter->status().ok());
+  delete iter;
+
+  // Offsets grow with the key across partitions and stay within the data.
+  Table* table;
+  iter = NewIterator(&table);
+  uint64_t last = table->ApproximateOffsetOf("");
+  ASSERT_EQ(0, last);
+  for (int k = 100; k < kNum; k += 100) {
+    const uint64_t offset = table->ApproximateOffsetOf(Key(k));
+    ASSERT_GT(offset, last);
+    ASSERT_LT(offset, file_size_);
+    last = offset;
+  }
+  ASSERT_GT(table->ApproximateOffsetOf(Key(kNum)), last);
+  ASSERT_LE(table->ApproximateOffsetOf(Key(kNum)), file_size_);
+  delete iter;
+}
+
+TEST_F(TableTest, OpenReadsFooterAndIndexOnly) {
+  // The footer says whether the index is partitioned, so without a filter
+  // neither kind of table needs its metaindex to be opened.
+  Build(2000);
+  ASSERT_EQ(2, OpenReads());
+  delete table_cache_;
+  options_.index_partition_size = 128;
+  Build(2000);
+  ASSERT_EQ(2, OpenReads());
+}
+
+TEST_F(TableTest, IndexInOnePartition) {
+  const int kNum = 20;
+  options_.index_partition_size = 64 << 10;
+  Build(kNum);
+
+  // The index fits in one partition, so it is kept as a single index
+  // block and a lookup only reads the data block.
+  uint64_t block_reads;
+  for (int i = 0; i < kNum; i++) {
+    ASSERT_EQ(Key(i) + "=" + Value(i), Get(Key(i), &block_reads));
+    ASSERT_EQ(1, block_reads);
+  }
+  ASSERT_EQ("NOT_FOUND", Get(Key(kNum)));
+
+  Table* table;
+  Iterator* iter = NewIterator(&table);
+  int i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+    ASSERT_EQ(Key(i), iter->key().ToString());
+  }
+  ASSERT_EQ(kNum, i);
+  iter->Seek(Key(5) + "!");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(Key(6), iter->key().ToString());
+  ASSERT_LT(table->ApproximateOffsetOf(Key(1)),
+            table->ApproximateOffsetOf(Key(kNum - 1)));
+  delete iter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
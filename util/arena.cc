@@ -4,17 +4,35 @@
 
 #include "util/arena.h"
 
+#include "port/port.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
+static const int kAlign = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+static const size_t kRegionAlign = 2 << 20;
+
+static size_t RegionSize(size_t requested) {
+  return (requested + kRegionAlign - 1) & ~(kRegionAlign - 1);
+}
 
-Arena::Arena()
-    : alloc_ptr_(nullptr), alloc_bytes_remaining_(0), memory_usage_(0) {}
+Arena::Arena(const ArenaOptions& options)
+    : alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      region_size_(RegionSize(options.huge_page_region_size)),
+      numa_node_(options.numa_node),
+      use_regions_(region_size_ > 0),
+      region_ptr_(nullptr),
+      region_bytes_remaining_(0),
+      memory_usage_(0) {}
 
 Arena::~Arena() {
   for (size_t i = 0; i < blocks_.size(); i++) {
     delete[] blocks_[i];
   }
+  for (size_t i = 0; i < regions_.size(); i++) {
+    port::UnmapHugePages(regions_[i], region_size_);
+  }
 }
 
 char* Arena::AllocateFallback(size_t bytes) {
@@ -36,7 +54,7 @@ char* Arena::AllocateFallback(size_t bytes) {
 }
 
 char* Arena::AllocateAligned(size_t bytes) {
-  const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+  const int align = kAlign;
   static_assert((align & (align - 1)) == 0,
                 "Pointer size should be a power of 2");
   size_t current_mod = reinterpret_cast<uintptr_t>(alloc_ptr_) & (align - 1);
@@ -56,11 +74,37 @@ char* Arena::AllocateAligned(size_t bytes) {
 }
 
 char* Arena::AllocateNewBlock(size_t block_bytes) {
-  char* result = new char[block_bytes];
-  blocks_.push_back(result);
+  char* result = nullptr;
+  if (use_regions_ && block_bytes <= region_size_) {
+    result = AllocateFromRegion(block_bytes);
+  }
+  if (result == nullptr) {
+    result = new char[block_bytes];
+    blocks_.push_back(result);
+  }
   memory_usage_.fetch_add(block_bytes + sizeof(char*),
                           std::memory_order_relaxed);
   return result;
 }
 
+char* Arena::AllocateFromRegion(size_t block_bytes) {
+  // Keep every block aligned, as AllocateAligned() relies on.
+  const size_t needed = (block_bytes + kAlign - 1) & ~size_t{kAlign - 1};
+  if (needed > region_bytes_remaining_) {
+    // The rest of the current region is wasted, as with blocks.
+    char* region = port::MapHugePages(region_size_, numa_node_);
+    if (region == nullptr) {
+      use_regions_ = false;
+      return nullptr;
+    }
+    regions_.push_back(region);
+    region_ptr_ = region;
+    region_bytes_remaining_ = region_size_;
+  }
+  char* result = region_ptr_;
+  region_ptr_ += needed;
+  region_bytes_remaining_ -= needed;
+  return result;
+}
+
 }  // namespace leveldb
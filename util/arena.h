@@ -13,9 +13,21 @@
 
 namespace leveldb {
 
+// Options for an Arena.  The defaults allocate 4KB blocks from the heap.
+struct ArenaOptions {
+  // If non-zero, blocks are carved out of regions of this many bytes
+  // (rounded up to a multiple of 2MB) mapped with port::MapHugePages(), so
+  // that the arena's memory is contiguous and backed by huge pages.  Falls
+  // back to the heap if regions cannot be mapped.
+  size_t huge_page_region_size = 0;
+
+  // NUMA node to place the regions on, or -1 to leave it to the OS.
+  int numa_node = -1;
+};
+
 class Arena {
  public:
-  Arena();
+  explicit Arena(const ArenaOptions& options = ArenaOptions());
 
   Arena(const Arena&) = delete;
   Arena& operator=(const Arena&) = delete;
@@ -37,6 +49,9 @@ class Arena {
  private:
   char* AllocateFallback(size_t bytes);
   char* AllocateNewBlock(size_t block_bytes);
+  // Carve a block out of the current huge page region, mapping a new
+  // region if needed.  Returns nullptr if no region could be mapped.
+  char* AllocateFromRegion(size_t block_bytes);
 
   // Allocation state
   char* alloc_ptr_;
@@ -45,6 +60,14 @@ class Arena {
   // Array of new[] allocated memory blocks
   std::vector<char*> blocks_;
 
+  // Huge page regions; see ArenaOptions::huge_page_region_size.
+  const size_t region_size_;
+  const int numa_node_;
+  bool use_regions_;  // Cleared once mapping a region fails
+  char* region_ptr_;
+  size_t region_bytes_remaining_;
+  std::vector<char*> regions_;
+
   // Total memory usage of the arena.
   //
   // TODO(costan): This member is accessed via atomics, but the others are
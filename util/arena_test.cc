@@ -11,9 +11,9 @@ namespace leveldb {
 
 TEST(ArenaTest, Empty) { Arena arena; }
 
-TEST(ArenaTest, Simple) {
+static void TestAllocations(const ArenaOptions& options) {
   std::vector<std::pair<size_t, char*>> allocated;
-  Arena arena;
+  Arena arena(options);
   const int N = 100000;
   size_t bytes = 0;
   Random rnd(301);
@@ -33,6 +33,7 @@ TEST(ArenaTest, Simple) {
     char* r;
     if (rnd.OneIn(10)) {
       r = arena.AllocateAligned(s);
+      ASSERT_EQ(0, reinterpret_cast<uintptr_t>(r) & (sizeof(void*) - 1));
     } else {
       r = arena.Allocate(s);
     }
@@ -58,6 +59,18 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+TEST(ArenaTest, Simple) { TestAllocations(ArenaOptions()); }
+
+TEST(ArenaTest, HugePageRegions) {
+  // The smallest regions there are.  Falls back to heap blocks where huge
+  // pages are not supported.
+  ArenaOptions options;
+  options.huge_page_region_size = 1;  // Rounded up to 2MB
+  TestAllocations(options);
+  options.numa_node = 0;
+  TestAllocations(options);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,9 +4,15 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <vector>
 
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -26,17 +32,23 @@ namespace {
 // entry being passed to its "deleter" are via Erase(), via Insert() when
 // an element with a duplicate key is inserted, or on destruction of the cache.
 //
-// The cache keeps two linked lists of items in the cache.  All items in the
-// cache are in one list or the other, and never both.  Items still referenced
-// by clients but erased from the cache are in neither list.  The lists are:
+// The cache keeps three linked lists of items in the cache.  All items in the
+// cache are in exactly one list.  Items still referenced by clients but erased
+// from the cache are in no list.  The lists are:
 // - in-use:  contains the items currently referenced by clients, in no
 //   particular order.  (This list is used for invariant checking.  If we
 //   removed the check, elements that would otherwise be on this list could be
 //   left as disconnected singleton lists.)
-// - LRU:  contains the items not currently referenced by clients, in LRU order
+// - LRU:  contains the low priority items not currently referenced by
+//   clients, in LRU order
+// - high-priority LRU:  same for the items inserted with Priority::kHigh
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// Eviction takes the oldest low priority item, unless the high priority items
+// use more than their reserved share of the capacity (or there are no low
+// priority items left), in which case it takes the oldest high priority item.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -49,6 +61,7 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool high_pri;     // Whether entry was inserted with Priority::kHigh.
   uint32_t refs;     // References, including cache reference, if present.
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -67,18 +80,19 @@ struct LRUHandle {
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
 // 4.4.3's builtin hashtable.
+template <typename Handle>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  Handle* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  Handle* Insert(Handle* h) {
+    Handle** ptr = FindPointer(h->key(), h->hash);
+    Handle* old = *ptr;
     h->next_hash = (old == nullptr ? nullptr : old->next_hash);
     *ptr = h;
     if (old == nullptr) {
@@ -92,9 +106,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  Handle* Remove(const Slice& key, uint32_t hash) {
+    Handle** ptr = FindPointer(key, hash);
+    Handle* result = *ptr;
     if (result != nullptr) {
       *ptr = result->next_hash;
       --elems_;
@@ -107,13 +121,13 @@ class HandleTable {
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
   uint32_t elems_;
-  LRUHandle** list_;
+  Handle** list_;
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  Handle** FindPointer(const Slice& key, uint32_t hash) {
+    Handle** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
     }
@@ -125,15 +139,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    Handle** new_list = new Handle*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      Handle* h = list_[i];
       while (h != nullptr) {
-        LRUHandle* next = h->next_hash;
+        Handle* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        Handle** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -147,27 +161,65 @@ class HandleTable {
   }
 };
 
+// Counters reported for one cache shard.
+struct ShardStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t lock_waits;  // Lock acquisitions that found the lock taken
+  size_t charge;
+};
+
+// Like MutexLock, but counts the acquisitions that had to wait for another
+// thread to release the mutex.
+class SCOPED_LOCKABLE CountingMutexLock {
+ public:
+  CountingMutexLock(port::Mutex* mu, std::atomic<uint64_t>* waits)
+      EXCLUSIVE_LOCK_FUNCTION(mu)
+      : mu_(mu) {
+    if (!mu_->TryLock()) {
+      waits->fetch_add(1, std::memory_order_relaxed);
+      mu_->Lock();
+    }
+  }
+  ~CountingMutexLock() UNLOCK_FUNCTION() { mu_->Unlock(); }
+
+  CountingMutexLock(const CountingMutexLock&) = delete;
+  CountingMutexLock& operator=(const CountingMutexLock&) = delete;
+
+ private:
+  port::Mutex* const mu_;
+};
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
+  typedef LRUHandle HandleType;
+
   LRUCache();
   ~LRUCache();
 
-  // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  // Separate from constructor so caller can easily make an array of LRUCache.
+  // "high_pri_capacity" is the share of the capacity reserved for items
+  // inserted with Priority::kHigh.
+  void SetCapacity(size_t capacity, size_t high_pri_capacity) {
+    capacity_ = capacity;
+    high_pri_capacity_ = high_pri_capacity;
+  }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
   void Erase(const Slice& key, uint32_t hash);
   void Prune();
   size_t TotalCharge() const {
-    MutexLock l(&mutex_);
+    CountingMutexLock l(&mutex_, &lock_waits_);
     return usage_;
   }
+  ShardStats Stats() const;
 
  private:
   void LRU_Remove(LRUHandle* e);
@@ -175,48 +227,70 @@ class LRUCache {
   void Ref(LRUHandle* e);
   void Unref(LRUHandle* e);
   bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  LRUHandle* EvictionCandidate() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   // Initialized before use.
   size_t capacity_;
+  size_t high_pri_capacity_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
-  // Entries have refs==1 and in_cache==true.
+  // Entries have refs==1, in_cache==true and high_pri==false.
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Dummy head of the high priority LRU list.
+  // Entries have refs==1, in_cache==true and high_pri==true.
+  LRUHandle high_pri_lru_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
-  HandleTable table_ GUARDED_BY(mutex_);
+  HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
+
+  mutable std::atomic<uint64_t> hits_;
+  mutable std::atomic<uint64_t> misses_;
+  mutable std::atomic<uint64_t> lock_waits_;
 };
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_capacity_(0),
+      usage_(0),
+      high_pri_usage_(0),
+      hits_(0),
+      misses_(0),
+      lock_waits_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  high_pri_lru_.next = &high_pri_lru_;
+  high_pri_lru_.prev = &high_pri_lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
-  for (LRUHandle* e = lru_.next; e != &lru_;) {
-    LRUHandle* next = e->next;
-    assert(e->in_cache);
-    e->in_cache = false;
-    assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
-    e = next;
+  for (LRUHandle* list : {&lru_, &high_pri_lru_}) {
+    for (LRUHandle* e = list->next; e != list;) {
+      LRUHandle* next = e->next;
+      assert(e->in_cache);
+      e->in_cache = false;
+      assert(e->refs == 1);  // Invariant of the LRU lists.
+      Unref(e);
+      e = next;
+    }
   }
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an LRU list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
@@ -231,9 +305,9 @@ void LRUCache::Unref(LRUHandle* e) {
     (*e->deleter)(e->key(), e->value);
     free(e);
   } else if (e->in_cache && e->refs == 1) {
-    // No longer in use; move to lru_ list.
+    // No longer in use; move to its LRU list.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Append(e->high_pri ? &high_pri_lru_ : &lru_, e);
   }
 }
 
@@ -251,24 +325,27 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
 }
 
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
     Ref(e);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
 void LRUCache::Release(Cache::Handle* handle) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   Unref(reinterpret_cast<LRUHandle*>(handle));
 }
 
 Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
                                 size_t charge,
-                                void (*deleter)(const Slice& key,
-                                                void* value)) {
-  MutexLock l(&mutex_);
+                                void (*deleter)(const Slice& key, void* value),
+                                Cache::Priority priority) {
+  CountingMutexLock l(&mutex_, &lock_waits_);
 
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
@@ -278,6 +355,7 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_pri = (priority == Cache::Priority::kHigh);
   e->refs = 1;  // for the returned handle.
   std::memcpy(e->key_data, key.data(), key.size());
 
@@ -286,13 +364,17 @@ Cache::Handle* LRUCache::Insert(const Slice& key, uint32_t hash, void* value,
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
+    if (e->high_pri) {
+      high_pri_usage_ += charge;
+    }
     FinishErase(table_.Insert(e));
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
   }
-  while (usage_ > capacity_ && lru_.next != &lru_) {
-    LRUHandle* old = lru_.next;
+  while (usage_ > capacity_) {
+    LRUHandle* old = EvictionCandidate();
+    if (old == nullptr) break;
     assert(old->refs == 1);
     bool erased = FinishErase(table_.Remove(old->key(), old->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -311,20 +393,32 @@ bool LRUCache::FinishErase(LRUHandle* e) {
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
+    if (e->high_pri) {
+      high_pri_usage_ -= e->charge;
+    }
     Unref(e);
   }
   return e != nullptr;
 }
 
+LRUHandle* LRUCache::EvictionCandidate() {
+  const bool have_low = lru_.next != &lru_;
+  const bool have_high = high_pri_lru_.next != &high_pri_lru_;
+  if (have_high && (!have_low || high_pri_usage_ > high_pri_capacity_)) {
+    return high_pri_lru_.next;
+  }
+  return have_low ? lru_.next : nullptr;
+}
+
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
+  CountingMutexLock l(&mutex_, &lock_waits_);
   FinishErase(table_.Remove(key, hash));
 }
 
 void LRUCache::Prune() {
-  MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
+  CountingMutexLock l(&mutex_, &lock_waits_);
+  LRUHandle* e;
+  while ((e = EvictionCandidate()) != nullptr) {
     assert(e->refs == 1);
     bool erased = FinishErase(table_.Remove(e->key(), e->hash));
     if (!erased) {  // to avoid unused variable when compiled NDEBUG
@@ -333,12 +427,288 @@ void LRUCache::Prune() {
   }
 }
 
-static const int kNumShardBits = 4;
-static const int kNumShards = 1 << kNumShardBits;
+ShardStats LRUCache::Stats() const {
+  ShardStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.lock_waits = lock_waits_.load(std::memory_order_relaxed);
+  stats.charge = TotalCharge();
+  return stats;
+}
+
+// CLOCK cache implementation
+//
+// Entries sit in a hash table and in a "clock" ring that the eviction hand
+// sweeps.  Each entry has a "referenced" bit that a hit sets; the hand
+// clears the bit and moves on (a second chance), and evicts the first
+// unreferenced entry that no client holds.
+//
+// Unlike LRUCache, a hit does not reorder any list.  Lookup() takes the
+// shard's lock in shared mode, and updates the entry's reference count and
+// referenced bit with atomic operations, so readers of one shard do not
+// wait for each other.  They still write shared cache lines (the lock's
+// reader count, the hit counter and the entry's reference count), so this
+// is not a lock-free lookup; micro_bench's BM_CacheHit compares it with
+// LRUCache.  Release() takes no lock at all.  Insert(), Erase(), Prune()
+// and eviction take the lock exclusively.
+//
+// While an entry is in the cache the cache holds one reference to it, so a
+// reader holding the shared lock can safely add its own reference: the
+// entry cannot be removed from the table until the reader lets go of the
+// lock.
+//
+// Entries inserted with Priority::kHigh start with the referenced bit set,
+// so the hand passes over them once more than over other new entries.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  size_t charge;
+  size_t key_length;
+  size_t clock_index;  // Position in the clock ring while in_cache.
+  std::atomic<uint32_t> refs;  // References, including the cache's.
+  std::atomic<bool> referenced;
+  bool in_cache;
+  uint32_t hash;
+  char key_data[1];  // Beginning of key
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+class ClockCache {
+ public:
+  typedef ClockHandle HandleType;
+
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of shards.
+  // CLOCK reserves no capacity for high priority entries.
+  void SetCapacity(size_t capacity, size_t high_pri_capacity) {
+    capacity_ = capacity;
+  }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const;
+  ShardStats Stats() const;
 
-class ShardedLRUCache : public Cache {
  private:
-  LRUCache shard_[kNumShards];
+  typedef std::unique_lock<std::shared_mutex> ExclusiveLock;
+
+  ExclusiveLock LockExclusive() const;
+  static void Unref(ClockHandle* e);
+  void RemoveFromRing(ClockHandle* e);
+  bool FinishErase(ClockHandle* e);
+  void EvictToCapacity();
+
+  // Initialized before use.
+  size_t capacity_;
+
+  // mutex_ protects the following state; see the comment above for what
+  // shared holders may do.
+  mutable std::shared_mutex mutex_;
+  size_t usage_;
+  std::vector<ClockHandle*> ring_;
+  size_t hand_;
+  HandleTable<ClockHandle> table_;
+
+  mutable std::atomic<uint64_t> hits_;
+  mutable std::atomic<uint64_t> misses_;
+  mutable std::atomic<uint64_t> lock_waits_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0),
+      usage_(0),
+      hand_(0),
+      hits_(0),
+      misses_(0),
+      lock_waits_(0) {}
+
+ClockCache::~ClockCache() {
+  for (ClockHandle* e : ring_) {
+    // Error if caller has an unreleased handle
+    assert(e->refs.load(std::memory_order_relaxed) == 1);
+    e->in_cache = false;
+    Unref(e);
+  }
+}
+
+ClockCache::ExclusiveLock ClockCache::LockExclusive() const {
+  ExclusiveLock l(mutex_, std::try_to_lock);
+  if (!l.owns_lock()) {
+    lock_waits_.fetch_add(1, std::memory_order_relaxed);
+    l.lock();
+  }
+  return l;
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {  // Deallocate.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    e->~ClockHandle();
+    free(e);
+  }
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  std::shared_lock<std::shared_mutex> l(mutex_, std::try_to_lock);
+  if (!l.owns_lock()) {
+    lock_waits_.fetch_add(1, std::memory_order_relaxed);
+    l.lock();
+  }
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    if (!e->referenced.load(std::memory_order_relaxed)) {
+      e->referenced.store(true, std::memory_order_relaxed);
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value),
+                                  Cache::Priority priority) {
+  void* mem = malloc(sizeof(ClockHandle) - 1 + key.size());
+  ClockHandle* e = new (mem) ClockHandle;
+  e->value = value;
+  e->deleter = deleter;
+  e->next_hash = nullptr;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->clock_index = 0;
+  e->refs.store(1, std::memory_order_relaxed);  // for the returned handle.
+  e->referenced.store(priority == Cache::Priority::kHigh,
+                      std::memory_order_relaxed);
+  e->in_cache = false;
+  e->hash = hash;
+  std::memcpy(e->key_data, key.data(), key.size());
+
+  ExclusiveLock l = LockExclusive();
+  if (capacity_ > 0) {
+    // for the cache's reference.
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    e->in_cache = true;
+    e->clock_index = ring_.size();
+    ring_.push_back(e);
+    usage_ += charge;
+    FinishErase(table_.Insert(e));
+  }  // else don't cache. (capacity_==0 is supported and turns off caching.)
+  EvictToCapacity();
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+void ClockCache::RemoveFromRing(ClockHandle* e) {
+  ClockHandle* last = ring_.back();
+  ring_[e->clock_index] = last;
+  last->clock_index = e->clock_index;
+  ring_.pop_back();
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.  Return whether e != nullptr.
+bool ClockCache::FinishErase(ClockHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    RemoveFromRing(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void ClockCache::EvictToCapacity() {
+  // Every entry is passed over at most twice: once to clear its referenced
+  // bit and once to evict it.  Entries held by clients are skipped, so give
+  // up rather than spin when everything left is in use.
+  size_t budget = 2 * ring_.size();
+  while (usage_ > capacity_ && !ring_.empty() && budget-- > 0) {
+    if (hand_ >= ring_.size()) hand_ = 0;
+    ClockHandle* e = ring_[hand_];
+    // No lookup can add a reference while we hold the lock exclusively.
+    if (e->refs.load(std::memory_order_acquire) > 1 ||
+        e->referenced.exchange(false, std::memory_order_relaxed)) {
+      hand_++;
+      continue;
+    }
+    // The last entry of the ring moves into the hand's slot, so the hand
+    // stays put.
+    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+    if (!erased) {  // to avoid unused variable when compiled NDEBUG
+      assert(erased);
+    }
+  }
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  ExclusiveLock l = LockExclusive();
+  FinishErase(table_.Remove(key, hash));
+}
+
+void ClockCache::Prune() {
+  ExclusiveLock l = LockExclusive();
+  for (size_t i = 0; i < ring_.size();) {
+    ClockHandle* e = ring_[i];
+    if (e->refs.load(std::memory_order_acquire) == 1) {
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    } else {
+      i++;
+    }
+  }
+}
+
+size_t ClockCache::TotalCharge() const {
+  std::shared_lock<std::shared_mutex> l(mutex_);
+  return usage_;
+}
+
+ShardStats ClockCache::Stats() const {
+  ShardStats stats;
+  stats.hits = hits_.load(std::memory_order_relaxed);
+  stats.misses = misses_.load(std::memory_order_relaxed);
+  stats.lock_waits = lock_waits_.load(std::memory_order_relaxed);
+  stats.charge = TotalCharge();
+  return stats;
+}
+
+static const int kDefaultNumShardBits = 4;
+static const int kMaxNumShardBits = 16;
+static const double kDefaultHighPriPoolRatio = 0.5;
+
+// Splits the key space over 2^num_shard_bits independent shards by the top
+// bits of the key hash.  Shard is LRUCache or ClockCache.
+template <typename Shard>
+class ShardedCache : public Cache {
+ private:
+  typedef typename Shard::HandleType Handle;
+
+  const size_t capacity_;
+  const int num_shard_bits_;
+  const int num_shards_;
+  Shard* const shard_;
   port::Mutex id_mutex_;
   uint64_t last_id_;
 
@@ -346,56 +716,139 @@ class ShardedLRUCache : public Cache {
     return Hash(s.data(), s.size(), 0);
   }
 
-  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+  uint32_t ShardOf(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
-    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
-    for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+  ShardedCache(size_t capacity, int num_shard_bits, double high_pri_pool_ratio)
+      : capacity_(capacity),
+        num_shard_bits_(num_shard_bits),
+        num_shards_(1 << num_shard_bits),
+        shard_(new Shard[num_shards_]),
+        last_id_(0) {
+    const size_t per_shard = (capacity + (num_shards_ - 1)) / num_shards_;
+    const size_t high_pri_per_shard =
+        static_cast<size_t>(per_shard * high_pri_pool_ratio);
+    for (int s = 0; s < num_shards_; s++) {
+      shard_[s].SetCapacity(per_shard, high_pri_per_shard);
     }
   }
-  ~ShardedLRUCache() override {}
-  Handle* Insert(const Slice& key, void* value, size_t charge,
-                 void (*deleter)(const Slice& key, void* value)) override {
+  ~ShardedCache() override { delete[] shard_; }
+  Cache::Handle* Insert(const Slice& key, void* value, size_t charge,
+                        void (*deleter)(const Slice& key,
+                                        void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Cache::Handle* Insert(const Slice& key, void* value, size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[ShardOf(hash)].Insert(key, hash, value, charge, deleter,
+                                        priority);
   }
-  Handle* Lookup(const Slice& key) override {
+  Cache::Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Lookup(key, hash);
+    return shard_[ShardOf(hash)].Lookup(key, hash);
   }
-  void Release(Handle* handle) override {
-    LRUHandle* h = reinterpret_cast<LRUHandle*>(handle);
-    shard_[Shard(h->hash)].Release(handle);
+  void Release(Cache::Handle* handle) override {
+    Handle* h = reinterpret_cast<Handle*>(handle);
+    shard_[ShardOf(h->hash)].Release(handle);
   }
   void Erase(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
-    shard_[Shard(hash)].Erase(key, hash);
+    shard_[ShardOf(hash)].Erase(key, hash);
   }
-  void* Value(Handle* handle) override {
-    return reinterpret_cast<LRUHandle*>(handle)->value;
+  void* Value(Cache::Handle* handle) override {
+    return reinterpret_cast<Handle*>(handle)->value;
   }
   uint64_t NewId() override {
     MutexLock l(&id_mutex_);
     return ++(last_id_);
   }
   void Prune() override {
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       shard_[s].Prune();
     }
   }
   size_t TotalCharge() const override {
     size_t total = 0;
-    for (int s = 0; s < kNumShards; s++) {
+    for (int s = 0; s < num_shards_; s++) {
       total += shard_[s].TotalCharge();
     }
     return total;
   }
+  size_t GetCapacity() const override { return capacity_; }
+  std::string GetStats() const override {
+    std::string result;
+    char buf[200];
+    std::snprintf(buf, sizeof(buf), "%5s %12s %12s %12s %14s\n", "Shard",
+                  "Hits", "Misses", "LockWaits", "Charge");
+    result.append(buf);
+    ShardStats total = {0, 0, 0, 0};
+    for (int s = 0; s < num_shards_; s++) {
+      const ShardStats stats = shard_[s].Stats();
+      std::snprintf(buf, sizeof(buf), "%5d %12llu %12llu %12llu %14llu\n", s,
+                    static_cast<unsigned long long>(stats.hits),
+                    static_cast<unsigned long long>(stats.misses),
+                    static_cast<unsigned long long>(stats.lock_waits),
+                    static_cast<unsigned long long>(stats.charge));
+      result.append(buf);
+      total.hits += stats.hits;
+      total.misses += stats.misses;
+      total.lock_waits += stats.lock_waits;
+      total.charge += stats.charge;
+    }
+    std::snprintf(buf, sizeof(buf), "%5s %12llu %12llu %12llu %14llu\n", "All",
+                  static_cast<unsigned long long>(total.hits),
+                  static_cast<unsigned long long>(total.misses),
+                  static_cast<unsigned long long>(total.lock_waits),
+                  static_cast<unsigned long long>(total.charge));
+    result.append(buf);
+    return result;
+  }
 };
 
+int SanitizeShardBits(int num_shard_bits) {
+  if (num_shard_bits < 0) return kDefaultNumShardBits;
+  if (num_shard_bits > kMaxNumShardBits) return kMaxNumShardBits;
+  return num_shard_bits;
+}
+
+double SanitizeRatio(double ratio) {
+  if (!(ratio >= 0.0)) return 0.0;  // Also catches NaN.
+  if (ratio > 1.0) return 1.0;
+  return ratio;
+}
+
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache::Handle* Cache::Insert(const Slice& key, void* value, size_t charge,
+                             void (*deleter)(const Slice& key, void* value),
+                             Priority priority) {
+  return Insert(key, value, charge, deleter);
+}
+
+std::string Cache::GetStats() const { return std::string(); }
+
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, kDefaultNumShardBits);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits) {
+  return NewLRUCache(capacity, num_shard_bits, kDefaultHighPriPoolRatio);
+}
+
+Cache* NewLRUCache(size_t capacity, int num_shard_bits,
+                   double high_pri_pool_ratio) {
+  return new ShardedCache<LRUCache>(capacity,
+                                    SanitizeShardBits(num_shard_bits),
+                                    SanitizeRatio(high_pri_pool_ratio));
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits) {
+  return new ShardedCache<ClockCache>(capacity,
+                                      SanitizeShardBits(num_shard_bits), 0.0);
+}
 
 }  // namespace leveldb
@@ -0,0 +1,347 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/cache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+// Conversions between numeric keys/values and the types expected by Cache.
+static std::string EncodeKey(int k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+static int DecodeKey(const Slice& k) {
+  assert(k.size() == 4);
+  return DecodeFixed32(k.data());
+}
+static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
+static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
+
+enum CacheType { kLRU, kClock };
+
+class CacheTest : public testing::TestWithParam<CacheType> {
+ public:
+  static void Deleter(const Slice& key, void* v) {
+    current_->deleted_keys_.push_back(DecodeKey(key));
+    current_->deleted_values_.push_back(DecodeValue(v));
+  }
+
+  static constexpr int kCacheSize = 1000;
+  std::vector<int> deleted_keys_;
+  std::vector<int> deleted_values_;
+  Cache* cache_;
+
+  CacheTest() : cache_(NewCache(kCacheSize, -1)) { current_ = this; }
+
+  ~CacheTest() { delete cache_; }
+
+  Cache* NewCache(size_t capacity, int num_shard_bits) const {
+    return GetParam() == kClock ? NewClockCache(capacity, num_shard_bits)
+                                : NewLRUCache(capacity, num_shard_bits);
+  }
+
+  int Lookup(int key) {
+    Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
+    const int r = (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
+    if (handle != nullptr) {
+      cache_->Release(handle);
+    }
+    return r;
+  }
+
+  void Insert(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTest::Deleter));
+  }
+
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTest::Deleter,
+                                   Cache::Priority::kHigh));
+  }
+
+  Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
+    return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                          &CacheTest::Deleter);
+  }
+
+  void Erase(int key) { cache_->Erase(EncodeKey(key)); }
+  static CacheTest* current_;
+};
+CacheTest* CacheTest::current_;
+
+TEST_P(CacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(-1, Lookup(300));
+
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST_P(CacheTest, Erase) {
+  Erase(200);
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  Insert(100, 101);
+  Insert(200, 201);
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST_P(CacheTest, EntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[1]);
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST_P(CacheTest, EvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+  Insert(300, 301);
+  Cache::Handle* h = cache_->Lookup(EncodeKey(300));
+
+  // Frequently used entry must be kept around,
+  // as must things that are still in use.  (The new entries are not looked
+  // up: CLOCK cannot tell apart entries that were all referenced since the
+  // hand last passed them.)
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(301, Lookup(300));
+  cache_->Release(h);
+}
+
+TEST_P(CacheTest, HighPriorityPool) {
+  if (GetParam() != kLRU) {
+    GTEST_SKIP() << "CLOCK reserves no capacity for high priority entries";
+  }
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0, 0.5);
+
+  // High priority entries within their half of the capacity outlive any
+  // number of low priority ones.
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    InsertHighPriority(i, 100 + i);
+  }
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(10000 + i, i);
+  }
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    ASSERT_EQ(100 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(10000));
+  ASSERT_EQ(2 * kCacheSize - 1, Lookup(10000 + 2 * kCacheSize - 1));
+
+  // Beyond their share, the oldest high priority entries go first.
+  for (int i = kCacheSize / 2; i < kCacheSize; i++) {
+    InsertHighPriority(i, 100 + i);
+    Insert(20000 + i, i);
+  }
+  ASSERT_EQ(-1, Lookup(0));
+  ASSERT_EQ(100 + kCacheSize - 1, Lookup(kCacheSize - 1));
+  ASSERT_EQ(kCacheSize, cache_->TotalCharge());
+}
+
+TEST_P(CacheTest, UseExceedsCacheSize) {
+  // Overfill the cache, keeping handles on all inserted entries.
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+  }
+
+  // Check that all the entries can be found in the cache.
+  for (int i = 0; i < h.size(); i++) {
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+  }
+
+  for (int i = 0; i < h.size(); i++) {
+    cache_->Release(h[i]);
+  }
+}
+
+TEST_P(CacheTest, HeavyEntries) {
+  // Add a bunch of light and heavy entries and then count the combined
+  // size of items still in the cache, which must be approximately the
+  // same as the total capacity.
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000 + i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+}
+
+TEST_P(CacheTest, NewId) {
+  uint64_t a = cache_->NewId();
+  uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+TEST_P(CacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST_P(CacheTest, ZeroSizeCache) {
+  delete cache_;
+  cache_ = NewCache(0, -1);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST_P(CacheTest, SingleShard) {
+  delete cache_;
+  cache_ = NewCache(10, 0);
+
+  for (int i = 0; i < 20; i++) {
+    Insert(i, 100 + i);
+  }
+  ASSERT_EQ(10, cache_->TotalCharge());
+  ASSERT_EQ(119, Lookup(19));
+  ASSERT_EQ(-1, Lookup(0));
+}
+
+TEST_P(CacheTest, Stats) {
+  delete cache_;
+  cache_ = NewCache(kCacheSize, 1);
+
+  Insert(1, 100);
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+
+  const std::string stats = cache_->GetStats();
+  // A header, one line per shard and a total line.
+  ASSERT_EQ(4, std::count(stats.begin(), stats.end(), '\n'));
+  const size_t total = stats.find("All");
+  ASSERT_NE(std::string::npos, total);
+  int hits, misses, waits, charge;
+  ASSERT_EQ(4, std::sscanf(stats.c_str() + total, "All %d %d %d %d", &hits,
+                           &misses, &waits, &charge));
+  ASSERT_EQ(2, hits);
+  ASSERT_EQ(1, misses);
+  ASSERT_EQ(1, charge);
+}
+
+TEST_P(CacheTest, ConcurrentLookups) {
+  const int kEntries = 100;
+  for (int i = 0; i < kEntries; i++) {
+    Insert(i, 1000 + i);
+  }
+
+  const int kThreads = 8;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kThreads, 0);
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([this, t, &failures]() {
+      for (int n = 0; n < 10000; n++) {
+        const int key = (n * 7 + t) % kEntries;
+        Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
+        if (handle == nullptr ||
+            DecodeValue(cache_->Value(handle)) != 1000 + key) {
+          failures[t]++;
+        }
+        if (handle != nullptr) {
+          cache_->Release(handle);
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < kThreads; t++) {
+    ASSERT_EQ(0, failures[t]);
+  }
+  ASSERT_EQ(0, deleted_keys_.size());
+}
+
+INSTANTIATE_TEST_SUITE_P(LRU, CacheTest, testing::Values(kLRU));
+INSTANTIATE_TEST_SUITE_P(Clock, CacheTest, testing::Values(kClock));
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
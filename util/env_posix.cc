@@ -101,6 +101,35 @@ class Limiter {
   std::atomic<int> acquires_allowed_;
 };
 
+// Ensures that all the caches associated with the given file descriptor's
+// data are flushed all the way to durable media, and can withstand power
+// failures.
+//
+// The path argument is only used to populate the description string in the
+// returned Status if an error occurs.
+Status SyncFd(int fd, const std::string& fd_path) {
+#if HAVE_FULLFSYNC
+  // On macOS and iOS, fsync() doesn't guarantee durability past power
+  // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
+  // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
+  // fsync().
+  if (::fcntl(fd, F_FULLFSYNC) == 0) {
+    return Status::OK();
+  }
+#endif  // HAVE_FULLFSYNC
+
+#if HAVE_FDATASYNC
+  bool sync_success = ::fdatasync(fd) == 0;
+#else
+  bool sync_success = ::fsync(fd) == 0;
+#endif  // HAVE_FDATASYNC
+
+  if (sync_success) {
+    return Status::OK();
+  }
+  return PosixError(fd_path, errno);
+}
+
 // Implements sequential read access in a file using read().
 //
 // Instances of this class are thread-friendly but not thread-safe, as required
@@ -322,6 +351,9 @@ class PosixWritableFile final : public WritableFile {
     return SyncFd(fd_, filename_);
   }
 
+  // Only touches fd_, so it does not race with Append() and Flush().
+  Status SyncData() override { return SyncFd(fd_, filename_); }
+
  private:
   Status FlushBuffer() {
     Status status = WriteUnbuffered(buf_, pos_);
@@ -360,35 +392,6 @@ class PosixWritableFile final : public WritableFile {
     return status;
   }
 
-  // Ensures that all the caches associated with the given file descriptor's
-  // data are flushed all the way to durable media, and can withstand power
-  // failures.
-  //
-  // The path argument is only used to populate the description string in the
-  // returned Status if an error occurs.
-  static Status SyncFd(int fd, const std::string& fd_path) {
-#if HAVE_FULLFSYNC
-    // On macOS and iOS, fsync() doesn't guarantee durability past power
-    // failures. fcntl(F_FULLFSYNC) is required for that purpose. Some
-    // filesystems don't support fcntl(F_FULLFSYNC), and require a fallback to
-    // fsync().
-    if (::fcntl(fd, F_FULLFSYNC) == 0) {
-      return Status::OK();
-    }
-#endif  // HAVE_FULLFSYNC
-
-#if HAVE_FDATASYNC
-    bool sync_success = ::fdatasync(fd) == 0;
-#else
-    bool sync_success = ::fsync(fd) == 0;
-#endif  // HAVE_FDATASYNC
-
-    if (sync_success) {
-      return Status::OK();
-    }
-    return PosixError(fd_path, errno);
-  }
-
   // Returns the directory name in a path pointing to a file.
   //
   // Returns "." if the path does not contain any directory separator.
@@ -436,6 +439,266 @@ class PosixWritableFile final : public WritableFile {
   const std::string dirname_;  // The directory of filename_.
 };
 
+#if defined(O_DIRECT)
+
+// Offsets, sizes and buffer addresses of O_DIRECT transfers are multiples
+// of this.
+constexpr const size_t kDirectIOAlignment = 4096;
+
+constexpr const size_t kDirectWritableFileBufferSize = 1 << 20;
+
+// Allocates |size| bytes aligned for O_DIRECT transfers.  Release with free().
+char* NewAlignedBuffer(size_t size) {
+  void* buffer = nullptr;
+  if (::posix_memalign(&buffer, kDirectIOAlignment, size) != 0) {
+    return nullptr;
+  }
+  return reinterpret_cast<char*>(buffer);
+}
+
+// Implements random read access in a file opened with O_DIRECT.  Each Read()
+// is widened to aligned boundaries, lands in an aligned bounce buffer and is
+// copied into |scratch|.  The file keeps one bounce buffer, grown to the
+// largest read so far; a Read() that finds it in use by another thread
+// allocates a temporary one.
+//
+// Like PosixRandomAccessFile, the file descriptor counts against
+// |fd_limiter| and the file is opened on every read once the limit is
+// reached.
+//
+// Instances of this class are thread-safe, as required by the RandomAccessFile
+// API.
+class PosixDirectRandomAccessFile final : public RandomAccessFile {
+ public:
+  // The new instance takes ownership of |fd|. |fd_limiter| must outlive this
+  // instance.
+  PosixDirectRandomAccessFile(std::string filename, int fd,
+                              Limiter* fd_limiter)
+      : has_permanent_fd_(fd_limiter->Acquire()),
+        fd_(has_permanent_fd_ ? fd : -1),
+        fd_limiter_(fd_limiter),
+        filename_(std::move(filename)),
+        buffer_(nullptr),
+        buffer_size_(0) {
+    if (!has_permanent_fd_) {
+      assert(fd_ == -1);
+      ::close(fd);  // The file will be opened on every read.
+    }
+  }
+
+  ~PosixDirectRandomAccessFile() override {
+    if (has_permanent_fd_) {
+      assert(fd_ != -1);
+      ::close(fd_);
+      fd_limiter_->Release();
+    }
+    std::free(buffer_);
+  }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    const uint64_t aligned_offset = offset & ~(kDirectIOAlignment - 1);
+    const size_t head = static_cast<size_t>(offset - aligned_offset);
+    const size_t aligned_size =
+        (head + n + kDirectIOAlignment - 1) & ~(kDirectIOAlignment - 1);
+
+    *result = Slice();
+    int fd = fd_;
+    if (!has_permanent_fd_) {
+      fd = ::open(filename_.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+      if (fd < 0) {
+        return PosixError(filename_, errno);
+      }
+    }
+
+    char* buffer;
+    const bool shared_buffer = buffer_mutex_.TryLock();
+    if (shared_buffer) {
+      if (buffer_size_ < aligned_size) {
+        std::free(buffer_);
+        buffer_ = NewAlignedBuffer(aligned_size);
+        buffer_size_ = (buffer_ != nullptr) ? aligned_size : 0;
+      }
+      buffer = buffer_;
+    } else {
+      buffer = NewAlignedBuffer(aligned_size);
+    }
+
+    Status status;
+    size_t read_total = 0;
+    if (buffer == nullptr) {
+      status = PosixError(filename_, ENOMEM);
+    }
+    while (status.ok() && read_total < aligned_size) {
+      ssize_t read_size =
+          ::pread(fd, buffer + read_total, aligned_size - read_total,
+                  static_cast<off_t>(aligned_offset + read_total));
+      if (read_size < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        status = PosixError(filename_, errno);
+        break;
+      }
+      read_total += read_size;
+      if (read_size == 0 || read_total % kDirectIOAlignment != 0) {
+        break;  // End of file
+      }
+    }
+
+    size_t available = 0;
+    if (status.ok() && read_total > head) {
+      available = std::min(read_total - head, n);
+      std::memcpy(scratch, buffer + head, available);
+    }
+    if (shared_buffer) {
+      buffer_mutex_.Unlock();
+    } else {
+      std::free(buffer);
+    }
+    if (!has_permanent_fd_) {
+      // Close the temporary file descriptor opened earlier.
+      assert(fd != fd_);
+      ::close(fd);
+    }
+    *result = Slice(scratch, available);
+    return status;
+  }
+
+ private:
+  const bool has_permanent_fd_;  // If false, the file is opened on every read.
+  const int fd_;                 // -1 if has_permanent_fd_ is false.
+  Limiter* const fd_limiter_;
+  const std::string filename_;
+
+  mutable port::Mutex buffer_mutex_;
+  mutable char* buffer_ GUARDED_BY(buffer_mutex_);  // Aligned, or nullptr
+  mutable size_t buffer_size_ GUARDED_BY(buffer_mutex_);
+};
+
+// Implements sequential writes to a file opened with O_DIRECT.  Appended data
+// collects in an aligned buffer that is written out whenever it fills up.
+// Sync() and Close() also write the partial tail block, zero-padded, and
+// truncate the file back to its logical size; later writes rewrite that
+// block in place.
+//
+// Instances of this class are not thread-safe, as required by the
+// WritableFile API.
+class PosixDirectWritableFile final : public WritableFile {
+ public:
+  PosixDirectWritableFile(std::string filename, int fd, char* buffer)
+      : buf_(buffer),
+        pos_(0),
+        offset_(0),
+        fd_(fd),
+        filename_(std::move(filename)) {}
+
+  ~PosixDirectWritableFile() override {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    std::free(buf_);
+  }
+
+  Status Append(const Slice& data) override {
+    const char* write_data = data.data();
+    size_t write_size = data.size();
+    while (write_size > 0) {
+      size_t copy_size =
+          std::min(write_size, kDirectWritableFileBufferSize - pos_);
+      std::memcpy(buf_ + pos_, write_data, copy_size);
+      write_data += copy_size;
+      write_size -= copy_size;
+      pos_ += copy_size;
+      if (pos_ == kDirectWritableFileBufferSize) {
+        Status status = WriteAlignedPrefix();
+        if (!status.ok()) {
+          return status;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    Status status = WriteTail();
+    const int close_result = ::close(fd_);
+    if (close_result < 0 && status.ok()) {
+      status = PosixError(filename_, errno);
+    }
+    fd_ = -1;
+    return status;
+  }
+
+  // Data is only written in aligned chunks; see Sync().
+  Status Flush() override { return Status::OK(); }
+
+  Status Sync() override {
+    Status status = WriteTail();
+    if (!status.ok()) {
+      return status;
+    }
+    return SyncFd(fd_, filename_);
+  }
+
+ private:
+  // Write the whole aligned blocks at the front of the buffer.
+  Status WriteAlignedPrefix() {
+    const size_t aligned = pos_ & ~(kDirectIOAlignment - 1);
+    Status status = WriteAt(buf_, aligned, offset_);
+    if (!status.ok()) {
+      return status;
+    }
+    offset_ += aligned;
+    pos_ -= aligned;
+    std::memmove(buf_, buf_ + aligned, pos_);
+    return Status::OK();
+  }
+
+  // Write everything buffered so far and trim the padding off the file.
+  Status WriteTail() {
+    Status status = WriteAlignedPrefix();
+    if (!status.ok() || pos_ == 0) {
+      return status;
+    }
+    std::memset(buf_ + pos_, 0, kDirectIOAlignment - pos_);
+    status = WriteAt(buf_, kDirectIOAlignment, offset_);
+    if (status.ok() &&
+        ::ftruncate(fd_, static_cast<off_t>(offset_ + pos_)) != 0) {
+      status = PosixError(filename_, errno);
+    }
+    return status;
+  }
+
+  Status WriteAt(const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+      ssize_t write_result =
+          ::pwrite(fd_, data, size, static_cast<off_t>(offset));
+      if (write_result < 0) {
+        if (errno == EINTR) {
+          continue;  // Retry
+        }
+        return PosixError(filename_, errno);
+      }
+      data += write_result;
+      size -= write_result;
+      offset += write_result;
+    }
+    return Status::OK();
+  }
+
+  // buf_[0, pos_ - 1] contains data not yet written to the file, which
+  // belongs at offset_.  offset_ is always aligned.
+  char* const buf_;
+  size_t pos_;
+  uint64_t offset_;
+  int fd_;
+  const std::string filename_;
+};
+
+#endif  // defined(O_DIRECT)
+
 int LockOrUnlock(int fd, bool lock) {
   errno = 0;
   struct ::flock file_lock_info;
@@ -568,6 +831,48 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status NewDirectRandomAccessFile(const std::string& filename,
+                                   RandomAccessFile** result) override {
+#if defined(O_DIRECT)
+    int fd = ::open(filename.c_str(), O_RDONLY | O_DIRECT | kOpenBaseFlags);
+    if (fd >= 0) {
+      *result = new PosixDirectRandomAccessFile(filename, fd, &fd_limiter_);
+      return Status::OK();
+    }
+    if (errno != EINVAL) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+    // The file system does not support direct I/O.
+#endif  // defined(O_DIRECT)
+    return NewRandomAccessFile(filename, result);
+  }
+
+  Status NewDirectWritableFile(const std::string& filename,
+                               WritableFile** result) override {
+#if defined(O_DIRECT)
+    int fd = ::open(filename.c_str(),
+                    O_TRUNC | O_WRONLY | O_CREAT | O_DIRECT | kOpenBaseFlags,
+                    0644);
+    if (fd >= 0) {
+      char* buffer = NewAlignedBuffer(kDirectWritableFileBufferSize);
+      if (buffer == nullptr) {
+        ::close(fd);
+        *result = nullptr;
+        return PosixError(filename, ENOMEM);
+      }
+      *result = new PosixDirectWritableFile(filename, fd, buffer);
+      return Status::OK();
+    }
+    if (errno != EINVAL) {
+      *result = nullptr;
+      return PosixError(filename, errno);
+    }
+    // The file system does not support direct I/O.
+#endif  // defined(O_DIRECT)
+    return NewWritableFile(filename, result);
+  }
+
   bool FileExists(const std::string& filename) override {
     return ::access(filename.c_str(), F_OK) == 0;
   }
@@ -661,7 +966,15 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    ScheduleWithPriority(background_work_function, background_work_arg, kLow);
+  }
+
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority pri) override;
+
+  void SetBackgroundThreads(int number, Priority pri) override;
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
@@ -717,10 +1030,10 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
+  void BackgroundThreadMain(Priority pri);
 
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
+  static void BackgroundThreadEntryPoint(PosixEnv* env, Priority pri) {
+    env->BackgroundThreadMain(pri);
   }
 
   // Stores the work item data in a Schedule() call.
@@ -737,12 +1050,22 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // The threads and queued work for one priority.
+  struct BackgroundPool {
+    explicit BackgroundPool(port::Mutex* mu)
+        : work_cv(mu), started_threads(0), max_threads(1) {}
+
+    port::CondVar work_cv;
+    int started_threads;  // Threads are started lazily, up to max_threads
+    int max_threads;
+    std::queue<BackgroundWorkItem> work_queue;
+  };
+
+  static constexpr int kNumPriorities = kHigh + 1;
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  port::Mutex background_work_mutex_;
+  BackgroundPool background_pools_[kNumPriorities] GUARDED_BY(
+      background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -773,45 +1096,53 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : background_pools_{BackgroundPool(&background_work_mutex_),
+                        BackgroundPool(&background_work_mutex_)},
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
-void PosixEnv::Schedule(
+void PosixEnv::ScheduleWithPriority(
     void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
+    void* background_work_arg, Priority pri) {
   background_work_mutex_.Lock();
+  BackgroundPool* pool = &background_pools_[pri];
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+  // Start another background thread if the pool is allowed one.
+  if (pool->started_threads < pool->max_threads) {
+    pool->started_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  pri);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  pool->work_queue.emplace(background_work_function, background_work_arg);
+  pool->work_cv.Signal();
+  background_work_mutex_.Unlock();
+}
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+void PosixEnv::SetBackgroundThreads(int number, Priority pri) {
+  background_work_mutex_.Lock();
+  BackgroundPool* pool = &background_pools_[pri];
+  if (number > pool->max_threads) {
+    pool->max_threads = number;
+  }
   background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadMain(Priority pri) {
   while (true) {
     background_work_mutex_.Lock();
+    BackgroundPool* pool = &background_pools_[pri];
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (pool->work_queue.empty()) {
+      pool->work_cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->work_queue.empty());
+    auto background_work_function = pool->work_queue.front().function;
+    void* background_work_arg = pool->work_queue.front().arg;
+    pool->work_queue.pop();
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
@@ -6,10 +6,13 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -212,6 +215,196 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, HighPriorityWorkDoesNotWaitForLowPriority) {
+  struct State {
+    std::atomic<bool> release_low{false};
+    std::atomic<bool> low_done{false};
+    std::atomic<bool> high_done{false};
+  };
+  State state;
+
+  // Occupy the only low-priority thread until the high-priority work ran.
+  env_->Schedule(
+      [](void* arg) {
+        State* state = reinterpret_cast<State*>(arg);
+        while (!state->release_low.load(std::memory_order_acquire)) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        state->low_done.store(true, std::memory_order_release);
+      },
+      &state);
+  env_->ScheduleWithPriority(
+      [](void* arg) {
+        State* state = reinterpret_cast<State*>(arg);
+        state->high_done.store(true, std::memory_order_release);
+      },
+      &state, Env::kHigh);
+
+  for (int i = 0; i < 5000 && !state.high_done.load(std::memory_order_acquire);
+       i++) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(state.high_done.load(std::memory_order_acquire));
+  ASSERT_FALSE(state.low_done.load(std::memory_order_acquire));
+
+  state.release_low.store(true, std::memory_order_release);
+  while (!state.low_done.load(std::memory_order_acquire)) {
+    env_->SleepForMicroseconds(1000);
+  }
+}
+
+TEST_F(EnvPosixTest, SetBackgroundThreadsRunsLowPriorityWorkConcurrently) {
+  struct State {
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::atomic<int> done{0};
+  };
+  State state;
+  env_->SetBackgroundThreads(2, Env::kLow);
+
+  constexpr int kNumItems = 2;
+  for (int i = 0; i < kNumItems; i++) {
+    env_->Schedule(
+        [](void* arg) {
+          State* state = reinterpret_cast<State*>(arg);
+          int now = state->running.fetch_add(1) + 1;
+          int prev = state->max_running.load();
+          while (now > prev &&
+                 !state->max_running.compare_exchange_weak(prev, now)) {
+          }
+          // Wait (bounded) for the other item to start.
+          for (int j = 0; j < 5000 && state->max_running.load() < kNumItems;
+               j++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+          state->running.fetch_sub(1);
+          state->done.fetch_add(1);
+        },
+        &state);
+  }
+  while (state.done.load() < kNumItems) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_EQ(kNumItems, state.max_running.load());
+}
+
+TEST_F(EnvPosixTest, SyncDataWhileAppending) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string file_path = test_dir + "/sync_data_while_appending.txt";
+
+  WritableFile* file;
+  ASSERT_LEVELDB_OK(env_->NewWritableFile(file_path, &file));
+  constexpr int kNumRecords = 1000;
+  std::atomic<bool> appending{true};
+  std::thread syncer([&]() {
+    while (appending.load(std::memory_order_acquire)) {
+      ASSERT_LEVELDB_OK(file->SyncData());
+    }
+  });
+  std::string expected;
+  for (int i = 0; i < kNumRecords; i++) {
+    std::string record = "record" + std::to_string(i) + "\n";
+    ASSERT_LEVELDB_OK(file->Append(record));
+    ASSERT_LEVELDB_OK(file->Flush());
+    expected += record;
+  }
+  appending.store(false, std::memory_order_release);
+  syncer.join();
+  ASSERT_LEVELDB_OK(file->Close());
+  delete file;
+
+  std::string contents;
+  ASSERT_LEVELDB_OK(ReadFileToString(env_, file_path, &contents));
+  ASSERT_EQ(expected, contents);
+  ASSERT_LEVELDB_OK(env_->RemoveFile(file_path));
+}
+
+TEST_F(EnvPosixTest, DirectIORoundTrip) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string file_path = test_dir + "/direct_io_round_trip.txt";
+
+  // Unaligned appends that span several write buffers, with a Sync() in
+  // the middle that has to write and later rewrite a partial block.
+  std::string expected;
+  WritableFile* writable_file;
+  ASSERT_LEVELDB_OK(env_->NewDirectWritableFile(file_path, &writable_file));
+  for (int i = 0; i < 3000; i++) {
+    std::string chunk(1 + (i * 7919) % 1500, static_cast<char>('a' + i % 26));
+    ASSERT_LEVELDB_OK(writable_file->Append(chunk));
+    expected += chunk;
+    if (i == 17) {
+      ASSERT_LEVELDB_OK(writable_file->Sync());
+      uint64_t synced_size;
+      ASSERT_LEVELDB_OK(env_->GetFileSize(file_path, &synced_size));
+      ASSERT_EQ(expected.size(), synced_size);
+    }
+  }
+  ASSERT_LEVELDB_OK(writable_file->Close());
+  delete writable_file;
+
+  uint64_t file_size;
+  ASSERT_LEVELDB_OK(env_->GetFileSize(file_path, &file_size));
+  ASSERT_EQ(expected.size(), file_size);
+
+  RandomAccessFile* random_access_file;
+  ASSERT_LEVELDB_OK(
+      env_->NewDirectRandomAccessFile(file_path, &random_access_file));
+  std::string scratch(10000, '\0');
+  Slice result;
+  for (uint64_t offset = 0; offset < expected.size(); offset += 4093) {
+    ASSERT_LEVELDB_OK(
+        random_access_file->Read(offset, 5000, &result, &scratch[0]));
+    ASSERT_EQ(expected.substr(offset, 5000), result.ToString());
+  }
+  delete random_access_file;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(file_path));
+}
+
+TEST_F(EnvPosixTest, DirectIOOpenOnRead) {
+  std::string test_dir;
+  ASSERT_LEVELDB_OK(env_->GetTestDirectory(&test_dir));
+  std::string file_path = test_dir + "/direct_io_open_on_read.txt";
+  std::string expected;
+  for (int i = 0; i < 20000; i++) {
+    expected.push_back(static_cast<char>('a' + (i * 7) % 26));
+  }
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, expected, file_path));
+
+  // More files than the read-only file limit, so the last ones are opened
+  // on every read.
+  const int kNumFiles = kReadOnlyFileLimit + 5;
+  leveldb::RandomAccessFile* files[kNumFiles] = {nullptr};
+  for (int i = 0; i < kNumFiles; i++) {
+    ASSERT_LEVELDB_OK(env_->NewDirectRandomAccessFile(file_path, &files[i]));
+  }
+
+  // Reads of one file from several threads at once share or bypass its
+  // bounce buffer.
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&files, &expected, t]() {
+      std::string scratch(5000, '\0');
+      Slice result;
+      for (int i = 0; i < kNumFiles; i++) {
+        for (uint64_t offset = t; offset < expected.size(); offset += 3001) {
+          const size_t n = 1 + (offset * 31) % 5000;
+          ASSERT_LEVELDB_OK(files[i]->Read(offset, n, &result, &scratch[0]));
+          ASSERT_EQ(expected.substr(offset, n), result.ToString());
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < kNumFiles; i++) {
+    delete files[i];
+  }
+  ASSERT_LEVELDB_OK(env_->RemoveFile(file_path));
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -18,16 +18,19 @@ class Histogram {
   void Add(double value);
   void Merge(const Histogram& other);
 
-  std::string ToString() const;
-
- private:
-  enum { kNumBuckets = 154 };
+  // Number of values added since the last Clear().
+  double Count() const { return num_; }
 
   double Median() const;
   double Percentile(double p) const;
   double Average() const;
   double StandardDeviation() const;
 
+  std::string ToString() const;
+
+ private:
+  enum { kNumBuckets = 154 };
+
   static const double kBucketLimit[kNumBuckets];
 
   double min_;
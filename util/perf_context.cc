@@ -0,0 +1,68 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <cstdio>
+
+namespace leveldb {
+
+void PerfContext::Reset() {
+  l0_files_considered = 0;
+  table_probes = 0;
+  table_opens = 0;
+  table_open_micros = 0;
+  block_cache_hits = 0;
+  block_reads = 0;
+  block_read_bytes = 0;
+  block_read_micros = 0;
+  filter_checks = 0;
+  filter_negatives = 0;
+}
+
+void PerfContext::Add(const PerfContext& other) {
+  l0_files_considered += other.l0_files_considered;
+  table_probes += other.table_probes;
+  table_opens += other.table_opens;
+  table_open_micros += other.table_open_micros;
+  block_cache_hits += other.block_cache_hits;
+  block_reads += other.block_reads;
+  block_read_bytes += other.block_read_bytes;
+  block_read_micros += other.block_read_micros;
+  filter_checks += other.filter_checks;
+  filter_negatives += other.filter_negatives;
+}
+
+std::string PerfContext::ToString() const {
+  std::string r;
+  char buf[80];
+#define PERF_CONTEXT_OUTPUT(counter)                                    \
+  if (counter > 0) {                                                    \
+    std::snprintf(buf, sizeof(buf), #counter " = %llu, ",               \
+                  static_cast<unsigned long long>(counter));            \
+    r.append(buf);                                                      \
+  }
+  PERF_CONTEXT_OUTPUT(l0_files_considered);
+  PERF_CONTEXT_OUTPUT(table_probes);
+  PERF_CONTEXT_OUTPUT(table_opens);
+  PERF_CONTEXT_OUTPUT(table_open_micros);
+  PERF_CONTEXT_OUTPUT(block_cache_hits);
+  PERF_CONTEXT_OUTPUT(block_reads);
+  PERF_CONTEXT_OUTPUT(block_read_bytes);
+  PERF_CONTEXT_OUTPUT(block_read_micros);
+  PERF_CONTEXT_OUTPUT(filter_checks);
+  PERF_CONTEXT_OUTPUT(filter_negatives);
+#undef PERF_CONTEXT_OUTPUT
+  if (r.size() >= 2) {
+    r.resize(r.size() - 2);  // Drop the trailing ", ".
+  }
+  return r;
+}
+
+PerfContext* GetPerfContext() {
+  static thread_local PerfContext perf_context;
+  return &perf_context;
+}
+
+}  // namespace leveldb
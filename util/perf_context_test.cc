@@ -0,0 +1,73 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "table/filter_block.h"
+
+namespace leveldb {
+
+TEST(PerfContextTest, ResetAndToString) {
+  PerfContext* perf = GetPerfContext();
+  perf->Reset();
+  ASSERT_EQ("", perf->ToString());
+
+  perf->table_probes = 3;
+  perf->filter_negatives = 2;
+  ASSERT_EQ("table_probes = 3, filter_negatives = 2", perf->ToString());
+
+  perf->Reset();
+  ASSERT_EQ(0, perf->table_probes);
+  ASSERT_EQ(0, perf->filter_negatives);
+}
+
+TEST(PerfContextTest, ThreadLocal) {
+  PerfContext* perf = GetPerfContext();
+  perf->Reset();
+  perf->block_reads = 7;
+
+  PerfContext* other = nullptr;
+  uint64_t other_block_reads = 1;
+  std::thread thread([&]() {
+    other = GetPerfContext();
+    other_block_reads = other->block_reads;
+    other->block_reads = 100;
+  });
+  thread.join();
+
+  ASSERT_NE(perf, other);
+  ASSERT_EQ(0, other_block_reads);
+  ASSERT_EQ(7, perf->block_reads);
+  ASSERT_EQ(perf, GetPerfContext());
+}
+
+TEST(PerfContextTest, FilterChecks) {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  FilterBlockBuilder builder(policy);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(9000);  // Blocks 1 and beyond before 9000 get no keys.
+  builder.AddKey("bar");
+  Slice block = builder.Finish();
+  FilterBlockReader reader(policy, block);
+
+  PerfContext* perf = GetPerfContext();
+  perf->Reset();
+  ASSERT_TRUE(reader.KeyMayMatch(0, "foo"));
+  ASSERT_TRUE(!reader.KeyMayMatch(4100, "foo"));
+  ASSERT_EQ(2, perf->filter_checks);
+  ASSERT_EQ(1, perf->filter_negatives);
+  delete policy;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/readahead_file.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+class ReadaheadRandomAccessFile : public RandomAccessFile {
+ public:
+  ReadaheadRandomAccessFile(RandomAccessFile* file, uint64_t file_size,
+                            size_t readahead_size)
+      : file_(file),
+        file_size_(file_size),
+        readahead_size_(readahead_size),
+        buffer_(new char[readahead_size]),
+        buffer_offset_(0),
+        buffer_len_(0) {}
+
+  ~ReadaheadRandomAccessFile() override { delete[] buffer_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    if (n > readahead_size_) {
+      // Too large to buffer; the request is its own readahead.
+      return file_->Read(offset, n, result, scratch);
+    }
+
+    MutexLock l(&mutex_);
+    if (offset < buffer_offset_ || offset + n > buffer_offset_ + buffer_len_) {
+      // Near the end of the file (e.g. for the footer) fetch only what is
+      // left of it.
+      size_t fetch_size = readahead_size_;
+      if (offset < file_size_ && file_size_ - offset < fetch_size) {
+        fetch_size = std::max(n, static_cast<size_t>(file_size_ - offset));
+      }
+      Slice fetched;
+      Status s = file_->Read(offset, fetch_size, &fetched, buffer_);
+      if (!s.ok()) {
+        buffer_len_ = 0;
+        *result = Slice();
+        return s;
+      }
+      if (fetched.data() != buffer_) {
+        // The file serves reads from its own memory; nothing to buffer.
+        buffer_len_ = 0;
+        *result = Slice(fetched.data(), std::min(n, fetched.size()));
+        return s;
+      }
+      buffer_offset_ = offset;
+      buffer_len_ = fetched.size();
+    }
+
+    // Serve from the buffer.  Callers may hold on to *result after the
+    // buffer is refilled, so copy into their scratch space.
+    assert(offset >= buffer_offset_);
+    const size_t start = static_cast<size_t>(offset - buffer_offset_);
+    assert(start <= buffer_len_);
+    const size_t available = std::min(n, buffer_len_ - start);
+    std::memcpy(scratch, buffer_ + start, available);
+    *result = Slice(scratch, available);
+    return Status::OK();
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  const uint64_t file_size_;
+  const size_t readahead_size_;
+
+  mutable port::Mutex mutex_;
+  // buffer_[0, buffer_len_ - 1] holds the file contents at buffer_offset_.
+  char* const buffer_;  // Contents guarded by mutex_
+  mutable uint64_t buffer_offset_ GUARDED_BY(mutex_);
+  mutable size_t buffer_len_ GUARDED_BY(mutex_);
+};
+
+}  // namespace
+
+RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                               uint64_t file_size,
+                                               size_t readahead_size) {
+  assert(readahead_size > 0);
+  return new ReadaheadRandomAccessFile(file, file_size, readahead_size);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,33 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
+#define STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace leveldb {
+
+class RandomAccessFile;
+
+// Returns a RandomAccessFile that serves reads of "file", which is
+// "file_size" bytes long, through a private buffer.  A read that misses the
+// buffer fetches the requested bytes plus whatever follows them,
+// "readahead_size" bytes in total but never past the end of the file, so a
+// sequential pass over the file is served by a few large reads instead of
+// one read per block.  Reads that "file" serves from its own memory (e.g.
+// mmap) are passed through unbuffered.
+//
+// The result does not take ownership of "file", which must remain live
+// while the result is in use.  Several results may read one "file", each
+// through its own buffer.
+// REQUIRES: readahead_size > 0
+RandomAccessFile* NewReadaheadRandomAccessFile(RandomAccessFile* file,
+                                               uint64_t file_size,
+                                               size_t readahead_size);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_READAHEAD_FILE_H_
@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/readahead_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+
+namespace leveldb {
+
+namespace {
+
+// Serves reads from a string, copying into scratch like a pread()-based
+// file, and counts them.
+class StringFile : public RandomAccessFile {
+ public:
+  StringFile(const std::string& contents, int* reads)
+      : contents_(contents), reads_(reads), last_read_size_(0) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    ++*reads_;
+    last_read_size_ = n;
+    if (offset > contents_.size()) {
+      *result = Slice();
+      return Status::OK();
+    }
+    n = std::min<size_t>(n, contents_.size() - offset);
+    std::memcpy(scratch, contents_.data() + offset, n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+  // Bytes asked for by the last Read()
+  size_t last_read_size() const { return last_read_size_; }
+
+ private:
+  const std::string contents_;
+  int* const reads_;
+  mutable size_t last_read_size_;
+};
+
+}  // namespace
+
+TEST(ReadaheadFileTest, SequentialReadsShareFetches) {
+  std::string contents;
+  for (int i = 0; i < 10000; i++) {
+    contents.push_back(static_cast<char>('a' + i % 26));
+  }
+  int reads = 0;
+  StringFile base(contents, &reads);
+  RandomAccessFile* file =
+      NewReadaheadRandomAccessFile(&base, contents.size(), 4096);
+
+  char scratch[512];
+  Slice result;
+  for (uint64_t offset = 0; offset < contents.size(); offset += 100) {
+    ASSERT_TRUE(file->Read(offset, 100, &result, scratch).ok());
+    ASSERT_EQ(contents.substr(offset, 100), result.ToString());
+  }
+  // 100 reads of 100 bytes served by three 4 KiB fetches.
+  ASSERT_EQ(3, reads);
+
+  // Reading backwards refetches; reads past the end are short.
+  ASSERT_TRUE(file->Read(50, 10, &result, scratch).ok());
+  ASSERT_EQ(contents.substr(50, 10), result.ToString());
+  ASSERT_TRUE(file->Read(9990, 100, &result, scratch).ok());
+  ASSERT_EQ(contents.substr(9990), result.ToString());
+  delete file;
+}
+
+TEST(ReadaheadFileTest, LargeReadsBypassBuffer) {
+  std::string contents(100000, 'x');
+  int reads = 0;
+  StringFile base(contents, &reads);
+  RandomAccessFile* file =
+      NewReadaheadRandomAccessFile(&base, contents.size(), 1024);
+  std::string scratch(5000, '\0');
+  Slice result;
+  ASSERT_TRUE(file->Read(10, 5000, &result, &scratch[0]).ok());
+  ASSERT_EQ(5000, result.size());
+  ASSERT_EQ(1, reads);
+  delete file;
+}
+
+TEST(ReadaheadFileTest, ReadsStopAtEndOfFile) {
+  std::string contents(100000, 'x');
+  int reads = 0;
+  StringFile base(contents, &reads);
+  RandomAccessFile* file =
+      NewReadaheadRandomAccessFile(&base, contents.size(), 65536);
+  char scratch[48];
+  Slice result;
+
+  // A footer-sized read at the end fetches only the footer.
+  ASSERT_TRUE(file->Read(contents.size() - 48, 48, &result, scratch).ok());
+  ASSERT_EQ(48, result.size());
+  ASSERT_EQ(48, base.last_read_size());
+
+  // Reads further from the end fetch up to the end.
+  ASSERT_TRUE(file->Read(contents.size() - 1000, 10, &result, scratch).ok());
+  ASSERT_EQ(1000, base.last_read_size());
+  ASSERT_TRUE(file->Read(0, 10, &result, scratch).ok());
+  ASSERT_EQ(65536, base.last_read_size());
+  ASSERT_EQ(3, reads);
+  delete file;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_pool.h"
+
+#include <cassert>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+ThreadPool::ThreadPool(int num_threads) : cv_(&mu_), shutting_down_(false) {
+  assert(num_threads > 0);
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    workers_.emplace_back(&ThreadPool::WorkerMain, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    MutexLock l(&mu_);
+    shutting_down_ = true;
+    cv_.SignalAll();
+  }
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+  assert(queue_.empty());
+}
+
+void ThreadPool::Schedule(void (*function)(void* arg), void* arg) {
+  MutexLock l(&mu_);
+  assert(!shutting_down_);
+  queue_.emplace(function, arg);
+  cv_.Signal();
+}
+
+void ThreadPool::WorkerMain() {
+  while (true) {
+    mu_.Lock();
+    while (queue_.empty() && !shutting_down_) {
+      cv_.Wait();
+    }
+    if (queue_.empty()) {
+      // Shutting down and nothing left to run.
+      mu_.Unlock();
+      return;
+    }
+    auto function = queue_.front().function;
+    void* arg = queue_.front().arg;
+    queue_.pop();
+    mu_.Unlock();
+    function(arg);
+  }
+}
+
+}  // namespace leveldb
@@ -0,0 +1,57 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+#define STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
+
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+
+// A fixed-size pool of worker threads that run (function, arg) work items
+// in FIFO order.  Used for foreground fan-out (e.g. probing several table
+// files for one lookup) where the single Env background thread would
+// serialize the work.
+//
+// The destructor drains all queued work and joins the workers.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool();
+
+  // Arrange to run "(*function)(arg)" once on one of the worker threads.
+  void Schedule(void (*function)(void* arg), void* arg);
+
+  int NumThreads() const { return static_cast<int>(workers_.size()); }
+
+ private:
+  struct WorkItem {
+    explicit WorkItem(void (*function)(void*), void* arg)
+        : function(function), arg(arg) {}
+
+    void (*const function)(void*);
+    void* const arg;
+  };
+
+  void WorkerMain();
+
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  bool shutting_down_ GUARDED_BY(mu_);
+  std::queue<WorkItem> queue_ GUARDED_BY(mu_);
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_THREAD_POOL_H_
@@ -0,0 +1,44 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/thread_pool.h"
+
+#include <atomic>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+struct Counter {
+  std::atomic<int> runs{0};
+};
+
+void Increment(void* arg) {
+  reinterpret_cast<Counter*>(arg)->runs.fetch_add(1, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+TEST(ThreadPoolTest, RunsEveryItem) {
+  Counter counter;
+  {
+    ThreadPool pool(4);
+    ASSERT_EQ(4, pool.NumThreads());
+    for (int i = 0; i < 1000; i++) {
+      pool.Schedule(&Increment, &counter);
+    }
+  }  // Destructor drains the queue.
+  ASSERT_EQ(1000, counter.runs.load());
+}
+
+TEST(ThreadPoolTest, EmptyShutdown) { ThreadPool pool(2); }
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_buffer_manager.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <vector>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/thread_pool.h"
+
+namespace leveldb {
+
+WriteBufferManager::~WriteBufferManager() = default;
+
+struct WriteBufferManager::Member {
+  void (*flush)(void*);
+  void* arg;
+  Usage usage;
+  bool flush_pending;
+};
+
+namespace {
+
+class WriteBufferManagerImpl : public WriteBufferManager {
+ public:
+  explicit WriteBufferManagerImpl(size_t buffer_size)
+      : buffer_size_(buffer_size),
+        flush_done_(&mu_),
+        memory_usage_(0),
+        mutable_usage_(0),
+        flush_pending_(false),
+        flush_pool_(1) {}
+
+  ~WriteBufferManagerImpl() override { assert(members_.empty()); }
+
+  size_t buffer_size() const override { return buffer_size_; }
+
+  size_t memory_usage() const override {
+    return memory_usage_.load(std::memory_order_relaxed);
+  }
+
+  Member* Register(void (*flush)(void*), void* arg) override {
+    Member* member = new Member{flush, arg, Usage(), false};
+    MutexLock l(&mu_);
+    members_.push_back(member);
+    return member;
+  }
+
+  void Unregister(Member* member) override {
+    MutexLock l(&mu_);
+    while (member->flush_pending) {
+      flush_done_.Wait();
+    }
+    SetUsage(member, Usage());
+    members_.erase(std::find(members_.begin(), members_.end(), member));
+    delete member;
+  }
+
+  void ReportUsage(Member* member, const Usage& usage) override {
+    MutexLock l(&mu_);
+    SetUsage(member, usage);
+    if (flush_pending_ || !ShouldFlush()) {
+      return;
+    }
+
+    // Flush the memtable that frees the most memory.  Memtables holding
+    // little besides entries carried over from their predecessor would
+    // come back just as large, so they are left alone.
+    Member* largest = nullptr;
+    for (Member* m : members_) {
+      if (largest == nullptr ||
+          m->usage.flushable_bytes > largest->usage.flushable_bytes) {
+        largest = m;
+      }
+    }
+    if (largest == nullptr ||
+        largest->usage.flushable_bytes < buffer_size_ / 64) {
+      return;
+    }
+    largest->flush_pending = true;
+    flush_pending_ = true;
+    flush_pool_.Schedule(&WriteBufferManagerImpl::BGFlush,
+                         new FlushTask{this, largest});
+  }
+
+ private:
+  struct FlushTask {
+    WriteBufferManagerImpl* manager;
+    Member* member;
+  };
+
+  static void BGFlush(void* arg) {
+    FlushTask* task = reinterpret_cast<FlushTask*>(arg);
+    WriteBufferManagerImpl* manager = task->manager;
+    Member* member = task->member;
+    delete task;
+
+    (*member->flush)(member->arg);
+
+    MutexLock l(&manager->mu_);
+    member->flush_pending = false;
+    manager->flush_pending_ = false;
+    manager->flush_done_.SignalAll();
+  }
+
+  void SetUsage(Member* member, const Usage& usage)
+      EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    const size_t old_total =
+        member->usage.mutable_bytes + member->usage.immutable_bytes;
+    const size_t new_total = usage.mutable_bytes + usage.immutable_bytes;
+    memory_usage_.store(memory_usage_.load(std::memory_order_relaxed) -
+                            old_total + new_total,
+                        std::memory_order_relaxed);
+    mutable_usage_ = mutable_usage_ - member->usage.mutable_bytes +
+                     usage.mutable_bytes;
+    member->usage = usage;
+  }
+
+  // Memtables already being flushed will free their memory on their own,
+  // so a flush is only requested once the memtables being written take up
+  // most of the budget, or the budget is spent and at least half of it is
+  // in memtables being written.
+  bool ShouldFlush() const EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    if (mutable_usage_ > buffer_size_ - buffer_size_ / 8) {
+      return true;
+    }
+    return memory_usage_.load(std::memory_order_relaxed) >= buffer_size_ &&
+           mutable_usage_ >= buffer_size_ / 2;
+  }
+
+  const size_t buffer_size_;
+
+  port::Mutex mu_;
+  port::CondVar flush_done_ GUARDED_BY(mu_);
+  // Only changed with mu_ held, but read without it.
+  std::atomic<size_t> memory_usage_;
+  size_t mutable_usage_ GUARDED_BY(mu_);
+  // At most one flush is requested at a time, so that the memory it frees
+  // is seen before the next memtable is picked.
+  bool flush_pending_ GUARDED_BY(mu_);
+  std::vector<Member*> members_ GUARDED_BY(mu_);
+
+  // Declared last so that it is joined before the members above go away.
+  ThreadPool flush_pool_;
+};
+
+}  // namespace
+
+WriteBufferManager* NewWriteBufferManager(size_t buffer_size) {
+  return new WriteBufferManagerImpl(buffer_size);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,127 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/write_buffer_manager.h"
+
+#include <atomic>
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+namespace {
+
+// Stands in for a DB: a flush moves its memtable to the immutable slot.
+struct FakeDB {
+  WriteBufferManager* manager = nullptr;
+  WriteBufferManager::Member* member = nullptr;
+  WriteBufferManager::Usage usage;
+  std::atomic<int> flushes{0};
+
+  void Report(size_t mutable_bytes, size_t flushable_bytes) {
+    usage.mutable_bytes = mutable_bytes;
+    usage.flushable_bytes = flushable_bytes;
+    manager->ReportUsage(member, usage);
+  }
+};
+
+void Flush(void* arg) {
+  FakeDB* db = reinterpret_cast<FakeDB*>(arg);
+  db->flushes.fetch_add(1, std::memory_order_relaxed);
+  WriteBufferManager::Usage usage;
+  usage.immutable_bytes = db->usage.mutable_bytes;
+  db->usage = usage;
+  db->manager->ReportUsage(db->member, usage);
+}
+
+}  // namespace
+
+class WriteBufferManagerTest : public testing::Test {
+ public:
+  WriteBufferManagerTest() : manager_(NewWriteBufferManager(1000)) {
+    for (FakeDB& db : dbs_) {
+      db.manager = manager_;
+      db.member = manager_->Register(&Flush, &db);
+    }
+  }
+
+  ~WriteBufferManagerTest() override {
+    Unregister();
+    delete manager_;
+  }
+
+  // Waits for requested flushes to finish.
+  void Unregister() {
+    for (FakeDB& db : dbs_) {
+      if (db.member != nullptr) {
+        manager_->Unregister(db.member);
+        db.member = nullptr;
+      }
+    }
+  }
+
+  WriteBufferManager* const manager_;
+  FakeDB dbs_[3];
+};
+
+TEST_F(WriteBufferManagerTest, SumsUsage) {
+  ASSERT_EQ(1000, manager_->buffer_size());
+  dbs_[0].Report(100, 100);
+  dbs_[1].Report(200, 200);
+  ASSERT_EQ(300, manager_->memory_usage());
+  dbs_[0].Report(50, 50);
+  ASSERT_EQ(250, manager_->memory_usage());
+  Unregister();
+  ASSERT_EQ(0, manager_->memory_usage());
+  for (FakeDB& db : dbs_) {
+    ASSERT_EQ(0, db.flushes.load());
+  }
+}
+
+TEST_F(WriteBufferManagerTest, FlushesLargestMemTable) {
+  dbs_[0].Report(300, 300);
+  dbs_[1].Report(500, 500);
+  ASSERT_EQ(0, dbs_[1].flushes.load());
+  dbs_[2].Report(100, 100);  // 900 bytes are past 7/8 of the budget
+  Unregister();
+  ASSERT_EQ(0, dbs_[0].flushes.load());
+  ASSERT_EQ(1, dbs_[1].flushes.load());
+  ASSERT_EQ(0, dbs_[2].flushes.load());
+}
+
+TEST_F(WriteBufferManagerTest, SkipsCarriedOverEntries) {
+  // dbs_[1] holds more memory, but would carry most of it over.
+  dbs_[0].Report(300, 300);
+  dbs_[1].Report(600, 10);
+  Unregister();
+  ASSERT_EQ(1, dbs_[0].flushes.load());
+  ASSERT_EQ(0, dbs_[1].flushes.load());
+}
+
+TEST_F(WriteBufferManagerTest, NothingWorthFlushing) {
+  dbs_[0].Report(500, 0);
+  dbs_[1].Report(450, 5);
+  Unregister();
+  ASSERT_EQ(0, dbs_[0].flushes.load());
+  ASSERT_EQ(0, dbs_[1].flushes.load());
+}
+
+TEST_F(WriteBufferManagerTest, ImmutableMemTablesAreNotFlushedAgain) {
+  // 800 bytes are already being flushed; the memtables being written take
+  // less than half of the budget, so no flush is requested.
+  dbs_[0].usage.immutable_bytes = 800;
+  dbs_[0].Report(100, 100);
+  dbs_[1].Report(200, 200);
+  ASSERT_EQ(1100, manager_->memory_usage());
+  Unregister();
+  ASSERT_EQ(0, dbs_[0].flushes.load());
+  ASSERT_EQ(0, dbs_[1].flushes.load());
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}